@@ -12,6 +12,7 @@
 				// 这里使用了其中的memset()函数。
 #include <linux/sched.h>	// 调度程序头文件。定义任务结构task_struct、任务0数据。
 #include <linux/kernel.h>	// 内核头文件。含有一些内核常用函数的原型定义。
+#include <linux/mm.h>		// 内存管理头文件。含有get_free_page()等函数的原型定义。
 
 /// 将指定地址（addr）处的一块1024字节内存清零。
 // 输入：eax = 0；ecx = 以长字为单位的数据块长度（BLOCK_SIZE/4）；edi = 指定起始地
@@ -70,27 +71,64 @@ __asm__("cld\n" 				/* 清方向位 */ \
 __asm__("":::"eax","edx","esi"); \
 __res;})
 
+/// 在addr开始的位图块中，从第offset位开始寻找第1个0值比特位。
+// 先逐位检查offset所在的长字，然后跳过全是1的长字。返回找到的比特位偏移值，没有
+// 找到则返回8192。
+static inline int find_next_zero(char * addr, int offset)
+{
+	unsigned long * p = (unsigned long *) addr;
+
+	while (offset < 8192) {
+		if (!(offset & 31) && p[offset>>5] == 0xffffffff) {
+			offset += 32;
+			continue;
+		}
+		if (!((p[offset>>5] >> (offset & 31)) & 1))
+			return offset;
+		offset++;
+	}
+	return 8192;
+}
+
+/// 读入超级块sb所在设备上从first块开始的位图中的第nr块。
+// 位图块不再常驻在高速缓冲区中，而是在用到时才读入，用完即释放。因为0号i节点和0号
+// 逻辑块都不能使用，所以位图第1块的最低比特位总是置为1。
+static struct buffer_head * read_map(struct super_block * sb, int first, int nr)
+{
+	struct buffer_head * bh;
+
+	if ((bh = bread(sb->s_dev, first + nr)) && !nr)
+		bh->b_data[0] |= 1;
+	return bh;
+}
+
+// i节点位图从2号块开始，逻辑块位图紧接在i节点位图之后。
+#define read_imap(sb,nr) read_map((sb), 2, (nr))
+#define read_zmap(sb,nr) read_map((sb), 2 + (sb)->s_imap_blocks, (nr))
+
 /// 释放设备dev上数据区中的逻辑块block。
 // 复位指定逻辑块block对应的逻辑块位图比特位，成功则返回1，否则返回0。
-// 参数：dev是设备号，block是逻辑块号（盘块号）。
+// 参数：dev是设备号，block是逻辑块号。一个逻辑块含有2^s_log_zone_size个盘块。
 int free_block(int dev, int block)
 {
 	struct super_block * sb;
 	struct buffer_head * bh;
+	int i;
 
 // 首先取设备dev上文件系统的超级块信息，根据其中数据区开始逻辑块号和文件系统中逻辑
 // 块总数信息判断参数block的有效性。如果指定设备超级块不存在，则出错停机。若逻辑块
 // 号小于盘上数据区第1个逻辑块的块号或者大于设备上总逻辑块数，也出错停机。
 	if (!(sb = get_super(dev)))		// fs/super.c
 		panic("trying to free block on nonexisten device");
-	if (block < sb->s_firstdatazone || block >= sb->s_nzones)
+	if (block < sb->s_firstdatazone || block >= sb->s_zones)
 		panic("trying to free block not in datazone");
-	bh = get_hash_table(dev, block);
-// 然后从hash表中寻找该块数据。若找到了则判断其有效性。此时若其引用次数大于1，表明
-// 还有他人在使用谇缓冲块，于是调用brelse()（其中会执行b_count--），然后退出。否则清
-// 除已修改和更新标志，释放该数据块。该段代码的主要用途是检测如果该逻辑块目前存在于高
-// 速缓冲区中，就释放对应的缓冲块。
-	if (bh) {
+// 然后对逻辑块中的每个盘块，从hash表中寻找该块数据。若找到了则判断其有效性。此时若
+// 其引用次数大于1，表明还有他人在使用谇缓冲块，于是调用brelse()（其中会执行b_count--），
+// 然后退出。否则清除已修改和更新标志，释放该数据块。该段代码的主要用途是检测如果该逻辑
+// 块目前存在于高速缓冲区中，就释放对应的缓冲块。
+	for (i = 0; i < (1 << sb->s_log_zone_size); i++) {
+		if (!(bh = get_hash_table(dev, (block << sb->s_log_zone_size) + i)))
+			continue;
 		if (bh->b_count > 1) {		// 如果引用次数大于1，则调用brelse(),
 			brelse(bh);		// b_count-- 后即退出，该块还有人用。
 			return 0;
@@ -104,64 +142,108 @@ int free_block(int dev, int block)
 // 数据逻辑块号（从1开始计数）。然后对逻辑块（区块）位图进行操作，复位对应的比特位。
 // 如果对应比特位原来就是0，则表示系统出错，停机。由于1个缓冲块在1024字节，即8192
 // 位，因此block/8192即可计算出指定块block在逻辑位图中的哪个块上。而block&8191可
-// 以得到block在逻辑块位图当前块中的比特偏移位置。
+// 以得到block在逻辑块位图当前块中的比特偏移位置。该位图块需要先读入。
+// 比特位复位成功时，相应位图块的空闲位数和空闲逻辑块总数都增1。
 	block -= sb->s_firstdatazone - 1;	// 即 block = block - (s_firstdatazone - 1);
-	if (clear_bit(block&8191, sb->s_zmap[block/8192]->b_data)) {
+	if (!(bh = read_zmap(sb, block/8192)))
+		panic("free_block: unable to read zone bitmap");
+	if (clear_bit(block&8191, bh->b_data)) {
 		printk("block (%04x:%d) ", dev, block+sb->s_firstdatazone-1);
 		printk("free_block: bit already cleared\n");
+	} else {
+		sb->s_zmap_free[block/8192]++;
+		sb->s_free_zones++;
 	}
-// 最后置相应逻辑块位图所在缓冲块已修改标志。
-	sb->s_zmap[block/8192]->b_dirt = 1;
+// 最后置相应逻辑块位图所在缓冲块已修改标志，并释放该缓冲块。
+	bh->b_dirt = 1;
+	brelse(bh);
 	return 1;
 }
 
 /// 向设备申请一个逻辑盘块。
-// 函数首先取得设备的超级块，并在逻辑块位图中寻找第一个0值比特位（代表一个空闲逻辑
-// 块）。然后设置该比特位，表示期望得到对应的逻辑块。接着为该逻辑块在缓冲区中取得一块
-// 对应缓冲块。最后将该缓冲块清零，并设置其已更新标志和已修改标志，并返回逻辑块号。函
+// 函数首先取得设备的超级块，并在逻辑块位图中寻找一个0值比特位（代表一个空闲逻辑
+// 块）。然后设置该比特位，表示期望得到对应的逻辑块。接着为该逻辑块的各盘块在缓冲区
+// 中取得对应缓冲块。最后将这些缓冲块清零，并设置其已更新标志和已修改标志，并返回逻辑块号。函
 // 数执行成功则返回逻辑块号（盘块号），否则返回0。
-int new_block(int dev)
+// 参数goal是希望得到的逻辑块号，通常是文件中前一块之后的那一块，这样顺序写入的文件在
+// 盘上也尽量连续。goal为0表示没有要求。
+int new_block(int dev, int goal)
 {
-	struct buffer_head * bh;
+	struct buffer_head * bh = NULL;
 	struct super_block * sb;
 	int i, j;
 	
-// 首先获取设备dev的超级块。然后扫描文件系统的8块逻辑块位图，寻找首个0值比特位，以
-// 寻找空闲逻辑块，获取放置该逻辑块的块号。如果全部扫描完8块逻辑块位图的所有比特位
-// （i >= 8 或 j >= 8192）还没找到0值比特位或者位图所在的缓冲块指针无效（bh = NULL）
-// 则返回0退出（没有空闲逻辑块）。
+// 首先获取设备dev的超级块。若给出了有效的目标块goal，则先从goal开始向后扫描逻辑块位
+// 图，寻找0值比特位。位图块在用到时才读入，读入时可能睡眠，因此读入后若发现其中已没
+// 有空闲位（被其他进程申请走了），就释放它接着看下一块。
 	if (!(sb = get_super(dev)))
 		panic("trying to get new block from nonexistant device");
-	j = 8192;
-	for (i = 0; i < 8; i++)
-		if ((bh = sb->s_zmap[i]))
+	if (!sb->s_free_zones)
+		return 0;
+	if (goal >= sb->s_firstdatazone && goal < sb->s_zones) {
+		goal -= sb->s_firstdatazone - 1;
+		for (i = goal/8192, j = goal&8191; i < sb->s_zmap_blocks; i++, j = 0) {
+			if (!sb->s_zmap_free[i])
+				continue;
+			if (!(bh = read_zmap(sb, i)))
+				return 0;
+			if ((j = find_next_zero(bh->b_data, j)) < 8192)
+				break;
+			brelse(bh);
+			bh = NULL;
+		}
+		if (bh && j + i*8192 + sb->s_firstdatazone - 1 >= sb->s_zones) {
+			brelse(bh);
+			bh = NULL;
+		}
+	}
+// 如果没有目标块，或者目标块之后已没有空闲块，则扫描文件系统的逻辑块位图，寻找首个0
+// 值比特位。超级块中记录着每块位图中的空闲位数，因此已满的位图块直接跳过，不用读入并
+// 扫描其中的8192个比特位。如果扫描完所有逻辑块位图还没找到0值比特位，或者读位图块出
+// 错，则返回0退出（没有空闲逻辑块）。
+	if (!bh)
+		for (i = 0; i < sb->s_zmap_blocks; i++) {
+			if (!sb->s_zmap_free[i])
+				continue;
+			if (!(bh = read_zmap(sb, i)))
+				return 0;
 			if ((j = find_first_zero(bh->b_data)) < 8192)
 				break;
-	if (i >= 8 || !bh || j >= 8192)
+			brelse(bh);
+			bh = NULL;
+		}
+	if (!bh)
 		return 0;
 // 接着设置找到的新逻辑块j对应逻辑块位图中的比特位。若对应比特位已经置位，则出错停
 // 机。否则置存放位图的对应缓冲区块已修改标志。因为逻辑块位图仅表示盘上数据区中逻辑块
 // 的中用情况，即逻辑块位图中比特位偏移值表示从数据区开始处算起的块号，因此这里需要加
 // 上数据区第1个逻辑块的块号，把j转换成逻辑块号。如果新逻辑块大于该设备上的总逻辑块
-// 数，则说明指定逻辑块在对应设备上不存在。申请失败，返回0退出。
+// 数，则说明指定逻辑块在对应设备上不存在。申请失败，返回0退出。否则相应位图块的空闲
+// 位数和空闲逻辑块总数都减1。最后释放位图块。
 	if (set_bit(j, bh->b_data))
 		panic("new_block: bit already set");
 	bh->b_dirt = 1;
 	j += i*8192 + sb->s_firstdatazone - 1;
-	if (j >= sb->s_nzones)
+	if (j >= sb->s_zones) {
+		brelse(bh);
 		return 0;
-// 然后在高速缓冲区中为该设备上指定的逻辑块号取得一个缓冲块，并返回缓冲块头指针。
-// 因为刚取得的逻辑块其引用次数一定为1（getblk()中会设置），因此若不为1则停机。
-// 最后将新逻辑块清零，并设置其已更新标志和已修改标志。然后释放对应缓冲块，返回
-// 逻辑块号。
-	if (!(bh = getblk(dev, j)))
-		panic("new_block: cannot get block");
-	if (bh->b_count != 1)
-		panic("new block: count is != 1");
-	clear_block(bh->b_data);
-	bh->b_uptodate = 1;
-	bh->b_dirt = 1;
+	}
+	sb->s_zmap_free[i]--;
+	sb->s_free_zones--;
 	brelse(bh);
+// 然后对新逻辑块中的每个盘块，在高速缓冲区中为其取得一个缓冲块。因为刚取得的逻辑块
+// 其引用次数一定为1（getblk()中会设置），因此若不为1则停机。将这些盘块清零，并设置
+// 其已更新标志和已修改标志。然后释放对应缓冲块，最后返回逻辑块号。
+	for (i = 0; i < (1 << sb->s_log_zone_size); i++) {
+		if (!(bh = getblk(dev, (j << sb->s_log_zone_size) + i)))
+			panic("new_block: cannot get block");
+		if (bh->b_count != 1)
+			panic("new block: count is != 1");
+		clear_block(bh->b_data);
+		bh->b_uptodate = 1;
+		bh->b_dirt = 1;
+		brelse(bh);
+	}
 	return j;
 }
 
@@ -175,13 +257,13 @@ void free_inode(struct m_inode * inode)
 	struct buffer_head * bh;
 
 // 首先判断参数给出的需要释放的i节点有效性或合法性。如果i节点指针=NULL，则退出。如
-// 果i节点上的设备号字段为0，说明该节点没有使用。于是用0清空对应i节点所占内存区并
-// 返回。memset()定义在include/string.h第395行开始处。这里表示用0填写inode指针指
-// 定处的长度是sizeof(*inode)的内存块。
+// 果i节点上的设备号字段为0，说明该节点没有使用。于是用clear_inode()清空该i节点结构
+// 并返回。clear_inode()定义在fs/inode.c中，它用0填写i节点结构，但保留其在内存i节点
+// 链表中的链接。
 	if (!inode)
 		return;
 	if (!inode->i_dev) {
-		memset(inode, 0, sizeof(*inode));
+		clear_inode(inode);
 		return;
 	}
 // 如果此i节点还有其他程序引用，则不释放，说明内核有问题，于是停机。如果文件链接数
@@ -195,21 +277,25 @@ void free_inode(struct m_inode * inode)
 // 在判断完i节点的合理性之后，我们开始利用其超级块信息对其中的i节点位图进行操作。
 // 首先取i节点所有设备的超级块，测试设备是否存在。然后判断i节点号的范围是否正确，
 // 如果i节点等于0或大于该设备上i节点总数，则出错（0号i节点保留没有使用）。
-// 如果该i节点对应的节点位图不存在，则出错。因为一个缓冲块的i节点位图有8192比
-// 特位，因此i_num>>13(即i_num/8192)可以得到当前i节点号所在的s_imap[]项，即所
-// 在盘块。
+// 如果该i节点对应的节点位图读不出来，则出错。因为一个缓冲块的i节点位图有8192比
+// 特位，因此i_num>>13(即i_num/8192)可以得到当前i节点号所在的位图块。
 	if (!(sb = get_super(inode->i_dev)))
 		panic("trying to free inode on nonexistent device");
 	if (inode->i_num < 1 || inode->i_num > sb->s_ninodes)
 		panic("trying to free inode 0 or nonexistant inode");
-	if (!(bh = sb->s_imap[inode->i_num>>13]))
-		panic("nonexistent imap in superblock");
+	if (!(bh = read_imap(sb, inode->i_num>>13)))
+		panic("unable to read imap");
 // 现在我们复位i节点对应的节点位图中的比特位。如果该比特位已经等于0，则显示出错
 // 警告信息。最后置i节点位图所在缓冲区已修改标志，并清空该i节点结构所占内存区。
 	if (clear_bit(inode->i_num&8191, bh->b_data))
 		printk("free_inode: bit already cleared.\n\r");
+	else {
+		sb->s_imap_free[inode->i_num>>13]++;
+		sb->s_free_inodes++;
+	}
 	bh->b_dirt = 1;
-	memset(inode, 0, sizeof(*inode));
+	brelse(bh);
+	clear_inode(inode);
 }
 
 /// 为设备dev建立一个新i节点。初始化并返回新i节点的指针。
@@ -221,29 +307,42 @@ struct m_inode * new_inode(int dev)
 	struct buffer_head * bh;
 	int i, j;
 
-// 首先从内存i节点表（inode_table）中获取一个空闲i节点项，并读取指定设备的超级块
-// 结构。然后扫描超级块中8块i节点位图，寻找首个0比特位，寻找空闲节点，获取放置
-// 该i节点的节点号。如果全部扫描完还没找到，或者位图所在的缓冲块无效（bh = NULL），
-// 则放回先前申请的i节点表中的i节点，并返回空闲指针退出（浓郁空闲i节点）。
+// 首先从内存i节点链表（first_inode）中获取一个空闲i节点项，并读取指定设备的超级块
+// 结构。然后扫描i节点位图，寻找首个0比特位，寻找空闲节点，获取放置该i节点的节点号。
+// 空闲位数为0的位图块不用读入和扫描。如果全部扫描完还没找到，或者读位图块出错，则放回
+// 先前申请的i节点表中的i节点，并返回空闲指针退出（没有空闲i节点）。
 	if (!(inode = get_empty_inode()))	// fs/inode.c
 		return NULL;
 	if (!(sb = get_super(dev)))		// fs/super.c
 		panic("new_inode with unknown device");
+	bh = NULL;
 	j = 8192;
-	for (i = 0; i < 8; i++)
-		if ((bh = sb->s_imap[i]))
-			if ((j = find_first_zero(bh->b_data)) < 8192)
-				break;
-	if (!bh || j >= 8192 || j+i*8192 > sb->s_ninodes) {
+	for (i = 0; i < sb->s_imap_blocks; i++) {
+		if (!sb->s_imap_free[i])
+			continue;
+		if (!(bh = read_imap(sb, i)))
+			break;
+		if ((j = find_first_zero(bh->b_data)) < 8192)
+			break;
+		brelse(bh);
+		bh = NULL;
+	}
+	if (!bh || j+i*8192 > sb->s_ninodes) {
+		brelse(bh);
 		iput(inode);
 		return NULL;
 	}
 // 现在我们已经找到了还未使用的i节点号j。于是置位i节点j对应的i节点位图相应比
-// 特位（如果已经置位，则出错）。然后置i节点位图所在缓冲块已修改标志。最后初始化
-// 该i节点结构（i_ctime量i节点内容改变时间）。
+// 特位（如果已经置位，则出错）。然后置i节点位图所在缓冲块已修改标志，并释放该缓冲
+// 块。最后初始化该i节点结构（i_ctime量i节点内容改变时间）。
 	if (set_bit(j, bh->b_data))
 		panic("new_inode: bit already set");
 	bh->b_dirt = 1;
+	sb->s_imap_free[i]--;
+	sb->s_free_inodes--;
+	brelse(bh);
+	inode->i_version = sb->s_version;	// 文件系统版本，决定逻辑块号的格式。
+	inode->i_log_zone_size = sb->s_log_zone_size; // 每逻辑块盘块数的对数。
 	inode->i_count = 1;			// 引用计数。
 	inode->i_nlinks = 1;			// 文件目录项链接数。
 	inode->i_dev = dev;			// i节点所在的设备号。
@@ -251,7 +350,69 @@ struct m_inode * new_inode(int dev)
 	inode->i_gid = current->egid;		// 组id。
 	inode->i_dirt = 1;			// 已修改标志置位。
 	inode->i_num = j + i*8192;		// 对应设备中的i节点号。
+	insert_inode_hash(inode);		// 加入i节点hash表，iget()才能找到它。
 	inode->i_mtime = inode->i_atime = inode->i_ctime = CURRENT_TIME; // 设置时间。
 	return inode;				 // 返回该i节点指针。
 }
 
+
+/// 统计位图块addr中前nbits个比特位里0值比特位的个数。
+// 全是1的长字直接跳过。
+static int count_zero(char * addr, int nbits)
+{
+	unsigned long * p = (unsigned long *) addr;
+	int i, n = 0;
+
+	for (i = 0; i < nbits; i++) {
+		if (!(i & 31) && i + 32 <= nbits && p[i>>5] == 0xffffffff) {
+			i += 31;
+			continue;
+		}
+		if (!((p[i>>5] >> (i & 31)) & 1))
+			n++;
+	}
+	return n;
+}
+
+/// 统计超级块sb中各位图块的空闲位数以及空闲i节点和逻辑块的总数。
+// 在read_super()读入超级块之后调用。逐块读入位图并统计，统计完即释放。此后new_block()、
+// free_block()、new_inode()和free_inode()在修改位图的同时维护这些计数，因此申请时可以
+// 直接跳过已满的位图块，ustat()也不用扫描位图就能得到空闲数。i节点位图中有效的是第
+// 0～s_ninodes位，逻辑块位图中有效的是第0～(s_zones - s_firstdatazone)位，位图块中其
+// 余的比特位不计入。逻辑块位图可多达Z_MAP_SLOTS块，其空闲计数表占用一页内存。
+// 成功返回1；内存不够或读位图块出错则返回0。
+int count_free(struct super_block * sb)
+{
+	struct buffer_head * bh;
+	int i, n;
+
+	if (!(sb->s_zmap_free = (unsigned short *) get_free_page()))
+		return 0;
+	sb->s_free_inodes = 0;
+	sb->s_free_zones = 0;
+	for (i = 0; i < sb->s_imap_blocks; i++) {
+		sb->s_imap_free[i] = 0;
+		if ((n = sb->s_ninodes + 1 - i*8192) <= 0)
+			continue;
+		if (!(bh = read_imap(sb, i)))
+			goto bad;
+		sb->s_imap_free[i] = count_zero(bh->b_data, n < 8192 ? n : 8192);
+		sb->s_free_inodes += sb->s_imap_free[i];
+		brelse(bh);
+	}
+	for (i = 0; i < sb->s_zmap_blocks; i++) {
+		sb->s_zmap_free[i] = 0;
+		if ((n = sb->s_zones - sb->s_firstdatazone + 1 - i*8192) <= 0)
+			continue;
+		if (!(bh = read_zmap(sb, i)))
+			goto bad;
+		sb->s_zmap_free[i] = count_zero(bh->b_data, n < 8192 ? n : 8192);
+		sb->s_free_zones += sb->s_zmap_free[i];
+		brelse(bh);
+	}
+	return 1;
+bad:
+	free_page((unsigned long) sb->s_zmap_free);
+	sb->s_zmap_free = NULL;
+	return 0;
+}
@@ -66,16 +66,16 @@ int block_write(int dev, long * pos, char * buf, int count)
 // 足一块，则需从块开始处填写（修改）所需的字节，因此这里需预先设置offset为零。此后将
 // 文件中偏移指针pos前移此次将要写的字节数chars，并累加这些要写的字节数到统计值written
 // 中。再把还需要写入的计数值count减去此次要写的字节数chars。然后我们从用户缓冲区复制
-// chars个字节到p指向的高速缓冲块中开始写入的位置处。复制完后就设置该缓冲块已修改标志，
-// 并释放该缓冲块（也即该缓冲区引用计数减1）。
+// chars个字节（memcpy_fromfs()）到p指向的高速缓冲块中开始写入的位置处。复制完后就设置
+// 该缓冲块已修改标志，并释放该缓冲块（也即该缓冲区引用计数减1）。
 		p = offset + bh->b_data;
 		offset = 0;
 		*pos += chars;
 		written += chars;		// 累计写入字节数。
 		count -= chars;
-		while (chars-- > 0) {
-			*(p++) = get_fs_byte(buf++);
-		}
+		memcpy_fromfs(p, buf, chars);
+		buf += chars;
+		bh->b_dirt = 1;
 		brelse(bh);
 	}
 	return written;				// 返回已写入的字节数，正常退出。
@@ -121,15 +121,15 @@ int block_read(int dev, unsigned long * pos, char * buf, int count)
 // 不足一块，则需从块起始处读取所需字节，因此这里需预告设置offset为零。此后将文件中偏移
 // 指针pos前移此次将要读的字节数chars，并且累加这些要读的字节数到时统计值read中。再把还
 // 需要读的计数值count减去此次要读的字节数chars。然后我们从高速缓冲块中p指向的开始读
-// 的位置处复制chars个字节到用户缓冲区中，同时把用户缓冲区指针前移。本次复制完后就释放
-// 该缓冲块。
+// 的位置处复制chars个字节（memcpy_tofs()）到用户缓冲区中，同时把用户缓冲区指针前移。
+// 本次复制完后就释放该缓冲块。
 		p = offset + bh->b_data;
 		offset = 0;
 		*pos += chars;
 		read += chars;			// 累计读入字节数。
 		count -= chars;
-		while (chars-- > 0)
-			put_fs_byte(*(p++), buf++);
+		memcpy_tofs(buf, p, chars);
+		buf += chars;
 		brelse(bh);
 	}
 	return read;				// 返回已读取的字节数，正常退出。
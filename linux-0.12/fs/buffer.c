@@ -40,16 +40,18 @@
 
 // 变量end是由链接程序ld在链接内核模块时生成，用于指明内核执行模块的末端位置，参见
 // 图12-15所示。我们可以从编译内核时生成的System.map文件中查出该值。这里用它来表明
-// 调整缓冲区开始于内核代码末端位置。
+// 调整缓冲区开始于内核代码末端位置。缓冲块头结构数组start_buffer则由buffer_head_init()
+// 在主内存区开始处分配，这样低端640KB内存就可以全部用作缓冲块数据区。
 // 第33行上的buffer_wait变量是等待空闲缓冲块而睡眠的任务队列头指针。它与缓冲块头部
 // 结构中b_wait指针的作用不同。当任务申请一个缓冲翼支付而正好遇到系统缺乏可用空闲缓冲块
 // 时，当前任务就会被添加到buffer_wait睡眠等待队列中。而b_wait则是专门供等待指定缓
 // 冲块（即b_wait对应的缓冲块）的任务使用的等待队列头指针。
 extern int end;
-struct buffer_head * start_buffer = (struct buffer_head *) &end;
+struct buffer_head * start_buffer = NULL;
+static long buffer_start = 0;			// 缓冲块数据区的开始位置（内核末端按1KB对齐）。
 struct buffer_head * hash_table[NR_HASH]; 	// NR_HASH = 307项。
 static struct buffer_head * free_list;		// 空闲缓冲块链表头指针。
-static struct task_struct * buffer_wait = NULL; // 等待空闲缓冲块面睡眠的任务队列。
+static struct wait_queue * buffer_wait = NULL;	// 等待空闲缓冲块面睡眠的任务队列。
 
 // 下面定义系统缓冲区中含有的缓冲块个数。这里，NR_BUFFERS是一个定义在linux/fs.h头
 // 文件第48行的常量符号，被定义为变量nr_buffers，而该变量在fs.h文件第172行被声明为
@@ -64,7 +66,7 @@ int NR_BUFFERS = 0;				// 系统含有缓冲块个数。
 // b_wait中。在缓冲块解锁时，其等待队列上的所有进程将被唤醒。虽然是在关闭中断（cli）
 // 之后去睡眠的，但这样做并不会影响在其他进程上下文中响应中断。因为每个进程都在自己的
 // TSS段中保存了标志寄存器EFLAGS的值，所以在进程切换时CPU中当前EFLAGS的值也随之改
-// 变。使用sleep_on()进入睡眠状态的进程需要用wake_up()明确地唤醒。
+// 变。使用sleep_on()进入睡眠状态的进程需要用wake_up_all()明确地唤醒。
 static inline void wait_on_buffer(struct buffer_head * bh)
 {
 	cli();					// 关中断。
@@ -89,6 +91,7 @@ int sys_sync(void)
 		wait_on_buffer(bh);		// 等待缓冲区解锁（如果已上锁的话）。
 		if (bh->b_dirt)
 			ll_rw_block(WRITE, bh);	// 产生写设备块请求。
+		cond_resched();			// 若时间片已用完则让出CPU。
 	}
 	return 0;
 }
@@ -193,6 +196,8 @@ void check_disk_change(int dev)
 			put_super(super_block[i].s_dev);
 	invalidate_inodes(dev);
 	invalidate_buffers(dev);
+	invalidate_dev_page_cache(dev);
+	dcache_invalidate_dev(dev);
 }
 
 // 下面两行代码是hash（散列）函数定义和hash表项的计算宏。
@@ -320,11 +325,17 @@ struct buffer_head * get_hash_table(int dev, int block)
 struct buffer_head * getblk(int dev, int block)
 {
 	struct buffer_head * tmp, * bh;
+	int slept = 0;
 
 repeat:
-// 搜索hash表，如果指定块已经在高速缓冲中，则返回对应缓冲块的头指针，退出。
-	if ((bh = get_hash_table(dev, block)))
+// 搜索hash表，如果指定块已经在高速缓冲中，则返回对应缓冲块的头指针，退出。等待空闲
+// 缓冲块的进程是以互斥方式被唤醒的，因此若本进程曾因此睡眠过而现在又不需要空闲缓冲
+// 块了，就把这次唤醒转交给下一个等待的进程。
+	if ((bh = get_hash_table(dev, block))) {
+		if (slept)
+			wake_up_one(&buffer_wait);
 		return bh;
+	}
 // 否则就扫描空闲空闲数据块链表，寻找空闲缓冲块。
 // 首先让tmp指向空链表的第一个空闲缓冲块头，然后执行下面循环中的操作。
 	tmp = free_list;
@@ -350,9 +361,10 @@ repeat:
 	} while ((tmp = tmp->b_next_free) != free_list);
 // 如果循环检查发现所有缓冲块都正在被使用（所有缓冲块的头部引用计数都>0）中，则睡眠
 // 等待有空闲缓冲块可用。当有空闲缓冲块可用时本进程会被明确地唤醒。然后我们就跳转到
-// 函数开始处重新查找空闲缓冲块。
+// 函数开始处重新查找空闲缓冲块。一个缓冲块只能满足一个进程，因此以互斥方式等待。
 	if (!bh) {
-		sleep_on(&buffer_wait);
+		sleep_on_exclusive(&buffer_wait);
+		slept = 1;
 		goto repeat;			// 跳转至210行。
 	}
 // 执行到这里，说明我们已经找到了一个比较适合的空闲缓冲块了。于是先等待该缓冲区解锁
@@ -396,7 +408,8 @@ repeat:
 }
 
 /// 释放指定缓冲块。
-// 等待该缓冲块解锁。然后引用计数递减1，并明确地唤醒等待空闲缓冲块的进程。
+// 等待该缓冲块解锁。然后引用计数递减1。若缓冲块因此而空闲，就唤醒一个等待空闲缓冲块
+// 的进程。
 void brelse(struct buffer_head *buf)
 {
 	if (!buf)				// 如果缓冲头指针无效则返回。
@@ -404,7 +417,8 @@ void brelse(struct buffer_head *buf)
 	wait_on_buffer(buf);
 	if (!(buf->b_count--))
 		panic("Trying to free free buffer");
-	wake_up(&buffer_wait);
+	if (!buf->b_count)
+		wake_up_one(&buffer_wait);
 }
 
 /*
@@ -538,11 +552,29 @@ struct buffer_head * breada(int dev, int first, ...)
 	return (NULL);
 }
 
+/// 为缓冲块头结构数组分配内存。
+// 参数mem_start是数组的开始位置（主内存区开始处），buffer_end是缓冲区内存末端。
+// 函数根据缓冲区中能划分出的缓冲块数计算出缓冲块头结构数组的长度，返回按页对齐后
+// 占用的内存字节数。调用者（init/main.c）据此把主内存区开始位置后移。
+long buffer_head_init(long mem_start, long buffer_end)
+{
+	long blocks;
+
+	buffer_start = ((long) &end + BLOCK_SIZE - 1) & ~(BLOCK_SIZE - 1);
+	blocks = (640*1024 - buffer_start) / BLOCK_SIZE;
+	if (buffer_end > 1<<20)
+		blocks += (buffer_end - (1<<20)) / BLOCK_SIZE;
+	start_buffer = (struct buffer_head *) mem_start;
+	return (blocks * sizeof(struct buffer_head) + 4095) & ~4095;
+}
+
 /// 缓冲区初始化函数。
 // 参数buffer_end是缓冲区内存末端。对于具有16MB内存的系统，缓冲区末端被设置为4MB。
 // 对于有8MB内存的系统，缓冲区末端被设置为2MB。该函数从缓冲区开始位置start_buffer
 // 处事缓冲区末端buffer_end处分别同时设置（初始化）缓冲块头结构和陈若仪的数据块，直到
-// 缓冲区中所有内存被分配完毕。参见程序列表前面的示意图。
+// 缓冲区中所有内存被分配完毕。参见程序列表前面的示意图。缓冲块头结构数组已由
+// buffer_head_init()在主内存区中分配，缓冲块数据区则从buffer_end一直向下划分到内核
+// 末端buffer_start处。
 void buffer_init(long buffer_end)
 {
 	struct buffer_head * h = start_buffer;
@@ -557,12 +589,9 @@ void buffer_init(long buffer_end)
 	else
 		b = (void *) buffer_end;
 // 下面这段代码用于初始化高速缓冲区，建立空闲缓冲块循环链表，并获取系统中缓冲块数目。
-// 操作的过程是从缓冲区高端开始划分1KB大小的缓冲块，与此同时在缓冲区低端建立描述该
-// 缓冲块的结构buffer_head，并将这些buffer_head给成双向链表。
-// h是指向缓冲块头结构的指针，而h+1是指向内存地址连续的下一个缓冲块头地址，也可以说
-// 是指向h缓冲块头的末端处。为了保证有足够长度的内存来存储一个缓冲块头结构，需要b所
-// 指向的内存块地址大于h的缓冲块头的末端，即要求b>h+1。
-	while ((b -= BLOCK_SIZE) >= ((void *) (h+1))) {
+// 操作的过程是从缓冲区高端开始划分1KB大小的缓冲块，与此同时在start_buffer数组中建立
+// 描述该缓冲块的结构buffer_head，并将这些buffer_head给成双向链表。
+	while ((b -= BLOCK_SIZE) >= (void *) buffer_start) {
 		h->b_dev = 0;			// 使用该缓冲块的设备号。
 		h->b_dirt = 0;			// 脏标志，即缓冲块修改标志。
 		h->b_count = 0;			// 缓冲块引用计数。
@@ -578,8 +607,6 @@ void buffer_init(long buffer_end)
 		NR_BUFFERS++;			// 缓冲区块数累加。
 		if (b == (void *) 0x100000)	// 若b递减到等于1MB，则跳过384KB，
 			b = (void *) 0xA0000;	// 让b指向地址0xA0000(640KB)处。
-		/* 640KB内存（buffer_head）大概可以映射17.8MB的内存block */
-		/* 所以更大的内存的话，这里会有bug，需要修改 */
 	}
 // 然后让h指向最后一个缓冲块头；让空闲链表头指向头一个缓冲块头；链表头的b_prev_free
 // 指向前一项（即最后一项）；h的下一项指针指向第一项，从而让空闲链表形成双向环形结构。
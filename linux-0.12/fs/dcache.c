@@ -0,0 +1,199 @@
+/*
+ * linux/fs/dcache.c
+ *
+ * (C) 1991 Linus Torvalds
+ */
+
+/*
+ * This file keeps a small cache of directory entries, indexed by
+ * (device, directory inode, name). It remembers which inode number a
+ * name maps to, so that path lookups don't have to read and search the
+ * directory blocks every time. Names that weren't found are remembered
+ * too (with inode number 0), as things like searching $PATH look up a
+ * lot of names that don't exist. Only numbers are kept here, so the
+ * cache holds no inodes or buffers - but it has to be told whenever a
+ * directory changes.
+ *
+ * 本文件维护一个小的目录项高速缓冲，以（设备号，目录i节点号，名字）为索引。它记住名字
+ * 对应的i节点号，这样路径名查找就不用每次都读入并搜索目录的数据块。找不到的名字也被
+ * 记住（i节点号为0），因为像在$PATH中搜索命令这样的操作会查找大量不存在的名字。缓冲
+ * 中只保存编号，因此并不占用任何i节点或缓冲块，但目录每次被修改时都必须通知它。
+ */
+
+#include <linux/fs.h>		// 文件系统头文件。定义文件表结构（file、m_inode）等。
+#include <linux/sched.h>	// 调度程序头文件。定义了任务结构task_struct、任务0的数据等。
+#include <asm/segment.h>	// 段操作头文件。定义了有关段寄存器操作的嵌入式汇编函数。
+
+#define NR_DCACHE 128		/* 目录项缓冲项数 */
+#define NR_DCACHE_HASH 61	/* 目录项缓冲hash表项数 */
+
+// 目录项缓冲项结构。这里同样不使用内存i节点指针，而用设备号和i节点号来确定目录。
+struct dir_cache {
+	unsigned short dev;			// 目录所在设备号（0表示该项空闲）。
+	unsigned short dir;			// 目录的i节点号。
+	unsigned short ino;			// 名字对应的i节点号。0表示目录中没有该名字。
+	unsigned char hash;			// 所在hash链表的索引。
+	unsigned char referenced;		// 最近被使用过的标志，回收缓冲项时用。
+	unsigned short len;			// 名字长度。
+	char name[NAME_LEN];			// 名字。
+	struct dir_cache * next;		// hash链表上的下一项。
+};
+
+static struct dir_cache dcache[NR_DCACHE];
+static struct dir_cache * dcache_hash[NR_DCACHE_HASH];
+static int dcache_clock = 0;		// 回收缓冲项时的循环扫描位置。
+// 缓冲项被置无效的次数。搜索目录时可能会睡眠，若在此期间目录被修改了，则搜索结果不
+// 能再加入缓冲。
+static unsigned long dcache_seq = 0;
+
+/// 把用户空间中长度为len的名字复制到buf中，并计算目录dir中该名字的hash值。
+// "."、".."和空名字（当作"."）不放入缓冲，因为find_entry()对它们在伪根目录和安装点上
+// 有特殊处理，而且它们本来就在目录的第一块中。对于这些名字以及太长的名字返回-1。
+static int dcache_name(struct m_inode * dir, const char * name, int len, char * buf)
+{
+	unsigned long hash;
+	int i;
+
+	if (len <= 0 || len > NAME_LEN)
+		return -1;
+	hash = dir->i_dev ^ dir->i_num;
+	for (i = 0; i < len; i++) {
+		buf[i] = get_fs_byte(name + i);
+		hash = (hash << 3) + (hash >> 28) + (unsigned char) buf[i];
+	}
+	if (buf[0] == '.' && (len == 1 || (len == 2 && buf[1] == '.')))
+		return -1;
+	return hash % NR_DCACHE_HASH;
+}
+
+/// 在hash链表hash上查找目录dir中的名字name（已复制到内核空间）。
+static struct dir_cache * find_dcache(struct m_inode * dir, const char * name,
+	int len, int hash)
+{
+	struct dir_cache * dc;
+	int i;
+
+	for (dc = dcache_hash[hash]; dc; dc = dc->next) {
+		if (dc->dev != dir->i_dev || dc->dir != dir->i_num || dc->len != len)
+			continue;
+		for (i = 0; i < len && dc->name[i] == name[i]; i++)
+			/* nothing */;
+		if (i == len)
+			return dc;
+	}
+	return NULL;
+}
+
+/// 从hash链表中取下并释放一个目录项缓冲项。
+static void remove_dcache(struct dir_cache * dc)
+{
+	struct dir_cache ** p;
+
+	for (p = dcache_hash + dc->hash; *p; p = &(*p)->next)
+		if (*p == dc) {
+			*p = dc->next;
+			break;
+		}
+	dc->dev = 0;
+}
+
+/// 在目录项缓冲中查找目录dir中的名字name。
+// 返回：-1表示缓冲中没有该项，需要搜索目录，此时在*seq中返回当前的置无效次数，供搜索
+// 完后调用dcache_add()时使用；0表示目录中没有该名字；否则返回名字对应的i节点号。
+int dcache_lookup(struct m_inode * dir, const char * name, int len,
+	unsigned long * seq)
+{
+	struct dir_cache * dc;
+	char buf[NAME_LEN];
+	int hash;
+
+	*seq = dcache_seq;
+	if ((hash = dcache_name(dir, name, len, buf)) < 0)
+		return -1;
+	if (!(dc = find_dcache(dir, buf, len, hash)))
+		return -1;
+	dc->referenced = 1;
+	return dc->ino;
+}
+
+/// 把目录dir中名字name对应i节点号ino（0表示没有该名字）的结果加入目录项缓冲。
+// 参数seq是dcache_lookup()返回的置无效次数。若此后有缓冲项被置无效，则目录可能已经
+// 被修改，搜索结果可能已经过时，于是不加入缓冲。缓冲满时按时钟算法回收一项：跳过最近
+// 被使用过的项（并清除其使用标志），回收第一个最近未被使用的项。
+void dcache_add(struct m_inode * dir, const char * name, int len, int ino,
+	unsigned long seq)
+{
+	struct dir_cache * dc;
+	char buf[NAME_LEN];
+	int hash, i;
+
+	if ((hash = dcache_name(dir, name, len, buf)) < 0 || seq != dcache_seq)
+		return;
+	if ((dc = find_dcache(dir, buf, len, hash))) {
+		dc->ino = ino;
+		return;
+	}
+	while (1) {
+		dc = dcache + dcache_clock;
+		if (++dcache_clock >= NR_DCACHE)
+			dcache_clock = 0;
+		if (!dc->dev)
+			break;
+		if (!dc->referenced) {
+			remove_dcache(dc);
+			break;
+		}
+		dc->referenced = 0;
+	}
+	dc->dev = dir->i_dev;
+	dc->dir = dir->i_num;
+	dc->ino = ino;
+	dc->hash = hash;
+	dc->referenced = 0;
+	dc->len = len;
+	for (i = 0; i < len; i++)
+		dc->name[i] = buf[i];
+	dc->next = dcache_hash[hash];
+	dcache_hash[hash] = dc;
+}
+
+/// 使目录dir中名字name的缓冲项无效。
+// 在目录中添加或删除名字时调用。名字若超过NAME_LEN则截短，与find_entry()一致。
+void dcache_invalidate(struct m_inode * dir, const char * name, int len)
+{
+	struct dir_cache * dc;
+	char buf[NAME_LEN];
+	int hash;
+
+	dcache_seq++;
+	if (len > NAME_LEN)
+		len = NAME_LEN;
+	if ((hash = dcache_name(dir, name, len, buf)) < 0)
+		return;
+	if ((dc = find_dcache(dir, buf, len, hash)))
+		remove_dcache(dc);
+}
+
+/// 使目录dir中所有名字的缓冲项无效。
+// 在删除目录时调用，因为以后该i节点号可能被分配给另一个目录。
+void dcache_invalidate_dir(struct m_inode * dir)
+{
+	struct dir_cache * dc;
+
+	dcache_seq++;
+	for (dc = dcache; dc < dcache + NR_DCACHE; dc++)
+		if (dc->dev == dir->i_dev && dc->dir == dir->i_num)
+			remove_dcache(dc);
+}
+
+/// 使设备dev上所有目录的缓冲项无效。
+// 在卸载文件系统或更换软盘时调用。
+void dcache_invalidate_dev(int dev)
+{
+	struct dir_cache * dc;
+
+	dcache_seq++;
+	for (dc = dcache; dc < dcache + NR_DCACHE; dc++)
+		if (dc->dev == dev)
+			remove_dcache(dc);
+}
@@ -79,12 +79,14 @@ int sys_uselib(const char * library)
 // 位置，并释放原库代码的页表和所占用的内存页面。最后让进程库i节点字段指针新库i节
 // 点，并返回0（成功）。与加载执行程序类似，实际库代码要到真正使用时才会读入内存中。
 // 另外，库文件代码被放置在进程空间的末端处，大小是4MB的整数倍，参见linux/sched.h。
+	unlink_inode_task(current, 1);
 	iput(current->library);
 	current->library = NULL;
 	base = get_base(current->ldt[2]);
 	base += LIBRARY_OFFSET;			// linux/sched.h，第26行。
-	free_page_tables(base, LIBRARY_SIZE);
+	free_page_tables(current, base, LIBRARY_SIZE);
 	current->library = inode;
+	link_inode_task(current, 1);
 	return 0;
 }
 
@@ -412,7 +414,7 @@ restart_interp:
 // 需要跳转到执行过的代码229行去，因此在确认并处理了脚本文件之后需要设置一个禁止再次执
 // 行下面的脚本处理代码标志sh_bang。在后面的代码中该标志也用来表示我们已经设置好执行文
 // 件的命令行参数，不要重复设置。
-	if (!(bh = bread(inode->i_dev, inode->i_zone[0]))) {
+	if (!(bh = bread(inode->i_dev, bmap(inode, 0)))) {
 		retval = -EACCES;
 		goto exec_error2;
 	}
@@ -590,9 +592,12 @@ restart_interp:
 // 这里我们首先放回进程原执行程序的i节点，并且让进程executable字符指向新执行文件的i
 // 节点。然后复位原进程的所有信号处理句柄，但对于SIG_IGN句柄无须复位。再根据设定的执行
 // 时关闭文件句柄（close_on_exec）位图标志，关闭指定的打开文件并复位该标志。
-	if (current->executable)
+	if (current->executable) {
+		unlink_inode_task(current, 0);
 		iput(current->executable);
+	}
 	current->executable = inode;
+	link_inode_task(current, 0);
 	current->signal = 0;
 	for (i = 0; i < 32; i++) {
 		current->sigaction[i].sa_mask = 0;
@@ -608,9 +613,11 @@ restart_interp:
 // 的物理内存页面及页表本身。此时新执行文件并没有占用主内存区任何页面，因此在处理器真正
 // 运行新执行文件代码时就会引起缺页异常中断。此时内存管理程序即会执行缺页处理而为新执行
 // 文件申请内存页面和设置相关页表项，并且把相关执行文件页面读入内存中。如果“上次任务使
-// 用了协处理器”指向的是当前进程，则将其置空，并复位使用也协处理器的标志。
-	free_page_tables(get_base(current->ldt[1]), get_limit(0x0f));
-	free_page_tables(get_base(current->ldt[2]), get_limit(0x17));
+// 用了协处理器”指向的是当前进程，则将其置空，并复位使用也协处理器的标志。在释放页表
+// 之前先解除原来程序的所有文件映射。
+	exit_mmap();
+	free_page_tables(current, get_base(current->ldt[1]), get_limit(0x0f));
+	free_page_tables(current, get_base(current->ldt[2]), get_limit(0x17));
 	if (last_task_used_math == current)
 		last_task_used_math = NULL;
 	current->used_math = 0;
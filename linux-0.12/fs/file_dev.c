@@ -29,12 +29,18 @@ int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
 // 我们根据i节点和文件表结构信息，并利用bmap()得到包含文件当前读写位置的数据在设备上
 // 对应的逻辑块号nr。若nr不为0，则从设备上读取该逻辑块。如果读操作失败则退出循环。若
 // nr为0，表示指定的数据块不存在，置缓冲块指针为NULL。（filp->f_pos）/BLOCK_SIZE用于计
-// 算出文件当前指针所在数据块号。
+// 算出文件当前指针所在数据块号。一个逻辑块中的盘块在盘上是连续的，因此若还要读下一块
+// 并且它与nr在同一逻辑块中，则它就是nr+1块，于是用breada()同时预读它。
 	if ((left = count) <= 0)
 		return 0;
 	while (left) {
 		if ((nr = bmap(inode, (filp->f_pos)/BLOCK_SIZE))) { // inode.c第140行。
-			if (!(bh = bread(inode->i_dev, nr)))
+			if (left > BLOCK_SIZE &&
+			    ((nr + 1) & ((1 << inode->i_log_zone_size) - 1)))
+				bh = breada(inode->i_dev, nr, nr + 1, -1);
+			else
+				bh = bread(inode->i_dev, nr);
+			if (!bh)
 				break;
 		} else
 			bh = NULL;
@@ -47,12 +53,11 @@ int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
 		chars = MIN(BLOCK_SIZE-nr, left);
 		filp->f_pos += chars;
 		left -= chars;
-// 若上面从设备上读取取了数据，则将p指向缓冲块中开始读取数据的位置，并且复制chars字节
-// 到用户缓冲区buf中。琐往用户缓冲区中填入chars个0值字节。
+// 若上面从设备上读取取了数据，则将p指向缓冲块中开始读取数据的位置，并且用
+// memcpy_tofs()一次复制chars字节到用户缓冲区buf中。琐往用户缓冲区中填入chars个0值字节。
 		if (bh) {
-			char * p = nr + bh->b_data;
-			while (chars-- > 0)
-				put_fs_byte(*(p++), buf++);
+			memcpy_tofs(buf, nr + bh->b_data, chars);
+			buf += chars;
 			brelse(bh);
 		} else {
 			while (chars-- > 0)
@@ -112,18 +117,23 @@ int file_write(struct m_inode * inode, struct file * filp, char * buf, int count
 // 在写入数据之前，我们先预先设置好下一次循环操作要读写文件中的位置。因此我们把pos
 // 指针前移此次需写入的字节数。如果此时pos位置值超过了文件当前长度，则修改i节点中
 // 文件长度字段，并置i节距已修改标志。然后把此次要写入的字节数c累加到已写入字节计
-// 数值i中，供循环判断使用。接着从用户缓冲区buf中复制c个字节到高速缓冲块中p指向
-// 的开始位置处。我刚完后就释放该缓冲块。
+// 数值i中，供循环判断使用。接着用memcpy_fromfs()从用户缓冲区buf中复制c个字节到高速
+// 缓冲块中p指向的开始位置处。我刚完后就释放该缓冲块。
 		pos += c;
 		if (pos > inode->i_size) {
 			inode->i_size = pos;
 			inode->i_dirt = 1;
 		}
 		i += c;
-		while (c-- > 0)
-			*(p++) = get_fs_byte(buf++);
+		memcpy_fromfs(p, buf, c);
+		buf += c;
 		brelse(bh);
 	}
+// 文件内容已被修改，因此页面缓冲中该文件的页面不能再用于以后的执行或映射。这要在写完
+// 数据之后才做：上面循环中create_block()、bread()等都会睡眠，其间缺页的进程可能又通过
+// 缓冲区读入旧的内容并把它加入页面缓冲，若在循环之前就清除缓冲，这些过时的页面会一直
+// 留在缓冲中。
+	invalidate_page_cache(inode);
 // 当数据已经全部写入文件或者在写操作过程中发生问题时就会退出循环。此时我们更改文件
 // 修改时间为当前时间，并调整谁的读写指针。如果此次操作不是在文件尾添加数据，则把文
 // 件写指针高速到当前读写位置pos处，并更改文件i节点的修改时间为当前时间。最后返
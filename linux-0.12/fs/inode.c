@@ -18,7 +18,26 @@
 // 块数数组每一项对应子设备号确定的一个子设备上所拥有的数据块总数（1块大小 = 1KB）。
 extern int *blk_size[];
 
-struct m_inode inode_table[NR_INODE] = {{0},};	// 内存中i节点表（NR_INODE=32项）。
+/*
+ * In-core inodes are no longer a fixed table: they are allocated a page
+ * at a time as needed (up to NR_INODE of them), and kept on a circular
+ * list. Inodes that belong to a device are also on a hash chain indexed
+ * by (dev, nr), so that iget() doesn't have to scan them all.
+ */
+/*
+ * 内存i节点不再是一个固定大小的表：它们在需要时按页面分配（最多NR_INODE个），并
+ * 链接在一个双向循环链表上。属于某个设备的i节点还链接在以（设备号，i节点号）为索引
+ * 的hash链表上，因此iget()不用再扫描所有的i节点。
+ */
+#define NR_IHASH 131				/* i节点hash表项数 */
+
+struct m_inode * first_inode = NULL;		// 内存i节点链表头。
+int nr_inodes = 0;				// 已分配的内存i节点数。
+static struct m_inode * inode_hash[NR_IHASH];	// i节点hash表。
+
+// 下面两行代码是hash（散列）函数定义和hash表项的计算宏。
+#define _inode_hashfn(dev,nr) (((unsigned)((dev)^(nr)))%NR_IHASH)
+#define inode_hashfn(dev,nr) inode_hash[_inode_hashfn(dev,nr)]
 
 static void read_inode(struct m_inode * inode);	// 读指定i节点号的i节点信息，297行。
 static void write_inode(struct m_inode * inode); // 写i节点信息到高速缓冲中，324行。
@@ -51,7 +70,80 @@ static inline void lock_inode(struct m_inode * inode)
 static inline void unlock_inode(struct m_inode * inode)
 {
 	inode->i_lock = 0;
-	wake_up(&inode->i_wait);		// kernel/sched.c，第204行。
+	wake_up_all(&inode->i_wait);		// kernel/sched.c，第204行。
+}
+
+/// 把i节点加入以其设备号和i节点号为索引的hash链表。
+void insert_inode_hash(struct m_inode * inode)
+{
+	struct m_inode ** head = &inode_hashfn(inode->i_dev, inode->i_num);
+
+	if ((inode->i_hash_next = *head))
+		(*head)->i_hash_pprev = &inode->i_hash_next;
+	*head = inode;
+	inode->i_hash_pprev = head;
+}
+
+/// 把i节点从hash链表中取下（若在链表上的话）。
+static inline void remove_inode_hash(struct m_inode * inode)
+{
+	if (!inode->i_hash_pprev)
+		return;
+	if ((*inode->i_hash_pprev = inode->i_hash_next))
+		inode->i_hash_next->i_hash_pprev = inode->i_hash_pprev;
+	inode->i_hash_next = NULL;
+	inode->i_hash_pprev = NULL;
+}
+
+/// 在hash表中查找设备dev上i节点号为nr的内存i节点。没有则返回NULL。
+static struct m_inode * find_inode(int dev, int nr)
+{
+	struct m_inode * inode;
+
+	for (inode = inode_hashfn(dev, nr); inode; inode = inode->i_hash_next)
+		if (inode->i_dev == dev && inode->i_num == nr)
+			return inode;
+	return NULL;
+}
+
+/// 清空i节点结构，只保留其在i节点链表中的链接。
+// 用来代替原来的memset()，因为现在i节点结构中含有链表指针。
+void clear_inode(struct m_inode * inode)
+{
+	struct m_inode * next = inode->i_next, * prev = inode->i_prev;
+
+	remove_inode_hash(inode);
+	memset(inode, 0, sizeof(*inode));
+	inode->i_next = next;
+	inode->i_prev = prev;
+}
+
+/// 申请一页内存用作新的内存i节点，并把它们加入i节点链表末尾。
+// 成功则返回1。若已经达到最大数NR_INODE，或者没有空闲内存，则返回0。
+static int grow_inodes(void)
+{
+	struct m_inode * inode;
+	unsigned long page;
+	int i;
+
+	if (nr_inodes >= NR_INODE)
+		return 0;
+	if (!(page = get_free_page()))
+		return 0;
+// get_free_page()返回的页面已经清零。申请页面时可能睡眠，因此链表要在这之后再操作。
+	inode = (struct m_inode *) page;
+	for (i = PAGE_SIZE / sizeof(struct m_inode); i; i--, inode++) {
+		if (!first_inode) {
+			first_inode = inode->i_next = inode->i_prev = inode;
+		} else {
+			inode->i_next = first_inode;
+			inode->i_prev = first_inode->i_prev;
+			inode->i_prev->i_next = inode;
+			first_inode->i_prev = inode;
+		}
+		nr_inodes++;
+	}
+	return 1;
 }
 
 /// 释放设备dev在内存i节点表中的所有i节点。
@@ -61,17 +153,18 @@ void invalidate_inodes(int dev)
 	int i;
 	struct m_inode * inode;
 
-// 首先让指针指向内存i节点表指针数组首项，然后扫描其中的所有i节点。针对其中每个i
-// 节点，先等待该i节点解锁可用（若目前正被上锁的话），再判断是否属于指定设备的i节
-// 点。如果是则释放之，即把i节点的设备号字段i_dev置0。期间还会查看它是否还被使
-// 用着（引用计数是否不为0），若是则显示警告信息。第50行上的指针赋值“0+inode_table”
-// 等同于“inode_table”、"&inode_table[0]"。不过这样写可更明了些。
-	inode = 0+inode_table;			// 指向i节点表指针数组首项。
-	for (i = 0; i < NR_INODE; i++,inode++) {
+// 首先让指针指向内存i节点链表头，然后扫描其中的所有i节点。针对其中每个i节点，先等
+// 待该i节点解锁可用（若目前正被上锁的话），再判断是否属于指定设备的i节点。如果是则
+// 释放之，即把它从hash链表中取下，并把i节点的设备号字段i_dev置0。期间还会查看它
+// 是否还被使用着（引用计数是否不为0），若是则显示警告信息。内存i节点从不释放，因此
+// 睡眠期间链表不会变短。
+	inode = first_inode;
+	for (i = nr_inodes; i > 0; i--, inode = inode->i_next) {
 		wait_on_inode(inode);		// 等待该i节点可用（解锁）。
 		if (inode->i_dev == dev) {
 			if (inode->i_count)	// 若其引用数不为0，则显示出错警告。
 				printk("inode in use on removed disk\n\r");
+			remove_inode_hash(inode);
 			inode->i_dev = inode->i_dirt = 0; // 释放i节点（置设备号为0）。
 		}
 	}
@@ -84,130 +177,177 @@ void sync_inodes(void)
 	int i;
 	struct m_inode * inode;
 
-// 首先让内存i节点类型的指针指向i节点表首项，然后扫描整个i节点表。针对其中每个i节
+// 首先让内存i节点类型的指针指向i节点链表头，然后扫描所有的i节点。针对其中每个i节
 // 点，先等待该i节点解锁可用（若正被上锁的话），然后判断该i节点是否已被修改并且不是
 // 管道节点。若是这种情况则将该i节点写入高速缓冲区中。缓冲区管理程序buffer.c会在适
 // 当时机将它们写入盘中。
-	inode = 0 + inode_table;		// 让指针首先指向i节点表指针数组首项。
-	for (i = 0; i < NR_INODE; i++,inode++) { // 扫描i节点表指针数组。
+	inode = first_inode;
+	for (i = nr_inodes; i > 0; i--, inode = inode->i_next) {
 		wait_on_inode(inode);		// 等待该i节点可用（解锁）。
 		if (inode->i_dirt && !inode->i_pipe) // 若i节点已修改且不是管道节点，
 			write_inode(inode);	     // 则写盘（实际是写入缓冲区中）。
 	}
 }
 
-/// 文件数据块映射到盘块的处理操作。（block位图处理函数，bmap - block map）
-// 参数：inode - 文件的i节点指针；block - 文件中的数据块号；create - 创建块标志。
-// 该函数把指定的文件数据块block对应到设备上逻辑块上，并返回逻辑块号。如果块创建标志
-// 置位，则在设备上对应逻辑块不存在时就申请新磁盘块，返回文件数据块block对应在设备上
-// 的逻辑块号（盘块号）。该函数分四个部分进行处理：（1）参数有效性检查；（2）直接块处理；
-// （3）一次间接块处理；（4）二次间接块处理。
-static int _bmap(struct m_inode * inode, int block, int create)
+static int _bmap(struct m_inode * inode, int block, int create);
+
+/// 为文件数据块nr申请逻辑块时的目标逻辑块号。
+// 取文件前一数据块所在盘块的下一块所在的逻辑块，使顺序写入的文件在盘上也尽量连续。
+// 前一块不存在时返回0，表示没有要求。为间接块申请逻辑块时也使用它们所映射的第一个数
+// 据块的目标块。
+static int bmap_goal(struct m_inode * inode, int nr)
 {
-	struct buffer_head * bh;
 	int i;
 
-// （1）首先判断参数的有效性。如果文件数据块号block小于0，则停机。如果块号大于
-// （直接块数 + 间接块数 + 二次间接块数），超出了文件系统表示范围，则停机。
-	if (block < 0)
-		panic("_bmap: block<0");
-	if (block >= 7+512+512*512)
-		panic("_bmap: block>big");
+	if (nr <= 0 || !(i = _bmap(inode, nr - 1, 0)))
+		return 0;
+	return (i + 1) >> inode->i_log_zone_size;
+}
 
-// （2）然后根据文件块号的大小值和是否设置了创建标志分别进行处理。如果该块号小于7，则使 
-// 用直接块表示。此时，如果创建标志置位，并且i节点中对应该块的逻辑块字段为0，则向相应
-// 设备申请一磁盘块（逻辑块），并且将盘上的该盘块号填入逻辑块字段中。然后设置i节点改变
-// 时间，置i节点已修改标志。最后返回逻辑块号。函数new_block()定义在bitmap.c中第76行。
-	if (block < 7) {
-		if (create && !inode->i_zone[block])
-			if ((inode->i_zone[block] = new_block(inode->i_dev))) {
-				inode->i_ctime = CURRENT_TIME; // ctime - Change time。
-				inode->i_dirt = 1;	       // 设置已修改标志。
-			}
-		return inode->i_zone[block];
-	}
+/// 设置i节点inode的逻辑块映射缓冲。
+// 参数p指向一组逻辑块号（i节点的i_zone[]或间接块中的项），其中第n项对应文件逻辑块fz，
+// 共有count项；v2表示每项占4个字节，否则占2个字节。从第n项开始向后找出设备上连续的
+// 一段逻辑块，记录在i节点中。以后映射这一段中的逻辑块时就不用再读间接块了。顺序写入
+// 的文件在盘上基本是连续的（见new_block()），所以这一段通常很长。
+static void set_map_cache(struct m_inode * inode, void * p, int n, int count,
+	int v2, int fz)
+{
+	unsigned long zone, len;
 
-// （3）如果该块号 >= 7，且小于（7+512），则说明使用的是一次间接块。于是下面对一次间接块
-// 进行处理。如果是创建操作，并且该i节点的间接块字段i_zone[7]是0，表明文件是首次使用
-// 一次间接块，于是需要申请一磁盘块用于存放间接块信息，并将此实际磁盘块号填入一次间接块
-// 字段中。然后设置i节点已修改标志和修改时间。如果创建时申请磁盘块失败，则此时i节点间
-// 接块字段i_zone[7]为0，则返回0。或者不创建，但i_zone[7]原型就为0，表明i节点中没
-// 有间接块，于是映射磁盘块失败，返回0退出。
-	block -= 7;
-	if (block < 512) {
-		if (create && !inode->i_zone[7])
-			if ((inode->i_zone[7] = new_block(inode->i_dev))) {
-				inode->i_dirt = 1;
-				inode->i_ctime = CURRENT_TIME;
-			}
-		if (!inode->i_zone[7])
-			return 0;
-// 现在读取设备上该i节点的一次间接块，并在其上读取第block项中的逻辑块号i（间接块上每
-// 项占2个字节）。如果是创建操作并且所取得的逻辑块号为0的话，则需要申请一磁盘块，并让
-// 间接块中的第block项等于该新逻辑块号。然后置位间接块的已修改标志。如果不是创建操作，
-// 则i就是需要映射（寻找）的逻辑块号。最后释放该间接块占用的缓冲块，并返回磁盘上新申请
-// 或原有的对应block的逻辑块块号。
-		if (!(bh = bread(inode->i_dev, inode->i_zone[7])))
-			return 0;
-		i = ((unsigned short *) (bh->b_data))[block];
-		if (create && !i)
-			if ((i = new_block(inode->i_dev))) {
-				((unsigned short *) (bh->b_data))[block] = i;
-				bh->b_dirt = 1;
-			}
-		brelse(bh);
-		return i;
-	}
+	zone = v2 ? ((unsigned long *) p)[n] : ((unsigned short *) p)[n];
+	for (len = 1; ++n < count; len++)
+		if ((v2 ? ((unsigned long *) p)[n] : ((unsigned short *) p)[n]) !=
+		    zone + len)
+			break;
+	inode->i_map_start = fz;
+	inode->i_map_zone = zone;
+	inode->i_map_len = len;
+}
 
-// （4）若程序运行到此，则表明数据块属于二次间接块。其处理过程与一次间接块类似。
-// 下面是对二次间接块的处理。首先将block再减去间接块所容纳的场数（512），然后根据是否
-// 设置了创建标志进行创建或寻找处理。如果量新创建并且i节点的二次间接块字段为0，则需申
-// 请一磁盘块用于存放二次间接块的一级块信息，并将此实际磁盘块号填入二次间接块字段中。
-// 之后，置i节点已修改标志和修改时间。同样地，如果创建时申请磁盘块失败，则此时i节点二
-// 次间接块字段i_zone[8]为0，则返回0。或者不是创建，但i_zone[8]原来就为0，表明i节点
-// 中没有间接块，于是映射磁盘块失败，返回0退出。
-	block -= 512;
-	if (create && !inode->i_zone[8])
-		if ((inode->i_zone[8] = new_block(inode->i_dev))) {
-			inode->i_dirt = 1;
-			inode->i_ctime = CURRENT_TIME;
-		}
-	if (!inode->i_zone[8])
-		return 0;
-// 现在读取设备上该i节点的二次间接块，并取该块的一级块上第（block / 512）项中的逻辑块
-// 号i。如果是创建操作，并且二次间接块的一级块上第（block/512）项中的逻辑块号为0的话，
-// 则需申请一磁盘块作为二次间接块的二级块i，并让二次间接块的一级块中第（block/512）项
-// 等于该二级块的块号i。然后置位二次间接块的一级块已修改标志，并释放二次间接块的一级块。
-// 如果不是创建操作，则i就是需要映射（寻找）的逻辑块号。
-	if (!(bh = bread(inode->i_dev, inode->i_zone[8])))
-		return 0;
-	i = ((unsigned short *) bh->b_data)[block>>9];
-	if (create && !i)
-		if ((i = new_block(inode->i_dev))) {
-			((unsigned short *) (bh->b_data))[block>>9] = i;
-			bh->b_dirt = 1;
+/// 取i节点inode的第n个逻辑块字段。如果该字段为0并且置位了创建标志，则向设备申请一
+// 个磁盘块，将其块号填入该字段，并设置i节点改变时间和已修改标志。参数nr是要映射的文
+// 件数据块号，用于计算申请盘块的目标块号。返回逻辑块号，0表示没有或申请失败。
+static int inode_zone(struct m_inode * inode, int n, int create, int nr)
+{
+	if (create && !inode->i_zone[n])
+		if ((inode->i_zone[n] = new_block(inode->i_dev, bmap_goal(inode, nr)))) {
+			inode->i_ctime = CURRENT_TIME;	// ctime - Change time。
+			inode->i_dirt = 1;		// 设置已修改标志。
 		}
-	brelse(bh);
-// 如果二次间接块的二级块块号为0，表示申请磁盘块失败或者原来对应块号为0，则返回0
-// 退出。否则就从设备上读取二次间接块的二级块，并取该二级块上第block项中的逻辑块号。
-	if (!i)
-		return 0;
-	if (!(bh = bread(inode->i_dev, i)))
+	return inode->i_zone[n];
+}
+
+// 间接块中的项数：MINIX 1.0为512，MINIX 2.0为256。
+#define IND_COUNT(inode) (((inode)->i_version == 2) ? 256 : 512)
+
+/// 取间接块zone中第n项的逻辑块号。
+// 读取设备上的间接块zone，取其中第n项的逻辑块号。MINIX 1.0间接块上每项占2个字节，
+// MINIX 2.0则占4个字节。如果是创建操作并且所取得的逻辑块号为0，则申请一磁盘块，并让
+// 间接块中的第n项等于该新逻辑块号，然后置位间接块的已修改标志。最后释放该间接块占用的
+// 缓冲块，并返回磁盘上新申请或原有的逻辑块号。zone为0时直接返回0。一个逻辑块含有
+// 多个盘块时，间接块中的项只存放在该逻辑块的第1个盘块中。
+// 参数fz不小于0表示这是最后一级间接块，第n项映射文件逻辑块fz，此时顺便设置i节点的逻辑
+// 块映射缓冲。
+static int block_entry(struct m_inode * inode, int zone, int n, int create, int nr,
+	int fz)
+{
+	struct buffer_head * bh;
+	int i;
+
+	if (!zone || !(bh = bread(inode->i_dev, zone << inode->i_log_zone_size)))
 		return 0;
-	i = ((unsigned short *) bh->b_data)[block&511]; // 项值不超过511（0x1ff）。
-// 如果创建标志是置位的，并且二级块的第block项中逻辑块号为0的话，则申请一磁盘块，作为
-// 最终存放数据信息的块，并让二级块中的第block项等于该逻辑块块号（i）。然后置位二级
-// 块的已修改标志。最后释放该二次间接块二级块，返回磁盘上新申请的或原有的对应block
-// 的逻辑块块号。
+	if (inode->i_version == 2)
+		i = ((unsigned long *) bh->b_data)[n];
+	else
+		i = ((unsigned short *) bh->b_data)[n];
 	if (create && !i)
-		if ((i = new_block(inode->i_dev))) {
-			((unsigned short *) (bh->b_data))[block&511] = i;
+		if ((i = new_block(inode->i_dev, bmap_goal(inode, nr)))) {
+			if (inode->i_version == 2)
+				((unsigned long *) bh->b_data)[n] = i;
+			else
+				((unsigned short *) bh->b_data)[n] = i;
 			bh->b_dirt = 1;
 		}
+	if (i && fz >= 0)
+		set_map_cache(inode, bh->b_data, n, IND_COUNT(inode),
+			inode->i_version == 2, fz);
 	brelse(bh);
 	return i;
 }
 
+/// 文件逻辑块映射到设备逻辑块的处理操作。
+// 参数：inode - 文件的i节点指针；block - 文件中的逻辑块（区段）号；create - 创建块标志；
+// nr - 要映射的文件数据块号，用于计算申请逻辑块的目标块号。
+// 该函数把指定的文件逻辑块block对应到设备上逻辑块上，并返回逻辑块号。如果块创建标志
+// 置位，则在设备上对应逻辑块不存在时就申请新逻辑块。该函数分四个部分进行处理：（1）直接
+// 块处理；（2）一次间接块处理；（3）二次间接块处理；（4）三次间接块处理（仅MINIX 2.0）。
+// 一个间接块中可存放的逻辑块号数是1<<shift：MINIX 1.0为512，MINIX 2.0为256。
+static int bmap_zone(struct m_inode * inode, int block, int create, int nr)
+{
+	int i, fz = block;		// fz是原文件逻辑块号，用于设置映射缓冲。
+	int shift = (inode->i_version == 2) ? 8 : 9;
+
+// （1）如果该块号小于7，则使用直接块表示。函数new_block()定义在bitmap.c中，它会尽量
+// 在文件前一块之后申请盘块。映射成功时用i_zone[]中从该块开始的连续逻辑块设置映射缓冲。
+	if (block < 7) {
+		if ((i = inode_zone(inode, block, create, nr)))
+			set_map_cache(inode, inode->i_zone, block, 7, 1, fz);
+		return i;
+	}
+
+// （2）如果该块号 >= 7，且小于（7 + 1<<shift），则说明使用的是一次间接块i_zone[7]。
+// 如果创建时申请间接块失败，或者不创建但i_zone[7]原来就为0，则映射失败，返回0。
+	block -= 7;
+	if (block < (1 << shift)) {
+		i = inode_zone(inode, 7, create, nr);
+		return block_entry(inode, i, block, create, nr, fz);
+	}
+
+// （3）若程序运行到此，则再减去一次间接块所容纳的块数，看数据块是否属于二次间接块
+// i_zone[8]。先取二次间接块的一级块上第（block>>shift）项中的二级块号，再取二级块
+// 上的第（block & ((1<<shift)-1)）项。
+	block -= 1 << shift;
+	if (block < (1 << 2*shift)) {
+		i = inode_zone(inode, 8, create, nr);
+		i = block_entry(inode, i, block >> shift, create, nr, -1);
+		return block_entry(inode, i, block & ((1 << shift) - 1), create, nr, fz);
+	}
+
+// （4）MINIX 2.0还有三次间接块i_zone[9]，依次取三级间接块中的项。块号超出了文件系统
+// 表示范围，则停机。
+	block -= 1 << 2*shift;
+	if (inode->i_version != 2 || block >= (1 << 3*shift))
+		panic("_bmap: block>big");
+	i = inode_zone(inode, 9, create, nr);
+	i = block_entry(inode, i, block >> 2*shift, create, nr, -1);
+	i = block_entry(inode, i, (block >> shift) & ((1 << shift) - 1), create, nr, -1);
+	return block_entry(inode, i, block & ((1 << shift) - 1), create, nr, fz);
+}
+
+/// 文件数据块映射到盘块的处理操作。（block位图处理函数，bmap - block map）
+// 参数：inode - 文件的i节点指针；block - 文件中的数据块号；create - 创建块标志。
+// 一个逻辑块含有2^i_log_zone_size个数据块（盘块）。该函数先把文件数据块号转换成文件中
+// 的逻辑块号，由bmap_zone()映射到设备上的逻辑块，再把该逻辑块号转换成盘块号，加上数据块
+// 在逻辑块中的偏移，返回数据块对应在设备上的盘块号。映射失败返回0。
+// 若文件逻辑块在i节点的映射缓冲所记录的那段连续逻辑块中，则直接算出设备逻辑块号，不用
+// 再读间接块。缓冲中只记录已经存在的逻辑块，而逻辑块只有在截断文件时才会被释放，因此
+// truncate()会使缓冲无效；申请新逻辑块只是填上原来为0的项，不会影响缓冲。
+static int _bmap(struct m_inode * inode, int block, int create)
+{
+	unsigned long fz;
+	int zone;
+
+	if (block < 0)
+		panic("_bmap: block<0");
+	fz = block >> inode->i_log_zone_size;
+	if (fz - inode->i_map_start < inode->i_map_len)
+		zone = inode->i_map_zone + (fz - inode->i_map_start);
+	else if (!(zone = bmap_zone(inode, fz, create, block)))
+		return 0;
+	return (zone << inode->i_log_zone_size) +
+		(block & ((1 << inode->i_log_zone_size) - 1));
+}
+
 /// 取文件数据块block在设备上对应的逻辑块号。
 // 参数：inode - 文件的内存i节点指针；block - 文件中的数据块号。
 // 若操作成功则返回对应的逻辑块号，否则返回0。
@@ -243,8 +383,8 @@ void iput(struct m_inode * inode)
 // 释放管道占用的内存页面，并复位该节点的引用计数值、已修改标志和管道标志，并返回。
 // 对于管道节点，inode->i_size存放着内存页地址。参见get_pipe_inode()，231，237行。
 	if (inode->i_pipe) {
-		wake_up(&inode->i_wait);
-		wake_up(&inode->i_wait2);
+		wake_up_all(&inode->i_wait);
+		wake_up_all(&inode->i_wait2);
 		if (--inode->i_count)
 			return;
 		free_page(inode->i_size);
@@ -296,46 +436,50 @@ repeat:
 
 /// 从i节点表中获取一个空闲i节点项。
 // 寻找引用计数count为0的i节点，并将其写盘后清零，返回其指针。此时引用计数被置1。
+// 若没有空闲i节点并且无法再分配新的i节点，则返回NULL。
 struct m_inode * get_empty_inode(void)
 {
 	struct m_inode * inode;
-	static struct m_inode * last_inode = inode_table; // 指向i节点表第1项。
+	static struct m_inode * last_inode = NULL;	// 上次扫描到的位置。
 	int i;
 
-// 在初始化last_inode指向i节点表头后循环扫描整个i节点表。如果last_inode已经指向i节
-// 点表的最后1项之后，则让其重新指向i节点表开始处，以继续循环寻找空闲i节点项。如果
-// last_inode所指向的i节点的计数值为0，则说明可能找到空闲i节点项。则让inode指向该
-// i节点。若该i节点的已修改和锁定标志均为0，则我们可以使用该i节点，于是退出循环。
-	do {
-		inode = NULL;
-		for (i = NR_INODE; i ; i--) {
-			if (++last_inode >= inode_table + NR_INODE)
-				last_inode = inode_table;
-			if (!last_inode->i_count) {
-				inode = last_inode;
-				if (!inode->i_dirt && !inode->i_lock)
-					break;
-			}
-		}
-// 如果没有找到空闲i节点（inode = NULL），则将i节点表打印出来供调试使用，并停机。
-		if (!inode) {
-			for (i = 0; i < NR_INODE; i++)
-				printk("%04x: %06d\t", inode_table[i].i_dev,
-				       inode_table[i].i_num);
-			panic("No free inodes in mem");
+// 从last_inode的下一项开始沿i节点链表循环扫描所有的i节点。如果last_inode所指向的
+// i节点的计数值为0，则说明可能找到空闲i节点项。则让inode指向该i节点。若该i节点的已
+// 修改和锁定标志均为0，则我们可以使用该i节点，于是退出循环。
+repeat:
+	inode = NULL;
+	if (!last_inode)
+		last_inode = first_inode;
+	for (i = nr_inodes; i ; i--) {
+		last_inode = last_inode->i_next;
+		if (!last_inode->i_count) {
+			inode = last_inode;
+			if (!inode->i_dirt && !inode->i_lock)
+				break;
 		}
+	}
+// 如果没有找到干净的空闲i节点，则先试着再分配一页新的i节点，而不是去写盘或停机。
+// 如果已经达到最大数或者没有空闲内存，那么若有需要写盘的空闲i节点就使用它，否则
+// 显示出错信息并返回NULL。
+	if ((!inode || inode->i_dirt || inode->i_lock) && grow_inodes())
+		goto repeat;
+	if (!inode) {
+		printk("No free inodes in mem\n\r");
+		return NULL;
+	}
 // 否则等待该i节点解锁（如果又被上锁的话）。如果该i节点已修改桂被置位的话，则将该
 // i节点刷新（同步）。因为刷新时可能会睡眠，因此需要再次循环等待该i节点解锁。
+	wait_on_inode(inode);
+	while (inode->i_dirt) {
+		write_inode(inode);
 		wait_on_inode(inode);
-		while (inode->i_dirt) {
-			write_inode(inode);
-			wait_on_inode(inode);
-		}
-	} while (inode->i_count);
+	}
+	if (inode->i_count)
+		goto repeat;
 // 如果i节点又被其他占用的话（i节点的计数值不为0了），则需要重新寻找空闲i节点。否则
-// 说明已找到符合要求的空闲i节点项。则将该i节点项内容清零，并置引用计数为1，返回该
-// i节点指针。
-	memset(inode, 0, sizeof(*inode));
+// 说明已找到符合要求的空闲i节点项。则将该i节点项内容清零（同时把它从hash链表中取
+// 下），并置引用计数为1，返回该i节点指针。
+	clear_inode(inode);
 	inode->i_count = 1;
 	return inode;
 }
@@ -368,38 +512,31 @@ struct m_inode * get_pipe_inode(void)
 /// 获取一个i节点。
 // 参数：dev - 设备号；nr - i节点号。
 // 从设备上读取指定节点号的i节点结构内容到内存i节点表中，并且返回该i节点指针。
-// 首先在位于高速缓冲区中的i节点表中搜寻，若找到指定节点号的i节点则在经过一些判断
-// 处理后返回该i节点指针。否则从设备dev上读取指定i节点号的i节点信息放入i节点表
-// 中，并返回该i节点指针。
+// 首先在i节点hash表中查找，若找到指定节点号的i节点则在经过一些判断处理后返回该i节
+// 点指针。否则才取一个空闲i节点，从设备dev上读取指定i节点号的i节点信息放入其中，
+// 并返回该i节点指针。
 struct m_inode * iget(int dev, int nr)
 {
 	struct m_inode * inode, * empty;
 
-// 首先判断参数有效性。若设备号是0，则表明内核代码问题，显示出错信息并停机。否则就预
-// 先从i节点表中取一个空闲i节点备用。接着扫描整个i节点表。寻找参数指定节点号nr的
-// i节点。并递增该节点的引用次数。但若当前扫描i节点的设备号不等于指定的设备号或者节
-// 点号不等于指定的节点号，则继续扫描。
+// 首先判断参数有效性。若设备号是0，则表明内核代码问题，显示出错信息并停机。然后在
+// hash表中查找参数指定设备号dev和节点号nr的i节点。原来这里先取一个空闲i节点备用，
+// 再扫描整个i节点表，找到时又把它放回。而取空闲i节点可能需要写盘并睡眠，所以现在
+// 只在没有找到时才去取。
 	if (!dev)
 		panic("iget with dev==0");
-	empty = get_empty_inode();
-	inode = inode_table;			// 指向inode表首。
-	while (inode < NR_INODE + inode_table) {
-		if (inode->i_dev != dev || inode->i_num != nr) {
-			inode++;
-			continue;
-		}
+repeat:
+	if ((inode = find_inode(dev, nr))) {
 // 如果找到指定设备号dev和节点号nr的i节点，则等待该节点解锁（如果已上锁的话）。
-// 在等待该节点解锁过程中，i节点表可能会发生变化。所以继续执行时需再次进行上述相同判
-// 断。如果发生了变化，则再次重新扫描整个i节点表。
+// 在等待该节点解锁过程中，该i节点可能被重新使用。所以继续执行时需再次进行上述相同判
+// 断。如果发生了变化，则重新查找。
 		wait_on_inode(inode);
-		if (inode->i_dev != dev || inode->i_num != nr) {
-			inode = inode_table;
-			continue;
-		}
+		if (inode->i_dev != dev || inode->i_num != nr)
+			goto repeat;
 // 到这里表示已找到相应的i节点。于是将该i节点引用计数增1。然后再作进一步检查，看它是
 // 否是另一个文件系统的安装点。若是，则寻找被安装文件系统根节点。如果该i节点的确是其
 // 他文件系统的安装点，则在超级块表中搜寻安装在此i节点的超级块。如果没有找到超级块，则
-// 显示出错信息，并放回本函数开始时获取的空闲节点empty，返回该i节点指针。
+// 显示出错信息，并返回该i节点指针。
 		inode->i_count++;
 		if (inode->i_mount) {
 			int i;
@@ -409,33 +546,34 @@ struct m_inode * iget(int dev, int nr)
 					break;
 			if (i >= NR_SUPER) {
 				printk("Mounted inode hasn't got sb\n");
-				if (empty)
-					iput(empty);
 				return inode;
 			}
 // 执行到这里表示已经找到安装到inode节点的文件系统超级块。于是将该i节点写盘放回，
 // 并利用超级块信息重新设置这里需要取得的i节点的设备号和i节点号。于是我们从安装在此
 // i节点上的文件系统超级块中取设备号，并指定需要的i节点号为ROOT_INO，即为1。然后重
-// 新扫描整个i节点表，以获取该被安装文件系统的根i节点信息。
+// 新查找该被安装文件系统的根i节点。
 			iput(inode);
 			dev = super_block[i].s_dev;
 			nr = ROOT_INO;
-			inode = inode_table;
-			continue;
+			goto repeat;
 		}
-// 最终我们找到了相应的i节点。因此可以放弃本函数开始处临时申请的空闲i节点，返回
-// 找到的i节点指针。
-		if (empty)
-			iput(empty);
 		return inode;
 	}
-// 如果我们在i节点表中没有找到指定的i节点，则利用前面申请的空闲i节点empty在i节点
-// 表中建立该i节点，并从相应设备上读取该i节点信息，返回该i节点指针。
-	if (!empty)
-		return (NULL);
+// 如果我们在hash表中没有找到指定的i节点，则取一个空闲i节点。由于这期间可能睡眠，其
+// 他进程可能已经读入了该i节点，因此需要再查找一次，若找到了就放回空闲i节点重新来过。
+// 否则利用该空闲i节点建立指定的i节点：设置设备号和i节点号，把它加入hash表，然后从相
+// 应设备上读取该i节点信息，返回该i节点指针。read_inode()会锁定该i节点，这样其他进程
+// 在hash表中找到它时会等待它读入完成。
+	if (!(empty = get_empty_inode()))
+		return NULL;
+	if (find_inode(dev, nr)) {
+		iput(empty);
+		goto repeat;
+	}
 	inode = empty;
 	inode->i_dev = dev;			// 设置i节点的设备。
 	inode->i_num = nr;			// 设置i节点号。
+	insert_inode_hash(inode);
 	read_inode(inode);
 	return inode;
 }
@@ -449,7 +587,7 @@ static void read_inode(struct m_inode * inode)
 {
 	struct super_block * sb;
 	struct buffer_head * bh;
-	int block;
+	int block, i;
 
 // 首先锁定该i节点，并取得该节点所在设备的超级块。	
 	//
@@ -460,19 +598,54 @@ static void read_inode(struct m_inode * inode)
 // 用的块数 + （i节点号-1）/每块含有的i节点数，参见图12-1所示。虽然i节点号从0开始编号，
 // 但第1个0号i节点不用，并且磁盘上也不保存对应的0号i节点结构。因此存放i节点的第1
 // 个磁盘上保存的是i节点号为1--32的i节点结构而不是0--31的。因此在计算i节点号对应的
-// i节点结构所在盘块号时需要减1。这里我们从设备上读取该i节点所在的逻辑块，并复制指定
-// i节点内容到inode所指位置处。
-	block = 2 + sb->s_imap_blocks + sb->s_zmap_blocks +
-		(inode->i_num-1)/INODES_PER_BLOCK;
-	if (!(bh = bread(inode->i_dev, block)))
-		panic("unable to read i-node block");
-	*(struct d_inode *)inode = ((struct d_inode *)bh->b_data)
-					[(inode->i_num-1)%INODES_PER_BLOCK];
+// i节点结构所在盘块号时需要减1。这里我们从设备上读取该i节点所在的逻辑块，并按文件系
+// 统的版本把磁盘上的i节点内容转换到inode所指的内存i节点中。MINIX 1.0的i节点只有一个
+// 时间字段，并且没有三次间接块。
+	inode->i_version = sb->s_version;
+	inode->i_log_zone_size = sb->s_log_zone_size;
+	if (sb->s_version == 2) {
+		struct d2_inode * d;
+
+		block = 2 + sb->s_imap_blocks + sb->s_zmap_blocks +
+			(inode->i_num-1)/V2_INODES_PER_BLOCK;
+		if (!(bh = bread(inode->i_dev, block)))
+			panic("unable to read i-node block");
+		d = (struct d2_inode *) bh->b_data +
+			(inode->i_num-1)%V2_INODES_PER_BLOCK;
+		inode->i_mode = d->i_mode;
+		inode->i_uid = d->i_uid;
+		inode->i_size = d->i_size;
+		inode->i_mtime = d->i_mtime;
+		inode->i_atime = d->i_atime;
+		inode->i_ctime = d->i_ctime;
+		inode->i_gid = d->i_gid;
+		inode->i_nlinks = d->i_nlinks;
+		for (i = 0; i < 10; i++)
+			inode->i_zone[i] = d->i_zone[i];
+	} else {
+		struct d_inode * d;
+
+		block = 2 + sb->s_imap_blocks + sb->s_zmap_blocks +
+			(inode->i_num-1)/INODES_PER_BLOCK;
+		if (!(bh = bread(inode->i_dev, block)))
+			panic("unable to read i-node block");
+		d = (struct d_inode *) bh->b_data +
+			(inode->i_num-1)%INODES_PER_BLOCK;
+		inode->i_mode = d->i_mode;
+		inode->i_uid = d->i_uid;
+		inode->i_size = d->i_size;
+		inode->i_mtime = inode->i_atime = inode->i_ctime = d->i_time;
+		inode->i_gid = d->i_gid;
+		inode->i_nlinks = d->i_nlinks;
+		for (i = 0; i < 9; i++)
+			inode->i_zone[i] = d->i_zone[i];
+		inode->i_zone[9] = 0;
+	}
 // 最后释放读入的缓冲块，并解锁该i节点。对于块设备文件，还需要设置i节点的文件最大
 // 长度值。
 	brelse(bh);
 	if (S_ISBLK(inode->i_mode)) {
-		int i = inode->i_zone[0];	// 对于块设备文件，i_zone[0]中是设备号。
+		i = inode->i_zone[0];		// 对于块设备文件，i_zone[0]中是设备号。
 		if (blk_size[MAJOR(i)])
 			inode->i_size = 1024 * blk_size[MAJOR(i)][MINOR(i)];
 		else
@@ -490,7 +663,7 @@ static void write_inode(struct m_inode * inode)
 {
 	struct super_block * sb;
 	struct buffer_head * bh;
-	int block;
+	int block, i;
 
 // 首先锁定该i节点，如果该i节点没有被修改过或者该i节点的设备号等于零，则解锁该
 // i节点，并退出。对于没有被修改过的i节点，其内容与缓冲区中或设备中的相同。然后
@@ -504,14 +677,44 @@ static void write_inode(struct m_inode * inode)
 		panic("trying to write inode without device");
 // 该i节点所在的设备逻辑块号 = （启动块 + 超级块）+ i节点位图占用的块数 + 逻辑块位
 // 图占用的块数 + （i节点号-1）/每块含有的i节点数。我们从设备上读取该i节点所在的
-// 逻辑块，并将该i节点信息复制到逻辑块对应该i节点的项位置处。
-	block = 2 + sb->s_imap_blocks + sb->s_zmap_blocks +
-		(inode->i_num-1)/INODES_PER_BLOCK;
-	if (!(bh = bread(inode->i_dev, block)))
-		panic("unable to read i-node block");
-	((struct d_inode *)bh->b_data)
-		[(inode->i_num-1)%INODES_PER_BLOCK] =
-			*(struct d_inode *)inode;
+// 逻辑块，并按文件系统的版本把该i节点信息转换到逻辑块对应该i节点的项位置处。
+	if (sb->s_version == 2) {
+		struct d2_inode * d;
+
+		block = 2 + sb->s_imap_blocks + sb->s_zmap_blocks +
+			(inode->i_num-1)/V2_INODES_PER_BLOCK;
+		if (!(bh = bread(inode->i_dev, block)))
+			panic("unable to read i-node block");
+		d = (struct d2_inode *) bh->b_data +
+			(inode->i_num-1)%V2_INODES_PER_BLOCK;
+		d->i_mode = inode->i_mode;
+		d->i_nlinks = inode->i_nlinks;
+		d->i_uid = inode->i_uid;
+		d->i_gid = inode->i_gid;
+		d->i_size = inode->i_size;
+		d->i_atime = inode->i_atime;
+		d->i_mtime = inode->i_mtime;
+		d->i_ctime = inode->i_ctime;
+		for (i = 0; i < 10; i++)
+			d->i_zone[i] = inode->i_zone[i];
+	} else {
+		struct d_inode * d;
+
+		block = 2 + sb->s_imap_blocks + sb->s_zmap_blocks +
+			(inode->i_num-1)/INODES_PER_BLOCK;
+		if (!(bh = bread(inode->i_dev, block)))
+			panic("unable to read i-node block");
+		d = (struct d_inode *) bh->b_data +
+			(inode->i_num-1)%INODES_PER_BLOCK;
+		d->i_mode = inode->i_mode;
+		d->i_uid = inode->i_uid;
+		d->i_size = inode->i_size;
+		d->i_time = inode->i_mtime;
+		d->i_gid = inode->i_gid;
+		d->i_nlinks = inode->i_nlinks;
+		for (i = 0; i < 9; i++)
+			d->i_zone[i] = inode->i_zone[i];
+	}
 // 然后置缓冲区已修改标志，而i节点内容已经与缓冲区中的一致，因此修改标志置零。然后
 // 释放该含有i节点的缓冲区，并解锁该i节点。
 	bh->b_dirt = 1;
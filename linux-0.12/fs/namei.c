@@ -218,7 +218,7 @@ static struct buffer_head * find_entry(struct m_inode ** dir,
 // 即取出目录i节点对应块设备数据区中的数据块（逻辑块）信息。这些逻辑块的块号被保存在
 // i俺不会空结构的i_zone[]数组中。我们先取其中保存的第1个直接块号，然后就从节点所在设备
 // 读取指定的目录项数据块。
-	if (!(block = (*dir)->i_zone[0]))
+	if (!(block = bmap(*dir, 0)))
 		return NULL;
 	if (!(bh = bread((*dir)->i_dev, block)))
 		return NULL;
@@ -259,6 +259,33 @@ static struct buffer_head * find_entry(struct m_inode ** dir,
 	return NULL;
 }
 
+/// 在目录*dir中查找名字name对应的i节点号。
+// 先查找目录项缓冲（fs/dcache.c），没有命中时才用find_entry()搜索目录，并把搜索结果（包
+// 括没有找到的情况）加入目录项缓冲。与find_entry()一样，对于名字‘..’，*dir可能会被换成
+// 安装点的i节点。
+// 返回：名字对应的i节点号，没有找到则返回0。
+static int lookup_entry(struct m_inode ** dir, const char * name, int namelen)
+{
+	struct buffer_head * bh;
+	struct dir_entry * de;
+	unsigned long seq;
+	int inr;
+
+#ifdef NO_TRUNCATE
+	if (namelen > NAME_LEN)
+		return 0;
+#endif
+	if ((inr = dcache_lookup(*dir, name, namelen, &seq)) >= 0)
+		return inr;
+	inr = 0;
+	if ((bh = find_entry(dir, name, namelen, &de))) {
+		inr = de->inode;
+		brelse(bh);
+	}
+	dcache_add(*dir, name, namelen, inr, seq);
+	return inr;
+}
+
 /*
  *	add_entry()
  *
@@ -303,7 +330,7 @@ static struct buffer_head * add_entry(struct m_inode * dir,
 // 点所在设备读取指定的目录项数据块。另外，如果文件名长度等于0，则也返回NULL退出。
 	if (namelen)
 		return NULL;
-	if (!(block = dir->i_zone[0]))
+	if (!(block = bmap(dir, 0)))
 		return NULL;
 	if (!(bh = bread(dir->i_dev, block)))
 		return NULL;
@@ -348,11 +375,14 @@ static struct buffer_head * add_entry(struct m_inode * dir,
 // 新目录项。于是更新目录的修改时间为当前时间，并从用户数据区复制文件名到该目录项的
 // 文件名字段，置含有本目录项的相应高速缓冲块已修改标志。返回该目录项的指针以及该高
 // 速缓冲块的指针，退出。
+// 目录项缓冲中该名字的项（可能是“没有该名字”）也必须置为无效。这要在最后做，因为从
+// 这里到调用者填入i节点号之间不会睡眠，其他进程不会在此期间又把旧的结果放入缓冲。
 		if (!de->inode) {
 			dir->i_mtime = CURRENT_TIME;
 			for (i = 0; i < NAME_LEN; i++)
 				de->name[i] = (i < namelen) ? get_fs_byte(name+i):0;
 			bh->b_dirt = 1;
+			dcache_invalidate(dir, name, namelen);
 			*res_dir = de;
 			return bh;
 		}
@@ -395,7 +425,7 @@ static struct m_inode * follow_link(struct m_inode * dir, struct m_inode * inode
 // 块数据区中。实际上，这个缓冲块数据区中仅包含一个链接指向的文件路径名字符串。
 	__asm__("mov %%fs,%0":"=r" (fs));
 	if (fs != 0x17 || !inode->i_zone[0] ||
-	    !(bh = bread(inode->i_dev, inode->i_zone[0]))) {
+	    !(bh = bread(inode->i_dev, bmap(inode, 0)))) {
 		iput(dir);
 		iput(inode);
 		return NULL;
@@ -428,9 +458,7 @@ static struct m_inode * get_dir(const char * pathname, struct m_inode * inode)
 {
 	char c;
 	const char * thisname;
-	struct buffer_head * bh;
 	int namelen, inr;
-	struct dir_entry * de;
 	struct m_inode * dir;
 
 // 首先判断参数有效性。如果给出的目录的i节点指针inode为空，则使用当前进程的当前工作
@@ -472,18 +500,15 @@ static struct m_inode * get_dir(const char * pathname, struct m_inode * inode)
 			/* nothing */;
 		if (!c)
 			return inode;
-// 在得到当前目录名部分（或文件名）后，我们调用查找目录项函数find_entry()在当前处
-// 理的目录中寻找指定名称的目录项。如果没有找到，则放回该i节点，并返回NULL退出。
-// 然后在找到的目录项中取出其i节点号inr和设备号idev，释放包含该目录项的高速缓冲
-// 块并放回该i节点。然后取节点号inr的i节点inode，并以该目录项为当前目录继续循
-// 环处理路径名中的下一目录名部分（或文件名）。如果当前处理的目录项是一个符号链接
-// 名，则使用follow_link()就可以得到其指向的目录项名的i节点。
-		if (!(bh = find_entry(&inode, thisname, namelen, &de))) {
+// 在得到当前目录名部分（或文件名）后，我们调用lookup_entry()在当前处理的目录中
+// 寻找指定名称对应的i节点号inr（先查目录项缓冲，没有命中才搜索目录）。如果没有找到，
+// 则放回该i节点，并返回NULL退出。然后取节点号inr的i节点inode，并以该目录项为当前
+// 目录继续循环处理路径名中的下一目录名部分（或文件名）。如果当前处理的目录项是一个
+// 符号链接名，则使用follow_link()就可以得到其指向的目录项名的i节点。
+		if (!(inr = lookup_entry(&inode, thisname, namelen))) {
 			iput(inode);
 			return NULL;
 		}
-		inr = de->inode;		// 当前目录名部分的i节点号。
-		brelse(bh);
 		dir = inode;
 		if (!(inode = iget(dir->i_dev, inr))) { // 取i节点内容。
 			iput(dir);
@@ -539,8 +564,6 @@ struct m_inode * _namei(const char * pathname, struct m_inode *base,
 	const char * basename;
 	int inr, namelen;
 	struct m_inode * inode;
-	struct buffer_head * bh;
-	struct dir_entry * de;
 
 // 首先查找指定路径名中最顶层目录的目录名并得到其i节点。若不存在，则返回NULL退出。
 // 如果返回的最顶层名字的长度是0，则表示该路径名以一个目录名为最后一项。因此说明我
@@ -555,18 +578,15 @@ struct m_inode * _namei(const char * pathname, struct m_inode *base,
 // 然后在返回的顶层目录中寻找指定文件名目录项的i节点。注意！因为如果最后也是一个目
 // 录名，但其后没有加‘/’，则不会返回该最后目录的i节点！例如：/usr/src/linux，将只
 // 返回src/目录名的i节点。因为函dir_namei()将不以‘/’结束的最后一个名字当作一个
-// 文件名来看待，所以这里需要使用寻找目录项i节点函数find_entry()来单独处理这种情况。
-// 此时de中含有寻找到的目录项指针，而dir是包含该目录项的目录的i节点指针。
-	bh = find_entry(&base, basename, namelen, &de);
-	if (!bh) {
+// 文件名来看待，所以这里需要使用lookup_entry()来单独处理这种情况，得到目录项的i节点
+// 号inr。此时base是包含该目录项的目录的i节点指针。
+	if (!(inr = lookup_entry(&base, basename, namelen))) {
 		iput(base);
 		return NULL;
 	}
-// 接着取该目录项的i节点号，并释放包吃住该目录项的高速缓冲块并放回目录i节点。然后取对应
-// 节点号的i节点，修改其被访问时间为当前时间，并置已修改标志。最后返回该i节点指针inode。
-// 另外，如果处理的目录项是一符号链接名，则使用follow_link()得到其指向的目录项的i节点。
-	inr = de->inode;
-	brelse(bh);
+// 接着取对应节点号的i节点，修改其被访问时间为当前时间，并置已修改标志。最后返回该i节点
+// 指针inode。另外，如果处理的目录项是一符号链接名，则使用follow_link()得到其指向的目录
+// 项的i节点。
 	if (!(inode = iget(base->i_dev, inr))) {
 		iput(base);
 		return NULL;
@@ -653,13 +673,11 @@ int open_namei(const char * pathname, int flag, int mode,
 		iput(dir);
 		return -EISDIR;
 	}
-// 接着根据上面得到的最顶层目录名的不节点dir，在其中查找取得路径名字符串中最后的文
-// 件名对应的目录贡结构de，并同时得到该目录项所在高速缓冲区指针。如果该高速缓冲
-// 指针为NULL，则表示没有找到叉文件名的目录项，因此只可能是创建文件操作。此时如
-// 果不是创建文件操作，或者用户在该目录没有写的权力，则放回该目录的i节点，返回相应
-// 出错号后退出。
-	bh = find_entry(&dir, basename, namelen, &de);
-	if (!bh) {
+// 接着根据上面得到的最顶层目录名的不节点dir，用lookup_entry()在其中查找取得路径名
+// 字符串中最后的文件名对应的i节点号inr（先查目录项缓冲）。如果inr为0，则表示没有
+// 找到叉文件名的目录项，因此只可能是创建文件操作。此时如果不是创建文件操作，或者用
+// 户在该目录没有写的权力，则放回该目录的i节点，返回相应出错号后退出。
+	if (!(inr = lookup_entry(&dir, basename, namelen))) {
 		if (!(flag & O_CREAT)) {
 			iput(dir);
 			return -ENOENT;
@@ -699,13 +717,10 @@ int open_namei(const char * pathname, int flag, int mode,
 		*res_inode = inode;
 		return 0;
 	}
-// 若上面（411行）在目录中取文件名对应目录项结构的操作成功（即bh不为NULL），则说
-// 明指定打开的文件已经存在。于是取出该目录项的i节点号和其所在设备号，并释放该高速
-// 缓冲块以及放回目录的i节点。如果此时独占操作标志O_EXCL置位，但现在文件已经存在，
-// 则返回文件已存在出错码退出。
-	inr = de->inode;
+// 若上面（411行）在目录中查找文件名的操作成功（即inr不为0），则说明指定打开的文件
+// 已经存在。于是取出其所在设备号。如果此时独占操作标志O_EXCL置位，但现在文件已经
+// 存在，则放回目录的i节点，返回文件已存在出错码退出。
 	dev = dir->i_dev;
-	brelse(bh);
 	if (flag & O_EXCL) {
 		iput(dir);
 		return -EEXIST;
@@ -848,7 +863,7 @@ int sys_mkdir(const char * pathname, int mode)
 // 接着为新i节点申请一用于保存目录项数据的磁盘块，并令i节点的第一个直接块指针等于该
 // 块号。如果申请失败则放回对应目录的i节点；复位新申请的i节点链接计数；放回该新的i节
 // 点，返回没有空间出错码退出。否则置该新的i节点已修改标志。
-	if (!(inode->i_zone[0] = new_block(inode->i_dev))) {
+	if (!(inode->i_zone[0] = new_block(inode->i_dev, 0))) {
 		iput(dir);
 		inode->i_nlinks--;		// i节点关联的目录（文件）项数。
 		iput(inode);
@@ -858,7 +873,7 @@ int sys_mkdir(const char * pathname, int mode)
 // 从设备上读取新申请的磁盘块（目的下把对应块读到高速缓冲区中）。若出错，则放回对应目录
 // 的i节点；释放申请的磁盘块；复位新申请的i节距链接计数；放回该新的i节点，返回没有空
 // 间出错码退出。
-	if (!(dir_block = bread(inode->i_dev, inode->i_zone[0]))) {
+	if (!(dir_block = bread(inode->i_dev, bmap(inode, 0)))) {
 		iput(dir);
 		inode->i_nlinks--;
 		iput(inode);
@@ -923,7 +938,7 @@ static int empty_dir(struct m_inode * inode)
 // 块没有指向任何磁盘块号，或者该直接块读不出，则是类不警告信息后返回0（失败）。
 	len = inode->i_size / sizeof(struct dir_entry); // 目录中目录项个数。
 	if (len < 2 || !inode->i_zone[0] ||
-	    !(bh = bread(inode->i_dev, inode->i_zone[0]))) {
+	    !(bh = bread(inode->i_dev, bmap(inode, 0)))) {
 		printk("warning - bad directory on dev %04x\n", inode->i_dev);
 		return 0;
 	}
@@ -1070,6 +1085,8 @@ int sys_rmdir(const char * name)
 	if (inode->i_nlinks != 2)
 		printk("empty directory has nlink!=2 (%d)", inode->i_nlinks);
 	de->inode = 0;
+	dcache_invalidate(dir, basename, namelen);
+	dcache_invalidate_dir(inode);		// 该i节点号以后可能属于另一个目录。
 	bh->b_dirt = 1;
 	brelse(bh);
 	inode->i_nlinks = 0;
@@ -1158,8 +1175,10 @@ int sys_unlink(const char * name)
 		inode->i_nlinks = 1;
 	}
 // 现在我们可以删除文件名对应的目录项了。于是将文件名目录项的i节点号字段置为0，
-// 表示释放该目录项，并设置包含该目录项的缓冲块已修改标志，释放该高速缓冲块。
+// 表示释放该目录项，并设置包含该目录项的缓冲块已修改标志，释放该高速缓冲块。同时
+// 使目录项缓冲中该名字的项无效。
 	de->inode = 0;
+	dcache_invalidate(dir, basename, namelen);
 	bh->b_dirt = 1;
 	brelse(bh);
 // 然后把文件名对应i节点的链接数减1，置已修改标志，更新改变时间为当前时间。最后放回该
@@ -1213,7 +1232,7 @@ int sys_symlink(const char * oldname, const char * newname)
 // 为了保存符号链接路径名字符串信息，我们需要为该i节点申请一个磁盘块，并让i节距的第1
 // 个直接块号i_zone[0]等于得到的逻辑块号，然后置i节点已修改标志。如果申请失败则放回对
 // 就目录的i节点；复位新申请的i节距链接计数；放回该新的i节点，返回没有空间出错码退出。
-	if (!(inode->i_zone[0] = new_block(inode->i_dev))) {
+	if (!(inode->i_zone[0] = new_block(inode->i_dev, 0))) {
 		iput(dir);
 		inode->i_nlinks--;
 		iput(inode);
@@ -1222,7 +1241,7 @@ int sys_symlink(const char * oldname, const char * newname)
 	inode->i_dirt = 1;
 // 然后从设备上读取新申请的磁盘块（目的是把对应块放到高速缓冲区中）。若出错，则放回对应
 // 目录的i节点；复位新申请的i节点链接计数；放回该新i节点，返回没有空间出错码退出。
-	if (!(name_block = bread(inode->i_dev, inode->i_zone[0]))) {
+	if (!(name_block = bread(inode->i_dev, bmap(inode, 0)))) {
 		iput(dir);
 		inode->i_nlinks--;
 		iput(inode);
@@ -24,9 +24,25 @@
 // 系统返回的文件系统信息。该系统调用用于返回已安装（mounted）文件系统的统计信息。
 // 成功时返回0，并且ubuf指向的ustat结构被清稿文件系统总空闲块数和空闲i节点数。
 // ustat结构定义在include/sys/types.h中。
+// 空闲数直接取自超级块中维护的计数（见fs/bitmap.c），不用扫描位图。空闲块数以盘块
+// 为单位，即空闲逻辑块数乘以每逻辑块的盘块数。文件系统名称和压
+// 缩名称字段没有使用，填为空串。
 int sys_ustat(int dev, struct ustat * ubuf)
 {
-	return -ENOSYS; 			// 出错码：功能还未实现。
+	struct super_block * sb;
+	int i;
+
+	if (!(sb = get_super(dev)))
+		return -EINVAL;
+	verify_area(ubuf, sizeof(struct ustat));
+	put_fs_long(sb->s_free_zones << sb->s_log_zone_size,
+		(unsigned long *) &ubuf->f_tfree);
+	put_fs_word(sb->s_free_inodes, (short *) &ubuf->f_tinode);
+	for (i = 0; i < 6; i++) {
+		put_fs_byte(0, ubuf->f_fname + i);
+		put_fs_byte(0, ubuf->f_fpack + i);
+	}
+	return 0;
 }
 
 /// 设置文件访问和修改时间。
@@ -29,14 +29,16 @@ int read_pipe(struct m_inode * inode, char * buf, int count)
 // 阻塞信号，则立刻返回已读取字节数退出；若还没有收到任何数据，则返回重新启动系统
 // 调用号退出。否则就让进程在该管道上睡眠，用以下等待信息的到来。宏PIPI_SIZE定义在
 // include/linux/fs.h中。关于“重新启动系统调用”，请参见kernel/signal.c程序。
+// 读写管道的进程都以互斥方式睡眠，每次只唤醒一个。被唤醒的进程结束读写时若管道中还
+// 有数据（或空间），就再唤醒下一个等待的读（写）进程。
 	while (count > 0) {
 		while (!(size = PIPE_SIZE(*inode))) { // 取管道中数据长度值。
-			wake_up(& PIPE_WRITE_WAIT(*inode));
+			wake_up_one(& PIPE_WRITE_WAIT(*inode));
 			if (inode->i_count != 2) /* are there any writers? */
 				return read;
 			if (current->signal & ~current->blocked)
 				return read ? read : -ERESTARTSYS;
-			interruptible_sleep_on(& PIPE_READ_WAIT(*inode));
+			interruptible_sleep_on_exclusive(& PIPE_READ_WAIT(*inode));
 		}
 // 此时说明管道（缓冲区）中有数据。于是我们取管道尾指针到缓冲区末端字节数chars。
 // 如果其大于还需要读取的字节数count，则令其等于count。如果chars大于当前管道中含
@@ -55,11 +57,14 @@ int read_pipe(struct m_inode * inode, char * buf, int count)
 		size = PIPE_TAIL(*inode);
 		PIPE_TAIL(*inode) += chars;
 		PIPE_TAIL(*inode) &= (PAGE_SIZE-1);
-		while (chars-- > 0)
-			put_fs_byte(((char *)inode->i_size)[size++], buf++);
+		memcpy_tofs(buf, (char *)inode->i_size + size, chars);
+		buf += chars;
 	}
-// 当此次读管道操作结束，则唤醒等待该管道的进程，并返回读取的字节数。
-	wake_up(& PIPE_WRITE_WAIT(*inode));
+// 当此次读管道操作结束，则唤醒等待该管道的写进程。若管道中还有数据，则再唤醒下一
+// 个读进程。最后返回读取的字节数。
+	wake_up_one(& PIPE_WRITE_WAIT(*inode));
+	if (PIPE_SIZE(*inode))
+		wake_up_one(& PIPE_READ_WAIT(*inode));
 	return read;
 }
 
@@ -77,12 +82,12 @@ int write_pipe(struct m_inode * inode, char * buf, int count)
 // PIPE_HEAD()定义在文件include/linux/fs.h中。
 	while (count > 0) {
 		while (!(size = (PAGE_SIZE-1) - PIPE_SIZE(*inode))) {
-			wake_up(& PIPE_READ_WAIT(*inode));
+			wake_up_one(& PIPE_READ_WAIT(*inode));
 			if (inode->i_count != 2) { /* no readers */
 				current->signal |= (1<<(SIGPIPE-1));
 				return written ? written : -1;
 			}
-			sleep_on(& PIPE_WRITE_WAIT(*inode));
+			sleep_on_exclusive(& PIPE_WRITE_WAIT(*inode));
 		}
 // 程序执行到这里表示管道缓冲区中有可写空间size。于是我们取管道头指针到缓冲区末端空
 // 间字节数chars。写管道操作是从管道头指针处开始写的。如果chars大于还需要写入的字节
@@ -102,11 +107,14 @@ int write_pipe(struct m_inode * inode, char * buf, int count)
 		size = PIPE_HEAD(*inode);
 		PIPE_HEAD(*inode) += chars;
 		PIPE_HEAD(*inode) &= (PAGE_SIZE-1);
-		while (chars-- > 0)
-			((char *)inode->i_size)[size++] = get_fs_byte(buf++);
+		memcpy_fromfs((char *)inode->i_size + size, buf, chars);
+		buf += chars;
 	}
-// 当此次写管道操作结束，则唤醒等待管道的进程，返回已写入的字节数，退出。
-	wake_up(& PIPE_READ_WAIT(*inode));
+// 当此次写管道操作结束，则唤醒等待管道的读进程。若管道中还有空间，则再唤醒下一个写
+// 进程。最后返回已写入的字节数，退出。
+	wake_up_one(& PIPE_READ_WAIT(*inode));
+	if ((PAGE_SIZE-1) - PIPE_SIZE(*inode))
+		wake_up_one(& PIPE_WRITE_WAIT(*inode));
 	return written;
 }
 
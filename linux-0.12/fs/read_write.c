@@ -8,6 +8,7 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <sys/types.h>
+#include <fcntl.h>
 
 #include <linux/kernel.h>
 #include <linux/sched.h>
@@ -117,21 +118,14 @@ int sys_read(unsigned int fd, char * buf, int count)
 	return -EINVAL;
 }
 
-/// 写文件系统调用。
-// 参数fd是文件句柄，buf是用户缓冲区，count是欲写字节数。
-int sys_write(unsigned int fd, char * buf, int count)
+/// 写文件函数。
+// 根据文件file的i节点属性调用相应的写操作函数，把buf中的count个字节写入文件。buf位于
+// fs段寄存器所指的段中。由sys_write()和sys_sendfile()调用。
+static int do_write(struct file * file, char * buf, int count)
 {
-	struct file * file;
 	struct m_inode * inode;
 
-// 同样地，我们首先判断函数参数的有效性。若进程文件句柄值大于程序最多打开文件数NR_OPEN，
-// 或者需要写入的字节计数小于0，或者该句柄的文件结构指针为空，则返回出错码并退出。如果
-// 需读取的字节数count等于0，则返回0退出。
-	if (fd >= NR_OPEN || count < 0 || !(file = current->filp[fd]))
-		return -EINVAL;
-	if (!count)
-		return 0;
-// 然后取文件的i节点，并根据该i节点的属性盆架调用相应的写操作函数。若是管道文件，并且
+// 取文件的i节点，并根据该i节点的属性盆架调用相应的写操作函数。若是管道文件，并且
 // 是写管道文件模式，则进行写管道操作，若成功则返回写入的字节数，否则返回出错码退出；如
 // 果是字符设备文件，则进行写字符设备操作，返回写入的字符数退出；如果是块设备文件，则进
 // 行块设备写操作，并返回写入的字节数退出；若是常规文件，则执行文件写操作，并返回写入的
@@ -150,3 +144,79 @@ int sys_write(unsigned int fd, char * buf, int count)
 	return -EINVAL;
 }
 
+/// 写文件系统调用。
+// 参数fd是文件句柄，buf是用户缓冲区，count是欲写字节数。
+int sys_write(unsigned int fd, char * buf, int count)
+{
+	struct file * file;
+
+// 同样地，我们首先判断函数参数的有效性。若进程文件句柄值大于程序最多打开文件数NR_OPEN，
+// 或者需要写入的字节计数小于0，或者该句柄的文件结构指针为空，则返回出错码并退出。如果
+// 需读取的字节数count等于0，则返回0退出。否则调用do_write()写文件。
+	if (fd >= NR_OPEN || count < 0 || !(file = current->filp[fd]))
+		return -EINVAL;
+	if (!count)
+		return 0;
+	return do_write(file, buf, count);
+}
+
+/// 在文件之间直接复制数据的系统调用。
+// 把文件句柄in_fd对应的普通文件从当前读写位置开始的count个字节写到文件句柄out_fd中（普
+// 通文件、管道、字符设备或块设备），并前移in_fd的读写指针。数据不经过用户空间：输入文
+// 件的数据块读入高速缓冲后，把fs段寄存器临时设置为内核数据段，直接把缓冲块中的数据交
+// 给输出文件的写操作函数。这样每块数据只被复制一次，而不是先复制到用户空间再复制回来。
+// 返回实际复制的字节数。
+int sys_sendfile(unsigned int out_fd, unsigned int in_fd, int count)
+{
+	static char zero_block[BLOCK_SIZE];	// 文件中不存在的数据块（空洞）读出为0。
+	struct file * in, * out;
+	struct m_inode * inode;
+	struct buffer_head * bh;
+	unsigned long old_fs;
+	int nr, chars, written = 0, ret = 0;
+
+// 首先检查参数的有效性。输入文件必须是以读方式打开的普通文件，复制的字节数不超过文件
+// 中剩余的字节数。
+	if (in_fd >= NR_OPEN || out_fd >= NR_OPEN || count < 0 ||
+	    !(in = current->filp[in_fd]) || !(out = current->filp[out_fd]))
+		return -EINVAL;
+	inode = in->f_inode;
+	if (!S_ISREG(inode->i_mode) || (in->f_flags & O_ACCMODE) == O_WRONLY)
+		return -EINVAL;
+	if (count + in->f_pos > inode->i_size)
+		count = inode->i_size - in->f_pos;
+// 然后像file_read()一样逐块读入输入文件的数据块（同一逻辑块中的下一块用breada()预读），
+// 并把块中从读写位置开始的数据写到输出文件中。若写入的字节数比要求的少（例如管道的读
+// 端已关闭）或者出错，则停止复制。
+	old_fs = get_fs();
+	while (count > 0) {
+		if ((nr = bmap(inode, in->f_pos / BLOCK_SIZE))) {
+			if (count > BLOCK_SIZE &&
+			    ((nr + 1) & ((1 << inode->i_log_zone_size) - 1)))
+				bh = breada(inode->i_dev, nr, nr + 1, -1);
+			else
+				bh = bread(inode->i_dev, nr);
+			if (!bh) {
+				ret = -EIO;
+				break;
+			}
+		} else
+			bh = NULL;
+		nr = in->f_pos % BLOCK_SIZE;
+		chars = (BLOCK_SIZE - nr < count) ? BLOCK_SIZE - nr : count;
+		set_fs(get_ds());
+		ret = do_write(out, bh ? nr + bh->b_data : zero_block, chars);
+		set_fs(old_fs);
+		brelse(bh);
+		if (ret <= 0)
+			break;
+		in->f_pos += ret;
+		written += ret;
+		count -= ret;
+		if (ret < chars)
+			break;
+	}
+	inode->i_atime = CURRENT_TIME;
+	return written ? written : ret;
+}
+
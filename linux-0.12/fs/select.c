@@ -48,9 +48,11 @@
  * 过程中我们不得不禁止中断。但是这样做并不会带来太多的损失；因为当我们不在执行
  * 本任务时睡眠状态会自动地释放中断（即其他任务会使用自己EFLAGS中的中断标志）。
  */
+// 等待表项。每一项含有一个挂在描述符相关等待队列上的等待项wait，以及该等待队列头
+// 指针的地址wait_address。
 typedef struct {
-	struct task_struct * old_task;
-	struct task_struct ** wait_address;
+	struct wait_queue wait;
+	struct wait_queue ** wait_address;
 } wait_entry;
 
 typedef struct {
@@ -59,61 +61,40 @@ typedef struct {
 } select_table;
 
 /// 等待队列添加入等待表。
-// 把未准备好描述符的等待队列指针加入等待表wait_table(应该是select_table?)中。参数*wait_address是与描述
-// 符相关的等待队列头指针。例如tty读缓冲队列secondary的等待队列头指针量proc_list。
-// 参数p是do_select()中定义的等待表结构指针。
-static void add_wait(struct task_struct ** wait_address, select_table * p)
+// 把未准备好描述符的等待队列加入等待表wait_table(应该是select_table?)中，并把当前任务
+// 挂到该等待队列上。参数*wait_address是与描述符相关的等待队列头指针。例如tty读缓冲
+// 队列secondary的等待队列头指针量proc_list。参数p是do_select()中定义的等待表结构指针。
+static void add_wait(struct wait_queue ** wait_address, select_table * p)
 {
 	int i;
 
-// 首先检查描述符是否有对应的等待队列，若无则返回。然后在等待表中搜索参数指定的等待队列
-// 指针是否已经在等待表中设置过，若设置过也立刻返回。这个检查主要是针对管道文件描述符。
-// 例如若一个管道在等待可以进行读操作，那么其必定三中心立刻进行写操作。
+// 首先检查描述符是否有对应的等待队列，若无则返回。然后在等待表中搜索参数指定的等待
+// 队列指针是否已经在等待表中设置过，若设置过也立刻返回。这个检查主要是针对管道文件
+// 描述符。例如若一个管道在等待可以进行读操作，那么其必定可以立刻进行写操作。
 	if (!wait_address)
 		return;
 	for (i = 0; i < p->nr; i++)
 		if (p->entry[i].wait_address == wait_address)
 			return;
-// 然后我们把描述符对应的等待队列的头指针保存在等待表wait_table中，同时让等待表项的
-// old_task字段指向等待队列头指针所指向的任务（若无则为NULL），再让等待队列头指针指
-// 向当前任务。最后把等待表有效项计数值nr增1（其在第179行被初始化为0）。
+// 然后把描述符对应的等待队列头指针的地址保存在等待表wait_table中，并把表项中的等待
+// 项以非互斥方式挂到该等待队列上，这样该队列上的任何唤醒操作都会唤醒本任务。最后把
+// 等待表有效项计数值nr增1（其在do_select()中被初始化为0）。
 	p->entry[p->nr].wait_address = wait_address;
-	p->entry[p->nr].old_task = *wait_address;
-	*wait_address = current;
+	p->entry[p->nr].wait.task = current;
+	add_wait_queue(wait_address, &p->entry[p->nr].wait);
 	p->nr++;
 }
 
-/// 唤醒所有等待项上的进程，清空等待表。
-// 参数是等待表结构指针。当前进程在do_select()函数中被唤醒时会调用本函数（第204、
-// 207行），用于唤醒等待表中处于各个等待队列上的其他任务。它与kernel/sched.c中
-// sleep_on()函数的后半部分代码几乎完全相同，可参考对sleep_on()函数的说明内容。
+/// 清空等待表。
+// 参数是等待表结构指针。把等待表中各项的等待项从各自的等待队列上取下，然后把等待表
+// 的有效表项计数值nr置零。等待项可以单独从队列中取下，因此不再需要像原来那样先唤醒
+// 在我们之后进入队列的任务。
 static void free_wait(select_table * p)
 {
 	int i;
-	struct task_struct ** tpp;
 
-// 如果等待表中各项（共nr个有效项）记录的等待队列头指针表明还有其他后来添加进的等待
-// 任务（例如其他进程调用sleep_on()函数而睡眠在该等待队列上），则此时等待队列头指针
-// 指向的不是当前进程，那么我们就需要先唤醒这些任务。操作方法是将等待队列头所指任务先
-// 转为就绪状态（state = 0），并把自己设置为不可中断等待状态，即自己要等待这些后续进队
-// 列的任务被唤醒而执行时来唤醒本任务。所以要重新执行调度程序。
-	for (i = 0; i < p->nr; i++) {
-		tpp = p->entry[i].wait_address;
-		while (*tpp && *tpp != current) {
-			(*tpp)->state = 0;
-			current->state = TASK_UNINTERRUPTIBLE;
-			schedule();
-		}
-// 执行到这里，说明等待表当前处理项中的等待队列头指针字段wait_address指向当前任务。
-// 若它为空，则说明调度有问题，于是显示警告信息。然后我们让等待队列头指针指向在我们
-// 前面进入队列的任务（第76行）。若此时该头指针确实指向一个任务而不是NULL，则说明
-// 队列中还有任务（*tpp不为空），于是将该任务设置成就绪状态，唤醒之。最后把等待表的
-// 有效表项计数段nr置零，清空该等待表。
-		if (!*tpp)
-			printk("free_wait: NULL");
-		if ((*tpp = p->entry[i].old_task))
-			(**tpp).state = 0;	// TASK_RUNNING
-	}
+	for (i = 0; i < p->nr; i++)
+		remove_wait_queue(&p->entry[i].wait);
 	p->nr = 0;
 }
 
@@ -365,7 +346,7 @@ int sys_select(unsigned long * buffer)
 		timeout += get_fs_long((unsigned long *)&tvp->tv_sec) * HZ;
 		timeout += jiffies;
 	}
-	current->timeout = timeout;		// 设置当前进程应该延时的滴答值。
+	set_timeout(timeout);		// 设置当前进程应该延时的滴答值。
 // select()函数的主要工作在do_select()中完成。在调用该函数之后的代码用于把处理结果复制
 // 到用户数据区中，返回给用户。为了避免出现竞争条件，在调用do_select()前需要禁止中断，
 // 并在该函数返回后再开启中断。
@@ -384,7 +365,7 @@ int sys_select(unsigned long * buffer)
 // 执行出错，于是返回这个错误号。然后我们把处理过的描述符集内容和延迟时间结构内容写回到
 // 用户数据缓冲空间。在写时间结构内容时还需要先将滴答时间单位表示的剩余延迟时间转换成秒
 // 和微秒值。
-	current->timeout = 0;
+	set_timeout(0);
 	if (i < 0)
 		return i;
 	if (inp) {
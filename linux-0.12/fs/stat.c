@@ -114,7 +114,7 @@ int sys_readlink(const char * path, char * buf, int bufsiz)
 	if (!(inode = lnamei(path)))
 		return -ENOENT;
 	if (inode->i_zone[0])
-		bh = bread(inode->i_dev, inode->i_zone[0]);
+		bh = bread(inode->i_dev, bmap(inode, 0));
 	else
 		bh = NULL;
 	iput(inode);
@@ -17,6 +17,7 @@
 #include <linux/sched.h>
 
 #include <linux/kernel.h>
+#include <linux/mm.h>
 #include <asm/system.h>
 
 #include <errno.h>
@@ -67,8 +68,8 @@ static void free_super(struct super_block * sb)
 {
 	cli();
 	sb->s_lock = 0;				// 复位锁定标志。
-	wake_up(&(sb->s_wait));			// 唤醒等待该超级块的进程。
-	sti();					// wake_up()在kernel/sched.c，第188行。
+	wake_up_all(&(sb->s_wait));			// 唤醒等待该超级块的进程。
+	sti();					// wake_up_all()在kernel/sched.c，第188行。
 }
 
 /// 睡眠等待超级块解锁。
@@ -120,7 +121,6 @@ struct super_block * get_super(int dev)
 void put_super(int dev)
 {
 	struct super_block * sb;
-	int i;
 
 // 首先判断参数的有效性和合法性。如果指定设备是根文件系统设备，则显示警告信息“根系
 // 统盘改变了，准备生死决战吧”，并返回。然后在超级块中寻找指定设备号的文件系统超
@@ -139,16 +139,14 @@ void put_super(int dev)
 	}
 // 然后在找到指定设备的超级块之后，我们先锁定该超级块，再置该超级块对应的设备号字段
 // d_dev为0，也即释放该设备上的文件系统超级块。然后释放该超级块占用的其他内核资源，
-// 即释放该设备上文件系统i节点位图和逻辑块位图在缓冲区中所占用的缓冲块。下面常数符
-// 号I_MAP_SLOTS和Z_MAP_SLOTS均等于8，用于分别指明i节点位图和逻辑块位图占用的磁
-// 盘逻辑块数。注意，若这些缓冲块内容被修改过，则需要作同步操作才能反缓冲块中的数据
-// 写入设备中。函数最后对该超级块解锁，并返回。
+// 即逻辑块位图空闲计数表所占用的内存页面。位图块并不常驻在缓冲区中，修改过的位图块
+// 会像其他缓冲块一样在同步操作时写入设备。函数最后对该超级块解锁，并返回。
 	lock_super(sb);
 	sb->s_dev = 0;				// 置超级块空闲。
-	for (i = 0; i < I_MAP_SLOTS; i++)
-		brelse(sb->s_imap[i]);
-	for (i = 0; i < Z_MAP_SLOTS; i++)
-		brelse(sb->s_zmap[i]);
+	invalidate_dev_page_cache(dev);		// 丢弃该设备上文件在页面缓冲中的页面。
+	dcache_invalidate_dev(dev);		// 丢弃该设备上目录的目录项缓冲项。
+	free_page((unsigned long) sb->s_zmap_free);
+	sb->s_zmap_free = NULL;
 	free_super(sb);
 	return;
 }
@@ -160,7 +158,6 @@ static struct super_block * read_super(int dev)
 {
 	struct super_block * s;
 	struct buffer_head * bh;
-	int i, block;
 
 // 首先判断参数的有效性，然后检查该设备是否已更换过盘片（也即是否是软盘设备）。如果更
 // 换过盘，则高速缓冲区有关该设备的所有缓冲块均失效，需要进行失效处理，即释放原来加载
@@ -199,53 +196,41 @@ static struct super_block * read_super(int dev)
 	*((struct d_super_block *) s) =
 		*((struct d_super_block *) bh->b_data);
 	brelse(bh);
-// 现在我们从设备dev上得到了文件系统的超级块，于是开始检查该超级块的有效性，并从设
-// 备上读取i节点位图和逻辑块位图等信息。如果所读取的超级块的文件系统魔数字段不对，
-// 说明设备上不是正确的文件系统，因此同上面一样，释放上面选定的超级块数组中的项，并
-// 解锁该项，返回空指针退出。对于该版Linux内核，只支持MINIX文件系统1.0版本，其魔
-// 数是0x137f。
-	if (s->s_magic != SUPER_MAGIC) {
+// 现在我们从设备dev上得到了文件系统的超级块，于是开始检查该超级块的有效性。如果所
+// 读取的超级块的文件系统魔数字段不对，说明设备上不是正确的文件系统，因此同上面一样，
+// 释放上面选定的超级块数组中的项，并解锁该项，返回空指针退出。本内核支持MINIX文件系
+// 统1.0版本（魔数0x137f）和名字长度为14的2.0版本（魔数0x2468）。2.0版本的逻辑块数
+// 是32位的s_zones字段；对于1.0版本，我们把s_nzones复制到s_zones中，以后就都使用
+// s_zones。位图块数超过超级块所能记录的空闲计数表项数的文件系统也不能安装。逻辑块
+// 可以含有1、2、4或8个盘块（s_log_zone_size为0～3），更大的逻辑块也不支持。
+	if (s->s_magic == SUPER_MAGIC) {
+		s->s_version = 1;
+		s->s_zones = s->s_nzones;
+	} else if (s->s_magic == SUPER_V2_MAGIC)
+		s->s_version = 2;
+	else {
 		s->s_dev = 0;
 		free_super(s);
 		return NULL;
 	}
-// 下面开始读取设备上i节点位图和逻辑块位图数据。首先初始化内存超级块结构中位图空间。
-// 然后从设备上读取i节点位图和逻辑块位图信息，并存放在超级块对应字段中。i节点位图
-// 保存在设备上2号块开始的逻辑块中，共占用s_imap_blocks个块。逻辑块位图在i节点位
-// 图所在的后续块中，共占用s_zmap_blocks个块。
-	for (i = 0; i < I_MAP_SLOTS; i++)	// 初始化操作。
-		s->s_imap[i] = NULL;
-	for (i = 0; i < Z_MAP_SLOTS; i++)
-		s->s_zmap[i] = NULL;
-	block = 2;
-	for (i = 0; i < s->s_imap_blocks; i++)	// 读取设备中i节点位图。
-		if ((s->s_imap[i] = bread(dev, block)))
-			block++;
-		else
-			break;
-	for (i = 0; i < s->s_zmap_blocks; i++)	// 读取设备中逻辑块位图。
-		if ((s->s_zmap[i] = bread(dev, block)))
-			block++;
-		else
-			break;
-// 如果读出的位图块数不等于位图应该占有的逻辑块数，说明文件系统位图信息有问题，超级
-// 块初始化失败。因此只能释放前面申请并占用的所有资源，即释放i节点位图和逻辑块位图
-// 占用的高速缓冲块、释放上面选定的超级块数组项、解锁该超级块项，并返回空指针退出。
-	if (block != 2 + s->s_imap_blocks + s->s_zmap_blocks) {
-		for (i = 0; i < I_MAP_SLOTS; i++) // 释放位图占用的高速缓冲块。
-			brelse(s->s_imap[i]);
-		for (i = 0; i < Z_MAP_SLOTS; i++)
-			brelse(s->s_zmap[i]);
+	if (s->s_imap_blocks > I_MAP_SLOTS || s->s_zmap_blocks > Z_MAP_SLOTS ||
+	    s->s_log_zone_size > 3) {
+		printk("read_super: unsupported filesystem on dev %04x\n\r", dev);
+		s->s_dev = 0;
+		free_super(s);
+		return NULL;
+	}
+// 位图块并不在这里读入并常驻在缓冲区中，而是在申请和释放i节点或逻辑块时才读入（见
+// fs/bitmap.c）。这里只读入一遍所有位图块，统计出各位图块中的空闲位数，以后申请i节点
+// 和逻辑块时就可以直接跳过已满的位图块。如果统计时读位图块出错或者没有内存存放空闲计
+// 数表，说明文件系统位图信息有问题，超级块初始化失败，于是释放上面选定的超级块数组
+// 项、解锁该超级块项，并返回空指针退出。否则一切成功，函数解锁该超级块，并返回超级
+// 块指针。
+	if (!count_free(s)) {
 		s->s_dev = 0;			// 释放选定的超级块数组项。
 		free_super(s);			// 释放该超级块项。
 		return NULL;
 	}
-// 否则一切成功。另外，由于对于申请空闲i节点的函数来讲，如果设备上所有的i节点已经
-// 全被使用，则查找函数会返回0值。因此0号i节点是不能用的，所以这里将位图中第1块
-// 的最低比特位置为1，以防止文件系统分配0号i节点。同样的道理，也将逻辑块位图的
-// 最低位置为1。最后函数解锁该超级块，并返回超级块指针。
-	s->s_imap[0]->b_data[0] |= 1;
-	s->s_zmap[0]->b_data[0] |= 1;
 	free_super(s);		// unlock super block
 	return s;
 }
@@ -259,7 +244,7 @@ int sys_umount(char * dev_name)
 {
 	struct m_inode * inode;
 	struct super_block * sb;
-	int dev;
+	int dev, i;
 
 // 首先根据设备文件名找到对应的i节点，并取其中的设备号。设备文件所定义设备的设备号
 // 是保存在其i节点的i_zone[0]中的。参见后面namei.c程序中系统调用sys_mknod()的代
@@ -284,7 +269,7 @@ int sys_umount(char * dev_name)
 		return -EBUSY;
 	if (!sb->s_imount->i_mount)
 		printk("Mounted inode has i_mount=0\n");
-	for (inode = inode_table+0; inode < inode_table+NR_INODE; inode++)
+	for (i = nr_inodes, inode = first_inode; i > 0; i--, inode = inode->i_next)
 		if (inode->i_dev==dev && inode->i_count)
 			return -EBUSY;
 // 现在该设备上文件系统的卸载条件均得到满足，因此我们可以开始实施真正的卸载操作了。
@@ -369,16 +354,16 @@ int sys_mount(char * dev_name, char * dir_name, int rw_flag)
 // 空闲i节点数）。该函数会在系统初始化时（sys_setup()）被调用（blk_drv/hd.c，157行）。
 void mount_root(void)
 {
-	int i, free;
+	int i;
 	struct super_block * p;
 	struct m_inode * mi;
 
-// 首先检查一个在磁盘i节点大小是否符合要求（32字节），以防止修改代码时出现不一致情况。
+// 首先检查两种磁盘i节点大小是否符合要求（32和64字节），以防止修改代码时出现不一致情况。
 // 然后初始化文件表数组（共64项，即系统同时只能打开64个文件）和超级块表（8项）。这里
 // 将所有文件结构中的引用计数设置为0（表示空闲），并把超级块表中各项的设备字段初始
 // 化为0（也表示空闲）。如果根文件系统所在设备量软盘的话，就提示“插入根文件系统盘并按
 // 回车键”，并等待按键。
-	if (32 != sizeof(struct d_inode))
+	if (32 != sizeof(struct d_inode) || 64 != sizeof(struct d2_inode))
 		panic("bad i-node size");
 	for (i = 0; i < NR_FILE; i++)		// 初始化文件表（共64项）。
 		file_table[i].f_count = 0;
@@ -407,25 +392,10 @@ void mount_root(void)
 	p->s_isup = p->s_imount = mi;
 	current->pwd = mi;
 	current->root = mi;
-// 然后我们对根文件系统上的资源作统计工作，统计该设备上空闲块数和空闲i节点数。首先令i
-// 等于超级块中表明的设备逻辑块总数，然后根据逻辑块位图中相应比特位的占用情况统计出空闲
-// 块数。这里宏函数set_bit()只测试比特位。“i&8191”用于取得i节点号在当前位图块中对应的
-// 比特位偏移值。“i>>13”是将i除以8192，也即除一个磁盘块包吃住的比特位数。
-	free = 0;
-	i = p->s_nzones;
-	while (--i >= 0)
-		if (!set_bit(i&8191, p->s_zmap[i>>13]->b_data))
-			free++;
-// 在显示过设备上空闲逻辑块数/逻辑块总数之后，我们再统计设备上空闲i节点数。首先令i
-// 等于超级块中表明的设备i节点总数+1（加1是将0节点也统计进去），然后根据i节点位
-// 图中相应比特位的占用情况计算出空闲i节点数。最后再显示设备上可用空闲i节点数和i
-// 节点总数。
-	printk("%d/%d free blocks\n\r", free, p->s_nzones);
-	free = 0;
-	i = p->s_ninodes+1;
-	while (--i >= 0)
-		if (!set_bit(i&8191, p->s_imap[i>>13]->b_data))
-			free++;
-	printk("%d/%d free inodes\n\r", free, p->s_ninodes);
+// 然后显示根文件系统上的资源情况，即设备上空闲块数/逻辑块总数和空闲i节点数/i节点总
+// 数。空闲数在read_super()安装文件系统时已经统计好了（fs/bitmap.c中的count_free()）。
+	printk("%d/%d free blocks\n\r", p->s_free_zones << p->s_log_zone_size,
+		p->s_zones << p->s_log_zone_size);
+	printk("%d/%d free inodes\n\r", p->s_free_inodes, p->s_ninodes);
 }
 
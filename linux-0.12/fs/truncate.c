@@ -9,13 +9,19 @@
 
 #include <sys/stat.h>		// 文件状态头文件。含有文件或文件系统状态结构stat{}和常量。
 
+// 间接块中第i项的逻辑块号。参数v2表示是MINIX 2.0文件系统，其间接块上每项占4个字节，
+// 共256项；否则每项占2个字节，共512项。一个逻辑块含有多个盘块时，间接块中的项只存放在
+// 该逻辑块的第1个盘块中。
+#define ind_entry(bh,i,v2) ((v2) ? ((unsigned long *) (bh)->b_data)[i] : \
+				   ((unsigned short *) (bh)->b_data)[i])
+#define ind_count(v2) ((v2) ? 256 : 512)
+
 /// 释放所有一次间接块。（内部函数）
-// 参数dev是文件系统所在设备的设备号；block量逻辑块号。成功则返回1，否则返回0。
-static int free_ind(int dev, int block)
+// 参数inode是被截断文件的i节点；block量逻辑块号。成功则返回1，否则返回0。
+static int free_ind(struct m_inode * inode, int block)
 {
 	struct buffer_head * bh;
-	unsigned short * p;
-	int i;
+	int i, dev = inode->i_dev, v2 = (inode->i_version == 2);
 	int block_busy;				// 有逻辑块没有被释放的标志。
 
 // 首先判断参数的有效性。如果逻辑块号为0，则返回。然后读取一次间接块，并释放其上表
@@ -24,12 +30,14 @@ static int free_ind(int dev, int block)
 	if (!block)
 		return 1;
 	block_busy = 0;
-	if ((bh = bread(dev, block))) {
-		p = (unsigned short *) bh->b_data; // 指向缓冲块数据区。
-		for (i = 0; i < 512; i++,p++)	   // 每个逻辑块上可有512个块号。
-			if (*p)
-				if (free_block(dev, *p)) { // 释放指定的设备逻辑块。
-					*p = 0;		   // 清零。
+	if ((bh = bread(dev, block << inode->i_log_zone_size))) {
+		for (i = 0; i < ind_count(v2); i++) // 每个逻辑块上可有512（或256）个块号。
+			if (ind_entry(bh, i, v2))
+				if (free_block(dev, ind_entry(bh, i, v2))) { // 释放指定的设备逻辑块。
+					if (v2)			   // 清零。
+						((unsigned long *) bh->b_data)[i] = 0;
+					else
+						((unsigned short *) bh->b_data)[i] = 0;
 					bh->b_dirt = 1;	   // 设置已修改标志。
 				} else 
 					block_busy = 1; // 设置逻辑块没有释放标志。
@@ -43,12 +51,13 @@ static int free_ind(int dev, int block)
 }
 
 /// 释放所有二次间接块。
-// 参数dev是文件系统所在设备的设备号；block是逻辑块号。
-static int free_dind(int dev, int block)
+// 参数inode是被截断文件的i节点；block是逻辑块号。参数level为1时，
+// 它把block当作二次间接块，释放其上各项指向的一次间接块；level为2时把block当作
+// 三次间接块（仅MINIX 2.0），释放其上各项指向的二次间接块。
+static int free_dind(struct m_inode * inode, int block, int level)
 {
 	struct buffer_head * bh;
-	unsigned short * p;
-	int i;
+	int i, n, dev = inode->i_dev, v2 = (inode->i_version == 2);
 	int block_busy;				// 有逻辑块没有被释放的标志。
 
 // 首先判断参数的有效性。如果逻辑块号为0，则返回。然后读取二次间接块的一级块，并释放
@@ -56,15 +65,21 @@ static int free_dind(int dev, int block)
 	if (!block)
 		return 1;
 	block_busy = 0;
-	if ((bh = bread(dev, block))) {
-		p = (unsigned short *) bh->b_data; // 指向缓冲块数据区。
-		for (i = 0; i < 512; i++,p++)	   // 每个逻辑块上可连512个二级块。
-			if (*p)
-				if (free_ind(dev, *p)) { // 释放所有一次间接块。
-					*p = 0;		 // 清零
+	if ((bh = bread(dev, block << inode->i_log_zone_size))) {
+		for (i = 0; i < ind_count(v2); i++) { // 每个逻辑块上可连512（或256）个二级块。
+			if ((n = ind_entry(bh, i, v2))) {
+				if (level > 1 ? free_dind(inode, n, level - 1) :
+						free_ind(inode, n)) {
+					if (v2)			 // 清零
+						((unsigned long *) bh->b_data)[i] = 0;
+					else
+						((unsigned short *) bh->b_data)[i] = 0;
 					bh->b_dirt = 1;	 // 设置已修改标志。
 				} else
 					block_busy = 1; // 设置逻辑块没有释放标志。
+			}
+			cond_resched();		// 每释放一个一次间接块就看是否需要让出CPU。
+		}
 		brelse(bh);				// 释放二次间接块占用的缓冲块。
 	}
 // 最后释放设备上的干净间接块。但如果其中有逻辑块没有被释放，则返回0（失败）。
@@ -89,6 +104,8 @@ void truncate(struct m_inode *inode)
 	if (!(S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode) ||
 	      S_ISLNK(inode->i_mode)))
 		return;
+	invalidate_page_cache(inode);		// 页面缓冲中该文件的页面已无效。
+	inode->i_map_len = 0;			// bmap()的逻辑块映射缓冲已无效。
 repeat:
 	block_busy = 0;
 	for (i = 0; i < 7; i++)
@@ -98,14 +115,18 @@ repeat:
 			else
 				block_busy = 1;	// 若没有释放掉则置标志。
 		}
-	if (free_ind(inode->i_dev, inode->i_zone[7])) // 释放所有一次间接块。
+	if (free_ind(inode, inode->i_zone[7])) // 释放所有一次间接块。
 		inode->i_zone[7] = 0;		      // 块指针置0。
 	else					      
 		block_busy = 1;			// 若没有释放掉则置标志。
-	if (free_dind(inode->i_dev, inode->i_zone[8])) // 释放所有二次间接块。
+	if (free_dind(inode, inode->i_zone[8], 1)) // 释放所有二次间接块。
 		inode->i_zone[8] = 0;		       // 块指针置0。
 	else
 		block_busy = 1;			// 若没有释放掉则置标志。
+	if (free_dind(inode, inode->i_zone[9], 2)) // 释放所有三次间接块。
+		inode->i_zone[9] = 0;		       // 块指针置0。
+	else
+		block_busy = 1;			// 若没有释放掉则置标志。
 // 此后设置i节点已修改标志，并且如果还有逻辑块由于“忙”而没有被释放，则把当前进程
 // 运行时间片置0，以先切换到其他进程去运行，稍等一会再重新执行释放操作。
 // 最后把文件修改标志和i节点改变时间设置为当前时间。宏CURRENT_TIME定义在头文件
@@ -117,6 +138,7 @@ repeat:
 		schedule();
 		goto repeat;
 	}
+	inode->i_map_len = 0;			// 释放时睡眠期间可能又被设置了。
 	inode->i_size = 0;			// 文件大小置零。
 	inode->i_mtime = inode->i_ctime = CURRENT_TIME;
 }
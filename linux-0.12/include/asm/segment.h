@@ -65,6 +65,53 @@ static inline void put_fs_long(unsigned long val, unsigned long * addr)
 __asm__("movl %0,%%fs:%1"::"r" (val),"m" (*addr));
 }
 
+/// 从fs段中from处复制n个字节到内核数据段中to处。
+// 先用MOVSB、MOVSW复制掉不足一个长字的那几个字节，再用REP MOVSL按长字复制其余部分。
+// 源操作数加上了fs段超越前缀，因此是从fs:[esi]复制到es:[edi]。
+// %0 - ecx（n）；%1 - edi（to）；%2 - esi（from）。
+static inline void memcpy_fromfs(void * to, const void * from, unsigned long n)
+{
+	long __d0, __d1, __d2;
+
+__asm__ __volatile__("cld\n\t"
+	"testb $1,%%cl\n\t"			/* 字节数是奇数吗？ */
+	"je 1f\n\t"
+	"fs ; movsb\n"				/* 是则先复制1个字节 */
+	"1:\ttestb $2,%%cl\n\t"		/* 还有多出的一个字吗？ */
+	"je 2f\n\t"
+	"fs ; movsw\n"				/* 有则复制1个字 */
+	"2:\tshrl $2,%%ecx\n\t"		/* 其余按长字复制 */
+	"rep ; fs ; movsl"
+	:"=&c" (__d0),"=&D" (__d1),"=&S" (__d2)
+	:"0" (n),"1" ((long) to),"2" ((long) from)
+	:"memory");
+}
+
+/// 从内核数据段中from处复制n个字节到fs段中to处。
+// REP MOVS的目的操作数总是使用es段，不能超越，因此临时把es设置为fs，复制完后再恢复。
+// %0 - ecx（n）；%1 - edi（to）；%2 - esi（from）。
+static inline void memcpy_tofs(void * to, const void * from, unsigned long n)
+{
+	long __d0, __d1, __d2;
+
+__asm__ __volatile__("cld\n\t"
+	"push %%es\n\t"
+	"push %%fs\n\t"
+	"pop %%es\n\t"			/* es = fs */
+	"testb $1,%%cl\n\t"
+	"je 1f\n\t"
+	"movsb\n"
+	"1:\ttestb $2,%%cl\n\t"
+	"je 2f\n\t"
+	"movsw\n"
+	"2:\tshrl $2,%%ecx\n\t"
+	"rep ; movsl\n\t"
+	"pop %%es"
+	:"=&c" (__d0),"=&D" (__d1),"=&S" (__d2)
+	:"0" (n),"1" ((long) to),"2" ((long) from)
+	:"memory");
+}
+
 /*
  * Someone who knows GNU asm better than I should double check the following.
  * It seems to work, but I don't know if I'm doning something subtly wrong.
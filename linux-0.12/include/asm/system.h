@@ -21,6 +21,13 @@ __asm__("movl %%esp,%%eax\n\t"	/* 保存堆栈指针esp到eax寄存器中 	*/ \
 
 #define iret() __asm__ ("iret"::)		/* 中断返回 */
 
+// 保存和恢复标志寄存器EFLAGS（包括中断允许标志IF）。用于在可能已经关中断的情况下临时
+// 关中断，退出时恢复原来的中断状态，而不是直接开中断。
+#define save_flags(x) \
+__asm__ __volatile__("pushfl ; popl %0":"=r" (x)::"memory")
+#define restore_flags(x) \
+__asm__ __volatile__("pushl %0 ; popfl"::"r" (x):"memory")
+
 /// 设置门描述符宏。
 // 根据参数中的中断或异常处理过程地址addr、门描述符类型type和特权级信息dpl，设置位于
 // 地址gate_addr处的门描述符。（注意：下面“偏移”值是相对于内核代码或数据段来说的）。
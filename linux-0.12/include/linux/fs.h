@@ -42,6 +42,7 @@
 #define READA 2		/* read-ahead - don't pause */
 #define WRITEA 3	/* “write-ahead” - silly, but somewhat useful  */
 
+long buffer_head_init(long mem_start, long buffer_end);	// 分配缓冲块头结构数组。
 void buffer_init(long buffer_end);		// 高速缓冲区初始化函数。
 
 #define MAJOR(a) (((unsigned)(a))>>8)		/* 取设备主设备号（是高字节） */
@@ -50,12 +51,13 @@ void buffer_init(long buffer_end);		// 高速缓冲区初始化函数。
 #define NAME_LEN 14				/* 名字长度值 */
 #define ROOT_INO 1				/* 根i节点 */
 
-#define I_MAP_SLOTS 8				/* i节点位图槽数 */
-#define Z_MAP_SLOTS 8				/* 逻辑块（区段块）位图槽数 */
-#define SUPER_MAGIC 0x137F			/* 文件系统魔数 */
+#define I_MAP_SLOTS 8				/* i节点位图最多块数 */
+#define Z_MAP_SLOTS 2048			/* 逻辑块位图最多块数（空闲计数表占1页） */
+#define SUPER_MAGIC 0x137F			/* MINIX 1.0文件系统魔数 */
+#define SUPER_V2_MAGIC 0x2468			/* MINIX 2.0文件系统魔数 */
 	
 #define NR_OPEN 20 				/* 进程最多打开文件数 */
-#define NR_INODE 64				/* 系统同时最多使用I节点个数 */
+#define NR_INODE 2048				/* 系统同时最多使用I节点个数（按需分配） */
 #define NR_FILE 64				/* 系统最多文件个数（文件数组项数） */
 #define NR_SUPER 8				/* 系统所含超级块个数（超级块数组项数） */
 #define NR_HASH 307				/* 缓冲区Hash表数组项数值 */
@@ -66,8 +68,9 @@ void buffer_init(long buffer_end);		// 高速缓冲区初始化函数。
 #define NULL ((void *) 0)
 #endif
 
-// 每个逻辑块可存放的i节点数。
+// 每个逻辑块可存放的i节点数（MINIX 1.0和2.0）。
 #define INODES_PER_BLOCK ((BLOCK_SIZE/(sizeof (struct d_inode))))
+#define V2_INODES_PER_BLOCK ((BLOCK_SIZE/(sizeof (struct d2_inode))))
 // 每个逻辑块可存放的目录项数。
 #define DIR_ENTRIES_PER_BLOCK ((BLOCK_SIZE/(sizeof (struct dir_entry))))
 
@@ -100,7 +103,7 @@ struct buffer_head {
 	unsigned char b_dirt;			/* 0-clean, 1-dirty */
         unsigned char b_count;			/* users using this block */ // 使用的用户数。
         unsigned char b_lock;			/* 0 - ok, 1 - lcoked */ // 缓冲区是否被锁定。
-        struct task_struct * b_wait;		// 指向等待该缓冲区解锁的任务。
+        struct wait_queue * b_wait;		// 指向等待该缓冲区解锁的任务。
         struct buffer_head * b_prev;		// hash队列上前一块（这四个指针用于缓冲区的管理）。
         struct buffer_head * b_next;		// hash队列上下一块。
         struct buffer_head * b_prev_free;	// 空闲表上前一块。
@@ -119,18 +122,34 @@ struct d_inode {
 						// zone是区的意思，可译成区段，或逻辑块。
 };
 
-// 这里在内存中的i节点结构。前7项与d_inode完全一样。
+// MINIX 2.0磁盘上的i节点结构（64字节）。逻辑块号是32位的，并且多了三次间接块。
+struct d2_inode {
+	unsigned short i_mode;			// 文件类型和属性（rwx位）。
+	unsigned short i_nlinks;		// 链接数。
+	unsigned short i_uid;			// 用户id。
+	unsigned short i_gid;			// 组id。
+	unsigned long i_size;			// 文件大小（字节数）。
+	unsigned long i_atime;			// 最后访问时间。
+	unsigned long i_mtime;			// 修改时间。
+	unsigned long i_ctime;			// i节点自身修改时间。
+	unsigned long i_zone[10];		// 直接（0-6）、间接（7）、双重间接（8）或三重
+						// 间接（9）逻辑块号。
+};
+
+// 这里在内存中的i节点结构。前7项对应磁盘上的i节点，由read_inode()和write_inode()
+// 在两种磁盘i节点格式之间转换，因此逻辑块号都按32位保存。
 struct m_inode {
         unsigned short i_mode;			// 文件类型和属性（rwx位）。
 	unsigned short i_uid;			// 用户id（文件拥有者标识符）。
 	unsigned long i_size;			// 文件大小（字节数）。
 	unsigned long i_mtime;			// 修改时间（自1970.1.1：0算起，秒）。
-	unsigned char i_gid;			// 组id（文件拥有都所在的组）。
-	unsigned char i_nlinks;			// 文件目录项链接数。
-	unsigned short i_zone[9];		// 直接（0-6）、间接（7）或双重间接（8）逻辑块号。
+	unsigned short i_gid;			// 组id（文件拥有都所在的组）。
+	unsigned short i_nlinks;		// 文件目录项链接数。
+	unsigned long i_zone[10];		// 直接（0-6）、间接（7）、双重间接（8）或三重
+						// 间接（9，仅MINIX 2.0）逻辑块号。
 /* these are in memory also */
-	struct task_struct * i_wait;		// 等待该i节点的进程。
-	struct task_struct * i_wait2; 		/* for pipes */
+	struct wait_queue * i_wait;		// 等待该i节点的进程。
+	struct wait_queue * i_wait2; 		/* for pipes */
 	unsigned long i_atime;			// 最后访问时间。
 	unsigned long i_ctime;			// i节点自身修改时间。
 	unsigned short i_dev;			// i节点所在的设备号。
@@ -142,6 +161,15 @@ struct m_inode {
 	unsigned char i_mount;			// 安装标志。
 	unsigned char i_seek;			// 搜寻标志（lseek时）。
 	unsigned char i_update;			// 更新标志。
+	unsigned char i_version;		// i节点所在文件系统的版本（1或2）。
+	unsigned char i_log_zone_size;		// 每逻辑块含有的盘块数的对数（同超级块）。
+	unsigned long i_map_start;		// bmap()缓冲的一段连续逻辑块：文件中的起始逻辑块号、
+	unsigned long i_map_zone;		// 对应的设备逻辑块号、
+	unsigned long i_map_len;		// 以及逻辑块数（0表示缓冲无效）。
+	struct task_struct * i_exec_tasks;	// 以该i节点为执行文件的任务链表（经exec_next链接）。
+	struct task_struct * i_lib_tasks;	// 以该i节点为库文件的任务链表（经lib_next链接）。
+	struct m_inode * i_next, * i_prev;	// 所有内存i节点的双向循环链表。
+	struct m_inode * i_hash_next, ** i_hash_pprev; // 以（设备号，i节点号）为索引的hash链表。
 };
 
 // 文件结构（用于在文件句柄与i节点之间建立关系）。
@@ -163,17 +191,23 @@ struct super_block {
 	unsigned short s_log_zone_size;		// log(数据块数/逻辑块)。（以2为底）。
 	unsigned long s_max_size;		// 文件最大长度。
 	unsigned short s_magic;			// 文件系统魔数。
+	unsigned short s_state;			// 文件系统状态（仅MINIX 2.0）。
+	unsigned long s_zones;			// 逻辑块数（仅MINIX 2.0）。
 /* These are only in memory */
-	struct buffer_head * s_imap[8];		// i节点位图缓冲块指针数组（占用8块，可表示64M）。
-	struct buffer_head * s_zmap[8];		// 逻辑块立体图缓冲块指针数组（占用8块）。
+	unsigned char s_version;		// 文件系统版本（1或2）。MINIX 1.0的s_zones被设
+						// 置为s_nzones，因此以后总是使用s_zones。
 	unsigned short s_dev;			// 超级块所在的设备号。
 	struct m_inode * s_isup;		// 被安装的文件系统根目录的i节点。（isup-super i）
 	struct m_inode * s_imount;		// 被安装到的i节点。
 	unsigned long s_time;			// 修改时间。
-	struct task_struct * s_wait;		// 等待该超级块的进程。
+	struct wait_queue * s_wait;		// 等待该超级块的进程。
 	unsigned char s_lock;			// 被锁定标志。
 	unsigned char s_rd_only;		// 只读标志。
 	unsigned char s_dirt;			// 已修改（脏）标志。
+	unsigned short s_imap_free[I_MAP_SLOTS]; // 各i节点位图块中的空闲位数。
+	unsigned short * s_zmap_free;		// 各逻辑块位图块中的空闲位数（占1页）。
+	unsigned long s_free_inodes;		// 空闲i节点总数。
+	unsigned long s_free_zones;		// 空闲逻辑块总数。
 };
 
 // 磁盘上超级块结构，与上面131-138行完全一样。
@@ -186,6 +220,8 @@ struct d_super_block {
 	unsigned short s_log_zone_size;		// log（数据块数/逻辑块）。（以2为底）。
 	unsigned long s_max_size;		// 文件最大长度。
 	unsigned short s_magic;			// 文件系统魔数。
+	unsigned short s_state;			// 文件系统状态（仅MINIX 2.0）。
+	unsigned long s_zones;			// 逻辑块数（仅MINIX 2.0）。
 };
 
 // 文件目录项结构（16字节）。
@@ -194,7 +230,8 @@ struct dir_entry {
 	char name[NAME_LEN];			// 文件名，长度NAME_LEN=14。
 };
 
-extern struct m_inode inode_table[NR_INODE];	// 字义i节点表数组（32项）。
+extern struct m_inode * first_inode;		// 内存i节点链表头（fs/inode.c）。
+extern int nr_inodes;				// 已分配的内存i节点数。
 extern struct file file_table[NR_FILE];		// 文件表数组（64项）。
 extern struct super_block super_block[NR_SUPER]; // 超级块数组（8项）。
 extern struct buffer_head * start_buffer;	// 缓冲区起始内存位置。
@@ -249,7 +286,7 @@ extern void iput(struct m_inode * inode);
 // 从设备读取指定节点号的一个i节点。
 extern struct m_inode * iget(int dev, int nr);
 
-// wwi节点表（inode_table）中获取一个空闲i节点项。
+// 从内存i节点链表（first_inode）中获取一个空闲i节点项。
 extern struct m_inode * get_empty_inode(void);
 
 // 获取（申请一）管道节点。返回为i节点指针（如果是NULL则失败）。
@@ -280,7 +317,7 @@ extern void bread_page(unsigned long addr, int dev, int b[4]);
 extern struct buffer_head * breada(int dev, int block, ...);
 
 // 向设备dev申请一个磁盘块（区段，逻辑块），返回逻辑块号。
-extern int new_block(int dev);
+extern int new_block(int dev, int goal);
 
 // 释放设备数据区中的逻辑块（区段，磁盘块）block。复位指定逻辑块block的逻辑块位图比特位。
 extern int free_block(int dev, int block);
@@ -291,6 +328,9 @@ extern struct m_inode * new_inode(int dev);
 // 释放一个i节点（删除文件时）。
 extern void free_inode(struct m_inode * inode);
 
+// 统计超级块sb中各位图块的空闲位数（安装文件系统时）。
+extern int count_free(struct super_block * sb);
+
 // 刷新指定设备缓冲区。
 extern int sync_dev(int dev);
 
@@ -307,6 +347,17 @@ extern void put_super(int dev);
 
 // inode.c
 extern void invalidate_inodes(int dev);
+extern void insert_inode_hash(struct m_inode * inode);
+extern void clear_inode(struct m_inode * inode);
+
+// dcache.c
+extern int dcache_lookup(struct m_inode * dir, const char * name, int len,
+	unsigned long * seq);
+extern void dcache_add(struct m_inode * dir, const char * name, int len, int ino,
+	unsigned long seq);
+extern void dcache_invalidate(struct m_inode * dir, const char * name, int len);
+extern void dcache_invalidate_dir(struct m_inode * dir);
+extern void dcache_invalidate_dev(int dev);
 
 #endif
 
@@ -48,7 +48,6 @@ extern void blank_screen(void);
 extern void unblank_screen(void);
 
 extern int beepcount;		// 蜂鸣时间嘀嗒计数（kernel/chr/console.c，950）。
-extern int hd_timeout;		// 硬盘超时滴答值（kernel/blk_drv/blk.h）。
 extern int blankinterval;	// 设定的屏幕黑屏间隔时间。
 extern int blankcount;		// 黑屏时间计数（kernel/chr_drv/console.c，138、139）。
 
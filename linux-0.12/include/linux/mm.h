@@ -24,13 +24,45 @@ extern void free_page(unsigned long addr);
 void swap_free(int page_nr);
 void swap_in(unsigned long *table_ptr);
 
+// 执行文件和库文件页面的页面缓冲（mm/filemap.c）。页面以（i节点，起始块号）为索引。
+struct m_inode;
+extern unsigned long find_page_cache(struct m_inode * inode, unsigned long block);
+extern int add_page_cache(struct m_inode * inode, unsigned long block, unsigned long page);
+extern void invalidate_page_cache(struct m_inode * inode);
+extern void invalidate_dev_page_cache(int dev);
+extern int shrink_page_cache(void);
+
+// 文件映射区结构（mm/mmap.c）。每个进程的映射区按起始地址排序链接在任务结构的mmap字段上。
+// 地址都是进程逻辑地址（相对于start_code），vm_offset是vm_start处对应的文件偏移。
+struct vm_area_struct {
+	unsigned long vm_start;			// 映射区起始地址（页面对齐）。
+	unsigned long vm_end;			// 映射区结束地址（不含）。
+	unsigned long vm_offset;		// vm_start处对应的文件偏移（页面对齐）。
+	unsigned short vm_flags;		// 映射区标志，见下面VM_xxx。
+	struct m_inode * vm_inode;		// 被映射文件的i节点（NULL表示该表项空闲）。
+	struct vm_area_struct * vm_next;	// 进程的下一个映射区。
+};
+
+#define VM_READ		0x0001			/* 可读 */
+#define VM_WRITE	0x0002			/* 可写 */
+#define VM_SHARED	0x0004			/* 共享映射，写入的内容会写回文件 */
+
+struct task_struct;
+extern struct vm_area_struct * find_vma(struct task_struct * p, unsigned long addr);
+extern unsigned long mmap_page(struct vm_area_struct * vma, unsigned long addr);
+extern int mmap_wp_page(unsigned long address, unsigned long * table_entry);
+extern void mmap_write_verify(unsigned long address);
+extern int copy_mmap(struct task_struct * p);
+extern void exit_mmap(void);
+
 // extern inline volatile void oom(void)
 // 这个函数貌似不能内联
 static inline void oom(void) __attribute__((noreturn));
 static inline void oom(void) 
 {
 // do_exit()应该使用退出代码，这里用了信号值SIGSEGV（11）相同值的出错码含义是“资源暂
-// 不可用”，正好同义。
+// 不可用”，正好同义。get_free_page()只有在当前任务自己被OOM选中（见mm/swap.c中的
+// oom_kill()，此时它已收到SIGKILL信号）时才返回0，因此这里退出的总是被选中的任务。
 	printk("out of memory\n\r");
 	do_exit(SIGSEGV);
 }
@@ -38,24 +70,38 @@ static inline void oom(void)
 // 刷新页变换高速缓冲（TLB）宏函数。
 // 为了提高地址转换的效率，CPU将最近使用的页表数据存放在芯片中高速缓冲中。在修改过
 // 页表信息之后，就需要刷新该缓冲区。 这里使用重新加载页目录基地址寄存器CR3的方法来
-// 进行刷新。下面eax = 0，是页目录的基址。
+// 进行刷新。每个任务都有自己的页目录表，因此这里把CR3原值重新写回去。
 #define invalidate() \
-__asm__("movl %%eax,%%cr3"::"a" (0))
+__asm__("movl %%cr3,%%eax\n\tmovl %%eax,%%cr3":::"ax")
+
+// 取任务tsk页目录表中线性地址address所对应目录项的指针。tss.cr3是任务页目录表的物理
+// 地址，内核中物理地址与线性地址对等映射，因此可以直接当作指针使用。任务0的页目录表
+// 就是物理地址0处的pg_dir。
+#define PAGE_DIR_OFFSET(tsk,address) \
+((unsigned long *) ((tsk)->tss.cr3 + (((address)>>20) & 0xffc)))
 
 /* these are not to be changed without changing head.s etc */
 /* 下面定义若需要改动，则需要与head.s等文件中的相关信息一起改变 */
-// Linux0.12内核默认支持的最大内存容量是16MB，可以修改这些定义以适合更多的内存。
+// 内核把物理内存对等映射在线性地址空间的头HIGH_MEMORY_LIMIT字节中，用户任务的线性空间
+// 从这之上开始（见sched.h中的TASK_BASE），因此这也是内核能使用的最大内存容量。head.s只
+// 映射了头64MB（HEAD_MAP_SIZE），其余部分的页表由kernel_map_init()按实际内存容量建立。
 #define LOW_MEM 0x100000			/* 机器物理内存低端（1MB） */
+#define HEAD_MAP_SIZE 0x4000000			/* head.s中的页表对等映射的物理内存（64MB） */
+#define HIGH_MEMORY_LIMIT 0x40000000		/* 内核线性空间能对等映射的最大物理内存（1GB） */
 extern unsigned long HIGH_MEMORY;		/* 存放实际物理内存最高端地址 */
-#define PAGING_MEMORY (15*1024*1024)		/* 分页内存15MB。主内存区最多15MB */
-#define PAGING_PAGES (PAGING_MEMORY>>12)	/* 分页后的物理内存页面数（3840） */
+extern unsigned long paging_pages;		/* 分页后的物理内存页面数，由mem_init()根据实际内存计算 */
+extern unsigned long nr_free_pages;		/* 主内存区当前空闲页面数 */
+extern unsigned long free_pages_low;		/* 低于该值时唤醒页面换出守护进程 */
+extern unsigned long free_pages_high;		/* 守护进程换出页面直到空闲页面数达到该值 */
+extern struct wait_queue * oom_wait;		/* 等待OOM牺牲者释放内存的任务队列 */
 #define MAP_NR(addr) (((addr)-LOW_MEM)>>12)	/* 指定内存地址映射为页面号 */
 #define USED 100				/* 页面被占用标志，参见memory.c，449行 */
 
 // 内存映射字节图（1字节代表1页内存）。每个页面对应的字节用于标志页面当前被引用
-// （占用）次数。它最大可以映射15MB的内存空间。在初始化函数mem_init()中，对于不
-// 能用作主内存区页面的位置均都预先被设置成USED（100）。
-extern unsigned char mem_map [ PAGING_PAGES ];
+// （占用）次数。它的长度按实际物理内存大小（paging_pages项）在mem_init()中从主内存区
+// 开始处分配。在初始化函数mem_init()中，对于不能用作主内存区页面的位置均都预先被设
+// 置成USED（100）。
+extern unsigned char * mem_map;
 
 // 下面字义的符号常量对应页目录表项和页表（二级页表）项中的一些标志位。
 #define PAGE_DIRTY	0x40			/* 位6，弹幕弹幕脏（已修改） */
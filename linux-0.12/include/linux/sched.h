@@ -3,8 +3,9 @@
 
 #define HZ 100			/* 定义系统时钟滴答频率（1百赫兹，每个滴答10ms） */
 
-#define NR_TASKS	64		/* 系统中同时最多任务（进程）数 */
+#define NR_TASKS	4096		/* 系统中同时最多任务（进程）数 */
 #define TASK_SIZE	0x04000000	/* 每个任务的长度（64MB） */
+#define TASK_BASE	HIGH_MEMORY_LIMIT	/* 用户任务线性空间的起始地址（1GB） */
 #define LIBRARY_SIZE	0x00400000	/* 动态加载库长度（4MB） */
 
 #if (TASK_SIZE &x3fffff)
@@ -22,12 +23,14 @@
 // 在进程逻辑地址空间中动态库被加载的位置（60MB处）。
 #define LIBRARY_OFFSET (TASK_SIZE - LIBRARY_SIZE)
 
+// 在进程逻辑地址空间中，未指定地址的文件映射从这里（32MB处）开始向上寻找空闲区域。
+#define MMAP_OFFSET (TASK_SIZE/2)
+
 // 下面宏CT_TO_SECS和CT_TO_USECS用于把系统当前滴答数转换成用秒值加微秒值表示。
 #define CT_TO_SECS(x)	((x) / HZ)
 #define CT_TO_USECS(x)	(((x) % HZ) * 1000000/HZ)
 
-#define FIRST_TASK task[0]			/* 任务0比较特殊，所以特意给它单独定义一个符号 */
-#define LAST_TASK task[NR_TASKS-1]		/* 任务数组中的最后一项任务 */
+#define FIRST_TASK (&init_task.task)		/* 任务0比较特殊，所以特意给它单独定义一个符号 */
 
 #include <linux/head.h>
 #include <linux/mm.h>
@@ -52,11 +55,16 @@
 #define NULL ((void *) 0)
 #endif
 
-// 复制进程的页目录页表。Linus认为这是内核中最复杂的函数之一。（mm/memory.c，118）
-extern int copy_page_tables(unsigned long from, unsigned long to, long size);
+struct task_struct;
+
+// 把当前进程线性地址from开始的页表复制到任务p页目录中线性地址to处。Linus认为这是
+// 内核中最复杂的函数之一。（mm/memory.c）
+extern int copy_page_tables(struct task_struct * p, unsigned long from,
+	unsigned long to, long size);
 
-// 释放页表所指定的内存块及页表本身。（mm/memory.c，69）
-extern int free_page_tables(unsigned long from, unsigned long size);
+// 释放任务p页目录中指定的内存块及页表本身。（mm/memory.c）
+extern int free_page_tables(struct task_struct * p, unsigned long from,
+	unsigned long size);
 
 // 调度程序的初始化函数。（kernel/sched.c，417）
 extern void sched_init(void);
@@ -89,6 +97,10 @@ struct i387_struct {
 };
 
 // 任务状态段数据结构。
+// 现在任务切换由switch_to()用软件完成，整个系统只有一个由CPU使用的任务状态段init_tss，
+// 其中只有esp0（特权级变化时使用的内核栈指针）在每次切换时被更新。各任务结构中的tss
+// 字段只用来保存本任务的esp0、页目录表物理地址cr3、切换时的内核栈指针esp和恢复执行
+// 地址eip、LDT选择符ldt以及协处理器状态i387，其余字段不再使用。
 struct tss_struct {
 	long 	back_link;	/* 16 high bits zero */
 	long 	esp0;
@@ -116,6 +128,30 @@ struct tss_struct {
 	struct i387_struct i387;
 };
 
+// 内核定时器结构。定时器挂在时间轮（timing wheel）的某个槽链表上，list指向所在槽的
+// 链表头指针，为NULL表示定时器当前没有挂在时间轮上。定时到时以data为参数调用function。
+// 使用者自己提供结构的定时器用mod_timer()设置、用del_timer()取消，例如硬盘和软盘的
+// 操作超时定时器（kernel/blk_drv/blk.h）。
+struct timer_list {
+	struct timer_list * next, * prev;	// 槽链表（双向循环）中的后一项和前一项。
+	struct timer_list ** list;		// 所在槽的链表头指针。
+	unsigned long expires;			// 定时到期时的jiffies值。
+	unsigned long data;			// 调用function时的参数。
+	void (*function)(unsigned long);	// 定时处理函数。
+};
+
+// 等待队列项结构。等待队列头是一个 struct wait_queue * 指针（NULL表示队列空），队列
+// 中各项通过next链接，pprev指向前一项（或队列头）的next字段，因此一个等待项不需要
+// 知道队列头就可以在O(1)时间内从队列中取下，也就不必再像原来那样通过每个睡眠任务内核
+// 栈上的tmp变量把睡眠任务串起来，唤醒时一个接一个地进行任务切换。exclusive置位的项是
+// 互斥等待项，wake_up_one()只唤醒其中的第1个。等待项通常就定义在睡眠任务的内核栈上。
+struct wait_queue {
+	struct task_struct * task;		// 等待的任务。
+	struct wait_queue * next;		// 队列中的下一项。
+	struct wait_queue ** pprev;		// 指向前一项的next字段或队列头指针。
+	int exclusive;				// 互斥等待标志。
+};
+
 // 下面是任务（进程）数据结构，或称为进程描述符。详细说明请参见5.7节内容。
 // long state			任务的运行状态（-1不可运行，0可运行（就绪），>0已停止）。
 // long counter			任务运行时间计数（递减）（滴答数），运行时间片。
@@ -155,6 +191,15 @@ struct tss_struct {
 // struct rlimit rlim[RLIM_ULIMITS] 进程资源使用统计数组。
 // unsigned int flags		各进程的标志，在下面第149行开始定义（还未使用）。
 // unsigned short used_math	标志：是否使用了协处理器。
+// struct task_struct * run_next, * run_prev 就绪队列中的后一个和前一个任务。
+// long run_index		所在就绪队列的序号（按counter值），-1表示不在就绪队列中。
+// unsigned long epoch		最后一次按优先权重新计算counter时的调度周期号。
+// long policy			调度策略（SCHED_OTHER、SCHED_FIFO或SCHED_RR，见<sched.h>）。
+// long rt_priority		实时任务的静态优先级（1-31），普通任务为0。
+// struct timer_list real_timer	报警定时器，到时向任务发送SIGALRM信号（alarm）。
+// struct timer_list timeout_timer 超时定时器，到时清timeout并唤醒可中断睡眠的任务。
+// struct task_struct * next_task, * prev_task 任务链表（经过任务0的双向循环链表）。
+// struct task_struct * pidhash_next, ** pidhash_pprev 进程号hash链表。
 // -----------------------------
 // int tty			进程使用tty终端的子设备号。-1表示没有使用。
 // unsigned short umask		文件创建属性屏蔽位。
@@ -162,6 +207,8 @@ struct tss_struct {
 // struct m_inode * root	根目录i节点结构指针。
 // struct m_inode * executable	执行文件i节点结构指针。
 // struct m_inode * library	被加载库文件i节点结构指针。
+// struct task_struct * exec_next 执行同一执行文件的下一个任务（i节点i_exec_tasks链表）。
+// struct task_struct * lib_next 使用同一库文件的下一个任务（i节点i_lib_tasks链表）。
 // unsigned long close_on_exec	执行时关闭文件句柄位图标志。（参见include/fcntl.h）
 // struct desc_struct ldt[3]	局部描述符表。0-空，1-代码段cs，2-数据和堆栈段ds&ss。
 // struct tss_struct tss	进程的任务状态段信息结构。
@@ -192,6 +239,16 @@ struct task_struct {
 	struct rlimit rlim[RLIM_NLIMITS];
 	unsigned int flags;	/* per process flags, defined below */
 	unsigned short used_math;
+/* run queue links, see kernel/sched.c */
+	struct task_struct * run_next, * run_prev;
+	long run_index;
+	unsigned long epoch;
+	long policy, rt_priority;
+/* timers for alarm and timeout, see kernel/sched.c */
+	struct timer_list real_timer, timeout_timer;
+/* task list and pid hash links, see kernel/fork.c */
+	struct task_struct * next_task, * prev_task;
+	struct task_struct * pidhash_next, ** pidhash_pprev;
 /* file system info */
 	int tty;		/* -1 if no tty, so it must be signed */
 	unsigned short umask;
@@ -199,6 +256,8 @@ struct task_struct {
 	struct m_inode * root;
 	struct m_inode * executable;
 	struct m_inode * library;
+	struct task_struct * exec_next, * lib_next;
+	struct vm_area_struct * mmap;	/* file mappings, see mm/mmap.c */
 	unsigned long close_on_exec;
 	struct file * filp[NR_OPEN];
 /* ldt for this task 0 - zero 1 - cs 2 - ds&ss */
@@ -238,8 +297,14 @@ struct task_struct {
 		  {0x7fffffff, 0x7fffffff}, {0x7fffffff, 0x7fffffff}}, 	\
 /* flags */	0, 	/* flags 						*/\
 /* math */	0, 	/* used_math 						*/\
-		/* tty, umask, pwd, root, executable, close_on_exec 		*/\
-/* fs info */	-1,0022,NULL,NULL,NULL,NULL,0, 					  \
+		/* run_next, run_prev, run_index, epoch, policy, rt_priority */\
+/* runq */	NULL,NULL,-1,0,0,0, 						  \
+/* timers */	{},{},	/* real_timer, timeout_timer 				*/\
+		/* next_task, prev_task, pidhash_next, pidhash_pprev 	*/\
+/* links */	&init_task.task,&init_task.task,NULL,NULL, 			  \
+		/* tty, umask, pwd, root, executable, library,		*/\
+		/* exec_next, lib_next, mmap, close_on_exec 		*/\
+/* fs info */	-1,0022,NULL,NULL,NULL,NULL,NULL,NULL,NULL,0, 		  \
 /* filp */	{NULL,},/* filp[20] 						*/\
 	{ 		/* ldt[3] 						*/\
 		{0,0}, 								  \
@@ -251,33 +316,130 @@ struct task_struct {
 /* tss */{0,PAGE_SIZE+(long)&init_task,0x10,0,0,0,0,(long)&pg_dir, /* tss 	*/\
 	  0,0,0,0,0,0,0,0, 							  \
 	  0,0,0x17,0x17,0x17,0x17,0x17,0x17, 					  \
-	  _LDT(0),0x80000000, 							  \
+	  _LDT,0x80000000, 							  \
 	  	{0} 								  \
 	  }, 									  \
 }
 
-extern struct  task_struct *task[NR_TASKS];	// 任务指针数组。
+// 任务结构与其内核态堆栈放在同一页内存中。任务0的这一页就是kernel/sched.c中的init_task。
+union task_union {
+	struct task_struct task;
+	char stack[PAGE_SIZE];
+};
+
+extern union task_union init_task;		// 任务0（所有任务链表的表头）。
+extern struct task_struct *child_reaper;	// 收养孤儿进程的init进程（任务1）。
+extern int nr_tasks;				// 系统中现有的任务数（不含任务0）。
+extern struct tss_struct init_tss;		// CPU使用的唯一任务状态段。
 extern struct task_struct *last_task_used_math;	// 上一个使用过协处理器的进程。
 extern struct task_struct *current;		// 当前运行进程结构指针变量。
 extern unsigned long volatile jiffies;		// 从开机开始算起的滴答数（10ms/滴答）。
 extern unsigned long startup_time;		// 开机时间。从1970:0:0开始计时的秒数。
 extern int jiffies_offset;			// 用于累计需要调整的时间滴答数。
+extern int volatile need_resched;		// 需要重新调度的标志（见kernel/sched.c）。
 
 // 当前时间（秒数）。
 #define CURRENT_TIME (startup_time+(jiffies+jiffies_offset)/HZ)
 
+/*
+ * The kernel isn't preemptible, so long kernel loops call this at points
+ * where nothing is half-done. If the timer (or a wake-up of a real-time
+ * task) has asked for a reschedule, we give up the cpu right there.
+ */
+/*
+ * 内核态代码是不可抢占的，因此内核中耗时较长的循环在没有半完成的操作的位置调用它。
+ * 若时钟中断（或唤醒实时任务时）要求重新调度，就在这里让出CPU。
+ */
+#define cond_resched() \
+do { if (need_resched) schedule(); } while (0)
+
+
+// 添加定时器函数（定时时间ticks滴答数，定时到时调用函数*fn()）。定时器结构从内核
+// 定时器池中分配，到时后自动释放，因此不能被取消。（kernel/sched.c）
+extern void add_timer(long ticks, void (*fn)(void));
+
+// 把定时器timer设置为在jiffies值等于expires时到期。若它已在计时则先取消。（kernel/sched.c）
+extern void mod_timer(struct timer_list * timer, unsigned long expires);
+
+// 取消定时器timer。若它还在计时则返回1，否则返回0。（kernel/sched.c）
+extern int del_timer(struct timer_list * timer);
+
+// 把等待项wait加入等待队列q的头部（非互斥等待项）。（kernel/sched.c）
+extern void add_wait_queue(struct wait_queue ** q, struct wait_queue * wait);
 
-// 添加定时器函数（定时时间jiffies滴答数，定时到时调用函数*fn()）。（kernel/sched.c）
-extern void add_timer(long jiffies, void (*fn)(void));
+// 把等待项wait加入等待队列q的尾部（互斥等待项）。（kernel/sched.c）
+extern void add_wait_queue_exclusive(struct wait_queue ** q, struct wait_queue * wait);
+
+// 把等待项wait从其所在的等待队列中取下。（kernel/sched.c）
+extern void remove_wait_queue(struct wait_queue * wait);
 
 // 不可中断的等待睡眠。（kernel/sched.c）
-extern void sleep_on(struct task_struct ** p);
+extern void sleep_on(struct wait_queue ** q);
 
 // 可中断的等待睡眠。（kernel/sched.c）
-extern void interruptible_sleep_on(struct task_struct ** p);
+extern void interruptible_sleep_on(struct wait_queue ** q);
+
+// 不可中断的互斥等待睡眠。（kernel/sched.c）
+extern void sleep_on_exclusive(struct wait_queue ** q);
+
+// 可中断的互斥等待睡眠。（kernel/sched.c）
+extern void interruptible_sleep_on_exclusive(struct wait_queue ** q);
+
+// 唤醒等待队列上所有的进程。（kernel/sched.c）
+extern void wake_up_all(struct wait_queue ** q);
+
+// 唤醒等待队列上所有非互斥等待的进程和第1个互斥等待的进程。（kernel/sched.c）
+extern void wake_up_one(struct wait_queue ** q);
+
+// 设置当前任务的超时时间timeout（jiffies值），到时唤醒任务。0表示取消超时，
+// 0xffffffff表示永不超时。（kernel/sched.c）
+extern void set_timeout(unsigned long timeout);
+
+// 取高精度的当前时间（秒和微秒），精度约1微秒。（kernel/sched.c）
+extern void do_gettimeofday(struct timeval * tv);
+
+// 任务p收到信号后调用。若p正处于可中断睡眠状态并且有未被阻塞的信号，则唤醒它。
+// （kernel/sched.c）
+extern void signal_wake_up(struct task_struct * p);
 
-// 明确唤醒睡眠的进程。（kernel/sched.c）
-extern void wake_up(struct task_struct ** p);
+// 把任务p置为就绪状态并放入就绪队列。所有把任务置为TASK_RUNNING的地方都应使用它。
+// （kernel/sched.c）
+extern void wake_up_process(struct task_struct * p);
+
+// 把任务p加入（移出）其执行文件（lib = 0）或库文件（lib = 1）i节点的共享任务链表。
+// 页面共享时只需搜索这些链表。（mm/memory.c）
+extern void link_inode_task(struct task_struct * p, int lib);
+extern void unlink_inode_task(struct task_struct * p, int lib);
+
+// 进程号hash表。同一hash表项上的任务通过pidhash_next链接。
+#define PIDHASH_SZ	256
+#define pid_hashfn(x)	((((x) >> 8) ^ (x)) & (PIDHASH_SZ - 1))
+extern struct task_struct * pidhash[PIDHASH_SZ];
+
+// 把任务p加入（移出）进程号hash表。（kernel/fork.c）
+extern void hash_pid(struct task_struct * p);
+extern void unhash_pid(struct task_struct * p);
+
+// 按进程号查找任务，没有找到返回NULL。任务0不在hash表中。（kernel/fork.c）
+extern struct task_struct * find_task_by_pid(int pid);
+
+// 把任务p加入任务链表的尾部（任务0之前），或从任务链表中取下。
+#define SET_LINKS(p) do { \
+	(p)->next_task = FIRST_TASK; \
+	(p)->prev_task = FIRST_TASK->prev_task; \
+	FIRST_TASK->prev_task->next_task = (p); \
+	FIRST_TASK->prev_task = (p); \
+} while (0)
+
+#define REMOVE_LINKS(p) do { \
+	(p)->next_task->prev_task = (p)->prev_task; \
+	(p)->prev_task->next_task = (p)->next_task; \
+} while (0)
+
+// 遍历除任务0以外的所有任务。用来代替原来对任务数组task[]的扫描，扫描时间只与现有
+// 任务数有关，而与最多任务数NR_TASKS无关。
+#define for_each_task(p) \
+	for (p = FIRST_TASK ; (p = p->next_task) != FIRST_TASK ; )
 
 // 检查当前进程是否在指定的用户组grp中。
 extern int in_group_p(gid_t grp);
@@ -292,32 +454,24 @@ extern int in_group_p(gid_t grp);
  */
 // 从该英文注释可以猜想到，Linus当时曾想把系统调用的代码专门放到GDT表中第4个独立的段中。
 // 但后来并没有那样做，于是就一起把GDT表跌第4个描述符项（上面syscall项）闲置在一旁。
-// 下面定义全局表中第1个任务的状态段（TSS）和局部描述符表（LDT）的描述符的选择符索引号。
+// 现在整个系统只有一个TSS（init_tss），其描述符在GDT第4项；也只有一个LDT描述符，在
+// GDT第5项，每次任务切换时由switch_to()把它改写成指向新任务的LDT。因此任务数不再受
+// GDT表长度的限制。
 #define FIRST_TSS_ENTRY 4
 #define FIRST_LDT_ENTRY (FIRST_TSS_ENTRY+1)
 
-// 宏定义，计算在全局表中第n个任务的TSS段描述符的选择符值（偏移量）。
-// 因每个描述符占8字节，因此FIRST_TSS_ENTY<<3表示该描述符在GDT表中的起始偏移位置。
-// 因为每个任务使用1个TSS和1个LDT描述符，共占用16字节，因此需要n<<4来表示对应
-// TSS起始位置。该宏得到的值正好也是该TSS的选择符值。随后的宏定义用于计算在全局表中
-// 第n个任务的LDT段描述符的选择符值（偏移量）。
-#define _TSS(n) ((((unsigned long) n)<<4) + (FIRST_TSS_ENTRY<<3))
-#define _LDT(n) ((((unsigned long) n)<<4) + (FIRST_LDT_ENTRY<<3))
-
-// 下面宏定义用于把第n个任务的TSS段选择符加载到任务寄存器TR中。
-// 随后一个宏则用于把第n个任务的LDT段选择符加载到局部描述符表寄存器LDTR中。
-#define ltr(n) __asm__("ltr %%ax"::"a" (_TSS(n)))
-#define lldt(n) __asm__("lldt %%ax"::"a" (_LDT(n)))
-
-// 取当前运行任务的任务号（是任务数组中的索引值，与进程号pid不同）。
-// 返回：n - 当前任务号。用于（kernel/traps.c，第78行）。
-#define str(n) \
-__asm__("str %%ax\n\t" 		/* 将任务寄存器中TSS段的选择符复制到ax中 	*/\
-	"subl %2,%%eax\n\t"	/* （eax - FIRST_TSS_ENTRY*8） -> eax 	*/\
-	"shrl $4,%%eax"		/* （eax/16）-> eax = 当前任务号 		*/\
-	:"=a" (n) 							  \
-	:"a" (0),"i" (FIRST_TSS_ENTRY<<3))
+// 宏定义，计算TSS段描述符和LDT段描述符的选择符值（偏移量）。因每个描述符占8字节，
+// 因此FIRST_TSS_ENTY<<3表示该描述符在GDT表中的起始偏移位置。
+#define _TSS (FIRST_TSS_ENTRY<<3)
+#define _LDT (FIRST_LDT_ENTRY<<3)
+
+// 下面宏定义用于把TSS段选择符加载到任务寄存器TR中。
+// 随后一个宏则用于把LDT段选择符加载到局部描述符表寄存器LDTR中。
+#define ltr() __asm__("ltr %%ax"::"a" (_TSS))
+#define lldt() __asm__("lldt %%ax"::"a" (_LDT))
 
+// 任务结构中tss字段各成员的偏移量，供switch_to()中的汇编语句使用。
+#define TSS_OFFSET(field) ((long) &((struct task_struct *) 0)->tss.field)
 
 /*
  *	switch_to(n) should switch tasks to task nr n, first
@@ -330,32 +484,56 @@ __asm__("str %%ax\n\t" 		/* 将任务寄存器中TSS段的选择符复制到ax
  * 如果是则什么也不做退出。如果我们切换到的任务最近（上次运行）使用过数学
  * 协处理器的话，则还需复位控制寄存器cr0中的TS标志。
  */
-// 跳转到一个任务的TSS段选择符组成的地址处会造成CPU进行任务切换操作。
-// 输入：%0 - 指向__tmp;		%1 - 指向__tmp.b处，用于存放新TSS的选择符；
-// 	DX - 新任务n的TSS段选择符；ECX - 新任务n的任务结构指针task[n]。
-// 其中临时数据结构__tmp用于组建228行远跳转（FAR JUMP）指令的操作数。访操作数由4字节
-// 偏移地址和2字节的段选择符组成。因此__tmp中a的值是32位偏移值，而b的低2字节是新
-// TSS段的选择符（高2字节不用）。跳转到TSS段选择符会造成任务切换到该TSS对应的进程。
-// 对于造成任务切换的长跳转，a值无用。228行上的间接跳转指令使用6字节操作数作为跳转目
-// 的地的长指针，其格式为：JMP 16位段选择符：32位偏移值。
-// 任务切换回来之后，在判断原任务上次执行是否使用过协处理器时，是通过将原任务指针与保存
-// 在last_task_used_math变量中的上次使用过协处理器任务指针进行比较而作出的，参见文件
-// kernel/sched.c中有关math_state_restore()函数的说明。
+// 原来这里通过长跳转到新任务的TSS段选择符，由CPU完成任务切换（保存和加载整个TSS）。
+// 现在改为在内核栈上用软件切换：把标志寄存器、ebp、fs和gs压入当前任务的内核栈，在
+// 当前任务的tss.esp和tss.eip中保存栈指针和恢复执行地址（标号2），然后换到新任务的内核
+// 栈，把新任务的内核栈顶esp0写入init_tss，加载新任务的LDT，最后跳转到新任务的tss.eip
+// 处继续执行。其余通用寄存器由gcc根据破坏描述自行保存。新创建的任务第1次运行时跳转到
+// sys_call.s中的ret_from_fork处。
+// 每个任务都有自己的页目录表（tss.cr3），切换时要把它加载到cr3中。内核对等映射所在
+// 的头1GB在所有页目录中都相同，因此换页目录前后内核栈都可以继续访问。GDT中唯一的LDT
+// 描述符在进入汇编之前先改成指向新任务的LDT，再由lldt重新加载。
+// CPU切换任务时会自动置位cr0中的TS标志，软件切换时则要自己做：如果新任务就是上次使用
+// 过协处理器的任务则清除TS标志，否则置位TS，让新任务第1次使用协处理器时引起异常7，
+// 参见kernel/sched.c中有关math_state_restore()函数的说明。
+// 输入：ECX - 新任务n的任务结构指针。
 #define switch_to(n) {				\
-struct {long a, b} __tmp; 			\
-__asm__("cmpl %%ecx,current\n\t" 	/* 任务n是当前任务吗？（current==task[n]?）	*/\
+long __d0; 					\
+set_ldt_desc(gdt+FIRST_LDT_ENTRY, &(n)->ldt);	\
+__asm__ __volatile__("cmpl %%ecx,current\n\t"	/* 任务n是当前任务吗？ 		*/\
 	"je 1f\n\t"			/* 是，则什么都不做，退出 			*/\
-	"movw %%dx,%1\n\t"		/* 将新任务TSS的16位选择符存入__tmp.b中 	*/\
-	"xchgl %%ecx,current\n\t"	/* current = task[n]; ecx = 被切换出的任务 */\
-	"ljmp %0\n\t"			/* 执行长跳转至*&__tmp，造成任务切换 	*/\
-					/* 在任务切换回来后才会继续执行下面的语句 	*/\
-	"cmpl %%ecx,last_task_used_math\n\t" 	/* 原任务上次使用过协处理器吗？ 	*/\
-	"jne 1f\n\t" 			/* 没有则跳转，退出 			*/\
-	"clts\n"			/* 原任务上次使用过协处理器，则清cr0中的任务 	*/\
-	"1:"				/* 切换标志TS 				*/\
-	::"m" (*&__tmp.a),"m" (*&__tmp.b), 	\
-	"d" (_TSS(n)),"c" ((long) task[n])); 	\
-__asm__("":::"ecx");	/* ecx被修改过，添加这一句不一定有用，但应该也不会有什么破坏性 */ \
+	"pushfl\n\t"			/* 保存标志寄存器、ebp、fs和gs 		*/\
+	"pushl %%ebp\n\t" 		\
+	"push %%fs\n\t" 		\
+	"push %%gs\n\t" 		\
+	"movl current,%%eax\n\t" 	\
+	"movl %%esp,%c2(%%eax)\n\t"	/* 保存原任务的内核栈指针和恢复执行地址 	*/\
+	"movl $2f,%c3(%%eax)\n\t" 	\
+	"movl %%ecx,current\n\t"	/* current = n 				*/\
+	"movl %c2(%%ecx),%%esp\n\t"	/* 换到新任务的内核栈 			*/\
+	"movl %c7(%%ecx),%%eax\n\t"	/* 加载新任务的页目录表 			*/\
+	"movl %%eax,%%cr3\n\t" 	\
+	"movl %c4(%%ecx),%%eax\n\t"	/* init_tss.esp0 = n->tss.esp0 		*/\
+	"movl %%eax,%6\n\t" 		\
+	"lldt %c5(%%ecx)\n\t"		/* 加载新任务的LDT 			*/\
+	"cmpl %%ecx,last_task_used_math\n\t" 	/* 新任务上次使用过协处理器吗？ 	*/\
+	"je 3f\n\t" 			\
+	"movl %%cr0,%%eax\n\t"		/* 没有则置位cr0中的TS标志 		*/\
+	"orl $8,%%eax\n\t" 		\
+	"movl %%eax,%%cr0\n\t" 		\
+	"jmp *%c3(%%ecx)\n" 		/* 跳转到新任务的恢复执行地址处 		*/\
+	"3:\tclts\n\t"			/* 使用过则清除TS标志 			*/\
+	"jmp *%c3(%%ecx)\n" 		\
+	"2:\tpop %%gs\n\t"		/* 任务切换回来后从这里继续执行 		*/\
+	"pop %%fs\n\t" 			\
+	"popl %%ebp\n\t" 		\
+	"popfl\n" 			\
+	"1:" 				\
+	:"=c" (__d0) 			\
+	:"0" ((long) (n)), "i" (TSS_OFFSET(esp)), "i" (TSS_OFFSET(eip)), \
+	 "i" (TSS_OFFSET(esp0)), "i" (TSS_OFFSET(ldt)), "m" (init_tss.esp0), \
+	 "i" (TSS_OFFSET(cr3)) \
+	:"ax","bx","dx","si","di","memory"); \
 }
 // 页面地址对准。（在内核代码中没有任何地方引用！！）
 #define PAGE_ALIGN(n) (((n)+0xfff)&0xfffff000)
@@ -92,6 +92,13 @@ extern int sys_symlink();			// 83 - 建立符号链接。
 extern int sys_lstat();				// 84 - 取符号链接文件状态。
 extern int sys_readlink();			// 85 - 读取符号链接文件信息。
 extern int sys_uselib();			// 86 - 选择共享库。
+extern int sys_swapd();				// 87 - 页面换出守护进程（仅init调用）。
+extern int sys_nanosleep();			// 88 - 高精度睡眠。
+extern int sys_sched_setscheduler();		// 89 - 设置进程调度策略和实时优先级。
+extern int sys_sched_getscheduler();		// 90 - 取得进程调度策略。
+extern int sys_mmap();				// 91 - 映射文件到内存。
+extern int sys_munmap();			// 92 - 解除内存映射。
+extern int sys_sendfile();			// 93 - 在文件之间直接复制数据。
 
 
 typedef int (*fn_ptr)();			// 本来定义在sched.h中
@@ -112,7 +119,9 @@ sys_getpgrp, sys_setsid, sys_sigaction, sys_sgetmask, sys_ssetmask,
 sys_setreuid, sys_setregid, sys_sigsuspend, sys_sigpending, sys_sethostname,
 sys_setrlimit, sys_getrlimit, sys_getrusage, sys_gettimeofday,
 sys_settimeofday, sys_getgroups, sys_setgroups, sys_select, sys_symlink,
-sys_lstat, sys_readlink, sys_uselib };
+sys_lstat, sys_readlink, sys_uselib, sys_swapd, sys_nanosleep,
+sys_sched_setscheduler, sys_sched_getscheduler, sys_mmap, sys_munmap,
+sys_sendfile };
 
 /* So we don't have to do any more manual updating.... */
 /* 下面这样定义后，我们就无需手工更新系统调用数目了 */
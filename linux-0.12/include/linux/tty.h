@@ -31,7 +31,7 @@ struct tty_queue {
 						// 对于串口终端，则存放串行端口地址。
 	unsigned long head;			// 缓冲区中数据头指针。
 	unsigned long tail;			// 缓冲区中数据尾指针。
-	struct task_struct * proc_list;		// 等待本队列的进程列表。
+	struct wait_queue * proc_list;		// 等待本队列的进程列表。
 	char buf[TTY_BUF_SIZE];			// 队列的缓冲区。
 };
 
@@ -0,0 +1,23 @@
+#ifndef _POSIX_SCHED_H
+#define _POSIX_SCHED_H
+
+#include <sys/types.h>
+
+/* Scheduling policies */
+/* 调度策略 */
+#define SCHED_OTHER	0		/* 普通分时任务，按counter和priority调度 */
+#define SCHED_FIFO	1		/* 先进先出实时任务，一直运行到自己放弃CPU */
+#define SCHED_RR	2		/* 时间片轮转实时任务 */
+
+// 实时任务静态优先级的取值范围。数值越大优先级越高。
+#define SCHED_PRIO_MIN	1
+#define SCHED_PRIO_MAX	31
+
+struct sched_param {
+	int sched_priority;		// 实时优先级。SCHED_OTHER时必须为0。
+};
+
+int sched_setscheduler(pid_t pid, int policy, const struct sched_param * param);
+int sched_getscheduler(pid_t pid);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef _SYS_MMAN_H
+#define _SYS_MMAN_H
+
+#include <sys/types.h>
+
+/* Protection of the mapped pages */
+/* 映射页面的访问权限 */
+#define PROT_NONE	0x0		/* 不能访问（本内核中按只读处理） */
+#define PROT_READ	0x1		/* 可读 */
+#define PROT_WRITE	0x2		/* 可写 */
+#define PROT_EXEC	0x4		/* 可执行（与可读相同） */
+
+/* Mapping type and flags */
+/* 映射类型和标志 */
+#define MAP_SHARED	0x01		/* 共享映射：写入的内容对其他映射者可见，并写回文件 */
+#define MAP_PRIVATE	0x02		/* 私有映射：写时复制，写入的内容不写回文件 */
+#define MAP_TYPE	0x0f		/* 映射类型屏蔽码 */
+#define MAP_FIXED	0x10		/* 必须映射在指定地址处 */
+
+// mmap()出错时的返回值。
+#define MAP_FAILED	((void *) -1)
+
+void * mmap(void * addr, size_t len, int prot, int flags, int fd, off_t off);
+int munmap(void * addr, size_t len);
+
+#endif
@@ -8,6 +8,13 @@ struct timeval {
         long    tv_usec;        /* microseconds */
 };
 
+/* nanosleep() takes this */
+/* nanosleep()函数使用该时间结构 */
+struct timespec {
+        long    tv_sec;         /* seconds */
+        long    tv_nsec;        /* nanoseconds */
+};
+
 // 时间区结构。tz为时区（Time Zone）的缩写，DST（Daylight Saving Time）是夏令时的缩写。
 struct timezone {
         int     tz_minuteswest; /* minutes west of Greenwich / 格林威治西部分钟时间 */
@@ -55,6 +62,7 @@ struct timezone {
 #include <sys/types.h>
 
 int gettimeofday(struct timeval * tp, struct timezone * tz);
+int nanosleep(const struct timespec * req, struct timespec * rem);
 int select(int width, fd_set * readfds, fd_set * writefds,
 	   fd_set * exceptfds, struct timeval * timeout);
 
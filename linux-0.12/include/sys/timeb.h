@@ -0,0 +1,17 @@
+#ifndef _SYS_TIMEB_H
+#define _SYS_TIMEB_H
+
+#include <sys/types.h>
+
+/* ftime() returns this */
+/* ftime()函数返回该时间结构 */
+struct timeb {
+	time_t time;			// 从1970年1月1日0时开始计的秒数。
+	unsigned short millitm;		// 毫秒数。
+	short timezone;			// 距格林尼治标准时间以西的分钟数。
+	short dstflag;			// 夏令时标志。
+};
+
+int ftime(struct timeb * tp);
+
+#endif
@@ -161,6 +161,13 @@
 #define __NR_lstat	84
 #define __NR_readlink	85
 #define __NR_uselib	86
+#define __NR_swapd	87
+#define __NR_nanosleep	88
+#define __NR_sched_setscheduler	89
+#define __NR_sched_getscheduler	90
+#define __NR_mmap	91
+#define __NR_munmap	92
+#define __NR_sendfile	93
 
 // 以下字义系统调用嵌入式汇编宏函数。
 // 不带参数的系统调用宏函数。type name(void)。
@@ -303,6 +310,8 @@ int getrlimit(int resource, struct rlimit *rlp);
 int getrusage(int who, struct rusage * rusage);
 int gettimeofday(struct timeval *tv, struct timezone *tz);
 int settimeofday(struct timeval *tv, struct timezone *tz);
+int nanosleep(const struct timespec *req, struct timespec *rem);
+int sendfile(int out_fd, int in_fd, off_t count);
 int getgroups(int gidsetlen, gid_t * gidset);
 int setgroups(int gidsetlen, gid_t * gidset);
 int select(int width, fd_set * readfds, fd_set * writefds,
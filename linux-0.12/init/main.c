@@ -40,6 +40,7 @@
 // int pause()系统调用：暂停进程的执行，直到收到一个信号。
 // int setup(void * BIOS)系统调用，仅用于linux初始化（仅在这个程序中被调用）。
 // int sync()系统调用：更新文件系统。
+// int swapd()系统调用：页面换出守护进程，不会返回（仅在这个程序中被调用）。
 /* static */
 inline _syscall0(int,fork)
 /* static */
@@ -48,6 +49,8 @@ inline _syscall0(int,pause)
 static inline _syscall1(int,setup,void *,BIOS)
 /* static */
 inline _syscall0(int,sync)
+/* static */
+static inline _syscall0(int,swapd)
 
 #include <linux/tty.h>          // tty头文件，定义了有关tty_io，串行通信方面的参数、常数。
 #include <linux/sched.h>        // 调度程序头文件，定义了任务结构 task_struct、第1个被始任务
@@ -82,6 +85,7 @@ extern void chr_dev_init();             // 字符设备初始化（chr_drv/tty_i
 extern void hd_init(void);              // 硬盘初始化程序（blk_drv/hd.c,378行）
 extern void floppy_init();              // 软驱初始化程序（blk_drv/floppy.c,469行）
 extern void mem_init(long start, long end);     // 内存管理初始化（mm/memory.c,443行）
+extern long kernel_map_init(long start, long end);// 建立64MB以上内存的对等映射（mm/memory.c）
 extern long rd_init(long mem_start, int length);// 虚拟盘初始化（blk_drv/ramdisk.c,52行）
 extern long kernel_mktime(struct tm * tm);      // 计算开机时间（kernel/mktime.c,41行）
 
@@ -107,6 +111,8 @@ extern long kernel_mktime(struct tm * tm);      // 计算开机时间（kernel/m
 // 这些指定地址处内存值的含义请参见第6章的表6-3（setup程序读取并保存的参数）。
 // drive_info结构请参见下面第125行。
 #define EXT_MEM_K (*(unsigned short *)0x90002)	       	/* 1MB以后的扩展内存大小（KB） */
+#define EXT_MEM_E801_K (*(unsigned short *)0x90010)	/* E801: 1MB--16MB的扩展内存（KB） */
+#define EXT_MEM_E801_64K (*(unsigned short *)0x90012)	/* E801: 16MB以上的内存（64KB块数） */
 #define CON_ROWS ((*(unsigned short *)0x9000e) & 0xff)	/* 选定的控制台屏幕行、列数 */ 
 #define CON_COLS (((*(unsigned short *)0x9000e) &0xff00) >> 8)
 #define DRIVE_INFO (*(struct drive_info *)0x90080) 	/* 硬盘参数表32字节内容 */ 
@@ -207,17 +213,35 @@ void _main(void)         /* This really IS void, no error here. */
 // 接着根据机器物理内存容量设置调整缓冲区和主内存区的位置和范围。
 // 高速缓存末端地址->buffer_memory_end; 机器内存容量->memory_end;
 // 主内存开始地址->main_memory_start;
-        memory_end = (1<<20) + (EXT_MEM_K<<10); // 内存大小=1MB + 扩展内存（K）*1024字节。
+// 若BIOS支持E801功能（setup.s中取得的值不为0），则优先使用它的结果，因为0x88功能最多
+// 只能报告64MB的扩展内存。内存容量最多只能使用到内核能对等映射的HIGH_MEMORY_LIMIT
+// （1GB），因为用户任务的线性空间从1GB处开始（见TASK_BASE）。这是本内核明确的限制：
+// 超过1GB的物理内存被忽略。
+        if (EXT_MEM_E801_K) {
+                if (EXT_MEM_E801_64K >= (HIGH_MEMORY_LIMIT>>16))
+                        memory_end = HIGH_MEMORY_LIMIT;
+                else
+                        memory_end = (1<<20) + (EXT_MEM_E801_K<<10) +
+                                (EXT_MEM_E801_64K<<16);
+        } else
+                memory_end = (1<<20) + (EXT_MEM_K<<10); // 内存大小=1MB + 扩展内存（K）*1024字节。
         memory_end &= 0xfffff000;               // 忽略不到4KB(1页)的内存数。
-        if (memory_end > 16*1024*1024)          // 如果内存量走过16MB，则按16MB计。
-                memory_end = 16*1024*1024;
-        if (memory_end > 12*1024*1024)          // 如果内存>12MB,则设置缓冲区末端=4MB
+        if (memory_end > HIGH_MEMORY_LIMIT)     // 如果内存量超过1GB，则按1GB计。
+                memory_end = HIGH_MEMORY_LIMIT;
+        if (memory_end > 32*1024*1024)          // 如果内存>32MB,则设置缓冲区末端=8MB
+                buffer_memory_end = 8*1024*1024;
+        else if (memory_end > 12*1024*1024)     // 否则若内存>12MB,则设置缓冲区末端=4MB
                 buffer_memory_end = 4*1024*1024;
         else if (memory_end > 6*1024*1024)      // 否则若内存>6MB,则设置缓冲区末端=2MB
                 buffer_memory_end = 2*1024*1024;
         else                                    // 否则则设置缓冲区末端=1MB
                 buffer_memory_end = 1*1024*1024;
         main_memory_start = buffer_memory_end;  // 主内存起始位置 = 缓冲区末端。
+// 缓冲块头结构数组不再放在内核代码之后的低端内存中，而是从主内存区开始处分配，这样
+// 高速缓冲区较大时也不会挤占640KB以下的空间。参见fs/buffer.c。
+        main_memory_start += buffer_head_init(main_memory_start, buffer_memory_end);
+// 若内存超过head.s已对等映射的64MB，则接着为其余内存建立内核页表。
+        main_memory_start += kernel_map_init(main_memory_start, memory_end);
 
 // 如果在Makefile文件中定义了内存虚拟符号 RAMDISK，则初始化虚拟盘。此时主内存将减少。
 // 参见kernel/blk_drv/ramdisk.c。
@@ -294,6 +318,11 @@ void init(void)
 // kernel/blk_drv/hd.c:74行。
         setup((void*) &drive_info);
 
+// 创建页面换出守护进程（任务2）。它在内核中循环，当空闲页面低于低水位线时被唤醒，
+// 在后台成批地换出页面。参见mm/swap.c中的sys_swapd()。
+        if (!fork())
+                swapd();
+
 // 下面以读写访问方式打开设备“/dev/tty0”，它对应终端控制台。由于这是第一次打开文件
 // 操作，因此产生的文件句柄号（文件描述符）肯定是0。该句柄是UNIX类操作系统默认的控
 // 制台标准输入句柄stdin(0)。这里再把它以读和写的方式分别打开是为了复制产生标准输出
@@ -308,14 +337,14 @@ void init(void)
                 NR_BUFFERS*BLOCK_SIZE);
         printf("Free mem: %d bytes\n\r",memory_end-main_memory_start);
 
-// 下面再创建一个子进程（任务2），并在该子进程中运行/etc/rc文件中的命令。对于被创建的子
+// 下面再创建一个子进程（任务3），并在该子进程中运行/etc/rc文件中的命令。对于被创建的子
 // 进程，fork()将返回0值，对于原进程（父进程）则返回子进程的进程号pid。所以第202-206行
 // 是子进程中执行的代码。该子进程的代码首先把标准输入stdint重定向到/etc/rc文件，然后使用
 // execve()函数运行/bin/sh程序。该程序从标准输入中读取rc文件中命令，并以解释方式执行
 // 之。sh运行时所携带的参数和环境变量分别由argv_rc和envp_rc数组给出。
 // 关闭句柄0并立刻打开/etc/rc文件的作用是把标准输入stdin重新定向到/etc/rc文件。这样通过
 // 控制台读操作就可以读取/etc/rc文件中的内容。由于这里sh的运行方式是非交互式的。因此在
-// 执行完rc文件后就会立刻退出，进程2也会随之结束。关于execve()函数说明请参见fs/exec.c
+// 执行完rc文件后就会立刻退出，进程3也会随之结束。关于execve()函数说明请参见fs/exec.c
 // 程序，207行。函数_exit()退出时的出错码1-操作未许可；2-文件或目录不存在。
         if(!(pid=fork())) {
                 close(0);
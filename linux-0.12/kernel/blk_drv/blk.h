@@ -42,7 +42,7 @@ struct request {
         unsigned long sector;           // 起始扇区。（1块=2扇区）
         unsigned long nr_sectors;       // 读/写扇区数。
         char * buffer;                  // 数据缓冲区。
-        struct task_struct * waiting;   // 任务等待请求完成操作的地方（队列）。
+        struct wait_queue * waiting;    // 任务等待请求完成操作的地方（队列）。
         struct buffer_head * bh;        // 缓冲区头指针（include/linux/fs.h，73）。
         struct request * next;          // 指向下一请求项。
 };
@@ -76,7 +76,7 @@ extern struct blk_dev_struct blk_dev[NR_BLK_DEV];
 // 请求项数组，共32项。
 extern struct request request[NR_REQUEST];
 // 等待空闲请求项的进程队列头指针。
-extern struct task_struct * wait_for_request;
+extern struct wait_queue * wait_for_request;
 
 // 一个块设备上数据块总数指针数组。每个指针项指向指定主设备号的总块数数组hd_sizes[]
 // （blk_drv/hd.c，62行）。该总块数数组每一项对应一个子设备上所拥有的数据块总数
@@ -113,6 +113,9 @@ extern int * blk_size[NR_BLK_DEV];
 #define DEVICE_NAME "floppy"
 /* 设备中断处理函数 */
 #define DEVICE_INTR do_floppy
+/* 设备超时定时器及其处理函数 */
+#define DEVICE_TIMEOUT floppy_timeout
+#define DEVICE_TIMEOUT_FN floppy_times_out
 /* 设备请求项处理函数 */
 #define DEVICE_REQUEST do_fd_request
 /* 子设备号（0 - 3） */
@@ -131,6 +134,7 @@ extern int * blk_size[NR_BLK_DEV];
 #define DEVICE_INTR do_hd
 /* 设备超时值 */
 #define DEVICE_TIMEOUT hd_timeout
+#define DEVICE_TIMEOUT_FN hd_times_out
 /* 设备请求项处理函数 */
 #define DEVICE_REQUEST do_hd_request
 /* 硬盘设备号（0 - 1） */
@@ -156,10 +160,13 @@ extern int * blk_size[NR_BLK_DEV];
 #ifdef DEVICE_INTR
 void (*DEVICE_INTR)(void) = NULL;
 #endif
-// 如果定义了设备超时符号，则定义同名变量，并令其值等于0，并定义SET_INTR()宏。
+// 如果定义了设备超时符号，则定义同名的定时器，到时调用DEVICE_TIMEOUT_FN，并定义
+// SET_INTR()宏。设置中断处理函数的同时启动200个滴答的超时定时，设备在此之前发出中断
+// 时，中断处理程序（kernel/sys_call.s）会用del_timer()取消该定时器。
 #ifdef DEVICE_TIMEOUT
-int DEVICE_TIMEOUT = 0;
-#define SET_INTR(x) (DEVICE_INTR = (x), DEVICE_TIMEOUT = 200)
+static void (DEVICE_TIMEOUT_FN)(unsigned long);
+struct timer_list DEVICE_TIMEOUT = { NULL, NULL, NULL, 0, 0, DEVICE_TIMEOUT_FN };
+#define SET_INTR(x) (DEVICE_INTR = (x), mod_timer(&DEVICE_TIMEOUT, jiffies + 200))
 #else
 #define SET_INTR(x) (DEVICE_INTR = (x))
 #endif
@@ -175,7 +182,7 @@ static inline void unlock_buffer(struct buffer_head * bh)
         if (!bh->b_lock)
                 printk(DEVICE_NAME ":free buffer being unlocked\n");
         bh->b_lock = 0;
-        wake_up(&bh->b_wait);
+        wake_up_all(&bh->b_wait);
 }
 
 // 结束请求处理“宏”。
@@ -184,6 +191,8 @@ static inline void unlock_buffer(struct buffer_head * bh)
 // 区数据更新标志，并解锁该缓冲区。如果更新标志参数值是0，表示此次请求项的操作已失
 // 败，因此显示相关块设备IO错误信息。最后，唤醒等待该请求项的进程以及等待空闲请求
 // 项出现的进程，释放并从请求链表中删除本请求项，并把当前请求项指针指向下一请求项。
+// 若有进程在等待该请求项（ll_rw_page()），则请求项由被唤醒的进程在把自己从waiting
+// 队列上取下之后再释放，以免请求项被重用时其waiting队列还挂着原来的等待项。
 /* extern inline void end_request(int uptodate) */
 static inline void end_request(int uptodate)
 {
@@ -197,16 +206,19 @@ static inline void end_request(int uptodate)
                 printk("dev %04x, block %d\n\r", CURRENT->dev,
                         CURRENT->bh->b_blocknr);
         }
-        wake_up(&CURRENT->waiting);                     // 唤醒等待该请求项的进程。
-        wake_up(&wait_for_request);                     // 唤醒等待空闲请求项的进程。
-        CURRENT->dev = -1;                              // 释放该请求项。
+        if (CURRENT->waiting)
+                wake_up_all(&CURRENT->waiting);         // 唤醒等待该请求项的进程。
+        else {
+                CURRENT->dev = -1;                      // 释放该请求项。
+                wake_up_one(&wait_for_request);         // 唤醒等待空闲请求项的进程。
+        }
         CURRENT = CURRENT->next;                        // 指向下一请求项。
 }
 
 // 如果定义了设备超时符号常量DEVICE_TIMEOUT，则定义CLEAR_DEVICE_TIMEOUT符号常量
-// 为“DEVICE_TIMEOUT = 0”。否则定义CLEAR_DEVICE_TIMEOUT为空。
+// 为“del_timer(&DEVICE_TIMEOUT);”。否则定义CLEAR_DEVICE_TIMEOUT为空。
 #ifdef DEVICE_TIMEOUT
-#define CLEAR_DEVICE_TIMEOUT DEVICE_TIMEOUT = 0;
+#define CLEAR_DEVICE_TIMEOUT del_timer(&DEVICE_TIMEOUT);
 #else
 #define CLEAR_DEVICE_TIMEOUT
 #endif
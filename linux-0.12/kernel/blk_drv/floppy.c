@@ -190,7 +190,7 @@ static unsigned char seek_track = 0;	       		// 寻道磁道号。
 static unsigned char current_track = 255;      		// 当前磁头所在磁道号。
 static unsigned char command = 0;			// 读/写命令。
 unsigned char selected = 0; 				// 软盘已选定标志。在处理请求项之前要首先选定软驱。
-struct task_struct * wait_on_floppy_select = NULL;  	// 等待选定软驱的任务队列。 
+struct wait_queue * wait_on_floppy_select = NULL;  	// 等待选定软驱的任务队列。 
 
 //// 取消选定软驱。
 // 如果函数参数指定的软驱nr当前并没有被选定，则显示警告信息。然后复位软驱已选定标志
@@ -201,7 +201,7 @@ void floppy_deselected(unsigned int nr)
 	if (nr != (current_DOR &3))
 		printk("floppy_deselected: drive not selected\n\r");
 	selected = 0;					// 复位软驱已选定标志。
-	wake_up(&wait_on_floppy_select);		// 唤醒等待的任务。
+	wake_up_all(&wait_on_floppy_select);		// 唤醒等待的任务。
 }
 
 /*
@@ -440,7 +440,7 @@ static void rw_interrupt(void)
 static inline void setup_rw_floppy(void)
 {
 	setup_DMA();			// 初始化软盘DMA通道。
-	do_floppy = rw_interrupt;	// 置软盘中断调用函数指针。
+	SET_INTR(rw_interrupt);	// 置软盘中断调用函数指针。
 	output_byte(command);		// 发送命令字节。
 	output_byte(head<<2 | current_drive); // 参数：磁头号+驱动器号。
 	output_byte(track);		      // 参数：磁道号。
@@ -524,7 +524,7 @@ static void transfer(void)
 	        setup_rw_floppy();		// 发送命令参数块。
 		return;
 	}
-	do_floppy = seek_interrupt;		// 寻道中断调用的C函数。
+	SET_INTR(seek_interrupt);		// 寻道中断调用的C函数。
 	if (seek_track) {			// 起始磁道号。
 		output_byte(FD_SEEK);		// 发送碰头寻道命令。
 		output_byte(head<<2 | current_drive);	// 发送参数：磁头号+当前软驱号。
@@ -569,6 +569,20 @@ void unexpected_floppy_interrupt()
 		recalibrate = 1;		    // 否则置重新校正标志。
 }
 
+//// 软盘操作超时处理函数。
+// 本函数是超时定时器floppy_timeout的处理函数（见blk.h）。在向软盘控制器发送命令后若
+// 经过200个滴答还没有产生软盘中断，就会被调用。此时按一次出错处理：清除中断调用函数
+// 指针，累计出错次数并视情况设置复位或重新校正标志，然后再执行软盘请求项操作。
+static void floppy_times_out(unsigned long unused)
+{
+	do_floppy = NULL;
+	if (!CURRENT)
+		return;
+	printk("Floppy timeout\n\r");
+	bad_flp_intr();
+	do_fd_request();
+}
+
 //// 软盘重新校正处理函数。
 // 首先复位重新校正标志，并向软盘控制器FDC发送重新校正命令和参数。当软盘控制器执行完
 // 重新校正命令，就会在其引发的软盘中断中调用recal_interrupt()函数。
@@ -576,7 +590,7 @@ static void recalibrate_floppy(void)
 {
 	recalibrate = 0;			    // 复位重新校正标志。
 	current_track = 0;			    // 当前磁道号归零。
-	do_floppy = recal_interrupt;		    // 指向重新校正中断调用的C函数。
+	SET_INTR(recal_interrupt);		    // 指向重新校正中断调用的C函数。
 	output_byte(FD_RECALIBRATE);		    // 命令：重新校正。
 	output_byte(head<<2 | current_drive);	    // 参数：磁头号 + 当前驱动器号。
 // 若上面任何一个output_byte()操作执行出错，则复位标志reset就会被置位。因此这里我们需
@@ -618,7 +632,7 @@ static void reset_floppy(void)
 	recalibrate = 1;			    // 重新校正标志置位。
 	printk("Reset-floppy called\n\r");	    // 显示执行软盘复位操作信息。
 	cli();					    // 关中断。
-	do_floppy = reset_interrupt;		    // 设置在中断处理程序中调用的函数。
+	SET_INTR(reset_interrupt);		    // 设置在中断处理程序中调用的函数。
 	outb_p(current_DOR & ~0x04, FD_DOR);	    // 对软盘控制FDC执行复位操作。
 	for (i = 0; i < 100; i++)		    // 空操作，延迟。
 		__asm__("nop");
@@ -508,13 +508,13 @@ static void recal_intr(void)
 }
 
 //// 硬盘操作超时处理函数。
-// 本函数会在do_timer()中（kernel/sched.c，第340行）被调用。在向硬盘控制器发送了
-// 一个命令后，若在经过了hd_timeout个系统嘀嗒后控制器还没有发出一个硬盘中断信号，
-// 则说明控制器（或硬盘）操作超时。此时do_timer()函数就会调用本函数来设置复位标志
-// reset，并调用do_hd_request()执行复位处理。若在预定时间内（200嘀嗒）硬盘控制器
-// 发出了硬盘中断并开始执行硬盘中断处理程序，那么hd_time_out值就会在中断处理程序
-// 中被置0。此时do_timer()就会跳过本函数。
-void hd_times_out(void)
+// 本函数是超时定时器hd_timeout的处理函数（见blk.h），由时钟中断中的定时器处理调用。
+// 在向硬盘控制器发送了一个命令后，若在经过了200个系统嘀嗒后控制器还没有发出一个硬
+// 盘中断信号，则说明控制器（或硬盘）操作超时。此时就会调用本函数来设置复位标志
+// reset，并调用do_hd_request()执行复位处理。若在预定时间内硬盘控制器发出了硬盘中
+// 断并开始执行硬盘中断处理程序，那么中断处理程序就会用del_timer()取消该定时器，
+// 本函数也就不会被调用。
+static void hd_times_out(unsigned long unused)
 {
 // 如果当前并没有请求项处理（设备请求项指针为NULL），则无超时可言，直接返回。否
 // 则先显示警告信息，然后判断当前请求项执行过程中发生的出错次数是否已经大于设定值
@@ -29,7 +29,10 @@ struct request request[NR_REQUEST];
  *
  * 是用于在请求数组没有空闲项时进程的临时等待处。
  */
-struct task_struct * wait_for_request = NULL;
+// 释放一个请求项时只唤醒一个互斥等待的进程（wake_up_one()）。读请求可以使用任何空闲
+// 项，因此以互斥方式等待；写请求只能使用前2/3的请求项，被唤醒时未必能用上刚释放的那
+// 一项，因此以非互斥方式等待，每次都会被唤醒。
+struct wait_queue * wait_for_request = NULL;
 
 /* blk_dev_struct is:
  *	do_request-address
@@ -77,7 +80,7 @@ static inline void unlock_buffer(struct buffer_head * bh)
 	if (!bh->b_lock)		// 如果该缓冲区没有被锁定，则打印出错信息。
 		printk("ll_rw_block.c: buffer not locked\n\r");
 	bh->b_lock = 0;			// 清锁定标志。
-	wake_up(&bh->b_wait);		// 唤醒等待该缓冲区的任务。
+	wake_up_all(&bh->b_wait);	// 唤醒等待该缓冲区的任务。
 }
 
 /*
@@ -190,6 +193,8 @@ repeat:
 	// 如果没有一项是空闲的（此时请求项数组指针已经搜索越过头部），则查看此次请求是否是提前
 	// 读/写（READA或WRITEA），如果是则放弃此次请求操作。否则让本次请求操作先睡眠（以等待
 	// 请求队列腾出空项），过一会再来搜索请求队列。
+	// 搜索和睡眠期间要关中断，以免在此期间释放的请求项的唤醒被丢失。
+	cli();
 	if (rw == READ)
 		req = request + NR_REQUEST;		// 对于读请求，将指针指向队列尾部。
 	else
@@ -202,18 +207,23 @@ repeat:
 	/* 如果没有找到空闲项，则让该次新请求操作睡眠：需检查是否提前读/写 */  
         if (req < request) {			// 如果已搜索到头（队列无空项），
                 if (rw_ahead) {			// 则若是提前读写请求，则退出。
+                        sti();
                         unlock_buffer(bh);
                         return;
                 }
-                sleep_on(&wait_for_request);	// 否则就睡眠，过会再查看请求队列。
+                if (rw == READ)			// 否则就睡眠，过会再查看请求队列。
+                        sleep_on_exclusive(&wait_for_request);
+                else
+                        sleep_on(&wait_for_request);
                 goto repeat;			// 跳转128行。
         }
+        req->dev = bh->b_dev;			// 先占用该请求项，再开中断。
+        sti();
 /* fill up the request-info, and add it to the queue */
 	/* 向空闲请求项中填写请求信息，并将其加入队列中 */
 	// OK，程序执行到这里表示已找到一个空闲请求项。于是我们在设置好的新请求项后就调用
 	// add_request()把它添加到请求队列中，立马退出。请求结构请参见blk_drv/blk.h，23行。
 	// req-sector是读写操作的起始扇区号，req->buffer是请求项存放数据的缓冲区。
-        req->dev = bh->b_dev;			// 设备号。
         req->cmd = rw;				// 命令（READ/WRITE）。
         req->errors = 0;			// 操作时产生的错误次数。
         req->sector = bh->b_blocknr<<1;		// 起始扇区。块号转换成扇区号（1块=2扇区）。
@@ -230,6 +240,7 @@ repeat:
 void ll_rw_page(int rw, int dev, int page, char * buffer)
 {
 	struct request * req;
+	struct wait_queue wait;
 	unsigned int major = MAJOR(dev);
 
 	if (major >= NR_BLK_DEV || !(blk_dev[major].request_fn)) {
@@ -243,13 +254,14 @@ void ll_rw_page(int rw, int dev, int page, char * buffer)
 	// 从后向前搜索，当请求结构request的设备字段dev值<0时，表示该项未被占用（空闲）。
 	// 如果没有一项是空闲的（此时请求项数组指针已经搜索越过头部），则让本次请求操作先睡
 	// 眠（以等待请求队列腾出空项），过一会再来搜索请求队列。
+	cli();
 repeat:
 	req = request + NR_REQUEST;
 	while (--req >= request)
 		if (req->dev < 0)
 			break;
 	if (req < request) {
-		sleep_on(&wait_for_request);	// 睡眠，过会再查看请求队列。
+		sleep_on_exclusive(&wait_for_request);	// 睡眠，过会再查看请求队列。
 		goto repeat;			// 跳转到174行去重新搜索。
 	}
 	/* fill up the request-info, and add it to the queue */
@@ -260,17 +272,27 @@ repeat:
 	// 而是调用了schedule()。这是因为make_request()函数仅读2个扇区数据，而这里需要对交换
 	// 设备读写8个扇区，需要花较长的时间。因此当前进程肯定需要等待而睡眠。因此这里直接就
 	// 让进程去睡眠了，省得在程序其他地方还要进行这些判断操作。
+	// 当前进程在调用add_request()之前就挂到请求项的waiting队列上（虚拟盘的请求在
+	// add_request()中就同步完成了）。请求完成后end_request()并不释放该请求项，而由
+	// 本进程被唤醒后把自己从waiting队列上取下之后再释放它。
 	req->dev = dev;				// 设备号。
 	req->cmd = rw;				// 命令（READ/WRITE）。
 	req->errors = 0;			// 读写操作错误计数。
 	req->sector = page<<3;			// 起始读写扇区。
 	req->nr_sectors = 8;			// 读写扇区数。
 	req->buffer = buffer;			// 数据缓冲区。
-	req->waiting = current;			// 当前进程进入该请求等待队列。
+	req->waiting = NULL;
 	req->bh = NULL;				// 无缓冲块头指针（不用调整缓冲）。
+	wait.task = current;
+	add_wait_queue(&req->waiting, &wait);	// 当前进程进入该请求等待队列。
 	current->state = TASK_UNINTERRUPTIBLE;	// 转为不可中断状态。
 	add_request(major+blk_dev, req);	// 将请求项加入队列中。
 	schedule();
+	cli();
+	remove_wait_queue(&wait);
+	req->dev = -1;				// 释放该请求项。
+	wake_up_one(&wait_for_request);
+	sti();
 }
 
 // 该函数是块设备驱动程序与系统其他部分之间的接口函数。通常在fs/buffer.c程序中审美观点调用。
@@ -142,7 +142,7 @@ void rd_load()
 	}
 	*((struct d_super_block *) &s) = *((struct d_super_block *) bh->b_data);
 	brelse(bh);
-	if (s.s_magic != SUPER_MAGIC)
+	if (s.s_magic != SUPER_MAGIC && s.s_magic != SUPER_V2_MAGIC)
 		/* No ram disk image present, assume normal floppy boot */
 		/* 磁盘中没有ramdisk映像文件，退出去执行通常的软盘引导 */
 		return;
@@ -151,7 +151,11 @@ void rd_load()
 // 段s_log_zone_size指定。因为文件系统中的数据块总数就等于 (逻辑块数 * 2^(每区
 // 段场数的次方))，即nblocks = (s_nzones * 2^s_log_zone_size)。如果遇到文件系统中数据块
 // 总数大于内存虚拟盘所能容纳的场数的情况，则不能执行加载操作，而只能显示出错信息并返回。
-	nblocks = s.s_nzones << s.s_log_zone_size;
+// MINIX 2.0文件系统的逻辑块数在32位的s_zones字段中。
+	if (s.s_magic == SUPER_V2_MAGIC)
+		nblocks = s.s_zones << s.s_log_zone_size;
+	else
+		nblocks = s.s_nzones << s.s_log_zone_size;
 	if (nblocks > (rd_lenght >> BLOCK_SIZE_BITS)) {
 	        printk("Ram disk image too big! (%d blocks, %d avail)\n",
 		       nblocks, rd_lenght >> BLOCK_SIZE_BITS);
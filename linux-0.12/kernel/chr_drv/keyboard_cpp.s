@@ -164,10 +164,14 @@ put_queue:
 	shrl $8, %ebx			// 将ebx值右移8位，并跳转到标号1继续操作。
 	jmp 1b
 2:	movl %ecx, head(%edx)		// 若已将所有字符都放入队列，则保存头指针。
-	movl proc_list(%edx), %ecx	// 该队列的等待进程指针？
-	testl %ecx, %ecx		// 检测是否有等待队列的进程。
+	leal proc_list(%edx), %ecx	// 该队列的等待队列头指针的地址。
+	cmpl $0, (%ecx)			// 检测是否有等待队列的进程。
 	je 3f				// 无，则跳转；
-	movl $0, (%ecx)			// 有，则唤醒进程（置该进程为就绪状态）。
+	pushl %eax			// 有，则调用wake_up_all()唤醒它们。
+	pushl %ecx
+	call wake_up_all
+	popl %ecx
+	popl %eax
 3:	popl %edx
 	popl %ecx
 	ret
@@ -35,7 +35,7 @@ static inline void pty_copy(struct tty_struct * from, struct tty_struct * to)
 			break;
 	}
 	copy_to_cooked(to);
-	wake_up(&from->write_q->proc_list);
+	wake_up_all(&from->write_q->proc_list);
 }
 
 /*
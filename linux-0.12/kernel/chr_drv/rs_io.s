@@ -165,11 +165,11 @@ write_char:
 	je	write_buffer_empty	// 若头指针 = 尾指针，说明写队列空，跳转处理。
 	cmpl	$startup, %ebx		// 不会死中字符数还超过256个？
 	ja	1f			// 超过则跳转处理。
-	movl	proc_list(%ecx), %ebx	// wake up sleeping process	// 唤醒等待的进程。
-					// 取等待该队列的进程指针，并判断是否为空。
-	testl	%ebx, %ebx		// is there any?	// 有等待写的进程吗？
+	leal	proc_list(%ecx), %ebx	// wake up sleeping process	// 唤醒等待的进程。
+					// 取等待该队列的等待队列头指针地址，并判断队列是否为空。
+	cmpl	$0, (%ebx)		// is there any?	// 有等待写的进程吗？
 	je	1f			// 是空的，则向前跳转到标号1处。
-	movl	$0, (%ebx)		// 否则将进程置为可运行状态（唤醒进程）。
+	call	wake_queue		// 否则唤醒队列上的进程。
 1:	movl	tail(%ecx), %ebx	// 取尾指针。
 	movb	buf(%ecx, %ebx), %al	// 从缓冲中尾指针处取一字符 -> al 。
 	outb	%al, %dx		// 向端口0x3f8（0x2f8）写到发送保持寄存器中。
@@ -188,11 +188,11 @@ write_char:
 // 因此UART就又会“自动”地来取写缓冲队列中的字符，并发送出去。
 .align 4
 write_buffer_empty:
-	movl	proc_list(%ecx), %ebx	// wake up sleeping process	// 唤醒等待的进程。
-					// 取等待该队列的进程的指针，并判断是否为空。
-	testl	%ebx, %ebx		// is there any?	// 有等待的进程吗？
+	leal	proc_list(%ecx), %ebx	// wake up sleeping process	// 唤醒等待的进程。
+					// 取等待该队列的等待队列头指针地址，并判断队列是否为空。
+	cmpl	$0, (%ebx)		// is there any?	// 有等待的进程吗？
 	je	1f			// 无，则向前跳转到标号1处。
-	movl	$0, (%ebx)		// 否则将进程转为可运行状态（唤醒进程）。
+	call	wake_queue		// 否则唤醒队列上的进程。
 1:	incl	%edx			// 指向端口0x3f9（0x2f9）。
 	inb	%dx, %al		// 读取中断允许寄存器IER。
 	jmp 	1f			// 稍作延迟。
@@ -201,3 +201,18 @@ write_buffer_empty:
 	outb	%al, %dx		// 写入0x3f9（0x2f9）。
 	ret
 	
+
+// 唤醒等待队列上的进程。ebx是等待队列头指针的地址。调用C函数wake_up_all()会破坏
+// eax、ecx和edx，而调用者还要用到它们，因此先保存起来。
+.align 4
+wake_queue:
+	pushl	%eax
+	pushl	%ecx
+	pushl	%edx
+	pushl	%ebx
+	call	wake_up_all		// kernel/sched.c
+	addl	$4, %esp
+	popl	%edx
+	popl	%ecx
+	popl	%eax
+	ret
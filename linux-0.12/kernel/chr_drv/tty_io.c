@@ -142,8 +142,8 @@ void change_console(unsigned int new_console)
 //// 如果队列缓冲区空则让进程进入可中断睡眠状态。
 // 参数：queue - 指定队列的指针。
 // 进程在取队列缓冲区中字符之前需要调用此函数加以验证。如果当前进程没有信号要处理，
-// 并且指定的队列缓冲区空，则让进程进入可中断睡眠状态，并让队列的进程等待指针指向
-// 该进程。
+// 并且指定的队列缓冲区空，则让进程进入可中断睡眠状态，并把它挂到队列的等待队列
+// proc_list上。
 static void sleep_if_empty(struct tty_queue * queue)
 {
 	cli();
@@ -156,7 +156,7 @@ static void sleep_if_empty(struct tty_queue * queue)
 // 参数：queue - 指定队列的指针。
 // 进程在往队列缓冲区中写入字符之前需要调用此函数判断队列情况。如果队列缓冲区不满则
 // 返回退出。否则若进程没有信号需要处理，并且队列缓冲区中空闲剩余区长度 < 128，则让
-// 进程进入可中断睡眠状态，并让该队列的进程等待指针指向该进程。
+// 进程进入可中断睡眠状态，并把它挂到该队列的等待队列proc_list上。
 static void sleep_if_full(struct tty_queue * queue)
 {
 	if (!FULL(queue))
@@ -338,7 +338,7 @@ void copy_to_cooked(struct tty_struct *tty)
 // 最后矸退出循环体后唤醒等待该辅助缓冲队列的进程（如果有的话）。
 		PUTCH(c, tty->secondary);
 	}
-	wake_up(&tty->secondary->proc_list);
+	wake_up_all(&tty->secondary->proc_list);
 }
 
 /*
@@ -438,14 +438,14 @@ int tty_read(unsigned channel, char * buf, int nr)
 // 和VMIN对应控制字符值的约束和控制，它们仅有非规范模式（生模式）操作中起作用。
 	if (L_CANON(tty)) {
 		minimum = nr;
-		current->timeout = 0xffffffff;
+		set_timeout(0xffffffff);
 		time = 0;
 	} else if (minimum)
-		current->timeout = 0xffffffff;
+		set_timeout(0xffffffff);
 	else {
 		minimum = nr;
 		if (time)
-			current->timeout = time + jiffies;
+			set_timeout(time + jiffies);
 		time = 0;
 	}
 	if (minimum > nr)
@@ -512,16 +512,16 @@ int tty_read(unsigned channel, char * buf, int nr)
 // 果超时定时值time不为0，我们就要求等待一定的时间让其他进程可以把字符写入读队列中。
 // 于是设置进程读超时值为系统当前时间jiffies + 读超时值time。当然，如果终端处于
 // 规范模式，或者已经读取了nr个字符，我们就可以直接退出这个大循环了。
-		wake_up(&tty->read_q->proc_list);
+		wake_up_all(&tty->read_q->proc_list);
 		if (time)
-			current->timeout = time + jiffies;
+			set_timeout(time + jiffies);
 		if (L_CANON(tty) || b-buf >= minimum)
 			break;
 	}
 // 此时读取tty字符循环操作结束，因此复位进程的读取超时定时值timeout。如果此时当前进
 // 程已收到信号并且还没有读取到任何字符，则以重新凉快去系统调用号返回，否则就返回已读取
 // 的字符数（b-buf）。
-	current->timeout = 0;
+	set_timeout(0);
 	if ((current->signal & ~current->blocked) && !(b-buf))
 		return -ERESTARTSYS;
 	return (b-buf);
@@ -18,15 +18,13 @@
 int sys_pause(void);		// 把进程置为睡眠状态，直到收到信号（kernel/sched.c，164行）。
 int sys_close(int fd);		// 关闭指定文件的系统调用（fs/open.c，219行）。
 
-//// 释放进程占用的任务槽及其任务数据结构占用的内存页面。
+//// 释放进程的任务数据结构及其页目录表占用的内存页面。
 // 参数p是任务数据结构指针。该函数在后面的 sys_kill() 和 sys_waitpid() 函数中被调用。
-// 扫描任务指针数组表 task[] 以寻找指定的任务。如果找到，则首先清空该任务槽，然后释放
-// 该任务数据结构所占用的内存页面。最后执行调度函数并在返回时立即退出。如果在任务数组
-// 表中没有找到指定任务对应的项，则内核panic。
+// 首先把任务从任务链表和进程号hash表中取下，然后释放该任务数据结构和页目录表所占用的
+// 内存页面。最后执行调度函数并在返回时立即退出。如果在进程号hash表中找不到指定的任
+// 务，则内核panic。
 void release(struct task_struct * p)
 {
-	int i;
-
 // 如果给定的任务结构指针为NULL则退出。如果该指针指向当前进程则显示警告信息退出。
 	if (!p)
 		return;
@@ -34,14 +32,16 @@ void release(struct task_struct * p)
 		printk("task releasing itself\n\r");
 		return;
 	}
-// 扫描任务结构指针数组，寻找指定的任务p。如果找到，则置空任务指针数组中对应项，并且
-// 更新任务结构之间的关联指针，释放任务p数据结构占用的内存页面。最后的执行调度程序
+// 按进程号查找任务p。如果找到，则把它从任务链表和进程号hash表中取下，并且更新任务
+// 结构之间的关联指针，释放任务p的页目录表和数据结构占用的内存页面。最后执行调度程序
 // 返回后退出。如果没有找到指定的任务p，则说明内核代码出错了，则显示出错信息并死机。
-// 更新链接部分的代码会把指定任务p从双向链表中删除。
-	for (i = 1; i < NR_TASKS; i++)
-		if (task[i] == p) {
-			task[i] = NULL;
-			/* Update links */
+// 更新链接部分的代码会把指定任务p从双向链表中删除。进程退出时已经释放了自己的所有
+// 页表，但它当时还在使用自己的页目录表，所以页目录表要到这里才能释放。
+	if (find_task_by_pid(p->pid) == p) {
+		REMOVE_LINKS(p);
+		unhash_pid(p);
+		nr_tasks--;
+		/* Update links */
 // 如果p不是最后（最老）的子进程，则让比其老的比邻进程指向比它新的比邻进程。如果p
 // 不是最新的子进程，则让比其新的比邻子进程指向比邻的老进程。如果任务p就是最新的
 // 子进程，则还需要更新其父进程最新子进程指针cptr为指向p的比邻子进程。
@@ -50,33 +50,32 @@ void release(struct task_struct * p)
 // 指针ysptr（younger sibling pointer）指向比p后创建的兄弟进程。
 // 指针pptr（parent pointer）指向p的父进程。
 // 指针cptr（child pointer）是父进程指向最新（最后）创建的子进程。
-			if (p->p_osptr)
-				p->p_osptr->p_ysptr = p->p_ysptr;
-			if (p->p_ysptr)
-				p->p_ysptr->p_osptr = p->p_osptr;
-			else
-				p->p_pptr->p_cptr = p->p_osptr;
-			free_page((long)p);
-			schedule();
-			return;
-		}
+		if (p->p_osptr)
+			p->p_osptr->p_ysptr = p->p_ysptr;
+		if (p->p_ysptr)
+			p->p_ysptr->p_osptr = p->p_osptr;
+		else
+			p->p_pptr->p_cptr = p->p_osptr;
+		free_page(p->tss.cr3);
+		free_page((long)p);
+		schedule();
+		return;
+	}
 	panic("trying to release non-existent task");
 }
 
 #ifdef DEBUG_PROC_TREE
 /* 
- * Check to see if a task_struct pointer is present in the task[] array
+ * Check to see if a task_struct pointer is present in the task list
  * Return 0 if found, and 1 if not found.
  */
-// 检测任务结构指针p。
+// 检测任务结构指针p。现在通过进程号hash表查找，而不用扫描所有任务。
 int bad_task_ptr(struct task_struct * p)
 {
-	int i;
-	if (!p)
+	if (!p || p == FIRST_TASK)
+		return 0;
+	if (find_task_by_pid(p->pid) == p)
 		return 0;
-	for (i = 0; i < NR_TASKS; i++)
-		if (task[i] == p)
-			return 0;
 	return 1;
 }
 
@@ -92,76 +91,74 @@ int bad_task_ptr(struct task_struct * p)
 // 检查进程树。
 void audit_ptree()
 {
-	int i;
+	struct task_struct * p;
 // 扫描系统中的除任务0以外的所有任务，检查它们中4个指针（pptr、cptr、ysptr和osptr）
-// 的正确性。若任务数组槽（项）为空则跳过。
-	for (i = 1; i < NR_TASKS; i++) {
-		if (!task[i])
-			continue;
+// 的正确性。
+	for_each_task(p) {
 // 如果任务父进程指针p_pptr没有指向任何进程（即在任务数组中不存在），则显示警告信息
 // “警告，pid号N的父进程链接有问题”。以下语句对cptr、ysptr和osptr进行类似操作。
-		if (bad_task_ptr(task[i]->p_pptr))
+		if (bad_task_ptr(p->p_pptr))
 			printk("Warning, pid %d's parent link is bad\n",
-				task[i]->pid);
-		if (bad_task_ptr(task[i]->p_cptr))
+				p->pid);
+		if (bad_task_ptr(p->p_cptr))
 			printk("Warning, pid %d's child link is bad\n",
-				task[i]->pid);
-		if (bad_task_ptr(task[i]->p_ysptr))
+				p->pid);
+		if (bad_task_ptr(p->p_ysptr))
 			printk("Warning, pid %d's ys link is bad\n",
-				task[i]->pid);
-		if (bad_task_ptr(task[i]->p_osptr))
+				p->pid);
+		if (bad_task_ptr(p->p_osptr))
 			printk("Warning, pid %d's os link is bad\n",
-				task[i]->pid);
+				p->pid);
 // 如果任务的父进程指针p_pptr指向了自己，则显示警告信息“警告，pid号N的父进程链接
 // 指针指向自己”。以下语句对cptr、ysptr和osptr进行类似操作。
-		if (task[i]->p_pptr == task[i])
+		if (p->p_pptr == p)
 			printk("Warning, pid %d parent link points to self\n",
-				task[i]->pid);
-		if (task[i]->p_cptr == task[i])
+				p->pid);
+		if (p->p_cptr == p)
 			printk("Warning, pid %d child link points to self\n",
-				task[i]->pid);
-		if (task[i]->p_ysptr == task[i])
+				p->pid);
+		if (p->p_ysptr == p)
 			printk("Warning, pid %d ys link points to self\n",
-				task[i]->pid);
-		if (task[i]->p_osptr == task[i])
+				p->pid);
+		if (p->p_osptr == p)
 			printk("Warning, pid %d os link points to self\n",
-				task[i]->pid);
+				p->pid);
 // 如果任务有比自己先创建的比邻兄弟进程，那么就检查它们是否有共同的父进程，并检查这个
 // 老兄进程的ysptr指针是否正确地指向本进程，否则显示警告信息。
-		if (task[i]->p_osptr) {
-			if (task[i]->p_pptr != task[i]->p_osptr->p_pptr)
+		if (p->p_osptr) {
+			if (p->p_pptr != p->p_osptr->p_pptr)
 				printk(
 			"Warning, pid %d older sibling %d parent is %d\n",
-				task[i]->pid, task[i]->p_osptr->pid,
-				task[i]->p_osptr->p_pptr->pid);
-			if (task[i]->p_osptr->p_ysptr != task[i])
+				p->pid, p->p_osptr->pid,
+				p->p_osptr->p_pptr->pid);
+			if (p->p_osptr->p_ysptr != p)
 				printk(
 			"Warning, pid %d older sibling %d has mismatch ys link\n",
-				task[i]->pid, task[i]->p_osptr->pid);
+				p->pid, p->p_osptr->pid);
 		}
 // 如果任务有比自己后创建的比邻兄弟进程，那么就检查它们是否有共同的父进程，并检查这个
 // 小弟进程的osptr指针是否正确地指向本进程，否则显示警告信息。
-		if (task[i]->p_ysptr){
-			if (task[i]->p_pptr != task[i]->p_ysptr->p_pptr)
+		if (p->p_ysptr){
+			if (p->p_pptr != p->p_ysptr->p_pptr)
 				printk(
 			"Warning, pid %d younger sibling %d parent is %d\n",
-				task[i]->pid, task[i]->p_osptr->pid,
-				task[i]->p_osptr->p_pptr->pid);
-			if (task[i]->p_ysptr->p_osptr != task[i])
+				p->pid, p->p_osptr->pid,
+				p->p_osptr->p_pptr->pid);
+			if (p->p_ysptr->p_osptr != p)
 				printk(
 			"Warning, pid %d younger sibling %d has mismatched os link\n",
-				task[i]->pid, task[i]->p_ysptr->pid);
+				p->pid, p->p_ysptr->pid);
 		}
 
-		if (task[i]->p_cptr) {
-			if (task[i]->p_cptr->p_pptr != task[i])
+		if (p->p_cptr) {
+			if (p->p_cptr->p_pptr != p)
 				printk(
 			"Warning, pid %d younger child %d has mismatched parent link\n",
-				task[i]->pid, task[i]->p_cptr->pid);
-			if (task[i]->p_cptr->p_ysptr)
+				p->pid, p->p_cptr->pid);
+			if (p->p_cptr->p_ysptr)
 				printk(
 			"Warning, pid %d youngest child %d has non-NULL ys link\n",
-				task[i]->pid, task[i]->p_cptr->pid);
+				p->pid, p->p_cptr->pid);
 		}
 	}
 }
@@ -185,7 +182,7 @@ static inline int send_sig(long sig, struct task_struct * p, int priv)
 // 停止的信号SIGSTOP、SIGTSTP、SIGTTIN和SIGTTOU。
 	if ((sig == SIGKILL) || (sig == SIGCONT)) {
 		if (p->state == TASK_STOPPED)
-			p->state = TASK_RUNNING;
+			wake_up_process(p);
 		p->exit_code = 0;
 		p->signal &= ~( (1<<(SIGSTOP-1)) | (1<<(SIGTSTP-1)) |
 				(1<<(SIGTTIN-1)) | (1<<(SIGTTOU-1)) );
@@ -201,6 +198,7 @@ static inline int send_sig(long sig, struct task_struct * p, int priv)
 		p->signal &= ~(1<<(SIGCONT-1));
 	/* Actually deliver the signal */
 	p->signal |= (1<<(sig-1));
+	signal_wake_up(p);
 	return 0;
 }
 
@@ -209,11 +207,11 @@ static inline int send_sig(long sig, struct task_struct * p, int priv)
 // 为pgrp的任何进程，则返回-1.
 int session_of_pgrp(int pgrp)
 {
-	struct task_struct **p;
+	struct task_struct *p;
 
-	for (p = &LAST_TASK; p > &FIRST_TASK; --p) //❓不应该是p>=&FIRST_TASK吗？
-		if ((*p)->pgrp == pgrp)
-			return ((*p)->session);
+	for_each_task(p)
+		if (p->pgrp == pgrp)
+			return (p->session);
 	return -1;
 }
 
@@ -224,7 +222,7 @@ int session_of_pgrp(int pgrp)
 // 找到进程组号为pgrp的进程，但是发送信号 失败，则返回发送失败的错误码。
 int kill_pg(int pgrp, int sig, int priv)
 {
-	struct task_struct **p;
+	struct task_struct *p;
 	int err, retval = -ESRCH;	// -ESRCH表示指定的进程不存在。
 	int found = 0;
 
@@ -232,9 +230,9 @@ int kill_pg(int pgrp, int sig, int priv)
 // pgrp的进程，就向其发送信号sig。只要有一次信号发送成功，函数最后就会返回0.
 	if (sig<1 || sig>32 || pgrp<=0)
 		return -EINVAL;
-	for (p = &LAST_TASK; p > &FIRST_TASK; --p)
-		if ((*p)->pgrp == pgrp) {
-			if (sig && (err = send_sig(sig, *p, priv)))
+	for_each_task(p)
+		if (p->pgrp == pgrp) {
+			if (sig && (err = send_sig(sig, p, priv)))
 				retval = err;
 			else
 				found++;
@@ -246,16 +244,15 @@ int kill_pg(int pgrp, int sig, int priv)
 // 参数：pid - 进程号；sig - 指定信号； priv - 权限。
 // 即 向进程号为pid的进程发送指定信号sig。若找到指定pid的进程，那么若信号发送成功，
 // 则返回0，否则返回信号发送出错号。如果没有找到指定进程号pid的进程，则返回出错号
-// -ESRCH（指定进程不存在）。
+// -ESRCH（指定进程不存在）。进程号为pid的进程通过进程号hash表查找。
 int kill_proc(int pid, int sig, int priv)
 {
-	struct task_struct **p;
+	struct task_struct *p;
 
 	if (sig<1 || sig>32)
 		return -EINVAL;
-	for (p = &LAST_TASK; p > &FIRST_TASK; --p)
-		if ((*p)->pid == pid)
-			return(sig ? send_sig(sig, *p, priv) : 0);
+	if ((p = find_task_by_pid(pid)) != NULL)
+		return(sig ? send_sig(sig, p, priv) : 0);
 	return(-ESRCH);
 }
 
@@ -274,14 +271,14 @@ int kill_proc(int pid, int sig, int priv)
 // 表示当前进程是进程组组长，因此需要向组内所有进程强制发送信号sig。
 int sys_kill(int pid, int sig)
 {
-	struct task_struct **p = NR_TASKS + task;	// p指向任务数组最后一项。
+	struct task_struct *p;
 	int err, retval = 0;
 
 	if (!pid)
 		return(kill_pg(current->pid, sig, 0));
 	if (pid == -1) {
-		while (--p > &FIRST_TASK)
-			if (err = send_sig(sig, *p, 0))
+		for_each_task(p)
+			if (err = send_sig(sig, p, 0))
 				retval = err;
 		return(retval);
 	}
@@ -319,16 +316,15 @@ int sys_kill(int pid, int sig)
 // 属于琴会话。因此指定的pgrp进程组肯定不是孤儿进程组。否则...。
 int is_orphaned_pgrp(int pgrp)
 {
-	struct task_struct **p;
+	struct task_struct *p;
 
-	for (p = &LAST_TASK; p > &FIRST_TASK; --p) {
-		if (!(*p) ||
-		     ((*p)->pgrp != pgrp) ||
-		     ((*p)->state == TASK_ZOMBIE) ||
-		     ((*p)->p_pptr->pid == 1))
+	for_each_task(p) {
+		if ((p->pgrp != pgrp) ||
+		     (p->state == TASK_ZOMBIE) ||
+		     (p->p_pptr->pid == 1))
 		     	continue;
-		if ((*p)->p_pptr->pgrp != pgrp &&
-		    ((*p)->p_pptr->session == (*p)->session))
+		if (p->p_pptr->pgrp != pgrp &&
+		    (p->p_pptr->session == p->session))
 		    	return 0;
 	}
 	return(1);	/* (sighing) "Often!" */
@@ -338,12 +334,12 @@ int is_orphaned_pgrp(int pgrp)
 // 查找方法是扫描整个任务数组。检查属于指定组pgrp的任何进程是否处于停止状态。
 static int has_stopped_jobs(int pgrp)
 {
-	struct task_struct ** p;
+	struct task_struct * p;
 
-	for (p = &LAST_TASK; p > &FIRST_TASK; --p) {
-		if ((*p)->pgrp != pgrp)
+	for_each_task(p) {
+		if (p->pgrp != pgrp)
 			continue;
-		if ((*p)->state == TASK_STOPPED)
+		if (p->state == TASK_STOPPED)
 			return(1);
 	}
 	return(0);
@@ -365,8 +361,10 @@ static int has_stopped_jobs(int pgrp)
 // 取段长度时使用该段的选择符作为参数（因为CPU有专用指令LSL通过选择符来取段长度）。
 // 函数free_page_tables()函数位于mm/memory.c文件的第69行开始处；
 // 宏get_base和get_limit()位于include/linux/sched.h头文件的第265行开始处。
-	free_page_tables(get_base(current->ldt[1]), get_limit(0x0f));
-	free_page_tables(get_base(current->ldt[2]), get_limit(0x17));
+// 在此之前先解除所有文件映射，把共享映射中被修改过的页面写回文件。
+	exit_mmap();
+	free_page_tables(current, get_base(current->ldt[1]), get_limit(0x0f));
+	free_page_tables(current, get_base(current->ldt[2]), get_limit(0x17));
 
 // 然后关闭当前进程打开着的所有文件。再对当前进程的工作目录pwd、根目录root、执行程序
 // 文件的i节点以及库文件进行同步操作，放回各个i节点并分别置空（释放）。接着把当前
@@ -378,12 +376,21 @@ static int has_stopped_jobs(int pgrp)
 	current->pwd = NULL;
 	iput(current->root);
 	current->root = NULL;
+	unlink_inode_task(current, 0);
 	iput(current->executable);
 	current->executable = NULL;
+	unlink_inode_task(current, 1);
 	iput(current->library);
 	current->library = NULL;
+// 取消当前进程的报警和超时定时器，因为进程结构在被父进程释放后就不再有效了。
+	del_timer(&current->real_timer);
+	del_timer(&current->timeout_timer);
 	current->state = TASK_ZOMBIE;
 	current->exit_code = code;
+// 唤醒在oom_kill()中等待内存的任务，让它们重新检查。本任务可能就是OOM牺牲者，而它
+// 独占的页面不一定都经过free_page()变为空闲。
+	if (oom_wait)
+		wake_up_all(&oom_wait);
 	/* 
 	 * Check to see if any process groups have become orphaned
 	 * as a result of our exiting, and if they have any stopped
@@ -406,6 +413,7 @@ static int has_stopped_jobs(int pgrp)
 	}
 	/* Let father know we died */
 	current->p_pptr->signal |= (1<<(SIGCHLD-1));
+	signal_wake_up(current->p_pptr);
 
 	/* 
 	 * This loop does two things:
@@ -415,14 +423,16 @@ static int has_stopped_jobs(int pgrp)
 	 *      as a result of our exiting, and if they have any stopped
 	 *      jons, send them a SIGHUP and then a SIGCONT.  (POSIX 3.2.2.2)
 	 */
-// 如果当前进程有子进程（其p_cptr指针指向最近创建的子进程），则让进程1（init进程）
+// 如果当前进程有子进程（其p_cptr指针指向最近创建的子进程），则让child_reaper（init进程）
 // 成为其所有子进程的父进程。如果父进程已经处于僵死状态，则向init进程（父进程）发送
 // 子进程已终止信号SIGCHLD。
 	if (p = current->p_cptr) {
 		while (1) {
-			p->p_pptr = task[1];
-			if (p->state == TASK_ZOMBIE)
-				task[1]->signal |= (1<<(SIGCHLD-1));
+			p->p_pptr = child_reaper;
+			if (p->state == TASK_ZOMBIE) {
+				child_reaper->signal |= (1<<(SIGCHLD-1));
+				signal_wake_up(child_reaper);
+			}
 			/* 
 			 * process group orphan check
 			 * Case ii: Our child is in a different pgrp
@@ -454,9 +464,9 @@ static int has_stopped_jobs(int pgrp)
 // 最老的（the oldest）兄弟子进程p_osptr指向原init进程的最年轻进程，而原init进
 // 程中最年轻进程的p_ysptr指向原子进程中最老的兄弟子进程。最后把当前进程的p_cptr
 // 指针置空，并退出循环。
-			p->p_osptr = task[1]->p_cptr;
-			task[1]->p_cptr->p_ysptr = p;
-			task[1]->p_cptr = current->p_cptr;
+			p->p_osptr = child_reaper->p_cptr;
+			child_reaper->p_cptr->p_ysptr = p;
+			child_reaper->p_cptr = current->p_cptr;
 			current->p_cptr = 0;
 			break;
 		}
@@ -465,7 +475,7 @@ static int has_stopped_jobs(int pgrp)
 // 进程组发送挂断信号SIGHUP，然后释放该终端。接着扫描任务数组，把属于当前进程会话中
 // 进程的终端置空（取消）。
 	if (current->leader) {
-		struct task_struct **p;
+		struct task_struct *p;
 		struct tty_struct *tty;
 
 		if (current->tty >= 0) {
@@ -475,9 +485,9 @@ static int has_stopped_jobs(int pgrp)
 			tty->pgrp = 0;
 			tty->session = 0;
 		}
-		for (p = &LAST_TASK; p > &FIRST_TASK; --p)
-			if ((*p)->session == current->session)
-				(*p)->tty = -1;
+		for_each_task(p)
+			if (p->session == current->session)
+				p->tty = -1;
 	}
 // 如果当前进程上次使用过协处理器，则把记录此信息的指针置空。若定义了调试进程树符号，
 // 则调用进程树检测显示函数。最后调用调度函数，重新调度进程运行，以让父进程能够处理
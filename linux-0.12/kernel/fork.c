@@ -19,8 +19,46 @@
 
 // 写页面验证。若页面不可写，则复制页面。定义在mm/memory.c第274行开始。
 extern void write_verify(unsigned long address);
+extern void ret_from_fork(void);	// 新任务第1次运行的入口（kernel/sys_call.s）。
 
 long last_pid = 0;              // 最新进程号，其值会由get_empyty_process()生成。
+int nr_tasks = 0;               // 系统中现有的任务数（不含任务0）。
+struct task_struct * child_reaper = NULL;       // init进程（任务1）。
+struct task_struct * pidhash[PIDHASH_SZ];       // 进程号hash表。
+
+/// 把任务p加入进程号hash表。
+// 新任务放在hash表项链表的头部。pidhash_pprev指向前一项的pidhash_next字段（或hash表
+// 项本身），因此取下一个任务时不用再搜索链表。
+void hash_pid(struct task_struct * p)
+{
+        struct task_struct ** htable = &pidhash[pid_hashfn(p->pid)];
+
+        if ((p->pidhash_next = *htable) != NULL)
+                (*htable)->pidhash_pprev = &p->pidhash_next;
+        *htable = p;
+        p->pidhash_pprev = htable;
+}
+
+/// 把任务p从进程号hash表中取下。
+void unhash_pid(struct task_struct * p)
+{
+        if (p->pidhash_next)
+                p->pidhash_next->pidhash_pprev = p->pidhash_pprev;
+        *p->pidhash_pprev = p->pidhash_next;
+}
+
+/// 按进程号pid查找任务。
+// 只需搜索pid所在的hash表项链表，而不用扫描所有任务。找到则返回任务结构指针，否则返回
+// NULL。任务0不在hash表中，因此find_task_by_pid(0)总是返回NULL。
+struct task_struct * find_task_by_pid(int pid)
+{
+        struct task_struct * p;
+
+        for (p = pidhash[pid_hashfn(pid)]; p; p = p->pidhash_next)
+                if (p->pid == pid)
+                        return p;
+        return NULL;
+}
 
 //// 进程空间区域写前验证函数。
 // 对于80386 CPU，在执行特权级0代码时不会理会用户空间中的页面是否是页保护的。因此
@@ -56,14 +94,16 @@ void verify_area(void * addr, int size)
 }
 
 // 复制内存页表。
-// 参数nr是新任务号；p是新任务数据结构指针。该函数为新任务在线性地址空间中设置代码
+// 参数p是新任务数据结构指针。该函数为新任务申请页目录表，在线性地址空间中设置代码
 // 段和数据段基址、限长，并复制页表。  由于Linux系统采用了写时复制（copy on write）
 // 技术，因此这里仅为新进程设置自己的页目录表项和页表项，并没有为新进程分配实际物理
 // 内存页面。此时亲进程与其父进程共享所有内存页面。操作成功返回0，否则返回出错号。
-int copy_mem(int nr, struct task_struct * p)
+int copy_mem(struct task_struct * p)
 {
         unsigned long old_data_base,new_data_base,data_limit;
         unsigned long old_code_base,new_code_base,code_limit;
+        unsigned long * dir;
+        int i;
 
 // 首先取当前进程局部描述符表中代码描述符和数据段描述符项中的段限长（字节数）。
 // 0x0f是代码段我把符；0x17是数据段选择符。然后取当前进程代码段和数据段在线性地址
@@ -79,11 +119,22 @@ int copy_mem(int nr, struct task_struct * p)
                 panic("We don't support separate I&D");
         if (data_limit < code_limit)
                 panic("Bad data limit");
-// 然后设置新建进程在线性地址空间中的基地址（等于64MB * 其任务号），并用该值设置新
-// 进程LDT中段描述符中的基地址字段值。接着设置新进程的页目录表项和页表项，即复制
-// 当前进程（父进程）的页目录表和页表项。  此时子进程共享父进程的内存页面。正常情
-// 况下 copy_page_tables()返回0。则表示出错，则释放刚申请的页表项。
-        new_data_base = new_code_base = nr * TASK_SIZE;
+// 然后为新进程申请一页内存作为它自己的页目录表，并把任务0页目录表pg_dir中内核对等
+// 映射所用的头256项（1GB）复制过来，这样切换到新进程之后内核仍可以访问所有物理内存。
+// 原来所有任务共用一个页目录表，每个任务占用其中64MB的线性空间，因此最多只能有64个
+// 任务；现在每个任务都有自己的页目录表，所有用户任务的线性空间都从TASK_BASE（1GB）处
+// 开始。内核的页表在mem_init()之前就已全部建立，以后不再变化，因此只需复制目录项。
+        if (!(dir = (unsigned long *) get_free_page()))
+                return -ENOMEM;
+        for (i = 0; i < (TASK_BASE>>22); i++)
+                dir[i] = pg_dir[i];
+        p->tss.cr3 = (long) dir;
+// 接着设置新建进程在线性地址空间中的基地址（1GB），并用该值设置新进程LDT中段描述符
+// 中的基地址字段值。然后设置新进程的页目录表项和页表项，即复制当前进程（父进程）的
+// 页表项到新进程的页目录表中。此时子进程共享父进程的内存页面。然后复制父进程的文件
+// 映射区链表。正常情况下copy_page_tables()和copy_mmap()都返回0，否则表示出错，则释放
+// 刚申请的页表和页目录表。
+        new_data_base = new_code_base = TASK_BASE;
         p->start_code = new_code_base;
         set_base(p->ldt[1], new_code_base);
         set_base(p->ldt[2], new_data_base);
@@ -91,8 +142,10 @@ int copy_mem(int nr, struct task_struct * p)
         // fix_set_base(&p->ldt[2], new_data_base);
         // printk("new_code_base = %x\n\r", get_base(p->ldt[1]));
         // printk("new_data_base = %x\n\r", get_base(p->ldt[2]));
-        if (copy_page_tables(old_data_base, new_data_base, data_limit)) {
-                free_page_tables(new_data_base, data_limit);
+        if (copy_page_tables(p, old_data_base, new_data_base, data_limit) ||
+            copy_mmap(p)) {
+                free_page_tables(p, new_data_base, data_limit);
+                free_page(p->tss.cr3);
                 return -ENOMEM;
         }
         return 0;
@@ -100,7 +153,7 @@ int copy_mem(int nr, struct task_struct * p)
 
 /* 
  *  Ok, this is the main fork-routine. It copies the system process
- * information (task[nr]) and sets up the necessary registers. It
+ * information (task_struct) and sets up the necessary registers. It
  * also copies the data segmetn in it's entirety.
  */
 // 复制进程信息。
@@ -110,9 +163,9 @@ int copy_mem(int nr, struct task_struct * p)
 // ① CPU执行中断指令压入用户栈地址ss和esp、标志eflags和返回地址cs和eip；
 // ② 第85--91行在刚进入system_call时入栈的段寄存器ds、es、fs和edx、ecx、ebx；
 // ③ 第97行上调用sys_call_table中sys_fork函数时入栈的返回地址（参数none表示）；
-// ④ 第226--230行在调用copy_process()之前入栈的gs、esi、edi、ebp、和eax（nr）。
-// 其中参数nr是调用find_empty_process()分配的任务数组项号。
-int copy_process(int nr, long ebp, long edi, long esi, long gs, long none,
+// ④ 第226--230行在调用copy_process()之前入栈的gs、esi、edi、ebp、和eax（pid）。
+// 其中参数pid是调用find_empty_process()分配的进程号。
+int copy_process(int pid, long ebp, long edi, long esi, long gs, long none,
                 long ebx, long ecx, long edx, long orig_eax,
                 long fs, long es, long ds,
                 long eip, long cs, long eflags, long esp, long ss)
@@ -120,14 +173,14 @@ int copy_process(int nr, long ebp, long edi, long esi, long gs, long none,
         struct task_struct *p;
         int i;
         struct file *f;
+        long * stack;
 
-// 首先为新任务数据结构分配内存（如果分配出错，则返回出错码并退出）。然后将新任务
-// 结构指针放入任务数组的nr项中。其中nr为任务号，它由前面find_empty_process()返回。
-// 接着把当前进程任务结构内容复制到刚申请到的内存页面p开始处。
+// 首先为新任务数据结构分配内存（如果分配出错，则返回出错码并退出）。然后把当前进程
+// 任务结构内容复制到刚申请到的内存页面p开始处。新任务要到最后才加入任务链表和进程
+// 号hash表，在此之前其他地方都看不到它。
         p = (struct task_struct *) get_free_page();
         if (!p)
                 return -EAGAIN;
-        task[nr] = p;
         *p = *current;  /* NOTE! this doesn't copy the supervisor stack */
 // 随后对复制来的进程结构内容进行一些修改，作为新进程的任务结构。先将新进程的状态
 // 置为不可中断等待状态，以防止内核调度其执行。然后设置新进程的进程号pid，并初始
@@ -135,42 +188,55 @@ int copy_process(int nr, long ebp, long edi, long esi, long gs, long none,
 // 位图、报警定时值、会话（session）领导标志leader、进程及其子进程在内核和用户
 // 态运行时间统计值，还设置进程开始运行的系统时间start_time。请参见5.7节内容。
         p->state = TASK_UNINTERRUPTIBLE;
-        p->pid = last_pid;              // 新进程号。也由find_empty_process()得到。
+        p->pid = pid;                   // 新进程号。由find_empty_process()得到。
         p->counter = p->priority;       // 运行时间片值（嘀嗒数）。
+        p->run_index = -1;              // 新进程还不在就绪队列中。
+        p->epoch = current->epoch;      // 当前进程的调度周期号总是最新的。
         p->signal = 0;                  // 信号位图。
         p->alarm = 0;                   // 报警定时值（嘀嗒数）。
+        p->timeout = 0;                 // 超时定时值。
+// 任务结构是从父进程复制来的，其中的两个定时器结构可能还挂在父进程的时间轮槽链表上，
+// 因此子进程的必须清空。
+        p->real_timer.next = p->real_timer.prev = NULL;
+        p->real_timer.list = NULL;
+        p->timeout_timer.next = p->timeout_timer.prev = NULL;
+        p->timeout_timer.list = NULL;
         p->leader = 0;                  /* process leadership doesn't inherit */
         p->utime = p->stime = 0;        // 用户态时间和核心态运行时间。
         p->cutime = p->cstime = 0;      // 子进程用户态和核心态运行时间。
         p->start_time = jiffies;        // 进程开始运行时间（当前时间滴答数）。
 
-// 再修改任务状态段TSS内容（参见列表后说明）。由于系统给任务结构p分配了1页新
-// 内存，所以（PAGE_SIZE + (long) p）让esp0正好指向该页项端。 ss0:esp0用作程序
-// 在内核态执行时的栈。另外，在第5章中我们已经知道，每个任务在GDT表中都有两个
-// 段描述符，一个是任务的TSS段描述符，另一个是任务的LDT表段描述符。下面110行
-// 语句就是把GDT中本任务LDT段描述符的选择符保存在本任务的TSS段中。当执行任务
-// 切换时，CPU会自动从TSS中把LDT段描述符的选择符加载到ldtr寄存器中。
-        p->tss.back_link = 0;
+// 再设置新任务的内核栈和切换信息。由于系统给任务结构p分配了1页新内存，所以
+// （PAGE_SIZE + (long) p）让esp0正好指向该页项端。ss0:esp0用作程序在内核态执行时的
+// 栈。任务切换由switch_to()用软件完成，新任务第1次被切换进来时从tss.eip即
+// ret_from_fork处开始执行，使用的内核栈指针是tss.esp。因此这里在新任务的内核栈顶
+// 构造出与本次系统调用返回时完全相同的栈帧（其中eax为0，这就是fork()在子进程中返回0
+// 的原因所在），并在其下放入ret_from_fork要恢复的gs、esi、edi和ebp。这样子进程就会
+// 经由ret_from_sys_call返回到用户态fork()调用之后。最后把GDT中LDT段描述符的选择符
+// 保存在tss.ldt中，任务切换时switch_to()先让该描述符指向新任务的LDT，再加载ldtr。
         p->tss.esp0 = PAGE_SIZE + (long) p;     // 任务内核态栈指针。
         p->tss.ss0 = 0x10;                      // 内核态栈的段选择符（与内核数据段相同）。
-        p->tss.eip = eip;                       // 指令代码指针。
-        p->tss.eflags = eflags;                 // 标志寄存器。
-        p->tss.eax = 0;                         // 这是当fork()返回时新进程会返回0的原因所在。
-        p->tss.ecx = ecx;
-        p->tss.edx = edx;
-        p->tss.ebx = ebx;
-        p->tss.esp = esp;
-        p->tss.ebp = ebp;
-        p->tss.esi = esi;
-        p->tss.edi = edi;
-        p->tss.es = es & 0xffff;                // 段寄存器仅16位有效。
-        p->tss.cs = cs & 0xffff;
-        p->tss.ss = ss & 0xffff;
-        p->tss.ds = ds & 0xffff;
-        p->tss.fs = fs & 0xffff;
-        p->tss.gs = gs & 0xffff;
-        p->tss.ldt = _LDT(nr);                  // 任务LDT描述符的选择符（LDT描述符在GDT中）
-        p->tss.trace_bitmap = 0x80000000;       // （高16位有效）。
+        stack = (long *) p->tss.esp0;
+        *--stack = ss & 0xffff;                 // 段寄存器仅16位有效。
+        *--stack = esp;
+        *--stack = eflags;
+        *--stack = cs & 0xffff;
+        *--stack = eip;
+        *--stack = ds & 0xffff;
+        *--stack = es & 0xffff;
+        *--stack = fs & 0xffff;
+        *--stack = orig_eax;
+        *--stack = edx;
+        *--stack = ecx;
+        *--stack = ebx;
+        *--stack = 0;                           // eax，子进程中fork()的返回值。
+        *--stack = ebp;
+        *--stack = edi;
+        *--stack = esi;
+        *--stack = gs & 0xffff;
+        p->tss.esp = (long) stack;              // 切换到子进程时使用的内核栈指针。
+        p->tss.eip = (long) ret_from_fork;      // 子进程第1次运行的入口。
+        p->tss.ldt = _LDT;                      // LDT描述符的选择符（LDT描述符在GDT中）
 // 如果当前任务使用了协处理器，就保存其上下文。指令CLTS用于清除控制寄存器CR0
 // 中的任务已交换（TS）标志。每当发生任务切换，CPU都会设置该标志。该标志用于管理
 // 数学协处理器：如果该标志置位，那么每个ESC指令都会被捕获（异常7）。如果协处理
@@ -181,11 +247,10 @@ int copy_process(int nr, long ebp, long edi, long esi, long gs, long none,
         if (last_task_used_math == current)
                 __asm__("clts ; fnsave %0 ; frstor %0"::"m" (p->tss.i387));
 
-// 接下来复制进程页表。即在线性地址空间中设置新任务代码段和数据段描述符中的基址
-// 和限长，并复制页表。如果出错（返回值不是0），则复位任务数组中相应项并释放为
-// 该新任务分配的用于任务结构的内存页。
-        if (copy_mem(nr, p)) {          // 返回不为0表示出错。
-                task[nr] = NULL;
+// 接下来复制进程页表。即为新任务申请页目录表，在线性地址空间中设置新任务代码段和
+// 数据段描述符中的基址和限长，并复制页表。如果出错（返回值不是0），则释放为该新任务
+// 分配的用于任务结构的内存页。
+        if (copy_mem(p)) {              // 返回不为0表示出错。
                 free_page((long) p);
                 return -EAGAIN;
         }
@@ -203,19 +268,20 @@ int copy_process(int nr, long ebp, long edi, long esi, long gs, long none,
                 current->executable->i_count++;
         if (current->library)
                 current->library->i_count++;
-// 随后在GDT表中设置新任务TSS段和LDT段描述符项。这两个段的限长均被设置成104
-// 字节。参见 include/asm/system.h，52--66行代码。然后设置进程之间的关系链表
-// 指针，即把新进程插入到当前进程的子进程链表中。把新进程的父进程设置为当前进程，
+        link_inode_task(p, 0);          // 把子进程加入执行文件和库文件的共享任务链表。
+        link_inode_task(p, 1);
+// 然后设置进程之间的关系链表指针，即把新进程插入到当前进程的子进程链表中，并把新
+// 进程加入任务链表和进程号hash表。任务0创建的第1个进程就是init进程，以后由它收养
+// 孤儿进程。把新进程的父进程设置为当前进程，
 // 把新进程的最新子进程指针p_cptr和年轻兄弟进程指针p_ysptr置空。接着让新进程
 // 的老兄进程指针p_osptr设置等于父进程的最新子进程指针。若当前进程确实还有其他
 // 子进程，则让比邻老兄进程的最年轻进程指针p_ysptr指向新进程。最后把当前进程
 // 的最新子进程指针指向这个新进程。然后把新进程设置成就绪态。最后返回新进程号。
-// 另外，set_tss_desc()和set_ldt_desc()定义在include/asm/system.h文件中。
-// “gdt+(nr<<1)+FIRST_TSS_ENTRY”是任务nr的TSS描述符项在全局表中的地址。因为
-// 每个任务占用GDT表中2项，因此上式中要包括‘(nr<<1)’。
-// 请注意，在任务切换时，任务寄存器TR会由CPU自动加载。
-        set_tss_desc(gdt+(nr<<1)+FIRST_TSS_ENTRY, &(p->tss));
-        set_ldt_desc(gdt+(nr<<1)+FIRST_LDT_ENTRY, &(p->ldt));
+        SET_LINKS(p);
+        hash_pid(p);
+        nr_tasks++;
+        if (current == FIRST_TASK)
+                child_reaper = p;
         p->p_pptr = current;                    // 设置新进程的父进程指针
         p->p_cptr = 0;                          // 复位新进程的最新子进程指针。
         p->p_ysptr = 0;                         // 复位新进程的比邻年轻兄弟进程指针。
@@ -223,28 +289,27 @@ int copy_process(int nr, long ebp, long edi, long esi, long gs, long none,
         if (p->p_osptr)                         // 若新进程有老兄兄弟进程，则让其
                 p->p_osptr->p_ysptr = p;        // 年轻进程兄弟指针指向新进程。
         current->p_cptr = p;                    // 让当前进程最新子进程指针指向新进程。
-        p->state = TASK_RUNNING;                /* do this last, just in case */
-        return last_pid;
+        wake_up_process(p);                     /* do this last, just in case */
+        return p->pid;
 }
 
-// 为新进程取得不重复的进程号last_pid。函数返回在任务数组中的任务号（数组项）。
+// 为新进程取得不重复的进程号last_pid。函数返回该进程号。
 int find_empty_process(void)
 {
-        int i;
+        struct task_struct * p;
 
-// 首先获取新的进程号。如果last_pid增1后超出进程号的正常数表示范围，则重新从1开始
-// 使用pid号。然后在任务数组中搜索刚设置的pid号是否已经被任何任务使用。如果是则
-// 跳转到函数开始处重新获得一个pid号。接着在任务数组中为新任务寻找一个空闲项，并
-// 返回项号。 last_pid是一个全局变量，不用返回。如果此时任务数组中64个项全已经被全
-// 部占用，则返回出错码。
+// 首先检查任务数是否已经达到上限NR_TASKS（任务0也算在内），是则返回出错码。然后获取
+// 新的进程号。如果last_pid增1后超出进程号的正常数表示范围，则重新从1开始使用pid号。
+// 接着在进程号hash表中查找刚设置的pid号是否已经被任何任务使用，并扫描任务链表检查它
+// 是否被用作某个进程组号。如果是则跳转到函数开始处重新获得一个pid号。
+        if (nr_tasks >= NR_TASKS - 1)
+                return -EAGAIN;
 repeat:
         if ((++last_pid) < 0) last_pid = 1;
-        for (i = 0; i < NR_TASKS; i++)
-                if (task[i] && ((task[i]->pid == last_pid) ||
-                                (task[i]->pgrp == last_pid)))
+        if (find_task_by_pid(last_pid))
+                goto repeat;
+        for_each_task(p)
+                if (p->pgrp == last_pid)
                         goto repeat;
-        for (i = 1; i < NR_TASKS; i++)          // 任务0项被排除在外。
-                if (!task[i])
-                        return i;
-        return -EAGAIN;       
-}
\ No newline at end of file
+        return last_pid;
+}
@@ -26,7 +26,7 @@ void sys_sync(void);            /* it's really int */
 void panic(const char * s)
 {
         printk("Kernel panic: %s\n\r", s);
-        if (current == task[0])
+        if (current == FIRST_TASK)
                 printk("In swapper task - not syncing\n\r");
         else
                 sys_sync();
@@ -20,7 +20,9 @@
 #include <asm/io.h>		// io头文件。定义硬件商品输入/输出宏汇编语句。
 #include <asm/segment.h>	// 段操作头文件。定义了有关段寄存器操作的嵌入式汇编函数。
 
+#include <errno.h>		// 错误号头文件。包含系统中各种出错号。
 #include <signal.h>		// 信号头文件。定义了有关信号符号常量，sigaction结构，操作函数原型。
+#include <sched.h>		// 调度策略头文件。定义了SCHED_FIFO等调度策略和sched_param结构。
 
 #include <sys/types.h>		// 定义了 NULL
 
@@ -30,12 +32,12 @@
 #define _S(nr) 		(1<<((nr)-1))
 #define _BLOCKABLE 	(~(_S(SIGKILL) | _S(SIGSTOP)))
 
-// 内核调试函数。显示任务号nr的进程号、进程状态、内核堆栈空闲字节数（大约）及其相关的
+// 内核调试函数。显示序号nr的进程号、进程状态、内核堆栈空闲字节数（大约）及其相关的
 // 子进程和父进程信息。
 // 因为任务结构的数据和任务的内核态栈在同一内存页面上，且任务内核态栈从页面末端开始，
 // 因此，28行上的j即表示最大内核栈容量，或内核栈最低顶端位置。
 // 参数：
-// nr - 任务号； p - 任务结构指针。
+// nr - 任务在任务链表中的序号； p - 任务结构指针。
 void show_task(int nr, struct task_struct * p)
 {
 	int i, j = 4096 - sizeof(struct task_struct);
@@ -56,14 +58,16 @@ void show_task(int nr, struct task_struct * p)
 }
 
 // 显示系统中所有任务的状态信息。
-// NR_TASKS是系统能容纳的最大任务数量（64个），定义在include/linux/sched.h 第6行。
+// 先显示任务0，然后沿任务链表显示其他任务。
 void show_state(void)
 {
-	int i;
+	struct task_struct * p;
+	int i = 0;
+
 	printk("\rTask-info:\n\r");
-	for (i = 0; i < NR_TASKS; i++)
-		if (task[i])
-			show_task(i, task[i]);
+	show_task(i++, FIRST_TASK);
+	for_each_task(p)
+		show_task(i++, p);
 }
 
 // PC机8253计数/定时芯片的输入时钟频率约为1.193180MHz。Linux内核希望定时器中断频率是
@@ -75,16 +79,12 @@ void show_state(void)
 extern int timer_interrupt(void);	// 定时中断程序（kernel/system_call.s，189）。
 extern int system_call(void);		// 系统调用中断程序（kernel/sys_call.s，84）。
 
-// 每个任务（进程）在内核态运行时都有自己的内核态堆栈。这里定义了任务的内核态堆栈结构。
-// 这里定义任务联合（任务结构成员和stack字符数组成员）。因为一个任务的数据结构与其内核
+// 每个任务（进程）在内核态运行时都有自己的内核态堆栈。任务联合task_union（任务结构成员
+// 和stack字符数组成员）定义在include/linux/sched.h中。因为一个任务的数据结构与其内核
 // 态堆栈放在同一内在页中，所以从堆栈寄存器ss可以获得数据段选择符。
-// 67行上设置初始任务的数据。初始数据在include/linux/sched.h中，第156行开始。
-union task_union {
-	struct task_struct task;
-	char stack[PAGE_SIZE];
-};
-
-static union task_union init_task = {INIT_TASK,};
+// 这里设置初始任务的数据。初始数据在include/linux/sched.h中的INIT_TASK。任务0同时是
+// 任务链表的表头，其他任务都由fork()动态分配并链接在它的前后。
+union task_union init_task = {INIT_TASK,};
 
 // 从开机算起的滴答数（10ms/滴答）。系统时钟中断每发生一次即一个滴答。
 // 前面的限定符volatile，英文解释意思是易变的、不稳定的。这个限定词的含义是向编译器
@@ -104,11 +104,28 @@ int jiffies_offset = 0;		/* # clock ticks to add to get "true
 				    who like to syncronize their machines
 				    to WWV :-) */
 
+/*
+ * need_resched is set by the timer when the current task's time-slice
+ * runs out, and when a real-time task that should preempt it is woken.
+ * Returning to user mode checks it, and so do the cond_resched() points
+ * in long kernel loops. Before these points the scheduling latency was
+ * bounded only by the longest kernel path: sys_sync() over every buffer,
+ * fork or exit of a big process (every entry of up to 16 page tables),
+ * or truncating a file with 512*512 doubly indirect blocks. Now it is
+ * one buffer, one page table or one indirect block.
+ */
+/*
+ * 当前任务的时间片用完时，或者唤醒了一个应该抢占当前任务的实时任务时，设置
+ * need_resched标志。返回用户态时，以及内核中耗时较长的循环里的cond_resched()处都会
+ * 检查它。在此之前，调度延迟只受最长内核路径的限制：sys_sync()写出所有缓冲块，大进
+ * 程fork或exit时处理最多16个页表的所有表项，或者截断一个含有512*512个二次间接块的
+ * 文件。现在则最多只是处理一个缓冲块、一个页表或一个间接块的时间。
+ */
+int volatile need_resched = 0;
+
 struct task_struct *current = &(init_task.task);	// 当前任务指针（初始化指向任务0）。
 struct task_struct *last_task_used_math = NULL;		// 使用过协处理器任务的指针。
-
-// 定义任务指针数组。第1项被初始化指向初始任务（任务0）的任务数据结构。
-struct task_struct * task[NR_TASKS] = {&(init_task.task), };
+struct tss_struct init_tss;				// CPU使用的唯一任务状态段。
 
 // 定义用户堆栈（数组），共1K项，容量4K字节。在刚开始初始化操作过程中被用作内核栈，
 // 初始化操作完成后将被用作任务0的用户态堆栈。在运行任务0之前它是内核栈，以后用作任务0
@@ -152,6 +169,151 @@ void math_state_restore()
 	}	
 }
 
+/*
+ * The run queues. Runnable tasks are kept on one of NR_RUN_QUEUES
+ * circular lists indexed by their 'counter', and run_bitmap has a bit
+ * set for every non-empty list. Picking the next task is then just a
+ * 'bsr' of the bitmap instead of a scan of the whole task[] array.
+ */
+/*
+ * 就绪队列。就绪的任务按其counter值被放在NR_RUN_QUEUES个双向循环链表中的一个上，
+ * 位图run_bitmap中每一位对应一个非空的队列。于是选择下一个要运行的任务只需对位图
+ * 执行一条bsr指令，而不用扫描整个任务数组。counter值大于等于NR_RUN_QUEUES-1的任务
+ * 都放在最高的队列中。任务0是空闲任务，从不放入就绪队列。
+ * 所有任务的counter都用完时，原来需要扫描所有任务重新计算counter。现在只是把调度
+ * 周期号sched_epoch增1，各任务的counter在它下次进入就绪队列时再按错过的周期数补算
+ * （见update_counter()），因此与原来的计算结果相同。
+ */
+#define NR_RUN_QUEUES 32
+
+static struct task_struct * run_queue[NR_RUN_QUEUES];
+static unsigned long run_bitmap = 0;
+static unsigned long sched_epoch = 0;
+
+/*
+ * Real-time tasks (SCHED_FIFO and SCHED_RR) live on a second set of
+ * queues, indexed by their static rt_priority. These are always looked
+ * at first, so a runnable real-time task always beats a normal one.
+ * Their 'run_index' is offset by NR_RUN_QUEUES so that dequeue_task()
+ * can tell which set a task is on.
+ */
+/*
+ * 实时任务（SCHED_FIFO和SCHED_RR）放在另一组按静态优先级rt_priority索引的就绪队列
+ * 上。选择任务时总是先看这组队列，因此就绪的实时任务总是先于普通任务运行。实时任务
+ * 的run_index加上了NR_RUN_QUEUES，dequeue_task()据此知道任务在哪一组队列上。
+ */
+static struct task_struct * rt_queue[NR_RUN_QUEUES];
+static unsigned long rt_bitmap = 0;
+
+/// 把任务p加入它所属的就绪队列末尾。调用时需关中断。
+// 普通任务按counter值选择队列，实时任务按rt_priority选择队列。
+static inline void enqueue_task(struct task_struct * p)
+{
+	struct task_struct ** queue = run_queue;
+	unsigned long * bitmap = &run_bitmap;
+	long i = p->counter;
+
+	if (p->policy != SCHED_OTHER) {
+		queue = rt_queue;
+		bitmap = &rt_bitmap;
+		i = p->rt_priority;
+	}
+	if (i < 0)
+		i = 0;
+	if (i >= NR_RUN_QUEUES)
+		i = NR_RUN_QUEUES - 1;
+	p->run_index = (queue == rt_queue) ? i + NR_RUN_QUEUES : i;
+	if (queue[i]) {
+		p->run_next = queue[i];
+		p->run_prev = queue[i]->run_prev;
+		p->run_prev->run_next = p;
+		queue[i]->run_prev = p;
+	} else {
+		queue[i] = p->run_next = p->run_prev = p;
+		*bitmap |= 1 << i;
+	}
+}
+
+/// 把任务p从它所在的就绪队列中取下。调用时需关中断。
+static inline void dequeue_task(struct task_struct * p)
+{
+	struct task_struct ** queue = run_queue;
+	unsigned long * bitmap = &run_bitmap;
+	long i = p->run_index;
+
+	if (i >= NR_RUN_QUEUES) {
+		queue = rt_queue;
+		bitmap = &rt_bitmap;
+		i -= NR_RUN_QUEUES;
+	}
+	if (p->run_next == p) {
+		queue[i] = NULL;
+		*bitmap &= ~(1 << i);
+	} else {
+		p->run_next->run_prev = p->run_prev;
+		p->run_prev->run_next = p->run_next;
+		if (queue[i] == p)
+			queue[i] = p->run_next;
+	}
+	p->run_index = -1;
+}
+
+/// 补算任务p在不在就绪队列期间错过的counter重新计算。
+// 每错过一个调度周期就执行一次 counter = counter/2 + priority，与原来schedule()中对所有
+// 任务的计算完全一样。该值很快收敛（最多约为2*priority），因此最多计算32次。
+static inline void update_counter(struct task_struct * p)
+{
+	unsigned long n = sched_epoch - p->epoch;
+
+	if (p->policy != SCHED_OTHER) {		// 实时任务不参与counter的重新计算。
+		p->epoch = sched_epoch;
+		return;
+	}
+	if (n > 32)
+		n = 32;
+	while (n--)
+		p->counter = (p->counter >> 1) + p->priority;
+	p->epoch = sched_epoch;
+}
+
+/// 检查就绪任务p是否应抢占当前任务。
+// 若p是实时任务，并且当前任务是普通任务或优先级比p低的实时任务，则设置need_resched，
+// 这样当前任务在返回用户态或到达cond_resched()时就会重新调度。当前任务的时间片不受
+// 影响，被抢占的实时任务也仍然留在其队列的队首。任务0本来就会在下一次中断后调用
+// schedule()，不用处理。
+static inline void check_preempt(struct task_struct * p)
+{
+	if (p->policy != SCHED_OTHER && current != FIRST_TASK &&
+	    (current->policy == SCHED_OTHER || p->rt_priority > current->rt_priority))
+		need_resched = 1;
+}
+
+/// 唤醒任务p，即把它置为就绪状态并放入就绪队列。
+// 可以在中断处理程序中调用，因此这里只是临时关中断，退出时恢复原来的中断状态。
+void wake_up_process(struct task_struct * p)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	p->state = TASK_RUNNING;
+	if (p->run_index < 0 && p != FIRST_TASK) {
+		update_counter(p);
+		enqueue_task(p);
+		check_preempt(p);
+	}
+	restore_flags(flags);
+}
+
+/// 任务p收到信号后调用。若p正处于可中断睡眠状态并且有未被阻塞的信号，则唤醒它。
+// 原来这项检查是在每次schedule()时对所有任务做的，现在由发送信号的地方来做。
+void signal_wake_up(struct task_struct * p)
+{
+	if (p->state == TASK_INTERRUPTIBLE &&
+	    (p->signal & ~(_BLOCKABLE & p->blocked)))
+		wake_up_process(p);
+}
+
 /**
  * 'schedule()' is the scheduler function. This is GOOD CODE! There
  * probably won't be any reason to change this, as it should work well
@@ -164,156 +326,250 @@ void math_state_restore()
  */
 void schedule(void)
 {
-	int i, next, c;
-	struct task_struct ** p;		// 任务结构指针的指针。
+	int i;
+	unsigned long flags;
+	struct task_struct * next, * tmp;
 
 /* check alarm, wake up any interruptible tasks that have got a signal */
 
-// 从任务数组中最后一个任务开始循环检测alarm。在循环时路过空指针项。
-	for (p = &LAST_TASK; p > &FIRST_TASK; --p)
-		if (*p) {
-// 如果设置过任务超时定时值timeout，并且已经超时，则复位超时定时值，并且如果任务处于可
-// 中断睡眠状态TASK_INTERRUPTIBLE下，将其置为就绪状态（TASK_RUNNING）。
-			if ((*p)->timeout && (*p)->timeout < jiffies){
-				(*p)->timeout = 0;
-				if ((*p)->state == TASK_INTERRUPTIBLE)
-					(*p)->state = TASK_RUNNING;
+// 任务的timeout和alarm现在由各自的定时器在到期时处理（见后面的process_timeout()和
+// it_real_fn()），发送信号的地方也会用signal_wake_up()唤醒接收信号的任务，因此这里
+// 不再需要扫描所有任务。只需检查当前任务：若它正要进入可中断睡眠，但已经有未被阻塞
+// 的信号，则让它继续就绪。
+	if (current->state == TASK_INTERRUPTIBLE &&
+	    (current->signal & ~(_BLOCKABLE & current->blocked)))
+		current->state = TASK_RUNNING;
+/* this is the scheduler propr: */
+
+// 首先把当前任务放回正确的就绪队列：它运行期间counter已经减少，所以先取下再按新的
+// counter值重新放入队尾；若它已不是就绪状态（睡眠、停止或僵死），则只需取下。
+// 仍然就绪的实时任务则保持它在队列中的位置，因此被抢占的FIFO任务以后仍最先运行。
+// 只有当RR任务的时间片用完（counter为0）时，才重新给它一个时间片并把它移到同优先级
+// 队列的末尾。
+	save_flags(flags);
+	cli();
+	need_resched = 0;
+	if (current != FIRST_TASK) {
+		if (current->policy != SCHED_OTHER && current->state == TASK_RUNNING) {
+			if (current->counter <= 0) {
+				current->counter = current->priority;
+				if (current->policy == SCHED_RR && current->run_index >= 0)
+					dequeue_task(current);
 			}
-// 如果设置过任务的SIGALRM信号超时定时器值alarm，并且已经过期（alarm<jiffies），则在信号
-// 位图中置SIGALRM信号，即向任务发送SIGALRM信号。然后清alarm。该信号的默认操作是终止
-// 进程。jiffies是系统从开机开始算起的滴答数（10ms/滴答）。定义在sched.h第139行。
-			if ((*p)->alarm && (*p)->alarm < jiffies) {
-				(*p)->signal |= (1<<(SIGALRM-1));
-				(*p)->alarm = 0;
+			if (current->run_index < 0)
+				enqueue_task(current);
+		} else {
+			if (current->run_index >= 0)
+				dequeue_task(current);
+			if (current->state == TASK_RUNNING) {
+				update_counter(current);
+				enqueue_task(current);
 			}
-// 如果信号位图中除被阻塞的信号外还有其他信号，并且任务处于可中断状态，则置任务为就绪
-// 状态。其中'～(_BLOCKABLE & (*p)->blocked)'用于忽略被阻塞的信号。但SIGKILL和
-// SIGSTOP不能被阻塞。
-			if (((*p)->signal & ~(_BLOCKABLE & (*p)->blocked)) &&
-			(*p)->state==TASK_INTERRUPTIBLE)
-				(*p)->state = TASK_RUNNING;	// 置为就绪（可执行）状态。
 		}
-/* this is the scheduler propr: */
-
+	}
+// 然后选择下一个任务。若有就绪的实时任务，则选优先级最高的实时队列的队首任务。否则
+// 选出counter值最大的就绪任务，即位图中最高置位位对应队列的队首任务。如果没有就
+// 绪任务，则运行任务0。如果最大的counter值为0，即所有就绪任务的时间片都已用完，则开
+// 始一个新的调度周期：调度周期号增1，然后对0号队列中的任务补算counter值，并按新值放
+// 入相应队列中，再重新选择。其他（睡眠中的）任务的counter值在它们被唤醒时再补算。
 	while (1) {
-		c = -1;
-		next = 0;
-		i = NR_TASKS;
-		p = &task[NR_TASKS];
-// 这段代码也是从任务数组的最后一个任务开始循环处理，并路过不含任务的数组槽。它比较每个
-// 就绪状态任务的counter（任务运行时间的递减滴答计数）值，哪一个值大，就表示相应任务的
-// 运行时间还有很多，next就指向哪个的任务号。
-		while (--i) {
-			if (!*--p)
-				continue;
-			if ((*p)->state == TASK_RUNNING && (*p)->counter > c)
-				c = (*p)->counter, next = i;
+		if (rt_bitmap) {
+			__asm__("bsrl %1,%0":"=r" (i):"r" (rt_bitmap));
+			next = rt_queue[i];
+			break;
 		}
-// 如果比较得出有counter值不等于0的结果，或者系统中没有一个可运行的任务存在（此时c仍
-// 为-1，next=0），则退出外层while循环（144行），并执行后面的任务切换操作（161行）。
-// 否则就根据每个任务的优先权值，更新每一个任务的counte值，然后再回到144行重新比较。
-// counter值的计算方式为 counter = counter/2 + priority
-// 注意，这里计算过程不考虑进程的状态。
-		if (c) break;
-		for (p = &LAST_TASK; p > &FIRST_TASK; --p)
-			if (*p)
-				(*p)->counter = ((*p)->counter >> 1) +
-						(*p)->priority;
-	}
-// 下面宏（在sched.h中）把上面选出来的任务next作为湔任务current，并切换到该任务
-// 中运行。因为next在146行上被初始化为0，因此若系统中没有任何其他任务可运行时，则
-// next始终为0.结果是高度函数会在系统空闲时去执行任务0。此时任务0仅执行 pause()
+		if (!run_bitmap) {
+			next = FIRST_TASK;
+			break;
+		}
+		__asm__("bsrl %1,%0":"=r" (i):"r" (run_bitmap));
+		if (i) {
+			next = run_queue[i];
+			break;
+		}
+		sched_epoch++;
+		while ((tmp = run_queue[0])) {
+			dequeue_task(tmp);
+			update_counter(tmp);
+			enqueue_task(tmp);
+		}
+	}
+	restore_flags(flags);
+// 下面宏（在sched.h中）把上面选出来的任务next作为当前任务current，并切换到该任务
+// 中运行。若系统中没有任何其他任务可运行时，则next为任务0。此时任务0仅执行 pause()
 // 系统调用，并不会调用本函数。
-	switch_to(next);	// 切换到任务号为next的任务，并运行之。
+	switch_to(next);		// 切换到任务next，并运行之。
 }
 
+static void cpu_idle(void);
+
 //// 下面是pause()系统调用，用于转换当前任务的状态为可中断的等待状态，并重新高度。
 // 该系统调用将导致进程进入睡眠状态，直到收到一个信号。该信号用于终止进程或者使进程
 // 调用一个信号捕获函数。只有当捕获了一个信号，并且信号捕获处理函数返回，pause()才
 // 会返回。此时 pause()返回值应该是 -1，并且errno被置为 EINTR。这里还没有完全实
 // 现（直到0.95版）。
+// 任务0调用pause()时，若调度后仍没有其他任务可运行，则由cpu_idle()停机等待中断。
 int sys_pause(void)
 {
 	current->state = TASK_INTERRUPTIBLE;
 	schedule();
+	if (current == FIRST_TASK)
+		cpu_idle();
 	return 0;
 }
 
-// 下面函数把当前任务置为可中断的或不可中断的睡眠状态，并让睡眠队列头指针指向当前任务。
-// 函数参数p是等待任务队列头指针。指针是含有一个变量地址的变量。这里参数p使用了指针的
-// 指针形式 '**p'，这是因为C函数参数只能传值，没有直接的方式让被调用函数改变调用该函数
-// 程序中变量的值。但是指针'*p'指向的目标（这里是任务结构）会改变，因此为了能修改调用该
-// 函数程序中原来就是指针变量的值，就需要传递指针'*p'的指针，即'**p'。参见程序前示例图
-// 中p指针的使用情况。
+/// 把等待项wait加入等待队列q的头部。
+// 非互斥等待项总是放在队列前部，这样wake_up_one()在遇到第1个互斥等待项之前就已经唤醒
+// 了所有非互斥等待的任务（例如select()）。等待队列可能在中断处理程序中被唤醒，因此修改
+// 队列时要关中断。
+void add_wait_queue(struct wait_queue ** q, struct wait_queue * wait)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	wait->exclusive = 0;
+	if ((wait->next = *q))
+		(*q)->pprev = &wait->next;
+	wait->pprev = q;
+	*q = wait;
+	restore_flags(flags);
+}
+
+/// 把等待项wait加入等待队列q的尾部。
+// 互斥等待项按先来先服务的顺序排在队列后部，wake_up_one()只唤醒其中的第1个。
+void add_wait_queue_exclusive(struct wait_queue ** q, struct wait_queue * wait)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	wait->exclusive = 1;
+	while (*q)
+		q = &(*q)->next;
+	wait->next = NULL;
+	wait->pprev = q;
+	*q = wait;
+	restore_flags(flags);
+}
+
+/// 把等待项wait从其所在的等待队列中取下。
+// pprev为NULL表示该项已不在任何队列上，此时什么也不做。
+void remove_wait_queue(struct wait_queue * wait)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if (wait->pprev) {
+		if ((*wait->pprev = wait->next))
+			wait->next->pprev = wait->pprev;
+		wait->next = NULL;
+		wait->pprev = NULL;
+	}
+	restore_flags(flags);
+}
+
+// 下面函数把当前任务置为可中断的或不可中断的睡眠状态，并把它挂到等待队列q上。
+// 等待项就定义在本任务的内核栈上，被唤醒后由本任务自己把它从队列中取下，因此唤醒者
+// 只需把队列上的任务置为就绪状态即可，不再需要睡眠任务之间一个接一个地相互唤醒。
 // 参数state是任务睡眠使用的状态：TASK_UNINTERRUPTIBLE或TASK_INTERRUPTIBLE。处于不可
-// 中断睡眠状态（TASK_UNINTERRUPTIBLE）的任务需要内核程序利用wake_UP()函数明确唤醒之。
-// 处于可中断睡眠状态（TASK_INTERRUPTIBLE）的任务可以通过信号、任务超时等手段唤醒
-// （置为就绪状态 TASK_RUNNING）。
-// *** 注意，由于本内核代码还是很成熟，因此下列与睡眠相关的代码还存在一些问题。
-static inline void __sleep_on(struct task_struct **p, int state)
+// 中断睡眠状态（TASK_UNINTERRUPTIBLE）的任务需要内核程序利用wake_up_all()等函数明确唤醒
+// 之。处于可中断睡眠状态（TASK_INTERRUPTIBLE）的任务可以通过信号、任务超时等手段唤醒
+// （置为就绪状态 TASK_RUNNING）。参数exclusive非0表示以互斥方式等待。
+// 与原来一样，调用者应在关中断的情况下检查等待条件并调用本函数，以免丢失唤醒。
+static inline void __sleep_on(struct wait_queue ** q, int state, int exclusive)
 {
-	struct task_struct *tmp;
+	struct wait_queue wait;
+	unsigned long flags;
+
 // 若指针无效，则退出。（指针所指的对象可以是NULL，但指针本身不会为0）。
 // 如果当前任务是任务0，则死机（impossible!）。
-	if (!p)
+	if (!q)
 		return;
 	if (current == &(init_task.task))
 		panic("task[0] trying to sleep");
-// 让tmp指向已经在等待队列上的任务（如果有的话），例如inode->i_wait，并且将睡眠队列头
-// 的指针指向当前任务。这样就把当前任务插入到等待队列中。然后将当前任务置为指定
-// 的等待状态，并执行重新高度。
-	tmp = *p;
-	*p = current;
+	wait.task = current;
+	save_flags(flags);
+	cli();
+	if (exclusive)
+		add_wait_queue_exclusive(q, &wait);
+	else
+		add_wait_queue(q, &wait);
 	current->state = state;
-repeat:	schedule();
+	schedule();
+// 只有当这个等待任务被唤醒时，程序才又会从这里继续执行。把等待项从队列中取下。
+	remove_wait_queue(&wait);
+	restore_flags(flags);
+}
 
-// 只有当这个等待任务被唤醒时，程序才又会从这里继续执行。表示进程已被明确地唤醒并执行。
-// 如果队列中还有等待的任务，并且队列头指针 *p所指向的任务不是当前任务，则说明在本任务
-// 插入队列后还有任务进入队列，于是我们应该也要唤醒这些后续进入队列的任务，因此这里将队列
-// 头所指任务先置为就绪状态，而自己则置为不可中断等待状态，即要等待这些后续进入队列的任务
-// 被唤醒后才用wake_up()唤醒本任务。然后中转至repeat标号处重新执行高度函数。
-	if (*p && *p != current) {
-		(**p).state = 0;
-		current->state = TASK_UNINTERRUPTIBLE;
-		goto repeat;
-	}
+// 将当前任务置为可中断的等待状态（TASK_INTERRUPTIBLE），并放入等待队列q中。这种等待
+// 状态的任务可以通过信号、任务超时等手段唤醒。
+void interruptible_sleep_on(struct wait_queue ** q)
+{
+	__sleep_on(q, TASK_INTERRUPTIBLE, 0);
+}
 
-// 执行到这里，说明任务真正被唤醒执行。此时等待队列头指针应该指向本任务。若它为空，
-// 则表明调度有问题，于是显示警告信息。最后我们让头指针指向在我们的前面进入队列的任务
-// (*p = tmp)。若确实存在这样一个任务，即队列中还有任务（tmp不为空），就唤醒之。因
-// 此，最先进入队列的任务在唤醒后运行时最终会把等待队列头指针置成NULL。
-	if (!*p)
-		printk("Warning: *p = NULL\n\r");
-	if ((*p = tmp))
-		tmp->state = 0;	// TASK_RUNNING
+// 把当前任务置为不可中断的等待状态（TASK_UNINTERRUPTIBLE），并放入等待队列q中。这种
+// 等待状态的任务需要利用wake_up_all()等函数来明确唤醒。该函数提供了进程与中断处理程序
+// 之间的同步机制。
+void sleep_on(struct wait_queue ** q)
+{
+	__sleep_on(q, TASK_UNINTERRUPTIBLE, 0);
 }
 
-// 将当前伤置为可中断的等待状态（TASK_INTERRUPTIBLE），并被放入头指针*p指定的等待
-// 队列中。这种等待状态的任务可以通过信号、任务超时等手段唤醒。
-void interruptible_sleep_on(struct task_struct **p)
+// 以互斥方式等待。用于那些一次唤醒只能有一个任务得到资源的地方（例如空闲缓冲块、空闲
+// 请求项），避免资源释放时唤醒所有等待者而它们中只有一个能得到资源（惊群）。
+void sleep_on_exclusive(struct wait_queue ** q)
 {
-	__sleep_on(p, TASK_INTERRUPTIBLE);
+	__sleep_on(q, TASK_UNINTERRUPTIBLE, 1);
 }
 
-// 把当前任务置为不可中断的等待状态（TASK_UNINTERRUPTIBLE），并让睡眠队列头指针指向
-// 当前任务。这种等待状态的任务需要利用wake_up()函数来明确唤醒。该函数提供了进程与中
-// 断处理程序之间的同步机制。
-void sleep_on(struct task_struct **p)
+void interruptible_sleep_on_exclusive(struct wait_queue ** q)
 {
-	__sleep_on(p, TASK_UNINTERRUPTIBLE);
+	__sleep_on(q, TASK_INTERRUPTIBLE, 1);
 }
 
-// 唤醒不可中断等待任务。*p是任务等待队列头指针。由于新等待任务是插入在等待队列头指针
-// 处的，因此唤醒的是最后进入等待队列的任务。若该任务已经处于停止或僵死状态，则显示警告
-// 信息。
-void wake_up(struct task_struct **p){
-	if (p && *p) {
-		if ((**p).state == TASK_STOPPED)	// 处于停止状态。
+// 唤醒等待队列q上的任务。nr_exclusive是最多唤醒的互斥等待任务数（0表示不限）。非互斥
+// 等待的任务总是全部被唤醒。若任务已经处于停止或僵死状态，则显示警告信息。
+static inline void __wake_up(struct wait_queue ** q, int nr_exclusive)
+{
+	struct wait_queue * wait;
+	struct task_struct * p;
+	unsigned long flags;
+
+	if (!q)
+		return;
+	save_flags(flags);
+	cli();
+	for (wait = *q; wait; wait = wait->next) {
+		p = wait->task;
+		if (p->state == TASK_STOPPED)		// 处于停止状态。
 			printk("wake_up: TASK_STOPED");
-		if ((**p).state == TASK_ZOMBIE)		// 处于僵死状态。
+		if (p->state == TASK_ZOMBIE)		// 处于僵死状态。
 			printk("wake_up: TASK_ZOMBIE");
-		(**p).state = 0;			// 置为就绪状态 TASK_RUNNING。
+		if (p->state != TASK_INTERRUPTIBLE &&
+		    p->state != TASK_UNINTERRUPTIBLE)
+			continue;
+		wake_up_process(p);			// 置为就绪状态 TASK_RUNNING。
+		if (wait->exclusive && !--nr_exclusive)
+			break;
 	}
+	restore_flags(flags);
+}
+
+/// 唤醒等待队列q上所有的任务。
+void wake_up_all(struct wait_queue ** q)
+{
+	__wake_up(q, 0);
+}
+
+/// 唤醒等待队列q上所有非互斥等待的任务，以及排在最前面的1个互斥等待任务。
+// 已经被唤醒但还没有运行（因而还没有把自己从队列中取下）的互斥等待任务不计数，因此
+// 连续释放两个资源时会唤醒两个不同的等待任务。
+void wake_up_one(struct wait_queue ** q)
+{
+	__wake_up(q, 1);
 }
 
 /*
@@ -327,7 +583,7 @@ void wake_up(struct task_struct **p){
 // 数组wait_motor[]用于存放等待马达启动到正常转速的进程指针。数组索引　0－3分别对应软驱A－D。
 // 数组mon_timer[]存放各软驱马达启动所需要的滴答数。默认启动时间为50个滴答（0.5秒）。
 // 数组moff_timer[]存放各软驱在马达停转之前需维持的时间。程序中设定为10000个滴答（100秒）。
-static struct task_struct * wait_motor[4] = {NULL, NULL, NULL, NULL};
+static struct wait_queue * wait_motor[4] = {NULL, NULL, NULL, NULL};
 static int mon_timer[4] = {0, 0, 0, 0};
 static int moff_timer[4] = {0, 0, 0, 0};
 
@@ -410,7 +666,7 @@ void do_floppy_timer(void)
 			continue;
 		if (mon_timer[i]) {			// 如果马达启动定时到则唤醒进程。
 			if (!--mon_timer[i])
-				wake_up(i+wait_motor);
+				wake_up_all(i+wait_motor);
 		} else if (!moff_timer[i]) {		// 如果马达停转定时到则
 			current_DOR &= ~mask;		// 复位相应马达启动位，并且
 			outb(current_DOR, FD_DOR);	// 更新数字输出寄存器。
@@ -419,56 +675,449 @@ void do_floppy_timer(void)
 	}
 }
 
-// 下面是关于内核定时器的代码。最多可有64个定时器。
-#define TIME_REQUESTS 64
+/*
+ * The kernel timers are kept on a hierarchical timing wheel, so that
+ * adding or removing a timer is O(1) however many of them there are.
+ * Timers due within the next 256 ticks hang directly off tv1, indexed
+ * by the low 8 bits of their expiry time. Later ones go into one of
+ * the four 64-slot vectors of tvn, and are cascaded down a level each
+ * time the level below wraps.
+ */
+/*
+ * 内核定时器放在一个分级时间轮（timing wheel）上，因此不管有多少个定时器，添加和
+ * 删除一个定时器都只需常数时间。在256个滴答之内到期的定时器直接挂在tv1上，以到期
+ * 时间的低8位为索引。更晚到期的定时器则按到期时间的高位放在tvn的4级64槽向量中的一
+ * 级上，每当低一级的时间轮转完一圈时，高一级当前槽中的定时器就被重新分配（cascade）
+ * 到较低的级上。
+ * timer_jiffies是时间轮下一个要处理的滴答数。每个时钟滴答do_timer()只处理tv1中的
+ * 一个槽，而不再像原来那样扫描整个定时器链表。
+ */
+#define TVN_BITS 6
+#define TVR_BITS 8
+#define TVN_SIZE (1 << TVN_BITS)
+#define TVR_SIZE (1 << TVR_BITS)
+#define TVN_MASK (TVN_SIZE - 1)
+#define TVR_MASK (TVR_SIZE - 1)
+
+static struct timer_list * tv1[TVR_SIZE];
+static struct timer_list * tvn[4][TVN_SIZE];
+static unsigned long timer_jiffies = 0;
+
+/// 把定时器timer按其到期时间挂到时间轮的相应槽中。调用时需关中断。
+static void internal_add_timer(struct timer_list * timer)
+{
+	unsigned long expires = timer->expires;
+	unsigned long idx = expires - timer_jiffies;
+	struct timer_list ** list;
+
+// 到期时间已过的定时器放在下一个要处理的槽中，使它在下一个滴答就被处理。
+	if ((long) idx < 0)
+		list = tv1 + (timer_jiffies & TVR_MASK);
+	else if (idx < TVR_SIZE)
+		list = tv1 + (expires & TVR_MASK);
+	else if (idx < 1 << (TVR_BITS + TVN_BITS))
+		list = tvn[0] + ((expires >> TVR_BITS) & TVN_MASK);
+	else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS))
+		list = tvn[1] + ((expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK);
+	else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS))
+		list = tvn[2] + ((expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK);
+	else
+		list = tvn[3] + ((expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK);
+// 加到槽链表的末尾。
+	timer->list = list;
+	if (*list) {
+		timer->next = *list;
+		timer->prev = (*list)->prev;
+		timer->prev->next = timer;
+		(*list)->prev = timer;
+	} else
+		*list = timer->next = timer->prev = timer;
+}
+
+/// 把定时器timer从它所在的槽链表中取下。调用时需关中断。
+static void detach_timer(struct timer_list * timer)
+{
+	struct timer_list ** list = timer->list;
+
+	if (timer->next == timer)
+		*list = NULL;
+	else {
+		timer->next->prev = timer->prev;
+		timer->prev->next = timer->next;
+		if (*list == timer)
+			*list = timer->next;
+	}
+	timer->next = timer->prev = NULL;
+	timer->list = NULL;
+}
 
-// 定时器链表结构和定时器数组。该定时器链表专用于供软驱关闭马达和启动马达定时操作。
-// 这种类型定时器类似现代Linux系统中的动态定时器（Dynamic Timer），仅供内核使用。
-static struct timer_list {
-	long jiffies;			// 定时滴答数。
-	void (*fn)();			// 定时处理程序。
-	struct timer_list * next;	// 链接指向下一个定时器
-} timer_list[TIME_REQUESTS], * next_timer = NULL; // next_timer是定时器队列头指针。
+/// 设置定时器timer在jiffies等于expires时到期。若定时器已在计时，则按新时间重新计时。
+void mod_timer(struct timer_list * timer, unsigned long expires)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if (timer->list)
+		detach_timer(timer);
+	timer->expires = expires;
+	internal_add_timer(timer);
+	restore_flags(flags);
+}
+
+/// 取消定时器timer。若定时器还在计时则返回1，若已经到期或从未设置过则返回0。
+int del_timer(struct timer_list * timer)
+{
+	unsigned long flags;
+	int ret = 0;
+
+	save_flags(flags);
+	cli();
+	if (timer->list) {
+		detach_timer(timer);
+		ret = 1;
+	}
+	restore_flags(flags);
+	return ret;
+}
+
+/*
+ * add_timer() callers don't keep a timer structure of their own, so
+ * they get one from a pool that grows a page at a time. The first
+ * TIMER_POOL_INIT come from a static array: the floppy driver calls
+ * add_timer() from interrupt level, where we'd rather not have to go
+ * looking for a free page.
+ */
+/*
+ * add_timer()的调用者并不自己提供定时器结构，因此从定时器池中为它们分配。定时器池
+ * 在用完时每次从主内存区申请一页来扩充，而不再像原来那样用完64项后就死机。最初的
+ * TIMER_POOL_INIT项来自一个静态数组，因为软盘驱动程序会在中断过程中调用add_timer()，
+ * 那时最好不要去申请内存页面。
+ */
+#define TIMER_POOL_INIT 16
+
+// 定时器池中的定时器。fn是add_timer()调用者给出的定时处理函数。
+struct pool_timer {
+	struct timer_list timer;
+	void (*fn)(void);
+};
+
+static struct pool_timer timer_pool[TIMER_POOL_INIT];
+static struct timer_list * free_timers = NULL;	// 空闲定时器链表（用next字段链接）。
+
+/// 把定时器池中的pt链入空闲链表。调用时需关中断。
+static inline void free_pool_timer(struct pool_timer * pt)
+{
+	pt->timer.next = free_timers;
+	free_timers = &pt->timer;
+}
+
+/// 从定时器池中分配一个定时器。池空时申请一页内存扩充。调用时需关中断。
+static struct pool_timer * get_pool_timer(void)
+{
+	struct pool_timer * pt;
+	unsigned long page;
+
+	if (!free_timers) {
+		if (!(page = get_free_page()))
+			panic("No more timer requests free");
+		for (pt = (struct pool_timer *) page;
+		     (unsigned long) (pt + 1) <= page + PAGE_SIZE; pt++)
+			free_pool_timer(pt);
+	}
+	pt = (struct pool_timer *) free_timers;
+	free_timers = free_timers->next;
+	return pt;
+}
+
+/// 定时器池中定时器的处理函数。先释放定时器，再调用add_timer()时给出的处理函数。
+static void pool_timer_fn(unsigned long data)
+{
+	struct pool_timer * pt = (struct pool_timer *) data;
+	void (*fn)(void) = pt->fn;
+
+	free_pool_timer(pt);
+	(fn)();
+}
 
 // 添加定时器。输入参数为指定的定时值（滴答数）和相应的处理程序指针。
 // 软盘驱动程序（floppy.c）利用该函数执行启动或关闭马达的延时操作。
-// 参数jiffies - 以10毫秒计的滴答数；*fn() - 定时时间到时执行的函数。
-void add_timer(long jiffies, void (*fn)(void))
+// 参数ticks - 以10毫秒计的滴答数；*fn() - 定时时间到时执行的函数。
+void add_timer(long ticks, void (*fn)(void))
 {
-	struct timer_list * p;
+	struct pool_timer * pt;
+	unsigned long flags;
 
 // 如果定时处理程序指针为空，则退出。否则关中断。
 	if (!fn)
 		return;
+	save_flags(flags);
 	cli();
-// 如果定时值<=0，则立刻调用其处理程序。并且该定时器不加入链表中。
-	if (jiffies <= 0)
+// 如果定时值<=0，则立刻调用其处理程序。并且该定时器不加入时间轮中。
+	if (ticks <= 0)
 		(fn)();
 	else {
-// 否则从定时器数组中，找一个空闲项。
-		for (p = timer_list; p < timer_list + TIME_REQUESTS; p++)
-			if (!p->fn)
-				break;
-// 如果已经用完了定时器数组，则系统崩溃。否则向定时吕数据结构填入相应信息，并链入
-// 链表头。
-		if (p >= timer_list + TIME_REQUESTS)
-			panic("No more timer requests free");
-		p->fn = fn;
-		p->jiffies = jiffies;
-		p->next = next_timer;
-		next_timer = p;
-// 链表项按定时值从小到大排序。在排序时减去排在前面需要的滴答数，这样在处理定时器时
-// 只要查看链表头的第一项的定时是不到期即可。
-
-		while (p->next && p->next->jiffies < p->jiffies) {
-			p->jiffies -= p->next->jiffies;
-			fn = p->fn;
-			p->fn = p->next->fn;
-			p->next->fn = fn;
-			jiffies = p->jiffies;
-			p->jiffies = p->next->jiffies;
-			p->next->jiffies = jiffies;
-			p = p->next;
+// 否则从定时器池中取一个定时器，填入相应信息后挂到时间轮上。
+		pt = get_pool_timer();
+		pt->fn = fn;
+		pt->timer.data = (unsigned long) pt;
+		pt->timer.function = pool_timer_fn;
+// 到期时间与mod_timer()的调用者一样由全局jiffies算出。空闲时跳过的滴答由
+// account_idle_ticks()直接加到jiffies上，timer_jiffies要等run_timers()才追上，因此
+// 不能用它来计算。
+		pt->timer.expires = jiffies + ticks;
+		internal_add_timer(&pt->timer);
+	}
+	restore_flags(flags);
+}
+
+/// 把tvn[n]中槽index上的所有定时器重新分配到较低级的时间轮上。
+static void cascade_timers(int n, int index)
+{
+	struct timer_list * timer;
+
+	while ((timer = tvn[n][index])) {
+		detach_timer(timer);
+		internal_add_timer(timer);
+	}
+}
+
+/// 处理到当前jiffies为止所有到期的定时器。在时钟中断中被调用，此时中断是关闭的。
+// 每处理一个滴答，若tv1转完了一圈则先把tvn[0]当前槽中的定时器分配下来，若tvn[0]也
+// 转完了一圈则再分配tvn[1]的，依此类推。然后调用tv1当前槽上所有定时器的处理函数。
+// timer_jiffies在调用处理函数之前就已增1，因此处理函数中新加入的已到期定时器会放到
+// 下一个槽中，而不会在这里造成死循环。
+static void run_timers(void)
+{
+	struct timer_list * timer;
+	unsigned long j;
+	int index, n;
+
+	while ((long) (jiffies - timer_jiffies) >= 0) {
+		index = timer_jiffies & TVR_MASK;
+		if (!index) {
+			j = timer_jiffies >> TVR_BITS;
+			for (n = 0; n < 4; n++) {
+				cascade_timers(n, j & TVN_MASK);
+				if (j & TVN_MASK)
+					break;
+				j >>= TVN_BITS;
+			}
+		}
+		timer_jiffies++;
+		while ((timer = tv1[index])) {
+			detach_timer(timer);
+			(timer->function)(timer->data);
+		}
+	}
+}
+
+/*
+ * The clock. Channel 0 of the 8253 normally runs periodically in mode
+ * 2, giving one interrupt per tick, and can be read back to find how
+ * far we are into the current tick. It is switched to one-shot mode 0
+ * for two reasons: to skip idle ticks (see cpu_idle()), and to
+ * interrupt in the middle of a tick when a high-resolution sleeper
+ * (nanosleep()) is due. A one-shot always starts and ends at a known
+ * offset from the last tick, so the tick boundaries themselves never
+ * drift.
+ */
+/*
+ * 时钟。8253的通道0平时工作在方式2（频率发生器），每个滴答产生一次中断，并且可以读回
+ * 计数值以得知当前时刻在本滴答内已过去了多少。在两种情况下它被切换到单次定时方式0：
+ * 一是空闲时跳过没有工作的滴答（见cpu_idle()），二是在某个滴答中间高精度睡眠（nanosleep()）
+ * 的任务到期时产生中断。单次定时的起点和终点相对于上一个滴答的偏移总是已知的，恢复
+ * 周期方式时又扣除了中断响应的延迟（见do_timer()），因此滴答边界本身不会漂移。
+ * 注意：原来通道0使用方式3（方波），该方式下计数器每次减2并且一个周期内要计数两遍，
+ * 读出的计数值无法直接换算成时间，因此这里改用方式2。
+ */
+#define MAX_IDLE_TICKS (0xffff / LATCH)
+#define MIN_ONESHOT 20			// 最小单次定时计数值（约17微秒）。
+
+static unsigned long oneshot_base = 0;	// 单次定时开始时在本滴答内已过去的计数值。
+static unsigned long oneshot_count = 0;	// 单次定时的计数值，0表示时钟处于周期方式。
+static int oneshot_ticks = 0;		// 单次定时结束时经过的滴答边界数，0表示结束在
+					// 滴答中间（高精度定时器到期）。
+static int blanked = 0;			// 黑屏标志。
+
+// 高精度睡眠项。到期时刻为滴答jiffies开始后再过counts个8253计数。项按到期时刻从早
+// 到晚链接在hr_list上。
+struct hr_sleeper {
+	unsigned long jiffies;
+	unsigned long counts;
+	struct task_struct * task;
+	struct hr_sleeper * next;
+};
+
+static struct hr_sleeper * hr_list = NULL;
+
+/// 设置8253通道0的工作方式控制字mode和计数初值count。
+static inline void set_pit(int mode, unsigned long count)
+{
+	outb_p(mode, 0x43);
+	outb_p(count & 0xff, 0x40);	/* LSB */
+	outb(count >> 8, 0x40);		/* MSB */
+}
+
+/// 设置单次定时。base是当前时刻在本滴答内已过去的计数值，count是定时计数值，ticks是
+// 定时结束时经过的滴答边界数。
+static void set_oneshot(unsigned long base, unsigned long count, int ticks)
+{
+	oneshot_base = base;
+	oneshot_count = count;
+	oneshot_ticks = ticks;
+	set_pit(0x30, count);		/* binary, mode 0, LSB/MSB, ch 0 */
+}
+
+/// 返回当前时刻距最后一个已计入jiffies的滴答已经过去的8253计数值。调用时需关中断。
+// 周期方式下计数器从LATCH递减到1，若计数器已经重装而时钟中断还没有被处理（8259A的
+// IRR中IRQ0位置位），则还要加上一个滴答。单次定时方式下计数器减到0后会继续从0xffff
+// 往下减，因此读到的值大于定时计数值就说明定时已经到了。
+static unsigned long clock_offset(void)
+{
+	unsigned long count, elapsed;
+
+	outb_p(0x00, 0x43);		/* latch ch 0 */
+	count = inb_p(0x40);
+	count |= inb_p(0x40) << 8;
+	if (oneshot_count) {
+		if (count > oneshot_count)
+			return oneshot_base + oneshot_count + (0x10000 - count);
+		return oneshot_base + oneshot_count - count;
+	}
+	elapsed = LATCH - count;
+	outb_p(0x0a, 0x20);		// OCW3：读IRR。
+	if ((inb_p(0x20) & 1) && elapsed < LATCH/2)
+		elapsed += LATCH;
+	return elapsed;
+}
+
+/// 取高精度的当前时间（秒和微秒）。
+// 在滴答数jiffies的基础上，再加上当前时刻在本滴答内已过去的时间，精度约为1微秒。
+void do_gettimeofday(struct timeval * tv)
+{
+	unsigned long flags, ticks, usec;
+
+	save_flags(flags);
+	cli();
+	ticks = jiffies + jiffies_offset;
+	usec = clock_offset() * (1000000/HZ) / LATCH;
+	restore_flags(flags);
+	ticks += usec / (1000000/HZ);
+	tv->tv_sec = startup_time + CT_TO_SECS(ticks);
+	tv->tv_usec = CT_TO_USECS(ticks) + usec % (1000000/HZ);
+}
+
+/// 唤醒到期的高精度睡眠任务，并按需要设置单次定时。调用时需关中断。
+// 参数offs是当前时刻在本滴答内已过去的计数值；midtick表示时钟当前停在滴答中间（处于
+// 单次定时方式），否则处于周期方式。若下一个睡眠项在本滴答内到期，则设置单次定时到
+// 它到期为止；否则若停在滴答中间，则设置单次定时到本滴答结束为止，由do_timer()恢复
+// 周期时钟。单次定时至少MIN_ONESHOT个计数，离滴答结束太近的睡眠项就留给下个滴答处理。
+static void hrtimer_program(unsigned long offs, int midtick)
+{
+	struct hr_sleeper * hr;
+	unsigned long count;
+
+	while ((hr = hr_list) && ((long) (hr->jiffies - jiffies) < 0 ||
+	       (hr->jiffies == jiffies && hr->counts <= offs))) {
+		hr_list = hr->next;
+		hr->next = NULL;
+		wake_up_process(hr->task);
+		hr->task = NULL;
+	}
+	if (hr && hr->jiffies == jiffies) {
+		count = hr->counts - offs;
+		if (count < MIN_ONESHOT)
+			count = MIN_ONESHOT;
+		if (offs + count + MIN_ONESHOT <= LATCH) {
+			set_oneshot(offs, count, 0);
+			return;
+		}
+	}
+	if (midtick)
+		set_oneshot(offs, LATCH - offs, 1);
+}
+
+/// 计算空闲时的单次定时可以覆盖多少个滴答，即到下一个需要处理的滴答为止的滴答数。
+// 软驱马达计时、黑屏和恢复显示、扬声器发声、时间轮上的定时器以及高精度睡眠项都会使
+// 某个滴答需要处理。时间轮在tv1转完一圈时要从高一级分配定时器下来，这个滴答也需要
+// 按时处理。返回1表示不能跳过任何滴答。
+static int next_event_ticks(void)
+{
+	int n = MAX_IDLE_TICKS, j, index;
+
+	if (current_DOR & 0xf0)
+		return 1;
+	if (blankcount || !blankinterval) {
+		if (blanked)
+			return 1;
+		if (blankcount && blankcount < n)
+			n = blankcount;
+	} else if (!blanked)
+		return 1;
+	if (beepcount && beepcount < n)
+		n = beepcount;
+	if (hr_list) {
+		if ((long) (hr_list->jiffies - jiffies) < 1)
+			return 1;
+		if (hr_list->jiffies - jiffies < n)
+			n = hr_list->jiffies - jiffies;
+	}
+// timer_jiffies是时间轮下一个要处理的滴答，即从现在起的第1个滴答。
+	for (j = 0; j < n; j++) {
+		index = (timer_jiffies + j) & TVR_MASK;
+		if (tv1[index] || !index)
+			return j + 1;
+	}
+	return n;
+}
+
+/// 补上空闲时跳过的n个滴答。这些滴答中没有要处理的工作，因此只需增加jiffies，并把
+// 每滴答递减的计数也减去n。next_event_ticks()保证这些计数不会因此减到0以下；中断
+// 处理过程只会把它们重新设置得更大。跳过的时间都算作空闲任务的内核态时间。
+static void account_idle_ticks(int n)
+{
+	jiffies += n;
+	if (blankcount)
+		blankcount -= n;
+	if (beepcount)
+		beepcount -= n;
+	FIRST_TASK->stime += n;
+}
+
+/// 空闲任务（任务0）在没有其他任务可运行时调用，见sys_pause()。
+// 若确实没有就绪任务，时钟处于周期方式，并且接下来的几个滴答都没有工作要处理，则把
+// 时钟设为单次定时，到下一个有工作的滴答边界为止，然后停机等待。sti指令要到下一条
+// 指令之后才开中断，因此“sti; hlt”之间不会漏掉中断。
+static void cpu_idle(void)
+{
+	unsigned long elapsed;
+	int n;
+
+	cli();
+	if (run_bitmap || rt_bitmap) {
+		sti();
+		return;
+	}
+	if (!oneshot_count && (n = next_event_ticks()) > 1) {
+		elapsed = clock_offset();
+		if (elapsed < LATCH - MIN_ONESHOT)
+			set_oneshot(elapsed, n * LATCH - elapsed, n);
+	}
+	__asm__("sti ; hlt");
+// 被某个中断唤醒了。若是单次定时到期，则do_timer()已经处理过了。否则是其他中断提前
+// 唤醒了CPU：补上已经过去的整滴答数，再把单次定时改为到当前这个滴答结束为止。于是
+// 下一次时钟中断仍落在原来的滴答边界上，并由do_timer()恢复周期时钟。
+	cli();
+	if (oneshot_count && oneshot_ticks > 1) {
+		elapsed = clock_offset();
+		if (elapsed < oneshot_base + oneshot_count) {
+			if (elapsed >= LATCH)
+				account_idle_ticks(elapsed / LATCH);
+			elapsed %= LATCH;
+			if (elapsed + MIN_ONESHOT > LATCH)
+				elapsed = LATCH - MIN_ONESHOT;
+			set_oneshot(elapsed, LATCH - elapsed, 1);
 		}
 	}
 	sti();
@@ -480,7 +1129,38 @@ void add_timer(long jiffies, void (*fn)(void))
 // 对于一个任务，若其执行时间片用完，则进行任务切换。同时函数执行一个计时更新工作。
 void do_timer(long cpl)
 {
-	static int blanked = 0;
+// 如果时钟处于单次定时方式，则这次中断是单次定时到期。若定时结束在滴答中间，则这不
+// 是一个滴答，只需唤醒到期的高精度睡眠任务并设置下一个单次定时，若中断发生在用户态
+// 则让调度程序看看被唤醒的任务是否应该先运行。否则先恢复每10ms一次
+// 的周期时钟，再补上空闲时被跳过的滴答。
+// 从单次定时到期到这里已经过去了一段中断响应时间，计数器仍在继续往下减。offs取的是实际
+// 的当前时刻而不是定时的终点，late是越过终点（滴答边界）的计数值。恢复周期时钟时先以
+// LATCH - late为初值，再写入LATCH作为以后每次重装的值（方式2下计数过程中写入的新初值
+// 要到本周期结束时才装入），这样下一个滴答仍落在原来的边界之后LATCH个计数处，滴答的
+// 相位不会因中断响应延迟而漂移。延迟过长时只能尽量靠近。
+	if (oneshot_count) {
+		int ticks = oneshot_ticks;
+		unsigned long offs = clock_offset();
+		unsigned long late = offs - (oneshot_base + oneshot_count);
+
+		oneshot_count = 0;
+		if (!ticks) {
+			if (offs + MIN_ONESHOT > LATCH)
+				offs = LATCH - MIN_ONESHOT;
+			hrtimer_program(offs, 1);
+			if (cpl)
+				schedule();
+			return;
+		}
+		if (late > LATCH - MIN_ONESHOT)
+			late = LATCH - MIN_ONESHOT;
+		set_pit(0x34, LATCH - late);	/* binary, mode 2, LSB/MSB, ch 0 */
+		outb_p(LATCH & 0xff, 0x40);	/* LSB */
+		outb(LATCH >> 8, 0x40);		/* MSB */
+		if (ticks > 1)
+			account_idle_ticks(ticks - 1);
+	}
+	jiffies++;
 
 // 首先判断是否需要执行黑屏（bankout）操作。如果blankcount计数不为零，或者黑屏
 // 延时间隔时间blankinterval为0的话，那么若已经处于黑屏状态（黑屏标志blanked=1），
@@ -497,11 +1177,6 @@ void do_timer(long cpl)
 		blanked = 1;
 	}
 
-// 接着处理硬盘操作超时问题。如果硬盘超时计数递减之后为0，则进行硬盘访问超时处理。
-	if (hd_timeout)
-		if (!--hd_timeout)
-			hd_times_out();	// 硬盘访问超时处理（blk_drv/hd.c，318行）。
-
 // 如果发声计数次数到，则关闭发声。（向0x61口发送命令，复位位0和1。位0控制8253
 // 计数器2的工作，位1控制气场器）。
 	if (beepcount)			// 气场器发声时间滴答数（chr_drv/console.c，950行）。
@@ -517,46 +1192,166 @@ void do_timer(long cpl)
 	else
 		current->stime++;
 
-// 如果有定时器存在，则将链表第1个定时器的值减1。如果已等于0，则调用相应的处理程序，
-// 并将该处理程序指针置为空。然后去掉该项定时器。
-	if (next_timer) {
-		next_timer->jiffies--;
-		while (next_timer && next_timer->jiffies <= 0) {
-			void (*fn)(void);	// 这里插入了一个函数指针定义！！😔
-
-			fn = next_timer->fn;
-			next_timer->fn = NULL;
-			next_timer = next_timer->next;
-			(fn)();			// 调用定时处理函数。
-		}
-	}
+// 处理时间轮上所有到期的定时器，包括硬盘和软盘的操作超时定时器。
+	run_timers();
+// 若有高精度睡眠的任务在本滴答内到期，则设置单次定时到它到期为止。
+	if (hr_list)
+		hrtimer_program(clock_offset(), 0);
 // 如果当前软盘控制器FDC的数字输出寄存器DOR中马达启动位有置位，则执行软盘定时程序。
 	if (current_DOR & 0xf0)
 		do_floppy_timer();		// 前面第264行开始。
-// 如果任务运行时间还没用完，则退出这里继续运行该任务。否则置当前任务运行计数值为0。并且
-// 若发生时钟中断时正在内核代码中运行则返回，否则表示在执行用户程序，于是调用高度函数尝试
-// 执行任务切换操作。
+// 如果任务运行时间还没用完，则退出这里继续运行该任务。否则置当前任务运行计数值为0，并置
+// need_resched标志。若发生时钟中断时正在内核代码中运行则返回，由返回用户态时或者内核中的
+// cond_resched()处再进行调度。否则表示在执行用户程序，于是调用高度函数尝试执行任务切换
+// 操作。
+// SCHED_FIFO实时任务没有时间片，它一直运行到自己睡眠或被更高优先级的实时任务抢占。
+// SCHED_RR实时任务的时间片用完时同样置counter为0，schedule()会把它移到同优先级队列
+// 的末尾，并重新给它一个时间片。
+	if (current->policy == SCHED_FIFO)
+		return;
 	if ((--current->counter)>0) return;
 	current->counter = 0;
+	need_resched = 1;
 	if (!cpl) return;			// 对于内核态程序，不依赖counter值进行调度。
 	schedule();
 }
 
+/// 任务超时定时器的处理函数。清任务的超时时间，若任务在可中断睡眠则唤醒它。
+static void process_timeout(unsigned long data)
+{
+	struct task_struct * p = (struct task_struct *) data;
+
+	p->timeout = 0;
+	if (p->state == TASK_INTERRUPTIBLE)
+		wake_up_process(p);
+}
+
+/// 设置当前任务的超时时间timeout（jiffies值）。
+// timeout为0表示取消超时，0xffffffff表示永不超时，这两种情况都不需要定时器。若超时时间
+// 已经到了，则直接把timeout置0，就像定时器已经到期一样。
+void set_timeout(unsigned long timeout)
+{
+	struct timer_list * timer = &current->timeout_timer;
+
+	if (!timeout || timeout == 0xffffffff) {
+		del_timer(timer);
+		current->timeout = timeout;
+		return;
+	}
+	if ((long) (timeout - jiffies) <= 0) {
+		del_timer(timer);
+		current->timeout = 0;
+		return;
+	}
+	current->timeout = timeout;
+	timer->data = (unsigned long) current;
+	timer->function = process_timeout;
+	mod_timer(timer, timeout);
+}
+
+/// 任务报警定时器的处理函数。向任务发送SIGALRM信号，然后清alarm。该信号的默认操作是
+// 终止进程。
+static void it_real_fn(unsigned long data)
+{
+	struct task_struct * p = (struct task_struct *) data;
+
+	p->signal |= (1<<(SIGALRM-1));
+	p->alarm = 0;
+	signal_wake_up(p);
+}
+
 // 系统调用功能 - 设置报警定时器时间值（秒）。
 // 若参数seconds > 0，则设置新定时时间值，并返回原定时时间刻还剩余的时间，否则返回0。
 // 进程数据结构中报警字段alarm的单位是系统滴答，它是系统开机运行到现在的嘀嗒数jiffies
 // 与定时值之和，即‘jiffies + HZ*定时秒值’，其中常数HZ = 100。本函数的主要功能是设置alarm
-// 字段和进行两种单位之间的转换。
+// 字段和进行两种单位之间的转换，并用任务的报警定时器real_timer在alarm到期时发送信号。
 int sys_alarm(long seconds)
 {
 	int old = current->alarm;
 
 	if (old)
 		old = (old - jiffies) / HZ;
-	current->alarm = (seconds>0) ? (jiffies+HZ*seconds) : 0;
+	if (seconds > 0) {
+		current->alarm = jiffies + HZ*seconds;
+		current->real_timer.data = (unsigned long) current;
+		current->real_timer.function = it_real_fn;
+		mod_timer(&current->real_timer, current->alarm);
+	} else {
+		del_timer(&current->real_timer);
+		current->alarm = 0;
+	}
 	return (old);
 }
 
+/// 系统调用nanosleep()：高精度睡眠。
+// 参数req指向用户空间中要睡眠的时间；rem不为空时，若睡眠被信号中断，则在其中返回剩余
+// 的时间。睡眠时间被换算成（滴答数，8253计数值）形式的到期时刻，睡眠项按到期时刻插入
+// hr_list中。到期时刻所在的滴答开始时，do_timer()会把时钟设为单次定时，到期时就产生
+// 中断唤醒本任务，因此睡眠时间不会被舍入成整数个滴答。睡眠项就放在本任务的内核栈上。
+int sys_nanosleep(struct timespec * req, struct timespec * rem)
+{
+	struct hr_sleeper hr, ** p;
+	unsigned long sec, nsec, ticks, counts, offs, flags;
+
+	sec = get_fs_long((unsigned long *) &req->tv_sec);
+	nsec = get_fs_long((unsigned long *) &req->tv_nsec);
+	if ((long) sec < 0 || nsec >= 1000000000)
+		return -EINVAL;
+// 最长睡眠时间限制在滴答数不超过0x7fffffff（约248天）。
+	if (sec > 0x7fffffff / HZ - 1)
+		sec = 0x7fffffff / HZ - 1;
+	ticks = sec * HZ + nsec / (1000000000/HZ);
+	counts = (nsec % (1000000000/HZ)) / 1000 * LATCH / (1000000/HZ);
+	save_flags(flags);
+	cli();
+	counts += clock_offset();
+	hr.jiffies = jiffies + ticks + counts / LATCH;
+	hr.counts = counts % LATCH;
+	hr.task = current;
+	for (p = &hr_list; *p; p = &(*p)->next)
+		if ((long) ((*p)->jiffies - hr.jiffies) > 0 ||
+		    ((*p)->jiffies == hr.jiffies && (*p)->counts > hr.counts))
+			break;
+	hr.next = *p;
+	*p = &hr;
+// 若本睡眠项排在最前面并且就在当前这个滴答内到期，则马上设置单次定时。
+	if (hr_list == &hr && hr.jiffies == jiffies)
+		hrtimer_program(clock_offset(), oneshot_count != 0);
+	while (hr.task && !(current->signal & ~current->blocked)) {
+		current->state = TASK_INTERRUPTIBLE;
+		schedule();
+	}
+	if (!hr.task) {
+		restore_flags(flags);
+		return 0;
+	}
+// 睡眠被信号中断。从hr_list中取下睡眠项，并算出剩余的时间。
+	for (p = &hr_list; *p; p = &(*p)->next)
+		if (*p == &hr) {
+			*p = hr.next;
+			break;
+		}
+	offs = clock_offset();
+	ticks = hr.jiffies - jiffies;
+	counts = hr.counts;
+	if (counts < offs) {
+		ticks--;
+		counts += LATCH;
+	}
+	counts -= offs;
+	restore_flags(flags);
+	if ((long) ticks < 0)
+		ticks = counts = 0;
+	if (rem) {
+		verify_area(rem, sizeof(*rem));
+		put_fs_long(ticks / HZ, (unsigned long *) &rem->tv_sec);
+		put_fs_long((ticks % HZ) * (1000000000/HZ) +
+			counts * (1000000/HZ) / LATCH * 1000,
+			(unsigned long *) &rem->tv_nsec);
+	}
+	return -EINTR;
+}
+
 // 取当前进程号pid。
 int sys_getpid(void)
 {
@@ -602,11 +1397,72 @@ int sys_nice(long increment)
 	return 0;
 }
 
+/// 系统调用：设置进程pid的调度策略policy和实时优先级param->sched_priority。
+// pid为0表示当前进程。只有超级用户才能设置实时调度策略；普通用户只能把自己的进程
+// 设为SCHED_OTHER。若任务正在就绪队列中，则按新策略把它重新放入相应的队列。RR任务
+// 的时间片长度仍由priority（nice）决定。
+int sys_sched_setscheduler(int pid, int policy, struct sched_param * param)
+{
+	struct task_struct * p;
+	unsigned long flags;
+	int prio;
+
+	if (policy != SCHED_OTHER && policy != SCHED_FIFO && policy != SCHED_RR)
+		return -EINVAL;
+	if (!param || pid < 0)
+		return -EINVAL;
+	prio = get_fs_long((unsigned long *) &param->sched_priority);
+	if (policy == SCHED_OTHER ? prio != 0 :
+	    (prio < SCHED_PRIO_MIN || prio > SCHED_PRIO_MAX))
+		return -EINVAL;
+	if (!(p = pid ? find_task_by_pid(pid) : current))
+		return -ESRCH;
+	if (!suser()) {
+		if (policy != SCHED_OTHER)
+			return -EPERM;
+		if (current->euid != p->euid && current->euid != p->uid)
+			return -EPERM;
+	}
+	save_flags(flags);
+	cli();
+	if (p->run_index >= 0) {
+		dequeue_task(p);
+		p->policy = policy;
+		p->rt_priority = prio;
+		update_counter(p);
+		enqueue_task(p);
+	} else {
+		p->policy = policy;
+		p->rt_priority = prio;
+	}
+	if (policy != SCHED_OTHER)
+		p->counter = p->priority;
+	restore_flags(flags);
+// 若改变的是当前进程，则马上重新调度，因为它可能不再是优先级最高的任务了。否则检查
+// 进程p是否应该抢占当前进程。
+	if (p == current)
+		schedule();
+	else if (p->state == TASK_RUNNING)
+		check_preempt(p);
+	return 0;
+}
+
+/// 系统调用：取得进程pid的调度策略。pid为0表示当前进程。
+int sys_sched_getscheduler(int pid)
+{
+	struct task_struct * p;
+
+	if (pid < 0)
+		return -EINVAL;
+	if (!(p = pid ? find_task_by_pid(pid) : current))
+		return -ESRCH;
+	return p->policy;
+}
+
 // 内核调度程序的初始化子程序。
 void sched_init(void)
 {
 	int i;
-	struct desc_struct * p;		// 描述符表结构指针。
 
 // Linux系统开发之初，内核不成熟。内核代码会经常被修改。Linus怕自己无意中修改了这些
 // 关键性的数据结构，造成与POSIX标准的不妆容。这里加入下面的这个判断语句并无必要，纯粹
@@ -614,39 +1470,41 @@ void sched_init(void)
 	if (sizeof(struct sigaction) != 16)	// sigaction是存放有信号状态的结构。
 		panic("Struct sigaction MUST be 16 bytes");
 
-// 在全局描述符表GDT中设置初始任务（任务0）的任务状态TSS描述符和局部数据表LDT描述符。
-// FIST_TSS_ENTRY和FIST_LDT_ENTRY的值分别是4和5，定义在include/linux/sched.h；
-// gdt是一个描述符表数组（include/linux/head.h），实际上对应程序head.s中第234行上
-// 的全局描述符表基址（_gdt）。因此gdt+FIRST_TSS_ENTRY即为gdt[FIRST_TSS_ENTRY]（
-// 即是gdt[4]），也即gdt数组第4项的地址。参见include/asm/system.h，第65行开始。
-	set_tss_desc(gdt+FIRST_TSS_ENTRY, &(init_task.task.tss));
+// 在全局描述符表GDT中设置系统唯一的任务状态段init_tss的描述符和初始任务（任务0）的
+// 局部数据表LDT描述符。FIST_TSS_ENTRY和FIST_LDT_ENTRY的值分别是4和5，定义在
+// include/linux/sched.h；gdt是一个描述符表数组（include/linux/head.h），实际上对应程序
+// head.s中第234行上的全局描述符表基址（_gdt）。因此gdt+FIRST_TSS_ENTRY即为
+// gdt[FIRST_TSS_ENTRY]（即是gdt[4]），也即gdt数组第4项的地址。参见include/asm/system.h，
+// 第65行开始。init_tss中只需设置内核栈ss0:esp0，I/O位图偏移（高16位）超出TSS段限长，
+// 表示不允许用户程序访问任何I/O端口。
+	init_tss.esp0 = init_task.task.tss.esp0;
+	init_tss.ss0 = 0x10;
+	init_tss.trace_bitmap = 0x80000000;
+	set_tss_desc(gdt+FIRST_TSS_ENTRY, &init_tss);
 	set_ldt_desc(gdt+FIRST_LDT_ENTRY, &(init_task.task.ldt));
 
-// 清任务数组和描述符表项（注意从i=1开始，所以初始任务的描述符还在）。描述符结构
-// 定义在文件include/linux/head.h中。
-	p = gdt + 2 + FIRST_TSS_ENTRY;
-	for (i = 1; i < NR_TASKS; i++){
-		task[i] = NULL;
-		p->a = p->b = 0;
-		p++;
-		p->a = p->b = 0;
-		p++;
-	}
+// 清进程号hash表。任务链表开始时只有任务0自己（见INIT_TASK）。
+	for (i = 0; i < PIDHASH_SZ; i++)
+		pidhash[i] = NULL;
 /* Clear NT, so that we won't have troubles with that later on */
 // EFLAGS中的NT标志位用于控制任务的嵌套调用。当NT位置位时，那么当前中断任务执行
 // IRET指令时就会引起任务切换。NT指出TSS中的back_link字段是否有效。NT=0时无效。
 	__asm__("pushfl ; andl $0xffffbfff,(%esp) ; popfl"); 	// 复位NT标志
 
-// 将任务0的TSS段选择符加载到任务寄存器tr。将局部描述符表段选择符加载到局部描述
-// 符表寄存器ldtr中。注意！！是将GDT中相应LDT描述符的选择符加载到ldtr。只明确
-// 加载这一次，以后新任务LDT的加载，是CPU根据TSS中的LDT项自动加载。
-	ltr(0);			// 定义在include/linux/sched.h 第157-
-	lldt(0);		// 其中参数（0）是任务号。
+// 把静态的初始定时器放入定时器池的空闲链表。
+	for (i = 0; i < TIMER_POOL_INIT; i++)
+		free_pool_timer(timer_pool + i);
+
+// 将TSS段选择符加载到任务寄存器tr。将任务0的局部描述符表段选择符加载到局部描述
+// 符表寄存器ldtr中。注意！！是将GDT中相应LDT描述符的选择符加载到ldtr。tr只加载
+// 这一次，以后新任务LDT的加载由switch_to()完成。
+	ltr();			// 定义在include/linux/sched.h
+	lldt();
 
-// 下面代码用于初始化8253定时器。通道0，选择工作方式3，二进制计数方式。通道0的
+// 下面代码用于初始化8253定时器。通道0，选择工作方式2，二进制计数方式。通道0的
 // 输出引脚接在中断控制主芯片的IRQ0上，它每10毫秒发出一个IRQ0请求。LATCH是初始
 // 定时计数值。
-	outb_p(0x36, 0x43);		/* binary, mode 3, LSB/MSB, ch 0 */
+	outb_p(0x34, 0x43);		/* binary, mode 2, LSB/MSB, ch 0 */
 	outb_p(LATCH & 0xff, 0x40);	/* LSB */ // 定时值低字节。
 	outb(LATCH >> 8, 0x40);		/* MSB */ // 定时值高字节。
 
@@ -15,6 +15,7 @@
 #include <sys/utsname.h>        // 系统名称结构头文件。
 #include <sys/param.h>          // 系统参数头文件。含有系统一些全局常数符号。例如HZ等。
 #include <sys/resource.h>       // 系统资源头文件。含有有关进程资源使用情况的结构等信息。
+#include <sys/timeb.h>          // 定义了ftime()返回的时间结构timeb。
 #include <string.h>             // 字符串头文件。字符串或内存字节序列操作函数。
 
 /* 
@@ -31,12 +32,22 @@ struct timezone sys_tz = {0, 0};
 extern int session_of_pgrp(int pgrp);
 
 // 返回日期和时间（ftime - Fetch time）。
-// 以下返回值是-ENOSYS的系统调用函数均表示在本版本内核中还未实现。
-int sys_ftime()
+// 参数tp是用户空间中timeb结构的指针。时间取自高精度时钟，精确到毫秒。
+int sys_ftime(struct timeb * tp)
 {
-        return -ENOSYS;
+        struct timeval tv;
+
+        do_gettimeofday(&tv);
+        verify_area(tp, sizeof *tp);
+        put_fs_long(tv.tv_sec, (unsigned long *) &tp->time);
+        put_fs_word(tv.tv_usec / 1000, (short *) &tp->millitm);
+        put_fs_word(sys_tz.tz_minuteswest, &tp->timezone);
+        put_fs_word(sys_tz.tz_dsttime, &tp->dstflag);
+        return 0;
 }
 
+// 以下返回值是-ENOSYS的系统调用函数均表示在本版本内核中还未实现。
+
 int sys_break()
 {
         return -ENOSYS;
@@ -301,9 +312,13 @@ int sys_times(struct tms * tbuf)
 // 发生）。该函数并不被用户直接调用，而由libc库函数进行包装，并且返回值也不一样。
 int sys_brk(unsigned long end_data_seg)
 {
-// 如果参数值大于代码结尾，并且小于（堆栈 - 16KB），则设置新数据段结尾值。
+        struct vm_area_struct * vma;
+
+// 如果参数值大于代码结尾，并且小于（堆栈 - 16KB），而且数据段扩展后不会与文件映射区
+// 重叠，则设置新数据段结尾值。
         if (end_data_seg >= current->end_code &&
-            end_data_seg < current->start_stack - 16384)
+            end_data_seg < current->start_stack - 16384 &&
+            !((vma = find_vma(current, current->brk)) && vma->vm_start < end_data_seg))
                 current->brk = end_data_seg;
         return current->brk;            // 返回进程当前的数据段结尾值。
 }
@@ -332,7 +347,7 @@ int sys_brk(unsigned long end_data_seg)
 // 的相同（263行）。
 int sys_setpgid(int pid, int pgid)
 {
-        int i;
+        struct task_struct * p;
 
 // 如果参数pid为0，则pid取值为当前进程的进程号pid。如果参数pgid为0，则pgid也
 // 取值为当前进程的pid。[？？这里与POSIX标准的描述有出入]。若pgid小于0，则返回
@@ -343,24 +358,22 @@ int sys_setpgid(int pid, int pgid)
                 pgid = current->pid;
         if (pgid < 0)
                 return -EINVAL;
-// 扫描任务数组，查找指定进程号pid的任务。如果找到了进程号是pid的进程，并且该进程
+// 在进程号hash表中查找指定进程号pid的任务。如果找到了进程号是pid的进程，并且该进程
 // 的父进程就是当前进程或者该进程就是当前进程，那么若该任务已经是会话首领，则出错返回。
 // 若该任务的会话（session）与当前进程的不同，或者指定的进程组号pgid与pid不同并且
 // pgid进程组所属的会话号与当前进程所属会话号不同，则也出错返回。 否则把查找到的进程的
 // pgrp设置为pgid，并返回0.若没有找到指定pid的进程，则返回进程不存在出错码。
-        for (i = 0; i < NR_TASKS; i++)
-                if (task[i] && (task[i]->pid == pid) &&
-                    ((task[i]->p_pptr == current) ||
-                     (task[i] == current))) {
-                        if (task[i]->leader)
-                                return -EPERM;
-                        if ((task[i]->session != current->session) ||
-                            ((pgid != pid) &&
-                             (session_of_pgrp(pgid) != current->session)))
-                                return -EPERM;
-                        task[i]->pgrp = pgid;
-                        return 0;
-                }
+        if ((p = find_task_by_pid(pid)) &&
+            ((p->p_pptr == current) || (p == current))) {
+                if (p->leader)
+                        return -EPERM;
+                if ((p->session != current->session) ||
+                    ((pgid != pid) &&
+                     (session_of_pgrp(pgid) != current->session)))
+                        return -EPERM;
+                p->pgrp = pgid;
+                return 0;
+        }
         return -ESRCH;
 }
 
@@ -618,15 +631,15 @@ int sys_gettimeofday(struct timeval * tv, struct timezone * tz)
 {
 // 如果参数给定的timeval结构指针不空，则在该结构中返回当前时间（秒值和微秒值）；
 // 如果参数给定的用户数据空间中timzezone结构的指针不空，则也返回该结构的信息。
-// 程序中startup_time是系统开机时间（秒值）。宏CT_TO_SECS和CT_TO_USECS用于
-// 把系统当前嘀嗒数转换成用秒值加微秒值表示。它们定义在include/linux/sched.h
-// 文件中。jiffies_offset是系统嘀嗒数误差调整数。
+// 当前时间由do_gettimeofday()取得，它在系统嘀嗒数的基础上再读8253计数器，以得到
+// 本嘀嗒内已经过去的微秒数（kernel/sched.c）。
         if (tv) {
+                struct timeval now;
+
+                do_gettimeofday(&now);
                 verify_area(tv, sizeof *tv);
-                put_fs_long(startup_time + CT_TO_SECS(jiffies+jiffies_offset),
-                            (unsigned long *) tv);
-                put_fs_long(CT_TO_USECS(jiffies+jiffies_offset),
-                            ((unsigned long *) tv) + 1);
+                put_fs_long(now.tv_sec, (unsigned long *) tv);
+                put_fs_long(now.tv_usec, ((unsigned long *) tv) + 1);
         }
         if (tz) {
                 verify_area(tz, sizeof *tz);
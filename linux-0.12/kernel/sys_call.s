@@ -75,7 +75,7 @@ ENOSYS          = 38    // 系统调用号出错码。
  * strange reason. Urgel. Now I just ignore them.
  */
 
-.globl system_call,sys_fork,timer_interrupt,sys_execve
+.globl system_call,sys_fork,timer_interrupt,sys_execve,ret_from_fork
 .globl hd_interrupt,floppy_interrupt,parallel_interrupt
 .globl device_not_available,coprocessor_error
 
@@ -140,10 +140,10 @@ system_call:
 // 以下这段代码执行从系统调用的C函数返回后，对信号进行识别处理。其他中断服务程序退出时也
 // 将跳转到这里进行处理后才退出中断过程，例如后面131行上的处理器出错中断 int 16。
 // 首先判别当前任务是否是初始任务task0，如果是则不必对其进行信号方面的处理，直接返回。
-// 109行上的_task对应C程序中的task[]数组，直接引用task相当于引用task[0]。
+// init_task是任务0的任务结构（kernel/sched.c），这里比较的是它的地址。
 ret_from_sys_call:
         movl    current, %eax
-        cmp     task, %eax              // task[0] cannot have signals
+        cmpl    $init_task, %eax        // task[0] cannot have signals
         je      3f                      // 向前（forward）跳转到标号3处退出中断处理。
 
 // 通过对调用程序代码选择符的检查来判断调用程序是否是用户任务。如果不是则直接退出中断
@@ -157,6 +157,11 @@ ret_from_sys_call:
         cmpw    $0x17, OLDSS(%esp)      // was stack segment = 0x17 ?
         jne     3f
 
+// 返回用户态之前，若时钟中断或唤醒实时任务时要求重新调度（need_resched不为0），则先
+// 执行调度程序。schedule()会清除该标志，返回后再从ret_from_sys_call处继续执行。
+        cmpl    $0, need_resched
+        jne     reschedule
+
 // 下面这段代码（行115-128）用于处理当前任务的信号。首先取当前任务结构中的信号位图（32位，
 // 每位代表1种信号），然后用任务结构中的信号阻塞（屏蔽）码，阻塞不允许的信号位，取得数值
 // 最小的信号值，再把信号位图中该信号对应的位复位（置0），最后将该信号值作为参数之一调
@@ -180,6 +185,7 @@ ret_from_sys_call:
         jne     2b                      // see if we need to switch tasks, or do more signals
 
 3:
+restore_all:
         popl    %eax                    // eax 中含有第100行入栈的系统调用返回值。
         popl    %ebx
         popl    %ecx
@@ -277,7 +283,7 @@ timer_interrupt:
         mov     %ax, %es
         movl    $0x17, %eax     // fs置为指向局部数据段（程序的数据段）。
         mov     %ax, %fs
-        incl    jiffies
+// jiffies由do_timer()增加，因为高精度睡眠的单次定时中断并不是一个滴答。
 // 由于初始化中断控制芯片时没有采用自动EOI，所以这里需要发指令结束该硬件中断。
         movb    $0x20, %al      // EOI to interrupt controller #1
         outb    %al, $0x20
@@ -304,7 +310,7 @@ sys_execve:
 
 #### sys_fork()调用，用于创建子进程，是system_call功能2.原形在include/linux/sys.h中。
 // 首先调用C函数find_empty_process()，取得一个进程号 last_pid。若返回负数则说明目前任务
-// 数组已满。否则调用copy_process()复制进程。
+// 数已达到上限NR_TASKS。否则以该进程号为参数调用copy_process()复制进程。
 .align 4
 sys_fork:
         call    find_empty_process      // 为新进程取得进程号 last_pid。（kernel/fork.c，143）。
@@ -319,6 +325,35 @@ sys_fork:
         addl    $20, %esp               // 丢弃这里所有压栈内容
 1:      ret
 
+#### 新创建的任务第1次被switch_to()切换进来时从这里开始执行。
+// copy_process()已在新任务的内核栈上构造好了与系统调用返回时相同的栈帧，其下是用户态的
+// gs、esi、edi和ebp。恢复这几个寄存器后开中断，然后就像系统调用返回一样返回用户态。
+.align 4
+ret_from_fork:
+        pop     %gs
+        popl    %esi
+        popl    %edi
+        popl    %ebp
+        sti
+        jmp     ret_from_sys_call
+
+#### 硬盘和软盘中断的返回处理。
+// 读写完成的中断会唤醒等待的任务，被唤醒的实时任务或更高优先级的任务会置need_resched。
+// 若中断发生在用户态，则像ret_from_sys_call一样先执行调度程序再返回，否则被唤醒的任务
+// 要等到下一次时钟中断或系统调用才能运行。中断发生在内核态时不调度（内核不可抢占），
+// 由返回用户态时或cond_resched()处处理。与ret_from_sys_call不同，这里不处理信号（见本
+// 文件开头的说明）。
+.align 4
+ret_from_intr:
+        cmpw    $0x0f, CS(%esp)         // 中断发生在用户态？
+        jne     restore_all
+        cmpw    $0x17, OLDSS(%esp)
+        jne     restore_all
+        cmpl    $0, need_resched
+        je      restore_all
+        call    schedule
+        jmp     ret_from_intr
+
 #### int 46 -- (int 0x2E) 硬盘中断处理程序，响应硬件中断请求 IRQ14。
 // 当请求的硬盘操作完成或出错就会发出此中断信号。（参见kernel/blk_drv/hd.c）。
 // 首先向8259A中断控制从芯片发送结束硬件中断指令（EOI），然后取变量do_hd中的函数指针放入edx
@@ -326,12 +361,14 @@ sys_fork:
 // unexcpected_hd_interrupt(),用于显示出错信息。随后向8259A主芯片发送EOI指令，并调用edx中
 // 指针指向的函数：read_intr()、write_intr()或unexcpected_hd_interrupt()。
 hd_interrupt:
-        pushl   %eax
-        pushl   %ecx
+        push    %ds                     // 按与时钟中断相同的格式保存寄存器，
+        push    %es                     // 以便返回时由ret_from_intr检查是否
+        push    %fs                     // 需要重新调度。
+        pushl   $-1                     // 填-1，表示不是系统调用。
         pushl   %edx
-        push    %ds
-        push    %es
-        push    %fs
+        pushl   %ecx
+        pushl   %ebx
+        pushl   %eax
         movl    $0x10, %eax             // ds,es置为内核数据段。
         mov     %ax, %ds
         mov     %ax, %es
@@ -345,21 +382,18 @@ hd_interrupt:
 // do_hd定义为一个函数指针，将被赋值read_intr()或write_intr()函数地址。放到edx寄存器后
 // 就将do_hd指针变量置为NULL。然后测试得到的函数指针，若该指针为空，则赋予该指针指向C
 // 函数 unexpected_hd_interupt()，以处理未知硬盘中断。
-1:      xorl    %edx, %edx
-        movl    %edx, hd_timeout        // hd_timeout置为0。表示控制器已在规定时间内产生了中断。
+1:      pushl   $hd_timeout             // 控制器已在规定时间内产生了中断，因此取消
+        call    del_timer               // 硬盘超时定时器hd_timeout。
+        addl    $4, %esp
+        movb    $0x20, %al              // del_timer()用了eax，重新置EOI指令。
+        xorl    %edx, %edx
         xchg    do_hd, %edx
         testl   %edx, %edx
         jne     1f                      // 若空，则让指针指向C函数 unexpected_hd_interrupt()。
         movl    $unexpected_hd_interrupt, %edx
 1:      outb    %al, $0x20              // 送8259A主芯片EOI指令（结束硬件中断）。
         call    *%edx                   // "interesting" way of handling intr.
-        pop     %fs                     // 上句调用do_hd指向的C函数。
-        pop     %es
-        pop     %ds
-        popl    %edx
-        popl    %ecx
-        popl    %eax
-        iret
+        jmp     ret_from_intr           // 上句调用do_hd指向的C函数。
 
 #### int38 -- (int 0x26) 软盘驱动器中断处理程序，响应硬件中断请求 IRQ6。
 // 其处理过程与上面对硬盘的处理基本一样。（kernel/blk_drv/floppy.c）。
@@ -368,12 +402,14 @@ hd_interrupt:
 // unexpected_floppy_interrupt()，用于显示出错信息。随后调用eax指向的函数：rw_interrupt,
 // seek_interrupt,recal_interrupt,reset_interrupt或unexpected_floppy_interrupt。
 floppy_interrupt:
-        pushl   %eax
-        pushl   %ecx
+        push    %ds                     // 按与时钟中断相同的格式保存寄存器，
+        push    %es                     // 以便返回时由ret_from_intr检查是否
+        push    %fs                     // 需要重新调度。
+        pushl   $-1                     // 填-1，表示不是系统调用。
         pushl   %edx
-        push    %ds
-        push    %es
-        push    %fs
+        pushl   %ecx
+        pushl   %ebx
+        pushl   %eax
         movl    $0x10, %eax             // ds,es置为内核数据段。
         mov     %ax, %ds
         mov     %ax, %es
@@ -384,19 +420,16 @@ floppy_interrupt:
 // do_floppy为一函数指针，将被赋值实际处理C函数指针。该指针在被交换放到eax寄存器后就将
 // do_floppy变量置空。然后测试eax中原指针是否为空，若是则使指针指向C函数
 // unexpected_floppy_interupt()。
+        pushl   $floppy_timeout         // 取消软盘超时定时器floppy_timeout。
+        call    del_timer
+        addl    $4, %esp
         xorl    %eax, %eax
         xchgl   do_floppy, %eax
         testl   %eax, %eax              // 测试函数指针是否=NULL？
         jne     1f                      // 若空，则使指针指向C函数unexpected_floppy_interrupt()。
         movl    $unexpected_floppy_interrupt, %eax
 1:      call    *%eax                   // "interesting" way of hanling intr.
-        pop     %fs
-        pop     %es
-        pop     %ds
-        popl    %edx
-        popl    %ecx
-        popl    %eax
-        iret
+        jmp     ret_from_intr
 
 #### int 39 -- (int 0x27) 并行口中断处理程序，对应硬件中断表示信号 IRQ7。
 // 本版本内核还未实现。这里只是发送EOI指令。
@@ -101,8 +101,7 @@ static void die(char * str,long esp_ptr,long nr)
 			printk("%p ",get_seg_long(0x17,i+(long *)esp[3]));
 		printk("\n");
 	}
-	str(i);		// 取当前运行任务的任务号（include/linux/sched.h，210行）。
-	printk("Pid: %d, process nr: %d\n\r",current->pid,0xfff & i); // 进程号，任务号。
+	printk("Pid: %d, tasks: %d\n\r",current->pid,nr_tasks); // 进程号，现有任务数。
 	for (i=0; i < 10; i++)
 		printk("%02x ", 0xff & get_seg_byte(esp[1], (i + (char *)esp[0])));
 	printk("\n\r");
@@ -0,0 +1,211 @@
+/*
+ * linux/mm/filemap.c
+ *
+ * (C) 1991 Linus Torvalds
+ */
+
+/*
+ * This file keeps a small cache of pages read in from executables
+ * and libraries, indexed by (device, inode, block). A page found here
+ * can be mapped read-only straight into a faulting process, without
+ * having to search other tasks or to re-read it through the buffer
+ * cache. The cache holds its own reference (mem_map count) on every
+ * page, so cached pages survive the exit of all their users. Entries
+ * are allocated a page at a time as needed, so a page that is mapped
+ * (and thus pinned) never has to be kept out of the cache. Entries are
+ * also chained by (device, inode), so that a write to a file only has
+ * to look at that file's pages.
+ *
+ * 本文件为执行文件和库文件中读入的页面维护一个小的页面高速缓冲，以（设备号，i节点
+ * 号，块号）为索引。在缺页处理中若在此找到了所需页面，就可以直接以只读方式把它映射
+ * 到进程的地址空间中，而不用再搜索其他任务或重新通过缓冲区读入页面并复制。页面缓冲
+ * 对其中每个页面都持有一个引用（mem_map[]计数），因此即使所有使用它的进程都退出了，
+ * 缓冲的页面依然有效。缓冲项按需一次申请一页，因此被映射着（因而不能回收）的页面总能
+ * 加入缓冲。缓冲项还按（设备号，i节点号）链接在一起，写文件时只需查看该文件的页面。
+ */
+
+#include "linux/fs.h"
+#include "sys/types.h"
+
+#include <linux/mm.h>		// 内存管理头文件。定义页面长度，和一些内存管理函数原型。
+#include <linux/sched.h>	// 调度程序头文件。定义了任务结构task_struct、任务0的数据，
+				// 还有一些有关描述符参数设置和获取的嵌入式汇编函数宏语句。
+#include <linux/kernel.h>	// 内核头文件。含有一些内核常用函数的原型定义。
+
+#define NR_CACHE_CHUNK 1024	/* 最多可申请的缓冲项页面数 */
+#define NR_PAGE_HASH 127	/* 页面缓冲hash表项数 */
+#define NR_INODE_HASH 307	/* 按文件链接缓冲项的hash表项数 */
+
+// 页面缓冲项结构。页面由其所属文件的设备号、i节点号以及页面在文件中的起始块号确定。
+// 这里不直接使用内存i节点指针，因为i节点被释放后内存i节点表项可能被其他文件重用。
+struct page_cache {
+	unsigned short dev;			// 文件所在设备号（0表示该项空闲）。
+	unsigned short ino;			// 文件i节点号。
+	unsigned long block;			// 页面在文件中的起始块号。
+	unsigned long page;			// 缓冲页面的物理地址。
+	struct page_cache * next;		// hash链表上的下一项。
+	struct page_cache * inode_next;		// 文件hash链表上的下一项、
+	struct page_cache ** inode_pprev;	// 以及指向前一项inode_next字段或表头的指针。
+};
+
+// 每页内存可存放的缓冲项数。
+#define PAGE_CACHE_PER_PAGE (PAGE_SIZE / sizeof (struct page_cache))
+// 取第i个缓冲项的指针。缓冲项存放在cache_chunk[]指向的各个页面中。
+#define cache_entry(i) \
+(cache_chunk[(i) / PAGE_CACHE_PER_PAGE] + (i) % PAGE_CACHE_PER_PAGE)
+
+static struct page_cache * cache_chunk[NR_CACHE_CHUNK];	// 存放缓冲项的页面。
+static int nr_page_cache = 0;		// 已申请的缓冲项数。
+static struct page_cache * page_hash[NR_PAGE_HASH];
+static struct page_cache * inode_hash[NR_INODE_HASH];
+static int cache_clock = 0;		// 回收缓冲项时的循环扫描位置。
+
+// 下面两行代码是hash（散列）函数定义和hash表项的计算宏。
+#define _pc_hashfn(dev,ino,block) (((unsigned)((dev^ino)+block))%NR_PAGE_HASH)
+#define pc_hash(dev,ino,block) page_hash[_pc_hashfn(dev,ino,block)]
+// 按文件（设备号，i节点号）链接缓冲项的hash表项。同一文件的所有缓冲项都在同一链表上。
+#define pc_inode_hash(dev,ino) inode_hash[((unsigned)(dev^ino))%NR_INODE_HASH]
+
+/// 从hash链表中取下并释放一个页面缓冲项。
+// 释放缓冲对页面的引用。若页面还被某些进程映射着，则页面本身仍被它们继续使用。
+static void remove_page_cache(struct page_cache * pc)
+{
+	struct page_cache ** p;
+
+	for (p = &pc_hash(pc->dev, pc->ino, pc->block); *p; p = &(*p)->next)
+		if (*p == pc) {
+			*p = pc->next;
+			break;
+		}
+	if ((*pc->inode_pprev = pc->inode_next))
+		pc->inode_next->inode_pprev = pc->inode_pprev;
+	pc->inode_next = NULL;
+	pc->inode_pprev = NULL;
+	free_page(pc->page);
+	pc->dev = 0;
+	pc->page = 0;
+}
+
+/// 在页面缓冲中查找文件inode从块号block开始的页面。
+// 找到则返回页面物理地址，否则返回0。注意：本函数并不增加页面的引用计数。
+unsigned long find_page_cache(struct m_inode * inode, unsigned long block)
+{
+	struct page_cache * pc;
+
+	for (pc = pc_hash(inode->i_dev, inode->i_num, block); pc; pc = pc->next)
+		if (pc->dev == inode->i_dev && pc->ino == inode->i_num &&
+		    pc->block == block)
+			return pc->page;
+	return 0;
+}
+
+/// 再申请一页内存存放缓冲项。
+// 新页面已被get_free_page()清零，其中的缓冲项都是空闲的。申请页面时可能睡眠，若在此
+// 期间其他进程已经申请过了，则释放刚申请的页面。成功返回1，否则返回0。
+static int grow_page_cache(void)
+{
+	unsigned long page;
+	int n = nr_page_cache / PAGE_CACHE_PER_PAGE;
+
+	if (n >= NR_CACHE_CHUNK || !(page = get_free_page()))
+		return 0;
+	if (cache_chunk[n]) {
+		free_page(page);
+		return 1;
+	}
+	cache_chunk[n] = (struct page_cache *) page;
+	nr_page_cache += PAGE_CACHE_PER_PAGE;
+	return 1;
+}
+
+/// 把文件inode从块号block开始的页面page加入页面缓冲。
+// 若加入成功，则缓冲持有页面的一个引用（mem_map[]计数增1），返回1。若缓冲中已经有
+// 该页面（例如在读页面而睡眠期间被其他进程加入），则返回0。没有空闲项时先回收那些只
+// 被缓冲自己引用着的页面（引用计数为1），若也没有，则再申请一页缓冲项。只有在内存耗尽
+// 时才会因为申请不到缓冲项而返回0。
+int add_page_cache(struct m_inode * inode, unsigned long block, unsigned long page)
+{
+	struct page_cache * pc;
+	int i;
+
+repeat:
+	if (find_page_cache(inode, block))
+		return 0;
+	for (i = 0; i < nr_page_cache; i++) {
+		pc = cache_entry(cache_clock);
+		if (++cache_clock >= nr_page_cache)
+			cache_clock = 0;
+		if (!pc->dev)
+			break;
+		if (mem_map[MAP_NR(pc->page)] == 1) {
+			remove_page_cache(pc);
+			break;
+		}
+	}
+	if (i >= nr_page_cache) {
+		if (!grow_page_cache())
+			return 0;
+		goto repeat;
+	}
+	pc->dev = inode->i_dev;
+	pc->ino = inode->i_num;
+	pc->block = block;
+	pc->page = page;
+	pc->next = pc_hash(pc->dev, pc->ino, block);
+	pc_hash(pc->dev, pc->ino, block) = pc;
+	pc->inode_pprev = &pc_inode_hash(pc->dev, pc->ino);
+	if ((pc->inode_next = *pc->inode_pprev))
+		pc->inode_next->inode_pprev = &pc->inode_next;
+	*pc->inode_pprev = pc;
+	mem_map[MAP_NR(page)]++;
+	return 1;
+}
+
+/// 使文件inode在页面缓冲中的所有页面无效。
+// 在文件被写入或截断时调用，以免以后执行或映射该文件时使用过时的页面内容。每次写文件
+// 都会调用本函数，因此这里只查看文件hash链表，而不扫描整个缓冲。该文件没有缓冲页面时
+// 链表通常为空，函数立刻返回。
+void invalidate_page_cache(struct m_inode * inode)
+{
+	struct page_cache * pc, * next;
+
+	for (pc = pc_inode_hash(inode->i_dev, inode->i_num); pc; pc = next) {
+		next = pc->inode_next;
+		if (pc->dev == inode->i_dev && pc->ino == inode->i_num)
+			remove_page_cache(pc);
+	}
+}
+
+/// 使设备dev在页面缓冲中的所有页面无效。
+// 在卸载文件系统或更换软盘时调用。
+void invalidate_dev_page_cache(int dev)
+{
+	struct page_cache * pc;
+	int i;
+
+	for (i = 0; i < nr_page_cache; i++) {
+		pc = cache_entry(i);
+		if (pc->dev == dev)
+			remove_page_cache(pc);
+	}
+}
+
+/// 回收一个页面缓冲页面。
+// 在get_free_page()找不到空闲页面时被调用。释放一个只被页面缓冲引用着的页面。
+// 成功则返回1，否则返回0。
+int shrink_page_cache(void)
+{
+	struct page_cache * pc;
+	int i;
+
+	for (i = 0; i < nr_page_cache; i++) {
+		pc = cache_entry(cache_clock);
+		if (++cache_clock >= nr_page_cache)
+			cache_clock = 0;
+		if (pc->dev && mem_map[MAP_NR(pc->page)] == 1) {
+			remove_page_cache(pc);
+			return 1;
+		}
+	}
+	return 0;
+}
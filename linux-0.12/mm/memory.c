@@ -45,6 +45,8 @@
 	current->start_code + current->end_code)
 
 unsigned long HIGH_MEMORY = 0;	// 全局变量，存放实际物理内存最高端地址。
+
+void do_no_page(unsigned long error_code, unsigned long address);
 // 从from处复制1页内存到to处（4K字节）。
 #define copy_page(from, to) 			\
 __asm__("cld \t\n rep  movsl" 			\
@@ -53,9 +55,11 @@ __asm__("cld \t\n rep  movsl" 			\
 __asm__("":::"ecx","edi","esi")
 
 // 物理内存映射字节图（1字节代表1页内存）。每个页面对应的字节用于标志页面当前被引用
-// （占用）次数。对于含有16MB物理内存的机器，它最大可以映射15MB的内存空间。在初始化
-// 函数mem_init()中，对于不能用作主内存区页面的位置均都预先被设置成USED（100）。
-unsigned char mem_map[PAGING_PAGES] = {0,};
+// （占用）次数。它的长度随实际物理内存大小而定，由mem_init()在主内存区开始处分配，
+// 共paging_pages项。在初始化函数mem_init()中，对于不能用作主内存区页面的位置均都预
+// 先被设置成USED（100）。
+unsigned char * mem_map = NULL;
+unsigned long paging_pages = 0;
 
 /*
  * Free a page of memory at physical address 'addr'. Used by
@@ -79,7 +83,14 @@ void free_page(unsigned long addr)
 // 题。于是显示出错信息并停机。
 	addr -= LOW_MEM;
 	addr >>= 12;
-	if (mem_map[addr]--) return;
+	if (mem_map[addr]--) {
+		if (!mem_map[addr]) {
+			nr_free_pages++;	// 页面变为空闲，空闲页面数增1。
+			if (oom_wait)		// 唤醒等待内存的任务（见mm/swap.c中oom_kill()）。
+				wake_up_all(&oom_wait);
+		}
+		return;
+	}
 	mem_map[addr] = 0;
 	panic("trying to free free page");
 }
@@ -89,13 +100,13 @@ void free_page(unsigned long addr)
  * by 'exit()'. As does copy_page_tables(), this handles only 4Mb blocks.
  */
 /// 根据指定的线性地址和限长（页表个数），释放内存块并置表项空闲。
-// 页目录表位于物理地址0开始处，共1024项，每项4字节，共占用4K字节。每个目录项指定一个
-// 页表。内核页表从物理地址0x1000处开始（紧接着目录空间），共4个页表。每个页表有1024
-// 项，每项4字节。因此也占4K（1页）内存。除了在内核代码中的进程0和1以外，其它各进程
-// 的页表所占据的页面在进程被创建时由内核为其在主内存区申请得到。每个页表项对应1页物理
-// 内存，因此一个页表最多可映射4MB的物理内存。
-// 参数：from - 起始线性基地址；size - 释放的字节长度。
-int free_page_tables(unsigned long from, unsigned long size)
+// 每个任务都有自己的页目录表，共1024项，每项4字节，共占用4K字节。每个目录项指定一个
+// 页表。任务0的页目录表pg_dir位于物理地址0开始处，其中头256项是内核对等映射用的页表，
+// 其他任务页目录表的头256项都是从pg_dir中复制来的。每个页表有1024项，每项4字节。因此也
+// 占4K（1页）内存。任务自己的页表所占据的页面在进程被创建时由内核为其在主内存区申请
+// 得到。每个页表项对应1页物理内存，因此一个页表最多可映射4MB的物理内存。
+// 参数：p - 页目录表所属的任务；from - 起始线性基地址；size - 释放的字节长度。
+int free_page_tables(struct task_struct * p, unsigned long from, unsigned long size)
 {
 	unsigned long * pg_table;
 	unsigned long * dir, nr;
@@ -106,14 +117,14 @@ int free_page_tables(unsigned long from, unsigned long size)
 // 1个页表可管理4MB物理内存，所以这里用右移22位的方式把需要复制的内存长度值除以4MB。
 // 其中加上0x3fffff（即4MB-1）用于得到进位整数倍结果，即除操作若有余数则进1.例如，如
 // 果原size = 4.01MB，那么可得到结果size = 2。接着计算给出的线性基地址对应的起始目录项。
-// 对应的目录项号等于from >> 20。因为每项占4字节，并且由于页目录表从物理地址0开始存放，
-// 因此实际目录项指针 = 目录项号<<2，也即（from>>20）。“与”上0xffc确保目录项指针范围有效。
+// 对应的目录项号等于from >> 22。因为每项占4字节，因此目录项在任务p页目录表中的偏移
+// = 目录项号<<2，也即（from>>20）。“与”上0xffc确保目录项指针范围有效。
 	if (from & 0x3fffff)
 		panic("free_page_tables called with wrong alignment");
 	if (!from)
 		panic("Trying to free up swapper memory space");
 	size = (size + 0x3fffff) >> 22;
-	dir = (unsigned long *) ((from>>20) & 0xffc); /* _pg_dir = 0 */
+	dir = PAGE_DIR_OFFSET(p, from);
 
 // 此时size是释放的页表个数，即页目录数，而dir是起始目录项指针。现在对页目录项开始
 // 循环操作，依次释放每个页表中的页表项。如果当前目录项无效（P位=0），表示该目录项没有
@@ -139,6 +150,7 @@ int free_page_tables(unsigned long from, unsigned long size)
 		}
 		free_page(0xfffff000 & *dir); 		// 释放该页表所占内存页面。 
 		*dir = 0;				// 对应页表的目录项清零。
+		cond_resched();				// 每处理完一个页表就看是否需要让出CPU。
 	}
 	invalidate();			// 刷新CPU页变换调整缓冲。
 	return 0;
@@ -182,8 +194,10 @@ int free_page_tables(unsigned long from, unsigned long size)
 // 理内存页面区被两套页表映射而共享使用。在复制时，需申请新页面来存放新页表，原物理内存
 // 区被共享。此后两个进程（父进程和其子进程）将共享内存区，直到有一个进程执行写操作时，
 // 内核才会为写操作进程分配新的内存页（写时复制机制）。
-// 参数from、to是线性地址，size是需要复制（共享）的内存长度，单位是字节。
-int copy_page_tables(unsigned long from, unsigned long to, long size)
+// 参数from是当前进程中的线性地址，to是新任务p中的线性地址，size是需要复制（共享）的
+// 内存长度，单位是字节。
+int copy_page_tables(struct task_struct * p, unsigned long from,
+	unsigned long to, long size)
 {
 	unsigned long * from_page_table;
 	unsigned long * to_page_table;
@@ -199,8 +213,8 @@ int copy_page_tables(unsigned long from, unsigned long to, long size)
 // 出的长度size计算要复制的内存块占用的页表数（即目录项数）。参见前面对78、79行的解释。
 	if ((from&0x3fffff) || (to&0x3fffff))
 		panic("copy_page_tables called with wrong alignment");
-	from_dir = (unsigned long *) ((from>>20) & 0xffc); /* _pg_dir = 0 */
-	to_dir = (unsigned long *) ((to>>20) & 0xffc);
+	from_dir = PAGE_DIR_OFFSET(current, from);
+	to_dir = PAGE_DIR_OFFSET(p, to);
 	size = ((unsigned) (size + 0x3fffff)) >> 22;
 // 在得到了源起始目录项指针from_dir和目的起始目录项指针to_dir以及需要复制的页表
 // 个数size后，下面开始对每个页目录项依次申请1页内存来保存对应的页表，并且开始
@@ -270,6 +284,9 @@ int copy_page_tables(unsigned long from, unsigned long to, long size)
 				mem_map[this_page]++;
 			}
 		}
+// 每复制完一个页表就看是否需要让出CPU。此时这个页表已经完整，切换任务时重新加载CR3
+// 也会刷新页变换高速缓冲。
+		cond_resched();
 	}
 	invalidate();			// 刷新页变换调整缓冲。
 	return 0;
@@ -294,8 +311,6 @@ int copy_page_tables(unsigned long from, unsigned long to, long size)
 static unsigned long put_page(unsigned long page, unsigned long address)
 {
 	unsigned long tmp, *page_table;
-/* NOTE !!! This uses the fact that _pg_dir=0 */
-
 // 函数首先判断参数给定物理内存页面page的有效性。如果该页面位置低于LOW_MEM（1MB）或超
 // 出系统实际含有内存高端HIGH_MEMORY，则发出警告。LOW_MEM=1MB，在include/linux/mm.h中
 // 定义。它是主内存区可能有最小起始位置。当系统物理内存小于或等于6MB时，主内存区就直
@@ -310,7 +325,7 @@ static unsigned long put_page(unsigned long page, unsigned long address)
 // 二级页表地址。 如果该目录项有效（P=1），即指定的页表在内存中，则从中取得指定页表
 // 地址放到page_table变量中。否则申请一空闲页面给页表使用，并在对应目录项中置相应
 // 标志（7 - User、U/S、R/W）。然后将该页表地址放到page_table变量中。
-	page_table = (unsigned long *) ((address>>20) & 0xffc);
+	page_table = PAGE_DIR_OFFSET(current, address);
 	if ((*page_table) & 1)
 		page_table = (unsigned long *) (0xfffff000 & *page_table);
 	else {
@@ -327,6 +342,30 @@ static unsigned long put_page(unsigned long page, unsigned long address)
 	return page;		// 返回物理页面地址。
 }
 
+/// 把页面缓冲中的一物理页面映射到线性地址空间指定位置处。
+// 与put_page()几乎完全一样，但除非rw不为0（共享的可写文件映射），页表项中不置R/W标志，
+// 因此进程写该页面时会引起写保护异常而复制出自己的页面，页面缓冲中的内容不会被修改。
+// 页面的引用计数由调用者负责维护。
+static unsigned long put_shared_page(unsigned long page, unsigned long address, int rw)
+{
+	unsigned long tmp, *page_table;
+
+	if (page < LOW_MEM || page >= HIGH_MEMORY)
+		printk("Trying to put page %p at %p\n", page, address);
+	page_table = PAGE_DIR_OFFSET(current, address);
+	if ((*page_table) & 1)
+		page_table = (unsigned long *) (0xfffff000 & *page_table);
+	else {
+		if (!(tmp = get_free_page()))
+			return 0;
+		*page_table = tmp | 7;
+		page_table = (unsigned long *) tmp;
+	}
+	page_table[(address>>12) & 0x3ff] = page | (rw ? 7 : 5);	// 只读时为U/S、P。
+/* no need for invalidate */
+	return page;
+}
+
 /*
  * The preious function doesn't work very well if you also want to mark
  * the page dirty: exec.c wants this, as it has earlier changed the page,
@@ -345,13 +384,11 @@ unsigned long put_dirty_page(unsigned long page, unsigned long address)
 {
 	unsigned long tmp, *page_table;
 
-/* NOTE !!! This uses the fact that _pg_dir=0 */	
-
 	if (page < LOW_MEM || page >= HIGH_MEMORY)
 		printk("Trying to put page %p at %p\n", page, address);
 	if (mem_map[(page-LOW_MEM)>>12] != 1)
 		printk("mem_map disagrees with %p at %p\n", page, address);
-	page_table = (unsigned long *) ((address>>20) & 0xffc);
+	page_table = PAGE_DIR_OFFSET(current, address);
 	if ((*page_table) & 1)
 		page_table = (unsigned long *) (0xfffff000 & *page_table);
 	else {
@@ -374,7 +411,7 @@ unsigned long put_dirty_page(unsigned long page, unsigned long address)
 // 输入参数为页表项指针。[un_wp_page -- Un-Write Protect-Page]
 void un_wp_page(unsigned long * table_entry)
 {
-	unsigned long old_page, new_page;
+	unsigned long old_page, new_page, entry;
 
 // 首先取参数指定的页表项中物理页面位置（地址）并判断该页面是否是共享页面。如果原
 // 页面地址大于内存低端LOW_MEM（表示在主内存区中），并且其在页面映射字节图数组中
@@ -382,23 +419,35 @@ void un_wp_page(unsigned long * table_entry)
 // （可写），并刷新页变换高速缓冲，然后返回。即如果该内存页面此时只被一个进程使用，
 // 并且不是内核中的进程，就直接把属性改为可写即可，不用重新申请一个新页面。
 	//
-	old_page = 0xfffff000 & *table_entry; 	// 取指定页表项中物理页面地址。
+repeat:
+	entry = *table_entry;
+	old_page = 0xfffff000 & entry; 	// 取指定页表项中物理页面地址。
 	if (old_page >= LOW_MEM && mem_map[MAP_NR(old_page)] == 1) {
 		*table_entry |= 2;		// PAGE_RW 
 		invalidate();
 		return;
 	}
 // 否则就需要在主内存区内申请一空闲页面给执行写操作的进程单独使用，取消页面共享。
-// 如果原页面大于内存低端（则意味着mem_map[] > 1，页面是共享的），则交原页面的页
-// 面映射字节数组值递减1。然后将指定页表项内容更新为新页面地址，并置可读写等标志
-// （U/S、R/W、P）。在刷新页变换调整缓冲之后，最后将原页面内容复制到新页面。
+// get_free_page()可能睡眠（回收页面缓冲、换出页面或等待OOM牺牲者），其间页表项可能
+// 已被换出或修改，共享该页面的其他进程也可能已经放弃了它。因此申请到页面之后要重新
+// 检查：页表项变了就放弃新页面；页面不再共享则回到上面直接置为可写。然后将原页面内
+// 容复制到新页面，将指定页表项内容更新为新页面地址，并置可读写等标志（U/S、R/W、P）。
+// 最后用free_page()释放对原页面的引用，这样原页面变为空闲时空闲页面数和等待内存的
+// 任务也能得到正确的处理。
 	if (!(new_page = get_free_page()))
 		oom();			// Out of Memory。内存不够处理。
-	if (old_page >= LOW_MEM)
-		mem_map[MAP_NR(old_page)]--;
+	if (*table_entry != entry) {
+		free_page(new_page);
+		return;
+	}
+	if (old_page >= LOW_MEM && mem_map[MAP_NR(old_page)] == 1) {
+		free_page(new_page);
+		goto repeat;
+	}
 	copy_page(old_page, new_page);
 	*table_entry = new_page | 7;
 	invalidate();
+	free_page(old_page);
 }
 
 /*
@@ -420,12 +469,14 @@ void un_wp_page(unsigned long * table_entry)
 // 异常的页面线性地址。在写共享页面时需复制页面（写时复制）。
 void do_wp_page(unsigned long error_code, unsigned long address)
 {
+	unsigned long * table_entry;
+
 // 首先判断CPU控制寄存CR2给出的引起页面异常的线性地址在什么范围中。如果address
-// 小于 TASK_SIZE （0x4000000，即64MB），表示异常页面位置在内核或任务0或任务1所处
+// 小于 TASK_BASE （0x40000000，即1GB），表示异常页面位置在内核或任务0所处
 // 的线性地址范围内，于是发出警告信息“内核范围内存被写保护”；如果（address - 当前
 // 进程代码起始地址）大于一个进程的长度（64MB），表示address所指的线性地址不在引起
 // 异常的进程线性地址空间范围内，则在发出出错信息后退出。
-	if (address < TASK_SIZE)
+	if (address < TASK_BASE)
 		printk("\n\rBAD! KERNEL MEMORY WP-ERR!\n\r");
 	if (address - current->start_code > TASK_SIZE) {
 		printk("Bad things happen: page error in do_wp_page\n\r");
@@ -455,13 +506,17 @@ void do_wp_page(unsigned long error_code, unsigned long address)
 // = (address>>20)”就是指定项在目录表中的偏移地址。“&0xffc”用于屏蔽目录项索引值中最
 // 后2位。因为只移动了20位，因此最后2位还是页表索引的内容，所以应该屏蔽掉。而
 // “*((address >> 20) & 0xffc)”则是取指定目录表项内容中对应页表的物理地址。最后与上
-// “0xfffff000”用于屏蔽掉页目录项内容中的一些标志位（目录项低12位）。更直观地表示为
-// “(0xfffff000 & *((unsigned long *)(((address >> 22) & 0x3ff) << 2)))”。
+// “0xfffff000”用于屏蔽掉页目录项内容中的一些标志位（目录项低12位）。现在每个任务都有
+// 自己的页目录表，因此目录项偏移还要加上当前任务页目录表的地址，即PAGE_DIR_OFFSET()。
 // ③由①中页表项在页表中偏移地址，加上②中目录表项内容中对应页表的地址即可得到页表项
-// 的指针。然后这里对共享的页面进行复制操作。
-	un_wp_page((unsigned long *)
+// 的指针。然后这里对共享的页面进行复制操作。但共享文件映射区中的页面不复制，而是由
+// mmap_wp_page()直接置为可写。
+	table_entry = (unsigned long *)
 		(((address>>10) & 0xffc) +
-		 (0xfffff000 & *((unsigned long *) ((address>>20) & 0xffc)))));
+		 (0xfffff000 & *PAGE_DIR_OFFSET(current, address)));
+
+	if (!mmap_wp_page(address, table_entry))
+		un_wp_page(table_entry);
 }
 
 /// 写页面验证。
@@ -469,8 +524,21 @@ void do_wp_page(unsigned long error_code, unsigned long address)
 // 参数address是指定页面在4G空间中的线性地址。
 void write_verify(unsigned long address)
 {
-	unsigned long page;
+	unsigned long page, tmp;
 
+// 若地址在文件映射区中，则先把还不存在的页面映射进来（见mm/mmap.c）。执行文件和库文件
+// 中的页面同样可能以只读方式与页面缓冲或其他进程共享，因此对它们也先执行缺页处理。内
+// 核写用户空间时CPU不理会页面的写保护，若等到写时才缺页，被共享的页面就会被内核直接修
+// 改。页面映射进来之后，下面再按写保护页面处理（写时复制）。
+	mmap_write_verify(address);
+	tmp = address - current->start_code;
+	if ((tmp >= LIBRARY_OFFSET && current->library) ||
+	    (tmp < current->end_data && current->executable)) {
+		page = *PAGE_DIR_OFFSET(current, address);
+		if (!(page & 1) || !(1 & *(unsigned long *)
+		    ((page & 0xfffff000) + ((address>>10) & 0xffc))))
+			do_no_page(2, address);
+	}
 // 首先取指定线性地址对应的页目录项，并根据目录项中的存在位（P）判断目录项对应的页表是
 // 否存在（存在位P=1？）。若不存在（P=0）则返回。这样处理是因为对于不存在的页面没有共享
 // 和写时复制可言，并且若程序对此不存在的页面执行写操作时，系统就会因为缺页异常而去执行
@@ -478,7 +546,7 @@ void write_verify(unsigned long address)
 // 页表地址，加上指定页面在页表中的页表项偏移值，得对应地址的页表项指针。在该表项中包含
 // 着给定线性地址对应的物理页面。
 	//
-	if (!((page = *((unsigned long *) ((address>>20) & 0xffc))) & 1))
+	if (!((page = *PAGE_DIR_OFFSET(current, address)) & 1))
 		return;
 	page &= 0xfffff000;
 	page += ((address>>10) & 0xffc);
@@ -486,7 +554,8 @@ void write_verify(unsigned long address)
 // 那么就执行共享检验和复制页面操作（写时复制），否则什么也不做，直接退出。
 	// dummy
 	if ((3 & *(unsigned long *) page) == 1) /* non-writeable, present */
-		un_wp_page((unsigned long *) page);
+		if (!mmap_wp_page(address, (unsigned long *) page))
+			un_wp_page((unsigned long *) page);
 	return;
 }
 
@@ -533,15 +602,11 @@ static int try_to_share(unsigned long address, struct task_struct * p)
 	unsigned long from_page;
 	unsigned long to_page;
 	unsigned long phys_addr;
-// 首先分别未得指定进程p中和当前进程中逻辑地址address对应的页目录项。为了计算方便我们
-// 先求出给定逻辑地址address处‘逻辑’页目录项偏移位置，即以进程空间（0 - 64MB ）算出的
-// 页目录项偏移值。该‘逻辑’页目录项号加上p在CPU线性空间中起始地址对应的页目录项，
-// 即得到进程p中地址address处页面所对应的4G线性空间中的实际页目录项地址from_page。
-// 而‘逻辑’页目录项偏移加上当前进程起始地址对应的页目录项位置，即可最后得到当前进程中地
-// 址address处页面所对应的4G线性空间中的实际页目录项地址to_page。
-	from_page = to_page = ((address>>20) & 0xffc); 	// 逻辑的目录项偏移。
-	from_page += ((p->start_code>>20) & 0xffc);	// p进程目录项地址。
-	to_page += ((current->start_code>>20) & 0xffc); // 当前进程目录项地址。
+// 首先分别取得指定进程p中和当前进程中逻辑地址address对应的页目录项。逻辑地址address
+// 加上进程代码起始地址就是它在进程线性空间中的地址，再用PAGE_DIR_OFFSET()在各自的页
+// 目录表中找到对应的目录项from_page和to_page。
+	from_page = (unsigned long) PAGE_DIR_OFFSET(p, p->start_code + address);
+	to_page = (unsigned long) PAGE_DIR_OFFSET(current, current->start_code + address);
 // 在得到这两个进程的目录项后，下面分别对进程p和当前进程进行处理。首先对p进程的页表
 // 项进行操作，目标是取得p进程中address对应的物理内存页面地址，并且判断该物理页面是否
 // 存在，而且干净（没有被修改过，不脏）。方法是先取目录项内容，然后取该目录项对应页表物
@@ -629,40 +694,76 @@ static int try_to_share(unsigned long address, struct task_struct * p)
 // 当前进程欲与p进程共享页面的逻辑页面地址。返回1 - 共享操作成功，0 - 失败。
 static int share_page(struct m_inode * inode, unsigned long address)
 {
-	struct task_struct ** p;
+	struct task_struct * p;
 
 // 首先检查一下参数指定的内存i节点引用计数值。如果该内存i节点的引用计数值不等于1
 // （executable->i_count = 1）或者i节点指针空，表示当前系统中只有1个进程在运行该执
 // 行文件或者提供的i节点无效。因此无共享可言，直接退出函数。
 	if (inode->i_count < 2 || !inode)
 		return 0;
-// 否则搜索任务数组中所有任务，寻找与湔进程可休斯敦页面的进程，即运行相同执行文件的另一
-// 个进程，并尝试对指定地址的页面进行共享。若进程逻辑地址address小于进程库文件在逻辑地
-// 址空间的起始地址LIBRARY_OFFSET，则表明共享的页面在进程执行文件对应的逻辑地址空间范围
-// 内。于是检查指定i节点是否与进程的执行文件i节点（即进程的executable）相同，若不相同则
-// 继续寻找。若逻辑地址address大于等于进程库文件在逻辑地址空间的起始地址LIBRARY_OFFSET，
-// 则表明想要共享的页面在进程使用的库文件中。于是检查指定节点inode是否与进程的库文件i
-// 节点相同，若不相同则继续寻找。如果找到某个进程p，其executable或library字段与指定的
-// 节点inode相同，则调用页面共享试探函数try_to_share()尝试页面共享。若共享操作成功，则
-// 函数返回1，否则返回0。
-	for (p = &LAST_TASK; p > &FIRST_TASK; --p) {
-		if (!*p)				// 如果该任务项空闲，则继续寻找。
-			continue;
-		if (current == *p)			// 如果就是当前任务，也继续寻找。
-			continue;
-		if (address < LIBRARY_OFFSET) {
-			if (inode != (*p)->executable)	// 进程执行文件i节点。
-				continue;
-		} else {
-			if (inode != (*p)->library)	// 进程使用库文件i节点。
-				continue;
-		}
-		if (try_to_share(address, *p))		// 尝试共享页面。
-			return 1;
+// 否则寻找与当前进程可共享页面的进程，即运行相同执行文件的另一个进程，并尝试对指定地
+// 址的页面进行共享。若进程逻辑地址address小于进程库文件在逻辑地址空间的起始地址
+// LIBRARY_OFFSET，则表明共享的页面在进程执行文件对应的逻辑地址空间范围内，于是搜索以
+// inode为执行文件的任务链表i_exec_tasks；否则想要共享的页面在进程使用的库文件中，于是
+// 搜索以inode为库文件的任务链表i_lib_tasks。这样搜索的任务数只与实际共享该i节点的任务
+// 数有关，而与任务数组的大小无关。对找到的每个进程p调用页面共享试探函数try_to_share()
+// 尝试页面共享。若共享操作成功，则函数返回1，否则返回0。
+	if (address < LIBRARY_OFFSET) {
+		for (p = inode->i_exec_tasks; p; p = p->exec_next)
+			if (p != current && try_to_share(address, p))
+				return 1;
+	} else {
+		for (p = inode->i_lib_tasks; p; p = p->lib_next)
+			if (p != current && try_to_share(address, p))
+				return 1;
 	}
 	return 0;
 }
 
+/// 把任务p加入其执行文件（lib = 0）或库文件（lib = 1）i节点的共享任务链表中。
+// 在fork、exec和uselib设置了任务的executable或library字段之后调用。
+void link_inode_task(struct task_struct * p, int lib)
+{
+	if (lib) {
+		if (!p->library)
+			return;
+		p->lib_next = p->library->i_lib_tasks;
+		p->library->i_lib_tasks = p;
+	} else {
+		if (!p->executable)
+			return;
+		p->exec_next = p->executable->i_exec_tasks;
+		p->executable->i_exec_tasks = p;
+	}
+}
+
+/// 把任务p从其执行文件（lib = 0）或库文件（lib = 1）i节点的共享任务链表中删除。
+// 在放回任务的executable或library i节点之前调用。
+void unlink_inode_task(struct task_struct * p, int lib)
+{
+	struct task_struct ** tmp;
+
+	if (lib) {
+		if (!p->library)
+			return;
+		for (tmp = &p->library->i_lib_tasks; *tmp; tmp = &(*tmp)->lib_next)
+			if (*tmp == p) {
+				*tmp = p->lib_next;
+				break;
+			}
+		p->lib_next = NULL;
+	} else {
+		if (!p->executable)
+			return;
+		for (tmp = &p->executable->i_exec_tasks; *tmp; tmp = &(*tmp)->exec_next)
+			if (*tmp == p) {
+				*tmp = p->exec_next;
+				break;
+			}
+		p->exec_next = NULL;
+	}
+}
+
 /// 执行缺页处理。
 // 访问不存在页面的处理函数，页异常中断处理过程中调用此函数。在page.s程序中被调用。
 // 函数参数error_code和address是进程在访问页面时因缺页产生异常而由CPU自动生成。
@@ -676,15 +777,16 @@ void do_no_page(unsigned long error_code, unsigned long address)
 	int nr[4];
 	unsigned long tmp;
 	unsigned long page;
-	int block, i;
+	int block, i, cache;
 	struct m_inode * inode;
+	struct vm_area_struct * vma;
 
 // 首先判断CPU控制寄存器CR2给出的引起页面异常的线性地址在什么范围中。如果address
-// 小于TASK_SIZE（0x4000000，即64MB），表示异常页面位置在内核或任务0和任务1所处
+// 小于TASK_BASE（0x40000000，即1GB），表示异常页面位置在内核或任务0所处
 // 的线性地址范围内，于是发出警告信息“内核范围内存被写保护”；如果（address - 当前
 // 进程代码起始地址）大于琴进程的长度（64MB），表示address所指的线性地址不在引起
 // 异常的进程线性地址空间范围内，则在发出出错信息后退出。
-	if (address < TASK_SIZE)
+	if (address < TASK_BASE)
 		printk("\n\rBAD!! KERNEL PAGE MISSING\n\r");
 	if (address - current->start_code > TASK_SIZE) {
 		printk("Bad things happen: nonexistent page error in do_no_page\n\r");
@@ -696,7 +798,7 @@ void do_no_page(unsigned long error_code, unsigned long address)
 // 性地址address处页面对应的页面表项指针，从而获得页表项内容。若页表项内容不为0，但
 // 页表项存在位P=0，则说明该页表项指定的物理页面应该在交换设备中。于是从交换设备中调
 // 入指定页面后退出函数。
-	page = *(unsigned long *) ((address >> 20) & 0xffc); // 取目录项内容。
+	page = *PAGE_DIR_OFFSET(current, address);	// 取目录项内容。
 	if (page & 1) {
 		page &= 0xfffff000;			// 二级页表地址。
 		page += (address >> 10) & 0xffc;	// 页表项指针。
@@ -712,6 +814,17 @@ void do_no_page(unsigned long error_code, unsigned long address)
 	address &= 0xfffff000;				// address处缺页页面地址。
 	tmp = address - current->start_code;		// 缺页页面对应逻辑地址。
 
+// 若缺页在某个文件映射区中，则从页面缓冲或文件中取得页面（见mm/mmap.c），并映射到
+// address处。共享的可写映射以及只被本进程使用的私有页面直接以可写方式映射，其他的以
+// 只读方式映射，写时再复制。
+	if ((vma = find_vma(current, tmp)) && vma->vm_start <= tmp) {
+		page = mmap_page(vma, tmp);
+		if (put_shared_page(page, address, (vma->vm_flags & VM_WRITE) &&
+		    ((vma->vm_flags & VM_SHARED) || mem_map[MAP_NR(page)] == 1)))
+			return;
+		free_page(page);
+		oom();
+	}
 // 如果该逻辑地址tmp大于库映像文件在进程逻辑空间中的起始位置，说明缺少的页面在库映像文
 // 件中。于是从当前进程任务数据结构中可以取得库映像文件的i节点library，并计算出该缺页
 // 在库文件中的起始数据块号block。如果该逻辑地址tmp小于进程的执行映像逻辑地址空
@@ -734,12 +847,23 @@ void do_no_page(unsigned long error_code, unsigned long address)
 	}
 // 若是进程访问其动态申请的页面或为了存放栈信息而引起的缺页异常，则直接申请一页物理内存
 // 页面并映射到线性地址address处即可。否则说明所缺页面在进程执行文件或库文件范围内，于
-// 是就尝试共享页面操作，若成功则退出。若不成功就只能申请一页物理内存页面page，然后从设
-// 备上读取执行文件中的相应页面并放置（映射）到进程页面逻辑地址tmp处。
+// 是先在页面缓冲中查找该页面，找到则直接以只读方式映射它。然后尝试共享页面操作，若成
+// 功则退出。若不成功就只能申请一页物理内存页面page，然后从设备上读取执行文件中的相应
+// 页面并放置（映射）到进程页面逻辑地址tmp处。
+// 执行文件中只有完全位于代码段（end_code）以内的页面才使用页面缓冲，数据段页面每个进程
+// 都有自己可写的页面。库文件没有记录代码段长度，其页面都使用页面缓冲，写时再复制。
 	if (!inode) {					// 是动态申请的数据内存页面。
 		get_empty_page(address);
 		return;
 	}
+	cache = (tmp >= LIBRARY_OFFSET) || (tmp + 4096 <= current->end_code);
+	if (cache && (page = find_page_cache(inode, block))) {
+		mem_map[MAP_NR(page)]++;
+		if (put_shared_page(page, address, 0))
+			return;
+		free_page(page);
+		oom();
+	}
 	if (share_page(inode, tmp))			// 尝试逻辑地址tmp处页面的共享。
 		return;
 	if (!(page = get_free_page()))			// 申请一页物理内存。
@@ -747,9 +871,9 @@ void do_no_page(unsigned long error_code, unsigned long address)
 /* remember that 1 block is used for header */
 // 根据这个块号和执行文件的i节点，我们就可以从映射位图中找到对应块设备中对应的设备
 // 逻辑块号（保存在nr[]数组中）。利用bread_page()即可把这4个逻辑块读入到物理页面
-// page中。
-	for (i = 0; i < 4; block++,i++)
-		nr[i] = bmap(inode, block);
+// page中。循环中不改变block，它仍是页面的起始块号，下面加入页面缓冲时作为索引。
+	for (i = 0; i < 4; i++)
+		nr[i] = bmap(inode, block + i);
 	bread_page(page, inode->i_dev, nr);
 
 // 在读设备逻辑块操作时，可能会出现这样一种情况，即在执行文件中的读取页面位置可能离
@@ -759,6 +883,14 @@ void do_no_page(unsigned long error_code, unsigned long address)
 	i = tmp + 4096 - current->end_data;		// 超出的字节长度值。
 	if (i > 4096)					// 离末端超过1页则不用清零。
 		i = 0;
+// 只有没有被清零过的完整页面才与文件内容完全一致，可以放入页面缓冲中（页面缓冲持有
+// 一个引用），然后以只读方式映射它。
+	if (cache && i <= 0 && add_page_cache(inode, block, page)) {
+		if (put_shared_page(page, address, 0))
+			return;
+		free_page(page);
+		oom();
+	}
 	tmp = page + 4096;				// tmp指向页面末端。
 	while (i-- > 0) {
 		tmp--;
@@ -772,6 +904,30 @@ void do_no_page(unsigned long error_code, unsigned long address)
 	oom();
 }
 
+/// 建立64MB以上物理内存的内核对等映射页表。
+// head.s中的16个页表只对等映射了头64MB物理内存。对于更多的内存，这里从主内存区开始处
+// start_mem（它在64MB以下，已经可以访问）为每4MB内存分配一个页表，把它填入pg_dir中相
+// 应的目录项。这些页表在创建任何其他任务之前建立，以后fork()把pg_dir中内核的目录项复制
+// 到每个新任务的页目录表中。返回页表占用的内存字节数，调用者（init/main.c）据此把主内
+// 存区开始位置后移。参数end_mem是实际物理内存最大地址，最大为HIGH_MEMORY_LIMIT。
+long kernel_map_init(long start_mem, long end_mem)
+{
+	unsigned long * pg_table, addr, page;
+	long size = 0;
+	int i;
+
+	for (addr = HEAD_MAP_SIZE; addr < end_mem; addr += 0x400000) {
+		pg_table = (unsigned long *) (start_mem + size);
+		size += 4096;
+		page = addr + 7;			// 存在、用户可读写，与head.s相同。
+		for (i = 0; i < 1024; i++, page += 4096)
+			pg_table[i] = page;
+		pg_dir[addr >> 22] = 7 + (unsigned long) pg_table;
+	}
+	invalidate();
+	return size;
+}
+
 /// 内存管理初始化。
 // 该函数对1MB以上的物理内存区域进行初始化设置工作。内核以页为单位管理和访问内存，一
 // 个内存页面长度为4KB。 该函数把1MB以上的所有内存划分成一个个页面，并使用一个页面映射
@@ -786,25 +942,34 @@ void do_no_page(unsigned long error_code, unsigned long address)
 // 而范围0 -- 1MB的内存区专供内核使用。
 // 参数start_mem是可用作页面分配的主内存区起始地址（已去除虚拟盘RAMDISK所占内存空间）。
 // end_mem是实际物理内存最大地址，而从start_mem到end_mem的地址范围就是主内存区。
+// mem_map[]本身也从start_mem处分配，因此主内存区实际从mem_map[]之后的页面开始。
 void mem_init(long start_mem, long end_mem)
 {
 	int i;
 
-// 首先将1MB到16MB范围内所有内存页面对应的内存映射字节数组项置为已占用状态，即各项字
-// 节值全部设置成USED（100）。PAGING_PAGES被定义为（PAGING_MEMORY>>12），即1MB以上所有
-// 物理内存分页后的低内存页面数（15MB/4KB = 3840）。
-	HIGH_MEMORY = end_mem;				// 设置内存最高端（16MB）。
-	for (i = 0; i < PAGING_PAGES; i++)
+// 首先根据实际物理内存容量计算1MB以上的内存页面数paging_pages，并在主内存区开始处
+// 为内存映射字节数组mem_map[]分配空间（按页对齐）。然后将1MB到end_mem范围内所有内
+// 存页面对应的字节项置为已占用状态，即各项字节值全部设置成USED（100）。
+	HIGH_MEMORY = end_mem;				// 设置内存最高端。
+	paging_pages = (end_mem - LOW_MEM) >> 12;
+	mem_map = (unsigned char *) start_mem;
+	start_mem += (paging_pages + 4095) & ~4095;
+	for (i = 0; i < paging_pages; i++)
 		mem_map[i] = USED;
 // 然后找出主内存区起始位置start_mem处的页面对应内存映射字节数组中项i，并计算出主内
 // 存区页面数。此时mem_map[]数组的第i项正对应主内存区中第1个页面。最后将主内存区中页
-// 面对应的数组项清零（表示空闲）。对于有16MB物理内存的系统，mem_map[]中对应4MB--16MB
-// 主内存区的字节项被清零。
+// 面对应的数组项清零（表示空闲）。
 	i = MAP_NR(start_mem);				// 主内存区起始位置处页面号。
 	end_mem -= start_mem;
 	end_mem >>= 12;					// 主内存区中的总页面数。
+	nr_free_pages = end_mem;
 	while (end_mem-- > 0)
 		mem_map[i++] = 0;			// 主内存区页面对应字节值清零。
+// 最后根据主内存区页面数设置页面换出守护进程使用的空闲页面低、高水位线。
+	free_pages_low = nr_free_pages >> 6;
+	if (free_pages_low < 16)
+		free_pages_low = 16;
+	free_pages_high = free_pages_low << 1;
 }
 
 /// 显示系统内存信息。
@@ -815,12 +980,13 @@ void show_mem(void)
 {
 	int i,j,k,free=0,total=0;
 	int shared = 0;
-	unsigned long * pg_tbl;
+	unsigned long * pg_tbl, * dir;
+	struct task_struct * p;
 
 // 首先根据内存映射字节数组mem_map[]，统计系统主内存区页面总数total，以及其中空闲页面
 // 数free和被共享的页面数shared。并显示这些信息。
 	printk("Mem-info:\n\r");
-	for (i = 0; i < PAGING_PAGES; i++) {
+	for (i = 0; i < paging_pages; i++) {
 		if (mem_map[i] == USED)			// 跳过不能用于分配的内存页面。
 			continue;
 		total++;
@@ -832,26 +998,31 @@ void show_mem(void)
 	printk("%d free pages of %d\n\r", free, total);
 	printk("%d pages shared\n\r", shared);
 
-// 接着统计处理器分页管理逻辑页面数。页目录表前4项供内核代码使用，不列为统计范围。方法
-// 是从第5页开始循环处理所有页目录项。若对应的页表存在，那么先统计页表本身占用的内存页
-// 面（484行），然后对该页表中所有页表项对应物理内存页面情况进行统计。
-	k = 0;						// 一个进程占用页面统计值。
-	for (i = 4; i < 1024; ) {
-		if (1 &pg_dir[i]) {
+// 接着按任务统计处理器分页管理的逻辑页面数。每个任务都有自己的页目录表，其中前256项
+// （头1GB）是内核对等映射用的页表，不列为统计范围；任务自己的64MB线性空间从其代码
+// 起始地址start_code开始，占用随后的16个目录项。若对应的页表存在，那么先统计页表本身
+// 占用的内存页面，然后对该页表中所有页表项对应物理内存页面情况进行统计。
+	for_each_task(p) {
+		k = 2;					// 任务结构和页目录表各占1页。
+		free += 2;
+		dir = PAGE_DIR_OFFSET(p, p->start_code);
+		for (i = 0; i < (TASK_SIZE>>22); i++, dir++) {
+			if (!(1 & *dir))
+				continue;
 // （如果页目录项对应二级页表地址大于机器最高物理内存地址HIGH_MEMORY，则说明该目录项
 // 有问题。于是显示该目录项信息并继续处理下一个目录项。）
-			if (pg_dir[i] > HIGH_MEMORY) {	// 目录项内容不正常。
-				printk("page directory[%d]: %08X\n\r",
-				       i, pg_dir[i]);
-				continue;		// continue之前需插入i++；
+			if (*dir > HIGH_MEMORY) {	// 目录项内容不正常。
+				printk("page directory[%d][%d]: %08X\n\r",
+				       p->pid, i, *dir);
+				continue;
 			}
 // 如果页目录项对应二级页表的“地址”大于LOW_MEM（即1MB），则把一个进程占用的物理
 // 内存页统计值增1，把系统占用的所有物理内存页统计值free增1。然后取对应页表地址
 // pg_tbl，并对该页表中所有页表项进行统计。如果当前页表项所指物理页面存在并且该物理
 // 页面“地址”大于LOW_MEM，那么就将页表项对应页面纳入统计值。
-			if (pg_dir[i] > LOW_MEM)
+			if (*dir > LOW_MEM)
 				free++,k++;		// 统计页表占用页面。
-			pg_tbl = (unsigned long *) (0xfffff000 & pg_dir[i]);
+			pg_tbl = (unsigned long *) (0xfffff000 & *dir);
 			for (j = 0; j < 1024; j++)
 				if ((pg_tbl[j]&1) && pg_tbl[j] > LOW_MEM) {
 // （若该物理页面地址大于机器最高物理内存地址HIGH_MEMORY，则说明该页表项内容有问题，
@@ -863,16 +1034,7 @@ void show_mem(void)
 						k++, free++; // 统计页表项对应的页面。
 				}
 		}
-// 因为每个任务线性空间大小是64MB，所以一个任务占用16个目录项。因此这里每统计16个目录
-// 项就会把进程的任务结构占用的页表统计进来。若此时k = 0则表示当前的16个页目录项所对应
-// 的进程在系统中不存在（没有创建或者已经终止）。然后在显示了对应进程号和其占用的物理内
-// 存页统计值k后，将k清零，以用于统计下一个进程占用的内存页面数。
-		i++;
-		if (!(i&15) && k) {			// k != 0表示相应进程存在。
-			k++,free++;		/* one page/process for task_struct */
-			printk("Process %d: %d pages\n\r", (i>>4)-1, k);
-			k = 0;
-		}
+		printk("Process %d: %d pages\n\r", p->pid, k);
 	}
 // 最后显示系统中正在使用的内存页面和主内存区中总的内存页面数。
 	printk("Memory found: %d (%d)\n\r",free-shared, total);
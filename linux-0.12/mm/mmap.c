@@ -0,0 +1,426 @@
+/*
+ * linux/mm/mmap.c
+ *
+ * (C) 1991 Linus Torvalds
+ */
+
+/*
+ * This file implements mmap() and munmap() for regular files. The
+ * pages of a mapping are read in on demand by do_no_page(), through
+ * the same page cache that is used for executables, so a page of a
+ * file is in memory only once however many processes map it. Shared
+ * mappings map the cached page writable, and dirty pages are written
+ * back to the file when they are unmapped. Private mappings map it
+ * read-only and get their own copy when written to (copy on write).
+ *
+ * 本文件实现普通文件的mmap()和munmap()。映射区中的页面由do_no_page()按需读入，并且
+ * 使用与执行文件相同的页面缓冲，因此无论有多少进程映射了文件的某个页面，该页面在内存
+ * 中都只有一份。共享映射以可写方式映射缓冲中的页面，被修改过的页面在解除映射时写回
+ * 文件。私有映射以只读方式映射缓冲中的页面，进程写页面时再复制出自己的页面（写时复制）。
+ */
+
+#include <errno.h>		// 错误号头文件。包含系统中各种出错号。
+#include <fcntl.h>		// 文件控制头文件。定义文件访问模式O_ACCMODE等。
+#include <string.h>		// 字符串头文件。定义了一些有关内存或字符串操作的嵌入函数。
+#include <sys/stat.h>		// 文件状态头文件。含有文件类型测试宏S_ISREG()等。
+#include <sys/mman.h>		// 内存映射头文件。定义PROT_xxx和MAP_xxx常数。
+
+#include <linux/sched.h>	// 调度程序头文件。定义了任务结构task_struct、任务0的数据等。
+#include <linux/kernel.h>	// 内核头文件。含有一些内核常用函数的原型定义。
+#include <linux/mm.h>		// 内存管理头文件。定义页面长度，和一些内存管理函数原型。
+#include <asm/segment.h>	// 段操作头文件。定义了有关段寄存器操作的嵌入式汇编函数。
+
+#define NR_VM_AREA 256		/* 系统中映射区表项数 */
+
+extern void do_no_page(unsigned long error_code, unsigned long address);
+
+static struct vm_area_struct vm_area_table[NR_VM_AREA];
+
+/// 在映射区表中取一个空闲表项。没有则返回NULL。
+// 调用者要在可能睡眠之前设置表项的vm_inode字段，以占用该表项。
+static struct vm_area_struct * get_vma(void)
+{
+	struct vm_area_struct * vma;
+
+	for (vma = vm_area_table; vma < vm_area_table + NR_VM_AREA; vma++)
+		if (!vma->vm_inode)
+			return vma;
+	return NULL;
+}
+
+/// 查找任务p中第1个结束地址大于逻辑地址addr的映射区。
+// 若返回的映射区起始地址也不大于addr，则addr就在该映射区中。没有则返回NULL。
+struct vm_area_struct * find_vma(struct task_struct * p, unsigned long addr)
+{
+	struct vm_area_struct * vma;
+
+	for (vma = p->mmap; vma; vma = vma->vm_next)
+		if (vma->vm_end > addr)
+			return vma;
+	return NULL;
+}
+
+/// 取当前进程线性地址address对应的页表项指针。若页表不存在则返回NULL。
+static unsigned long * get_pte(unsigned long address)
+{
+	unsigned long page;
+
+	if (!((page = *PAGE_DIR_OFFSET(current, address)) & 1))
+		return NULL;
+	return (unsigned long *) ((page & 0xfffff000) + ((address >> 10) & 0xffc));
+}
+
+/// 取得映射区vma中逻辑地址addr处页面的内容。
+// 在缺页处理中被调用。页面以（i节点，起始块号）为索引在页面缓冲中查找，找不到就从文件
+// 中读入并加入页面缓冲。文件末尾以后的部分清零。返回物理页面地址，调用者持有它的一个
+// 引用。若内存耗尽而没能加入缓冲，私有映射区返回的页面只被调用者使用（mem_map[]计数
+// 为1）；共享映射区则不能这样退化为私有页面（写入将不被其他映射者看到），只能按内存
+// 耗尽处理。
+unsigned long mmap_page(struct vm_area_struct * vma, unsigned long addr)
+{
+	struct m_inode * inode = vma->vm_inode;
+	unsigned long offset, page, tmp;
+	int nr[4], block, i;
+
+	offset = vma->vm_offset + (addr - vma->vm_start);
+	block = offset >> BLOCK_SIZE_BITS;
+	if ((page = find_page_cache(inode, block))) {
+		mem_map[MAP_NR(page)]++;
+		return page;
+	}
+	if (!(page = get_free_page()))
+		oom();
+	for (i = 0; i < 4; i++)
+		nr[i] = (offset + i * BLOCK_SIZE < inode->i_size) ?
+			bmap(inode, block + i) : 0;
+	bread_page(page, inode->i_dev, nr);
+	if (offset + PAGE_SIZE > inode->i_size) {
+		i = (inode->i_size > offset) ? inode->i_size - offset : 0;
+		memset((char *) page + i, 0, PAGE_SIZE - i);
+	}
+// 读页面时会睡眠，其间其他进程可能已把同一页面加入了缓冲，此时改用缓冲中的页面。
+	if (add_page_cache(inode, block, page))
+		return page;
+	if ((tmp = find_page_cache(inode, block))) {
+		free_page(page);
+		mem_map[MAP_NR(tmp)]++;
+		return tmp;
+	}
+	if (vma->vm_flags & VM_SHARED) {
+		free_page(page);
+		oom();
+	}
+	return page;
+}
+
+/// 处理映射区中页面的写保护异常。
+// 参数address是线性地址，table_entry是其页表项指针。写只读映射区则终止进程。共享映射
+// 区的页面不复制，直接置为可写（fork之后的页面也是写保护的），并返回1。其他情况返回0，
+// 由调用者按写时复制处理。
+int mmap_wp_page(unsigned long address, unsigned long * table_entry)
+{
+	struct vm_area_struct * vma;
+	unsigned long tmp = address - current->start_code;
+
+	if (!(vma = find_vma(current, tmp)) || vma->vm_start > tmp)
+		return 0;
+	if (!(vma->vm_flags & VM_WRITE))
+		do_exit(SIGSEGV);
+	if (!(vma->vm_flags & VM_SHARED))
+		return 0;
+	*table_entry |= PAGE_RW;
+	invalidate();
+	return 1;
+}
+
+/// 写页面验证时，先把映射区中还不存在的页面映射进来。
+// 内核写用户空间时CPU不理会页面的写保护，若等到写时才缺页，以只读方式映射的页面缓冲
+// 页面就会被内核直接修改。因此这里先执行缺页处理，此后write_verify()再按写保护页面处理。
+void mmap_write_verify(unsigned long address)
+{
+	struct vm_area_struct * vma;
+	unsigned long * pte, tmp = address - current->start_code;
+
+	if (!(vma = find_vma(current, tmp)) || vma->vm_start > tmp)
+		return;
+	if (!(pte = get_pte(address)) || !(1 & *pte))
+		do_no_page(2, address);
+}
+
+/// 把共享映射中的一页内容写回文件。
+// 参数offset是页面对应的文件偏移。只写回文件长度以内的数据块，不会使文件变长。
+static void write_page(struct m_inode * inode, unsigned long offset, unsigned long page)
+{
+	struct buffer_head * bh;
+	int i, block;
+
+	for (i = 0; i < PAGE_SIZE; i += BLOCK_SIZE, offset += BLOCK_SIZE) {
+		if (offset >= inode->i_size)
+			break;
+		if (!(block = create_block(inode, offset >> BLOCK_SIZE_BITS)))
+			break;
+		if (!(bh = bread(inode->i_dev, block)))
+			break;
+		memcpy(bh->b_data, (char *) page + i, BLOCK_SIZE);
+		bh->b_dirt = 1;
+		brelse(bh);
+	}
+	inode->i_mtime = inode->i_ctime = CURRENT_TIME;
+	inode->i_dirt = 1;
+}
+
+/// 解除当前进程映射区vma中逻辑地址从start到end之间页面的映射。
+// 共享映射中被修改过的页面（页表项PAGE_DIRTY置位）先写回文件，已被交换出去的则先交换
+// 进来。页表项要在写回之前清除，否则写回时睡眠，页面可能被交换出去。
+static void unmap_pages(struct vm_area_struct * vma, unsigned long start, unsigned long end)
+{
+	unsigned long * pte, page;
+
+	for ( ; start < end; start += PAGE_SIZE) {
+		if (!(pte = get_pte(current->start_code + start)))
+			continue;
+		while (*pte && !(1 & *pte) && (vma->vm_flags & VM_SHARED))
+			swap_in(pte);
+		if (!(page = *pte))
+			continue;
+		*pte = 0;
+		if (!(1 & page)) {
+			swap_free(page >> 1);
+			continue;
+		}
+		invalidate();
+		if ((vma->vm_flags & VM_SHARED) && (page & PAGE_DIRTY))
+			write_page(vma->vm_inode,
+				vma->vm_offset + (start - vma->vm_start), page & 0xfffff000);
+		free_page(page & 0xfffff000);
+		cond_resched();
+	}
+}
+
+/// 解除当前进程逻辑地址从addr开始长度为len的区域内的所有映射。
+// 映射区可以只被解除一部分。若要从某个映射区中间挖去一段，则需要一个新的映射区表项，
+// 因此要先把它取到，以免解除了一半映射才发现表项不够。
+static int do_munmap(unsigned long addr, unsigned long len)
+{
+	struct vm_area_struct ** p, * vma, * new = NULL;
+	struct m_inode * inode;
+	unsigned long start, end;
+
+	len = PAGE_ALIGN(len);
+	end = addr + len;
+	if ((addr & 0xfff) || !len || end < addr || end > TASK_SIZE)
+		return -EINVAL;
+	for (vma = current->mmap; vma; vma = vma->vm_next)
+		if (vma->vm_start < addr && vma->vm_end > end) {
+			if (!(new = get_vma()))
+				return -ENOMEM;
+			new->vm_inode = vma->vm_inode;
+			new->vm_inode->i_count++;
+			break;
+		}
+	p = &current->mmap;
+	while ((vma = *p) && vma->vm_start < end) {
+		if (vma->vm_end <= addr) {
+			p = &vma->vm_next;
+			continue;
+		}
+		start = (vma->vm_start > addr) ? vma->vm_start : addr;
+		unmap_pages(vma, start, (vma->vm_end < end) ? vma->vm_end : end);
+// 然后调整映射区：整个被解除的从链表中删除；解除头部或尾部的缩小；解除中间的则分成
+// 前后两个映射区，后一个使用前面取得的表项new。
+		if (vma->vm_start >= addr && vma->vm_end <= end) {
+			*p = vma->vm_next;
+			inode = vma->vm_inode;
+			vma->vm_inode = NULL;
+			iput(inode);
+			continue;
+		}
+		if (vma->vm_start >= addr) {
+			vma->vm_offset += end - vma->vm_start;
+			vma->vm_start = end;
+		} else if (vma->vm_end <= end)
+			vma->vm_end = addr;
+		else {
+			*new = *vma;
+			new->vm_start = end;
+			new->vm_offset += end - vma->vm_start;
+			vma->vm_end = addr;
+			vma->vm_next = new;
+		}
+		p = &vma->vm_next;
+	}
+	return 0;
+}
+
+/// 取得文件映射区的最高地址。
+// 映射区不能进入栈底下方16KB以内（与sys_brk()的限制相同），也不能进入库文件所在区域。
+static unsigned long mmap_top(void)
+{
+	unsigned long top = current->start_stack - 16384;
+
+	if (current->start_stack < 16384 || top > LIBRARY_OFFSET)
+		top = LIBRARY_OFFSET;
+	return top & 0xfffff000;
+}
+
+/// 为长度为len的映射寻找一块空闲的逻辑地址区域。
+// 从MMAP_OFFSET和数据段末端brk中较高者开始，沿按地址排序的映射区链表向上找到第1个
+// 足够大的空隙。找不到则返回0。
+static unsigned long get_unmapped_area(unsigned long len)
+{
+	struct vm_area_struct * vma;
+	unsigned long addr;
+
+	addr = PAGE_ALIGN(current->brk);
+	if (addr < MMAP_OFFSET)
+		addr = MMAP_OFFSET;
+	for (vma = current->mmap; vma; vma = vma->vm_next) {
+		if (vma->vm_end <= addr)
+			continue;
+		if (addr + len <= vma->vm_start)
+			break;
+		addr = vma->vm_end;
+	}
+	if (addr + len < addr || addr + len > mmap_top())
+		return 0;
+	return addr;
+}
+
+/// 建立文件映射。
+// 把文件描述符fd对应文件从偏移off开始长度为len的内容映射到当前进程的逻辑地址空间中。
+// 映射只记录在映射区链表中，页面在被访问时才由缺页处理读入。返回映射的起始地址，出错
+// 则返回出错码。
+static int do_mmap(unsigned long addr, unsigned long len, int prot, int flags,
+	int fd, unsigned long off)
+{
+	struct file * file;
+	struct m_inode * inode;
+	struct vm_area_struct ** p, * vma;
+	int error;
+
+// 首先检查参数。只能映射以读方式打开的普通文件，可写的共享映射还要求文件以读写方式
+// 打开。映射长度调整为页面的整数倍，文件偏移必须页面对齐。
+	if (fd >= NR_OPEN || fd < 0 || !(file = current->filp[fd]))
+		return -EBADF;
+	if (!(inode = file->f_inode) || !S_ISREG(inode->i_mode))
+		return -ENODEV;
+	if ((file->f_flags & O_ACCMODE) == O_WRONLY)
+		return -EACCES;
+	switch (flags & MAP_TYPE) {
+	case MAP_SHARED:
+		if ((prot & PROT_WRITE) && (file->f_flags & O_ACCMODE) != O_RDWR)
+			return -EACCES;
+		break;
+	case MAP_PRIVATE:
+		break;
+	default:
+		return -EINVAL;
+	}
+	len = PAGE_ALIGN(len);
+	if (!len || (off & 0xfff) || off + len < off)
+		return -EINVAL;
+// 然后取一个空闲映射区表项，并让它引用文件i节点。指定了MAP_FIXED时映射区必须位于数据
+// 段末端和栈之间，原来在该区域中的映射被解除；否则由内核选择映射地址。
+	if (!(vma = get_vma()))
+		return -ENOMEM;
+	vma->vm_inode = inode;
+	inode->i_count++;
+	if (flags & MAP_FIXED) {
+		error = -EINVAL;
+		if ((addr & 0xfff) || addr < PAGE_ALIGN(current->brk) ||
+		    addr + len < addr || addr + len > mmap_top())
+			goto out;
+		if ((error = do_munmap(addr, len)))
+			goto out;
+	} else if (!(addr = get_unmapped_area(len))) {
+		error = -ENOMEM;
+		goto out;
+	}
+// 最后设置映射区各字段，并按起始地址把它插入当前进程的映射区链表中。
+	vma->vm_start = addr;
+	vma->vm_end = addr + len;
+	vma->vm_offset = off;
+	vma->vm_flags = VM_READ;
+	if (prot & PROT_WRITE)
+		vma->vm_flags |= VM_WRITE;
+	if ((flags & MAP_TYPE) == MAP_SHARED)
+		vma->vm_flags |= VM_SHARED;
+	for (p = &current->mmap; *p && (*p)->vm_start < addr; p = &(*p)->vm_next)
+		/* nothing */;
+	vma->vm_next = *p;
+	*p = vma;
+	return addr;
+out:
+	vma->vm_inode = NULL;
+	iput(inode);
+	return error;
+}
+
+/// 映射文件系统调用。
+// 参数个数超过了系统调用能通过寄存器传递的3个，因此用户程序把addr、len、prot、flags、
+// fd和off这6个参数依次放在用户空间的数组buffer中。
+int sys_mmap(unsigned long * buffer)
+{
+	return do_mmap(get_fs_long(buffer), get_fs_long(buffer + 1),
+		get_fs_long(buffer + 2), get_fs_long(buffer + 3),
+		get_fs_long(buffer + 4), get_fs_long(buffer + 5));
+}
+
+/// 解除映射系统调用。
+int sys_munmap(unsigned long addr, unsigned long len)
+{
+	return do_munmap(addr, len);
+}
+
+/// 释放映射区链表vma中的所有表项。
+static void free_vma_list(struct vm_area_struct * vma)
+{
+	struct vm_area_struct * next;
+	struct m_inode * inode;
+
+// iput()可能睡眠，其间表项可能被重新分配，所以先取出下一项。
+	for ( ; vma; vma = next) {
+		next = vma->vm_next;
+		inode = vma->vm_inode;
+		vma->vm_inode = NULL;
+		iput(inode);
+	}
+}
+
+/// 为新进程p复制当前进程的映射区链表。
+// 在fork中被调用，映射区的页表项已由copy_page_tables()复制。成功返回0，映射区表项不够
+// 则返回-ENOMEM。
+int copy_mmap(struct task_struct * p)
+{
+	struct vm_area_struct * vma, * new, ** tail;
+
+	p->mmap = NULL;
+	tail = &p->mmap;
+	for (vma = current->mmap; vma; vma = vma->vm_next) {
+		if (!(new = get_vma())) {
+			free_vma_list(p->mmap);
+			p->mmap = NULL;
+			return -ENOMEM;
+		}
+		*new = *vma;
+		new->vm_next = NULL;
+		new->vm_inode->i_count++;
+		*tail = new;
+		tail = &new->vm_next;
+	}
+	return 0;
+}
+
+/// 解除当前进程的所有映射。
+// 在进程退出和执行新程序时，在释放页表之前调用，以便把共享映射中被修改过的页面写回文件。
+void exit_mmap(void)
+{
+	struct vm_area_struct * vma;
+
+	while ((vma = current->mmap)) {
+		unmap_pages(vma, vma->vm_start, vma->vm_end);
+		current->mmap = vma->vm_next;
+		vma->vm_next = NULL;
+		free_vma_list(vma);
+	}
+}
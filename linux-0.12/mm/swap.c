@@ -52,14 +52,22 @@ bitop(clrbit, "r")		/* 定义函数 clrbit(char * addr, unsigned int nr)  */
 static char * swap_bitmap = NULL;
 int SWAP_DEV = 0;		// 内核初始化时设置的交换设备号。
 
+// 空闲页面计数和页面换出守护进程的水位线。在mem_init()中初始化。
+unsigned long nr_free_pages = 0;
+unsigned long free_pages_low = 0;
+unsigned long free_pages_high = 0;
+static struct wait_queue * swapd_wait = NULL;	// 页面换出守护进程睡眠等待队列。
+static struct task_struct * swapd_task = NULL;	// 页面换出守护进程（不能被OOM选中）。
+struct wait_queue * oom_wait = NULL;		// 等待OOM牺牲者释放内存的任务队列。
+
 /*
  * We never page the pages in task[0] - kernel memory.
  * We page all other pages.
  */
-// 第1个虚拟内存页面。即从任务0末端（64MB）处开始的虚拟内存页面。
-#define FIRST_VM_PAGE (TASK_SIZE>>12) 		/* = 64MB/4KB = 16384 */
-#define LAST_VM_PAGE (1024*1024)      		/* = 4GB/4KB = 1048576 */
-#define VM_PAGES (LAST_VM_PAGE - FIRST_VM_PAGE) /* = 1032192（从0开始计） */
+// 第1个虚拟内存页面。即从内核对等映射区末端（1GB）处开始的虚拟内存页面。现在每个任务
+// 都有自己的页目录表，任务的64MB线性空间都从这里开始，只占用页目录表中随后的16项。
+#define FIRST_VM_PAGE (TASK_BASE>>12) 			/* = 1GB/4KB = 262144 */
+#define LAST_VM_PAGE ((TASK_BASE+TASK_SIZE)>>12)	/* = (1GB+64MB)/4KB = 278528 */
 
 /// 申请取得一交换页面号。
 // 扫描整个交换映射位图（除对应位图本身的位0以外），复位值为1的第一个比特位，并返回
@@ -140,11 +148,11 @@ int try_to_swap_out(unsigned long * table_ptr)
 	unsigned long swap_nr;
 
 // 首先判断参数有有效性。若需要交换出去的内存页面并不存在（或称无效），则即可退出。
-// 若页表项指定的物理页面地址大于分页管理的内存高端PAGING_MEMORY（15MB），也退出。
+// 若页表项指定的物理页面不在分页管理的内存范围（LOW_MEM--HIGH_MEMORY）内，也退出。
 	page = *table_ptr;
 	if (!(PAGE_PRESENT & page))
 		return 0;
-	if (page - LOW_MEM > PAGING_MEMORY)
+	if ((page & 0xfffff000) < LOW_MEM || (page & 0xfffff000) >= HIGH_MEMORY)
 		return 0;
 // 若内存页面已修改过，但是该页面是被共享的，那么为了提高运行效率，此类页面不宜
 // 被交换出去，于是直接退出，函数返回0。否则就申请一交换页面号，并把它保存在页表
@@ -173,68 +181,125 @@ int try_to_swap_out(unsigned long * table_ptr)
 	return 1;
 }
 
-/*
- * Ok, this has a rather intricate logic - the idea is to make good
- * and fast machine code. If we didn't worry about that, things would
- * be easier.
- *
- * OK，这个函数中有一个非常复杂的逻辑 - 用于产生逻辑性好并且速度快的
- * 机器码。如果我们不对此操心的话，那么事情可能更容易些。
- */
 /// 把内存页面放到交换设备中。
-// 从线性地址64MB对应的页目录项（FIRST_VM_PAGE >> 10）开始，搜索整个4GB线性空间。期间
-// 我们尝试把对应的物理内存页面交换到交换设备中去。一旦成功地换出一个页面，就返回1，否
-// 则返回0。函数中两个静态变量用于暂存当前搜索点，用于下次搜索时的起始位置。该函数会在
-// get_free_page()中被调用（该函数在下面172行）。
+// 原来所有任务都在同一个4GB线性空间中，因此只要从64MB处开始扫描pg_dir就能遍历所有任务
+// 的页面。现在每个任务都有自己的页目录表，于是改为沿任务链表逐个扫描各任务页目录表中
+// 的16个用户目录项（任务0的内核空间除外）。我们尝试把其中的物理内存页面交换到交换设
+// 备中去，一旦成功地换出一个页面，就返回1，否则返回0。函数中的静态变量用于暂存当前搜
+// 索点，用于下次搜索时的起始位置。因为任务在两次调用之间可能已经退出，所以这里记住的
+// 是任务的进程号而不是任务结构指针。该函数会在get_free_page()中被调用。
 int swap_out(void)
 {
-	static int dir_entry = FIRST_VM_PAGE>>10; // 即任务1的第1个目录项索引。
-	static int page_entry = -1;
-	int counter = VM_PAGES;			// 页面总数：1032192，见上面44行。
-	int pg_table;
+	static int swap_pid = 0;		// 上次扫描到的任务的进程号。
+	static int dir_entry = FIRST_VM_PAGE>>10;
+	static int page_entry = 0;
+	struct task_struct * p;
+	unsigned long pg_table;
+	int counter = nr_tasks + 1;		// 最多扫描一遍所有任务（起始任务扫描两次）。
 
-// 首先我们循环搜索页目录表，查找包含有效二级页表内容的页目录项pg_table，找到则退出循
-// 环，否则调整该页目录项对应剩余二级表数counter，然后继续检测下一页目录项。若全部搜
-// 索完还没有找到适合的（存在的）页目录项，则退出函数。
-	while (counter > 0) {
-		pg_table = pg_dir[dir_entry];	// 页目录项内容。
-		if (pg_table & 1)
-			break;
-		counter -= 1024;		// 1个页表对应1024个页帧。
-		dir_entry++;			// 下一目录项。
-		if (dir_entry > 1024)
-			dir_entry = FIRST_VM_PAGE>>10;
+	if (!(p = find_task_by_pid(swap_pid))) {
+		p = FIRST_TASK->next_task;
+		dir_entry = FIRST_VM_PAGE>>10;
+		page_entry = 0;
 	}
-// 在取得当前目录项中的页表指针后，针对该页表中的所有1024个页面，逐一调用交换函数
-// try_to_swap_out()尝试把它交换出去。一旦某个页面成功交换到到交换设备中就返回1.若对
-// 所有目录项的所有页表都已尝试失败，则显示“交换内存用完”的警告，并返回0。
-	pg_table &= 0xfffff000;			// 页表指针（地址）。
 	while (counter-- > 0) {
-		page_entry++;			// 页表项索引（初始为-1）。
-// 如果已经尝试处理完当前页表中的所有项，但还是没有找到一个能成功地交换出的页面，即此
-// 时页表项索引大于等于1024，则使用如同前面第135 - 143行语句相同的处理方式来先出下一
-// 个存在的二级页表。
-		if (page_entry >= 1024) {
-			page_entry = 0;
-repeat:
-			dir_entry++;
-			if (dir_entry >= 1024)
-				dir_entry = FIRST_VM_PAGE>>10;
-			pg_table = pg_dir[dir_entry];
-			if (!(pg_table & 1))
-				if ((counter -= 1024) > 0)
-					goto repeat;
-				else
-					break;
-			pg_table &= 0xfffff000;	// 页表指针。
-		}
-		if (try_to_swap_out(page_entry + (unsigned long *) pg_table))
-			return 1;
+// 从上次停下的目录项和页表项开始，对任务p的每个存在的页表，针对其中剩余的页表项逐一
+// 调用交换函数try_to_swap_out()尝试把页面交换出去。一旦某个页面成功交换出去就返回1。
+// 写交换页面时会睡眠，任务p可能在此期间退出，所以要先记下它的进程号。
+		swap_pid = p->pid;
+		if (p != FIRST_TASK)
+			for ( ; dir_entry < (LAST_VM_PAGE>>10); dir_entry++, page_entry = 0) {
+				pg_table = ((unsigned long *) p->tss.cr3)[dir_entry];
+				if (!(pg_table & 1))
+					continue;
+				pg_table &= 0xfffff000;	// 页表指针（地址）。
+				while (page_entry < 1024)
+					if (try_to_swap_out(page_entry++ + (unsigned long *) pg_table))
+						return 1;
+			}
+// 任务p的页面都已尝试过，则换到任务链表中的下一个任务，从头开始扫描。
+		p = p->next_task;
+		dir_entry = FIRST_VM_PAGE>>10;
+		page_entry = 0;
 	}
+// 若对所有任务的所有页表都已尝试失败，则显示“交换内存用完”的警告，并返回0。
+	swap_pid = 0;
 	printk("Out of swap-memory\n\r");
 	return 0;
 }
 
+/// 统计任务p独占的物理内存页面数。
+// 扫描任务p线性地址空间（64MB，16个页目录项）中的所有页表，统计映射到主内存区并且只被
+// 该任务使用（mem_map[]计数为1）的页面数，页表本身也计算在内。共享的页面即使杀死该任务
+// 也不会被释放，所以不计算在内。
+static int task_rss(struct task_struct * p)
+{
+	unsigned long * dir, * pg_table, page;
+	int i, j, rss = 0;
+
+	dir = PAGE_DIR_OFFSET(p, p->start_code);
+	for (i = 0; i < (TASK_SIZE >> 22); i++, dir++) {
+		if (!(1 & *dir))
+			continue;
+		rss++;					// 页表本身占用的页面。
+		pg_table = (unsigned long *) (0xfffff000 & *dir);
+		for (j = 0; j < 1024; j++) {
+			page = pg_table[j];
+			if (!(1 & page))
+				continue;
+			page &= 0xfffff000;
+			if (page < LOW_MEM || page >= HIGH_MEMORY)
+				continue;
+			if (mem_map[MAP_NR(page)] == 1)
+				rss++;
+		}
+	}
+	return rss;
+}
+
+/// 内存耗尽时选择一个任务杀死（OOM killer）。
+// 在get_free_page()既没有空闲页面，又回收不了页面时被调用。函数按独占物理页面数给每个
+// 任务打分，选择得分最高的任务作为牺牲者，而不是简单地杀死当前正在申请内存的任务。
+// 任务0、init进程（任务1）和页面换出守护进程不会被选中。若已经有一个任务收到SIGKILL
+// 信号正在退出，则不再选择新的牺牲者，只是睡眠在oom_wait上等它释放内存。有页面被释放
+// 或有任务退出时（见free_page()和do_exit()）等待的任务被唤醒。单纯让出CPU对实时任务
+// 无效（它仍会被立刻选中运行），所以这里必须睡眠。
+// 返回1表示调用者应该重新尝试申请页面；返回0表示调用者自己被选中（或没有可选的任务），
+// 此时调用者自己也被发送了SIGKILL信号，即使它没有通过oom()退出，返回用户态时也会被终止。
+static int oom_kill(void)
+{
+	struct task_struct * p, * victim = NULL;
+	int rss, max = 0;
+
+	for_each_task(p) {
+		if (p == child_reaper || p == swapd_task || p->state == TASK_ZOMBIE)
+			continue;
+		if (p->signal & (1 << (SIGKILL - 1)))
+			goto wait_for_victim;
+		if ((rss = task_rss(p)) > max) {
+			max = rss;
+			victim = p;
+		}
+	}
+	if (!victim)
+		victim = current;
+	printk("Out of memory: killing process %d (%d pages)\n\r", victim->pid, max);
+	victim->signal |= (1 << (SIGKILL - 1));
+	if (victim == current)
+		return 0;
+	if (victim->state == TASK_STOPPED)
+		wake_up_process(victim);
+	else
+		signal_wake_up(victim);
+wait_for_victim:
+	if (current->signal & (1 << (SIGKILL - 1)))
+		return 0;
+	interruptible_sleep_on(&oom_wait);	// 等待牺牲者运行并退出。
+	if (current->signal & (1 << (SIGKILL - 1)))
+		return 0;
+	return 1;
+}
+
 /*
  * Get physcal address of first (actually last :-) free page, and mark it
  * used. If no free page left, return 0.
@@ -244,14 +309,14 @@ repeat:
  */
 /// 在主内存区中申请取得一空闲物理页面。
 // 如果已经没有可用物理内存页面，则调用执行交换处理，然后再次申请页面。
-// 输入：%1(ax = 0) - 0；%2(LOW_MEM)字节位图管理的内存起始位置；%3(cx = PAGING_PAGES)；
-// %4(edi = mem_map + PAGING_PAGES - 1)。
+// 输入：%1(ax = 0) - 0；%2(LOW_MEM)字节位图管理的内存起始位置；%3(cx = paging_pages)；
+// %4(edi = mem_map + paging_pages - 1)。
 // 输出：返回%0(ax = 物理页面起始地址)，即函数返回新页面的物理内存地址。
 // 上面%4寄存器实际指向内存字节位图mem_map[]的最后一个字节。本函数从位图末端开始向前
-// 扫描所有页面标志（页面总数为PAGING_PAGES），若有页面空闲（内存位图字节为0）则返回
+// 扫描所有页面标志（页面总数为paging_pages），若有页面空闲（内存位图字节为0）则返回
 // 页面地址。 注意！本函数只是指出在主内存区的一页空闲物理页面，但并没有映射到某个进程的
 // 地址空间中。当然对于内核使用本函数时并不需要再使用put_page()进行映射，因为内核代码
-// 和数据空间（16MB）已经对等地映射到物理地址空间中。
+// 和数据空间（最多1GB）已经对等地映射到物理地址空间中。
 // 第174行定义了一个局部寄存器变量。该变量将被保存在eax寄存器中，以便于高效访问和操作。
 // 这种定义变量的方法主要用于内嵌汇编程序中，详细说明见gcc手册“在指定寄存器中的变量”。
 unsigned long get_free_page(void)
@@ -274,17 +339,48 @@ repeat:
 		"movl %%edx,%%eax\n"		// 将页面起始地址->eax(返回值)。
 		"1:\tcld"			// 恢复Direction标志
 		:"=a" (__res)
-		:"0" (0), "i" (LOW_MEM), "c" (PAGING_PAGES),
-		"D" (mem_map+PAGING_PAGES-1)
+		:"0" (0), "i" (LOW_MEM), "c" (paging_pages),
+		"D" (mem_map+paging_pages-1)
 		:/* "di","cx","dx" */);
 	__asm__("":::"edi","ecx","edx");
 	if (__res >= HIGH_MEMORY)		// 页面地址大于实际内存容量则重新寻找。
 		goto repeat;
-	if (!__res && swap_out())		// 若没得到空闲页面则执行交换处理，并重新查找。
+// 若没得到空闲页面则回收页面缓冲或执行交换处理，并重新查找。若还是不行则选择一个任务
+// 杀死，等它释放内存后再重新查找。
+	if (!__res && (shrink_page_cache() || swap_out() || oom_kill()))
 		goto repeat;
+// 得到空闲页面后空闲页面数减1。若空闲页面数已低于低水位线，则唤醒页面换出守护进程在
+// 后台成批地换出页面，这样以后的缺页处理就很少需要自己等待交换设备的写操作了。
+	if (__res && --nr_free_pages < free_pages_low)
+		wake_up_all(&swapd_wait);
         return __res;				// 返回空闲物理页面地址。
 }
 
+/*
+ * This may be used only once, enforced by 'static int callable'.
+ * It is called by a child of init, and never returns.
+ */
+/// 页面换出守护进程的系统调用。
+// 由init进程创建的一个子进程调用，并且不会返回。该进程平时睡眠在swapd_wait上。在
+// get_free_page()发现空闲页面数低于低水位线free_pages_low时被唤醒，然后成批地回收
+// 页面缓冲页面或把页面换出，直到空闲页面数达到高水位线free_pages_high，或者已没有
+// 页面可以换出为止。这里使用不可中断睡眠，因此守护进程不会被信号唤醒。
+int sys_swapd(void)
+{
+	static int callable = 1;
+
+	if (!callable)
+		return -1;
+	callable = 0;
+	swapd_task = current;
+	for (;;) {
+		while (nr_free_pages < free_pages_high)
+			if (!shrink_page_cache() && !swap_out())
+				break;
+		sleep_on(&swapd_wait);
+	}
+}
+
 /// 内存页面交换初始化。
 // 函数首先根据设备的分区数组（块数数组）检查系统是否有交换设备，并且交换设备有效。然后
 // 申请取得一页内存来存放交换页面位映射数组swap_bitmap[]。然后从交换设备的交换分区把交